@@ -0,0 +1,116 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "process_table.h"
+
+/** @brief Cgroup created under the cgroup v2 root to hold one cgroup per service. */
+#define CGROUP_PARENT "fiore"
+
+/** @brief cpu.max period in microseconds; a CPU quota is a share of it. */
+#define CGROUP_CPU_PERIOD_US 100000
+
+/** @brief cpu.weight and io.weight of a service that does not set one. */
+#define CGROUP_DEFAULT_WEIGHT 100
+
+/** @brief Largest cpu.weight and io.weight the kernel accepts. */
+#define CGROUP_MAX_WEIGHT 10000
+
+/**
+ * @brief Returns the directory holding the services' cgroups.
+ *
+ * On first use, finds the cgroup v2 hierarchy in @c /proc/self/mountinfo
+ * (the unified mount on hybrid hosts), creates @ref CGROUP_PARENT at its
+ * root and enables the @c cpu, @c memory, @c io and @c pids controllers
+ * for it, each as far as the host allows.
+ *
+ * @return  e.g. @c /sys/fs/cgroup/fiore, or NULL if there is no cgroup v2
+ *          hierarchy or it is not writable (not root, or not Linux). Services
+ *          then run in the supervisor's own cgroup.
+ */
+const char *cgroup_root(void);
+
+/**
+ * @brief Builds the path of a file in the leaf cgroup of one process.
+ *
+ * Each launch of a service gets its own leaf, @c <root>/<name>/<pid>, so
+ * that the old and new process of a rolling deploy are accounted and
+ * limited separately.
+ *
+ * @param name  Service name.
+ * @param pid   Process the leaf was created for.
+ * @param file  File in the leaf, e.g. "cpu.stat"; "" for the leaf itself.
+ * @param out   Receives the path.
+ * @param size  Size of @p out.
+ * @return      @c true on success, @c false if cgroups are unavailable or
+ *              the name cannot be a cgroup.
+ */
+bool cgroup_leaf_path(const char *name, pid_t pid, const char *file, char *out, size_t size);
+
+/**
+ * @brief Moves a process just launched for a node into a new leaf.
+ *
+ * The process must not have exec'd the service yet (see
+ * @ref supervisor_exec_gate), so that whatever it forks starts in the leaf.
+ *
+ * The leaf gets the node's limits and @c memory.oom.group, so that an OOM
+ * kill takes down the whole service rather than one of its processes, and
+ * only then receives the process. Leaves of earlier processes of the
+ * service that are gone are removed first, killing anything they left
+ * behind.
+ *
+ * @param node    Node being started; its limits are applied.
+ * @param pid     Process to move.
+ * @param unset   Receives the files of requested limits that could not be
+ *                written, e.g. "memory.max" if the memory controller is not
+ *                available ("" if all were set).
+ * @param size    Size of @p unset.
+ * @return        0 if the process is in its leaf, 1 if cgroups are
+ *                unavailable, -1 on error (errno is set).
+ */
+int cgroup_attach(const ProcessNode *node, pid_t pid, char *unset, size_t size);
+
+/**
+ * @brief Writes a node's limits to the leaf of its current process.
+ *
+ * Used to change the limits of a running service, which takes effect at once.
+ *
+ * @param node   Node whose @c cgroup limits and @c pid are used.
+ * @param unset  As for @ref cgroup_attach.
+ * @param size   Size of @p unset.
+ * @return       0 on success, -1 if the process has no leaf.
+ */
+int cgroup_apply_limits(const ProcessNode *node, char *unset, size_t size);
+
+/**
+ * @brief Whether the kernel OOM killer killed a process in the leaf of
+ *        @c node->pid, per the @c oom_kill count of its @c memory.events.
+ *
+ * @param node  Node whose process has exited.
+ */
+bool cgroup_oom_killed(const ProcessNode *node);
+
+/**
+ * @brief Kills what is left in the leaf of @c node->pid and removes it.
+ *
+ * Called once the service's main process has exited, so that processes it
+ * forked do not outlive it. Does not wait for the killed processes: if they
+ * are still exiting, the empty leaf is removed by the next
+ * @ref cgroup_attach or @ref cgroup_remove of the service.
+ *
+ * @param node  Node whose process has exited.
+ * @return      Number of processes that were still in the leaf, or -1 if
+ *              the node has no leaf.
+ */
+int cgroup_release(const ProcessNode *node);
+
+/**
+ * @brief Removes a service's cgroup once it has no leaves left.
+ *
+ * @param name  Service being removed from the table.
+ */
+void cgroup_remove(const char *name);
+
+#endif // CGROUP_H
@@ -0,0 +1,60 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "process_table.h"
+
+/**
+ * @brief One entry of the @c services: mapping of a deploy config.
+ */
+typedef struct ServiceConfig {
+    char          name[64];       /* Key of the entry: the service name. */
+    char          jar[256];       /* `jar`: path of the application JAR. */
+    char          env_file[256];  /* `envFile` (empty = none). */
+    char          log_file[256];  /* `logging.file` (empty = none). */
+    uint16_t      port;           /* `port`; with replicas, the load-balanced port. */
+    RestartPolicy restart_policy; /* `restartPolicy` (default on-failure). */
+    uint16_t      replicas;       /* `lb.replicas` (0 = not load balanced). */
+    CgroupLimits  resources;      /* `resources`: cgroup limits (zero = none). */
+    char          dependencies[MAX_DEPENDENCIES][64]; /* `dependencies` (empty = unused slot). */
+    size_t        line;           /* Line the entry starts on, for error messages. */
+} ServiceConfig;
+
+/**
+ * @brief A parsed deploy config.
+ */
+typedef struct Config {
+    ServiceConfig *services; /* Entries in file order. */
+    size_t         count;
+} Config;
+
+/**
+ * @brief Loads a deploy config from a YAML file.
+ *
+ * Only the subset of YAML that deploy configs use is understood: block
+ * mappings and sequences nested by spaces, flow sequences of scalars
+ * (`[a, b]`), plain, single- and double-quoted scalars, and comments.
+ * Recognised keys under each service are @c jar (required), @c envFile,
+ * @c port, @c restartPolicy, @c dependencies, @c logging (@c file;
+ * @c stdout is accepted and ignored, since service output always goes to
+ * the log pump) and @c lb (@c replicas, and @c strategy, which must be
+ * @c round-robin), and @c resources (@c memoryMax and @c memoryHigh, sizes
+ * such as @c 512M; @c cpuQuota, in percent of one core; @c cpuWeight and
+ * @c ioWeight, 1-10000). @c metrics is accepted and ignored, since every
+ * service is sampled. Any other key is an error.
+ *
+ * @param path   Path of the file.
+ * @param config Receives the services; release with @ref config_free.
+ * @param error  Receives a description of the first problem, with its line.
+ * @param size   Size of @p error.
+ * @return       0 on success, -1 on error (@p config is left empty).
+ */
+int config_load(const char *path, Config *config, char *error, size_t size);
+
+/**
+ * @brief Releases the services of a config loaded by @ref config_load.
+ */
+void config_free(Config *config);
+
+#endif // CONFIG_H
@@ -0,0 +1,155 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include "deploy.h"
+#include "process_table.h"
+#include "status_page.h"
+
+/** @brief Path of the Unix-domain socket a running daemon serves commands on. */
+#define CONTROL_SOCKET_PATH "state/supervisor.sock"
+
+/** @brief Protocol version; bumped whenever a message layout changes. */
+#define CONTROL_VERSION 3
+
+/** @brief Milliseconds the daemon waits for a client to send or read a message. */
+#define CONTROL_IO_TIMEOUT_MS 1000
+
+/** @brief Milliseconds a client waits for the daemon to answer a request. */
+#define CONTROL_REPLY_TIMEOUT_MS 5000
+
+/**
+ * @brief Commands served over the control socket.
+ */
+typedef enum {
+    CONTROL_SNAPSHOT = 1, /* Return every node, for `status` and `list`. */
+    CONTROL_START    = 2, /* Start a registered service that is down. */
+    CONTROL_STOP     = 3, /* Run a service's stop sequence. */
+    CONTROL_RESTART  = 4, /* Stop then start a service. */
+    CONTROL_DEPLOY   = 5, /* Roll a service's replicas onto a new JAR (deploy_run). */
+    CONTROL_APPLY    = 6  /* Bring the table in line with a deploy config (deploy_apply). */
+} ControlOp;
+
+/**
+ * @brief Outcome of a request, in @ref ControlReply.status.
+ */
+typedef enum {
+    CONTROL_OK          = 0, /* Done. */
+    CONTROL_FAILED      = 1, /* The command failed; see @c message. */
+    CONTROL_NOT_FOUND   = 2, /* No service has the requested name. */
+    CONTROL_BAD_REQUEST = 3, /* Unknown command, or a client of another version or build. */
+    CONTROL_ACCEPTED    = 4  /* Under way; the final reply follows within @c wait_ms (0 = no limit). */
+} ControlStatus;
+
+/**
+ * @brief A request: one fixed-size message per connection.
+ *
+ * Client and daemon are the same binary on the same host, so messages are
+ * in host byte order; @c version and @c record_size reject any other build.
+ */
+typedef struct ControlRequest {
+    uint32_t      version;     /* CONTROL_VERSION of the client. */
+    uint32_t      record_size; /* sizeof(ControlRecord) of the client. */
+    uint32_t      op;          /* A ControlOp. */
+    char          name[64];    /* Service the command applies to (unused for snapshots and configs). */
+    char          path[256];   /* CONTROL_DEPLOY: the JAR; CONTROL_APPLY: the config file. */
+    DeployOptions deploy;      /* CONTROL_DEPLOY: its tunables. */
+    ApplyOptions  apply;       /* CONTROL_APPLY: its tunables. */
+} ControlRequest;
+
+/**
+ * @brief The live state of one service, as sent to clients.
+ *
+ * The published status entry plus the counters `status <name>` shows.
+ * Settings are not sent: the client reads them from the table file.
+ */
+typedef struct ControlRecord {
+    StatusEntry entry;
+    uint32_t    failure_count;
+    uint32_t    threads;         /* Of the latest sample (0 = not sampled). */
+    uint32_t    fds;             /* Of the latest sample (0 = not sampled). */
+    uint16_t    health_failures;
+    uint16_t    rss_strikes;
+    uint16_t    cpu_strikes;
+    uint8_t     reserved[6];
+} ControlRecord;
+
+/**
+ * @brief The reply header, followed by @c count ControlRecord records.
+ *
+ * A snapshot carries every node, a command the node it applied to. A stop
+ * or restart is first answered with @ref CONTROL_ACCEPTED and no records;
+ * a second reply follows once its stop sequence is done.
+ */
+typedef struct ControlReply {
+    uint32_t status;       /* A ControlStatus. */
+    uint32_t count;        /* Records that follow. */
+    uint32_t wait_ms;      /* With CONTROL_ACCEPTED: the longest the final reply can take. */
+    char     message[128]; /* Why the command failed (empty on success). */
+} ControlReply;
+
+/**
+ * @brief Creates the daemon's listening socket at @p path.
+ *
+ * A socket file left behind by a daemon that died is replaced, so this must
+ * only be called while holding the daemon's pid file lock. The socket is
+ * accessible to the owner only.
+ *
+ * @param path  Socket path, normally @ref CONTROL_SOCKET_PATH.
+ * @return      The non-blocking listening descriptor, or -1 on error.
+ */
+int control_listen(const char *path);
+
+/**
+ * @brief Answers every connection pending on a listening socket.
+ *
+ * Called from the daemon's poll loop when @p listen_fd is readable. Each
+ * connection carries one request, which is executed against @p table and
+ * answered before the next is accepted. A client that does not send or read
+ * within @ref CONTROL_IO_TIMEOUT_MS is dropped, so a stuck client cannot
+ * stall the daemon. A stop or restart is run in the background (see
+ * @ref supervisor_bulk_background) and answered when it is done; one of a
+ * service that is already being stopped or started is refused.
+ *
+ * A deploy or config is run once the background work is done, and holds
+ * up the loop until it is finished, as it would hold up the CLI; the
+ * client is told at once that it is under way. The daemon's load balancer
+ * follows every replica it moves (see @ref deploy_run).
+ *
+ * @param listen_fd  Descriptor returned by @ref control_listen.
+ * @param table      The daemon's process table.
+ * @return           Number of nodes a command changed, so the caller can
+ *                   persist the table and update the load balancer.
+ */
+int control_serve(int listen_fd, ProcessTable *table);
+
+/**
+ * @brief Closes the listening socket and removes its file.
+ */
+void control_close(int listen_fd, const char *path);
+
+/**
+ * @brief Sends a request to the daemon and waits for its reply.
+ *
+ * Waits up to @ref CONTROL_REPLY_TIMEOUT_MS for the reply, and for as long
+ * as the daemon announces with @ref CONTROL_ACCEPTED for a stop or restart;
+ * a deploy is waited for until it is done or the daemon goes away.
+ *
+ * @param path     Socket path, normally @ref CONTROL_SOCKET_PATH.
+ * @param request  Command to run, with its @c op, @c name and, for
+ *                 deploys, @c path and options set; @c version and
+ *                 @c record_size are filled in.
+ * @param reply    Receives the final reply header.
+ * @param nodes    An in-memory table (zero-initialised, or loaded read-only
+ *                 by the caller for the services' settings; release with
+ *                 @ref process_table_free). Services in the reply have
+ *                 their live state copied into it, and those it lacks are
+ *                 appended. It is never saved.
+ * @return         0 if the daemon replied; -1 if no daemon listens on
+ *                 @p path, in which case the caller may fall back to
+ *                 working on the table file directly; -2 if the exchange
+ *                 failed or the reply did not come in time.
+ */
+int control_call(const char *path, ControlRequest *request, ControlReply *reply, ProcessTable *nodes);
+
+#endif // CONTROL_H
@@ -0,0 +1,52 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "process_table.h"
+
+/** @brief Path of the pid file locked by a running supervisor daemon. */
+#define DAEMON_PID_PATH "state/supervisor.pid"
+
+/** @brief Milliseconds between liveness passes over processes the daemon did not launch. */
+#define DAEMON_TICK_MS 5000
+
+/**
+ * @brief Tunables of a daemon run.
+ */
+typedef struct DaemonOptions {
+    unsigned sample_interval_ms; /* Milliseconds between resource samples (0 = no sampling). */
+} DaemonOptions;
+
+/**
+ * @brief Runs the supervisor as a resident process until SIGTERM or SIGINT.
+ *
+ * Takes an exclusive lock on @ref DAEMON_PID_PATH, launches or adopts every
+ * service in the table, and then waits in a poll loop. Exits of processes
+ * the daemon launched are delivered through SIGCHLD (via a self-pipe) and
+ * handled immediately by @ref supervisor_reap; processes that were already
+ * running when the daemon started are probed every @ref DAEMON_TICK_MS,
+ * and the loop also wakes when a backed-off restart falls due. Every
+ * running service is sampled for CPU, RSS, threads and open descriptors
+ * each @c sample_interval_ms (see sampler.h). Services with an @c lb_port
+ * are load balanced across their running replicas by a proxy thread that
+ * is handed the new backend set whenever a pass changed the table (see lb.h).
+ * The table is kept in memory and persisted only when a pass changed it.
+ * Clients' `status`, `list`, `start`, `stop` and `restart` commands are
+ * served from it over @ref CONTROL_SOCKET_PATH (see control.h).
+ *
+ * @param table    The loaded process table. Must not be NULL.
+ * @param options  Tunables; NULL selects the defaults.
+ * @return         0 on clean shutdown, -1 if the daemon could not start.
+ */
+int daemon_run(ProcessTable *table, const DaemonOptions *options);
+
+/**
+ * @brief Checks whether a supervisor daemon currently holds the pid file lock.
+ *
+ * @param pid  If not NULL and a daemon is running, receives its pid.
+ * @return     @c true if a daemon is running, @c false otherwise.
+ */
+bool daemon_running(pid_t *pid);
+
+#endif // DAEMON_H
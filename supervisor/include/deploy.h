@@ -0,0 +1,168 @@
+#ifndef DEPLOY_H
+#define DEPLOY_H
+
+#include <stdbool.h>
+#include "config.h"
+#include "process_table.h"
+
+/** @brief Replicas replaced at a time unless configured otherwise. */
+#define DEFAULT_DEPLOY_BATCH 1
+
+/**
+ * @brief Tunables of a rolling deploy.
+ */
+typedef struct DeployOptions {
+    unsigned batch;              /* Replicas replaced at a time (0 = DEFAULT_DEPLOY_BATCH). */
+    unsigned ready_timeout_secs; /* Time each replacement has to become ready (0 = DEFAULT_READY_WAIT_SECS). */
+} DeployOptions;
+
+/**
+ * @brief Initialises the module-level logger used by @ref deploy_run.
+ *
+ * If never called, all progress output is silently discarded.
+ *
+ * @param logfile_path   Path to the log file opened in append mode. May be NULL
+ *                       to disable file logging.
+ * @param stdout_enabled If @c true, progress is also written to stdout.
+ * @return               0 on success, -1 if the log file could not be opened.
+ */
+int deploy_logger_init(const char *logfile_path, bool stdout_enabled);
+
+/**
+ * @brief Replaces every replica of a service with a new JAR, a batch at a time.
+ *
+ * The replicas are the nodes for which @ref lb_service_of returns
+ * @p service. For each running replica of a batch, a replacement running
+ * @p jar is started on a spare port (the lowest port from the service's
+ * lowest one that no node uses and that can be bound) and must pass its
+ * readiness probe and, if it has one, a health probe. The batch's old
+ * processes are then drained and stopped, and each node takes over its
+ * replacement's pid, port and JAR; when run by the daemon, its load
+ * balancer is moved onto the replacement before the old process is
+ * stopped. Replicas that are not running only have their JAR switched.
+ *
+ * If a replacement exits, is not ready in time or is unhealthy, the
+ * batch's replacements are stopped and the replicas already switched are
+ * rolled back to their @c previous_path the same way.
+ *
+ * Progress is persisted in each node (@c previous_path, @c deploy_path,
+ * @c deploy_pid, @c deploy_port) after every step, so an interrupted
+ * deploy is resumed by running it again with the same JAR. A replacement
+ * left behind is taken over if the deploy died after stopping the old
+ * process and stopped otherwise, and only replicas not yet moved to @p jar
+ * are replaced.
+ *
+ * The deploy runs as background work (see @ref deploy_run_background),
+ * which this waits for with @ref supervisor_background_wait.
+ *
+ * @param table    The loaded process table. Must not be NULL.
+ * @param service  Service to deploy. Must not be NULL.
+ * @param jar      Path of the new JAR. Must not be NULL.
+ * @param options  Tunables; NULL selects the defaults.
+ * @return         0 if every replica runs @p jar, 1 if the deploy failed and
+ *                 was rolled back, -1 if it could not be started.
+ */
+int deploy_run(ProcessTable *table, const char *service, const char *jar, const DeployOptions *options);
+
+/**
+ * @brief Called once a deploy or config started in the background is done.
+ *
+ * @param arg  As passed when it was started.
+ * @param rc   As returned by its blocking counterpart.
+ */
+typedef void (*DeployDone)(void *arg, int rc);
+
+/**
+ * @brief Starts @ref deploy_run as background work and returns at once.
+ *
+ * The replacements are started here; their readiness waits, health
+ * probes and the stops of old processes run as background bulks and
+ * probes moved on by @ref supervisor_background_advance, so the daemon
+ * keeps reaping, restarting and serving clients during a rollout. The
+ * replicas are @c busy until the deploy is done, and a deploy is refused
+ * while any of them is.
+ *
+ * @param table    The loaded process table. Must not be NULL.
+ * @param service  Service to deploy. Must not be NULL.
+ * @param jar      Path of the new JAR. Must not be NULL.
+ * @param options  Tunables; NULL selects the defaults.
+ * @param done     Called when the deploy is done, never before this
+ *                 returns; may be NULL.
+ * @param arg      Passed to @p done.
+ * @return         0 if the deploy is under way, -1 if it could not be
+ *                 started; @p done is not called then.
+ */
+int deploy_run_background(ProcessTable *table, const char *service, const char *jar,
+                          const DeployOptions *options, DeployDone done, void *arg);
+
+/**
+ * @brief Tunables of @ref deploy_apply.
+ */
+typedef struct ApplyOptions {
+    unsigned parallel; /* Services (re)started at a time (0 = all at once). */
+    bool     prune;    /* Stop and remove registered services that are not in the config. */
+    bool     dry_run;  /* Only report what would change. */
+} ApplyOptions;
+
+/**
+ * @brief Brings the process table in line with a deploy config.
+ *
+ * Each service of @p config becomes one node, or, with @c lb.replicas, that
+ * many nodes named `<service>-1`, `<service>-2`, ... created on the ports
+ * after @c port, which the daemon balances; since @ref deploy_run moves
+ * replicas between ports, a replica's own port is never compared. A
+ * dependency on a replicated service is a dependency on each of its
+ * replicas.
+ *
+ * Only what differs is touched. A node is restarted if its JAR, port,
+ * env file or log file differs from the config, or if its JAR or env file
+ * was modified after it started. The replicas of a load-balanced service
+ * whose only change is the JAR are replaced one at a time via
+ * @ref deploy_run instead. A different restart policy, load balancing or
+ * dependency list is updated in place. Missing nodes are registered with
+ * the defaults of `supervisor start` and started, and matching nodes that
+ * are down are started. All starts and restarts run through
+ * @ref supervisor_bulk, dependencies first. Registered services that are
+ * not in the config are reported and, with @c prune, stopped and removed.
+ * A config that matches the table only costs a @c stat of each JAR and env
+ * file and a liveness check of each process.
+ *
+ * The config is applied as background work (see
+ * @ref deploy_apply_background), which this waits for with
+ * @ref supervisor_background_wait.
+ *
+ * @param table    The loaded process table. Must not be NULL.
+ * @param config   The desired services. Must not be NULL.
+ * @param options  Tunables; NULL selects the defaults.
+ * @return         0 if the table matches the config, 1 if some services
+ *                 failed to start, stop or deploy, -1 if the config could
+ *                 not be applied (e.g. a dependency cycle). Nothing has
+ *                 been started, stopped or changed then, unless memory ran
+ *                 out while registering services: @p table may then hold
+ *                 some of them and must not be saved.
+ */
+int deploy_apply(ProcessTable *table, const Config *config, const ApplyOptions *options);
+
+/**
+ * @brief Starts @ref deploy_apply as background work and returns at once.
+ *
+ * Diffing the config and registering new nodes, and removing pruned ones,
+ * wait until all other background work is done, since they move the
+ * table's nodes. Rolls, starts, restarts and stops run as background
+ * deploys and bulks in between, so the daemon keeps reaping and serving
+ * clients while a config is applied. A node that is @c busy when its
+ * restart or removal comes up is left alone and counts as failed.
+ *
+ * @param table    The loaded process table. Must not be NULL.
+ * @param config   The desired services, copied. Must not be NULL.
+ * @param options  Tunables; NULL selects the defaults.
+ * @param done     Called with the result of @ref deploy_apply once it is
+ *                 done, never before this returns; may be NULL.
+ * @param arg      Passed to @p done.
+ * @return         0 if the config is being applied, -1 if out of memory;
+ *                 @p done is not called then.
+ */
+int deploy_apply_background(ProcessTable *table, const Config *config, const ApplyOptions *options,
+                            DeployDone done, void *arg);
+
+#endif // DEPLOY_H
@@ -0,0 +1,75 @@
+#ifndef JVM_H
+#define JVM_H
+
+#include "process_table.h"
+
+/** @brief Percentage of host memory kept back from JVM heaps in auto mode (OS, page cache). */
+#define JVM_HOST_RESERVE_PERCENT 20
+
+/** @brief Percentage of a service's memory share given to its heap in auto mode; the
+ *  rest is left for metaspace, thread stacks, code cache and direct buffers. */
+#define JVM_HEAP_PERCENT 70
+
+/** @brief Smallest heap assigned in auto mode, in MiB. */
+#define JVM_MIN_HEAP_MB 64
+
+/** @brief Maximum number of arguments in a JVM command line. */
+#define JVM_MAX_ARGS 64
+
+/**
+ * @brief A ready-to-exec JVM command line.
+ *
+ * @c argv points into @c storage and is NULL-terminated.
+ */
+typedef struct JvmCommand {
+    char *argv[JVM_MAX_ARGS + 1];
+    char  storage[2048];
+} JvmCommand;
+
+/**
+ * @brief Resolves the profile a node is launched with.
+ *
+ * Returns @c node->jvm unchanged unless @c auto_size is set. In auto mode,
+ * an unset @c heap_max_mb is derived from host memory: after holding back
+ * @ref JVM_HOST_RESERVE_PERCENT and the explicit @c heap_max_mb of every
+ * service not in auto mode, the rest is divided among the auto-mode
+ * services in the table by @c weight, and @ref JVM_HEAP_PERCENT of the
+ * share becomes the heap. An unset @c cpus becomes the service's weighted
+ * share of the online cores, rounded up and at least one.
+ *
+ * @param table  Table of registered services; NULL sizes the node as if it were alone.
+ * @param node   Node to resolve. Must not be NULL.
+ * @param out    Receives the effective profile. Must not be NULL.
+ */
+void jvm_effective_profile(const ProcessTable *table, const ProcessNode *node, JvmProfile *out);
+
+/**
+ * @brief Builds the command line that launches a node.
+ *
+ * Produces `java [-Xms..] [-Xmx..] [-XX:ActiveProcessorCount=..] [-XX:+Use..GC]
+ * <jvm_args> -jar <path> --server.port=<port> <app_args>` from the node's
+ * effective profile (see @ref jvm_effective_profile). Extra arguments are
+ * split on whitespace; quoting is not supported.
+ *
+ * @param table  Table of registered services, used by auto mode. May be NULL.
+ * @param node   Node to launch. Must not be NULL.
+ * @param cmd    Receives the command line. Must not be NULL.
+ * @return       0 on success, -1 if the command line does not fit.
+ */
+int jvm_build_command(const ProcessTable *table, const ProcessNode *node, JvmCommand *cmd);
+
+/**
+ * @brief Returns the command-line name of a garbage collector (e.g. "g1").
+ */
+const char *jvm_gc_name(JvmGc gc);
+
+/**
+ * @brief Parses a garbage collector name as accepted on the command line.
+ *
+ * @param name  One of "default", "g1", "parallel", "serial", "zgc", "shenandoah".
+ * @param gc    Receives the collector. Must not be NULL.
+ * @return      0 on success, -1 if the name is unknown.
+ */
+int jvm_parse_gc(const char *name, JvmGc *gc);
+
+#endif // JVM_H
@@ -0,0 +1,64 @@
+#ifndef LB_H
+#define LB_H
+
+#include "process_table.h"
+
+/** @brief Size of a pooled proxy buffer; every connection holds one per direction. */
+#define LB_BUFFER_SIZE (16 * 1024)
+
+/** @brief Maximum number of replicas a single balancer distributes across. */
+#define LB_MAX_BACKENDS 32
+
+/** @brief Maximum number of balancers (distinct public ports) per daemon. */
+#define LB_MAX_BALANCERS 32
+
+/**
+ * @brief Returns the service a node is a replica of.
+ *
+ * @param node  Node to inspect. Must not be NULL.
+ * @return      @c node->service, or @c node->name if the node does not
+ *              name a service of its own.
+ */
+const char *lb_service_of(const ProcessNode *node);
+
+/**
+ * @brief Starts the load balancer thread.
+ *
+ * The balancer is an event-driven L4 proxy: one thread waits on an epoll
+ * (Linux) or kqueue (BSD, macOS) instance for every listening socket and
+ * proxied connection. Connections to a balancer's public port are handed to
+ * the service's running replicas in round-robin order over non-blocking
+ * connects to @c 127.0.0.1:<port>; if a replica refuses, the next one is
+ * tried. Proxy buffers and connection records are recycled through free
+ * lists instead of being allocated per connection. Nothing is balanced
+ * until the first @ref lb_update.
+ *
+ * @param logfile_path  Path of the balancer's log file.
+ * @return              0 on success, -1 if the thread could not be started.
+ */
+int lb_start(const char *logfile_path);
+
+/**
+ * @brief Hands the current backend set to the load balancer.
+ *
+ * Every node with a non-zero @c lb_port defines a balancer listening on
+ * that port for the service returned by @ref lb_service_of; its backends
+ * are the @c port of every running node of the same service whose
+ * @c readiness is @c READINESS_READY, so a replica that is still warming up
+ * or is being stopped gets no new connections. Listeners are
+ * opened and closed to match, and established connections are left alone.
+ * Intended to be called by the daemon whenever a pass changed the table.
+ * Does nothing if the balancer is not running.
+ *
+ * @param table  The process table. Must not be NULL.
+ */
+void lb_update(const ProcessTable *table);
+
+/**
+ * @brief Stops the load balancer thread and closes its listening sockets.
+ *
+ * Connections still being proxied are dropped when the process exits.
+ */
+void lb_stop(void);
+
+#endif // LB_H
@@ -1,27 +1,73 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Number of messages a Logger can queue before it starts dropping them. Must be a power of two. */
+#define LOGGER_RING_SLOTS 256
+
+/** @brief Maximum length of one formatted line, including the timestamp prefix and newline. */
+#define LOGGER_LINE_SIZE 1056
+
+/** @brief Default interval between background flushes, in milliseconds. */
+#define LOGGER_FLUSH_INTERVAL_MS 100
+
+/**
+ * @brief One queued log line.
+ *
+ * @c seq tells producers and the writer thread who owns the slot: it equals
+ * the slot's ring position when free, that position plus one once a line has
+ * been published, and advances by @ref LOGGER_RING_SLOTS when the writer
+ * hands it back.
+ */
+typedef struct LogSlot {
+    atomic_size_t seq;                    /**< Ownership sequence number, see above. */
+    size_t        len;                    /**< Length of @c line in bytes. */
+    char          line[LOGGER_LINE_SIZE]; /**< Formatted line, newline-terminated, not NUL-terminated. */
+} LogSlot;
 
 /**
  * @brief Holds the state for a single logger instance.
  *
  * A Logger can write timestamped messages to a file, to stdout, or both.
+ * Callers format their message into a lock-free ring buffer and return
+ * immediately; a background thread batches queued lines into @c writev
+ * calls every flush interval, or sooner once the ring is half full. When the
+ * ring is full, new messages are dropped and counted rather than blocking
+ * the caller.
+ *
  * Initialise with @ref logger_init before use and release resources with
- * @ref logger_close when done.
+ * @ref logger_close when done. Loggers that are still open when the
+ * program exits are drained and closed by an @c atexit handler.
  */
 typedef struct Logger {
-    char logfile_path[256]; /**< Absolute or relative path to the log file. */
-    FILE *logfile;          /**< Open file handle, or NULL if file logging is disabled. */
-    bool stdout_enabled;    /**< When @c true, messages are also written to stdout. */
+    char            logfile_path[256]; /**< Absolute or relative path to the log file. */
+    int             fd;                /**< Log file descriptor, or -1 if file logging is disabled. */
+    bool            stdout_enabled;    /**< When @c true, messages are also written to stdout. */
+    LogSlot         ring[LOGGER_RING_SLOTS]; /**< Queued lines awaiting the writer thread. */
+    atomic_size_t   tail;              /**< Next ring position to be claimed by a producer. */
+    atomic_size_t   head;              /**< Next ring position to be written by the writer thread. */
+    atomic_uint_least64_t dropped;     /**< Messages lost to a full ring or a failed write. */
+    atomic_uint     flush_interval_ms; /**< Maximum time a queued message waits before being written. */
+    atomic_bool     stop;              /**< Set by @ref logger_close to end the writer thread. */
+    bool            threaded;          /**< Whether the writer thread is running. */
+    pthread_t       thread;            /**< Background writer thread. */
+    pthread_mutex_t lock;              /**< Guards the condition variables; never taken by @ref logger_write. */
+    pthread_cond_t  wake;              /**< Wakes the writer thread early. */
+    pthread_cond_t  drained;           /**< Broadcast by the writer after each batch. */
 } Logger;
 
 /**
- * @brief Initialises a Logger instance and opens the log file for appending.
+ * @brief Initialises a Logger instance, opens the log file for appending, and
+ *        starts its background writer thread.
  *
  * If @p logfile_path is NULL or an empty string, file logging is disabled and
  * messages are only written to stdout when @p stdout_enabled is @c true.
+ * If the writer thread cannot be started, messages are written synchronously.
  *
  * @param logger          Pointer to an uninitialised Logger struct. Must not be NULL.
  * @param logfile_path    Path to the log file to open in append mode. May be NULL.
@@ -31,34 +77,57 @@ typedef struct Logger {
 int logger_init(Logger *logger, const char *logfile_path, bool stdout_enabled);
 
 /**
- * @brief Writes a formatted, timestamped message to the configured outputs.
+ * @brief Queues a formatted, timestamped message for the configured outputs.
  *
  * Uses printf-style format string and variadic arguments. Each message is
- * prefixed with an ISO-8601 timestamp. Output is written to the log file
- * and/or stdout depending on how the logger was initialised.
+ * prefixed with an ISO-8601 timestamp, formatted at most once per second
+ * per thread. The message is formatted directly into a ring slot and
+ * written later by the background thread; this call never blocks on I/O.
+ * Safe to call from several threads at once.
  *
  * @param logger  Pointer to an initialised Logger. Must not be NULL.
  * @param format  printf-compatible format string. Must not be NULL.
  * @param ...     Variadic arguments matching the format string.
- * @return        0 on success, -1 if the logger is uninitialised or a write fails.
+ * @return        0 on success, -1 if the logger is uninitialised or the
+ *                message was dropped because the ring is full.
  */
 int logger_write(Logger *logger, const char *format, ...);
 
 /**
- * @brief Flushes the log file's write buffer to disk.
+ * @brief Waits until every message queued before the call has been written.
  *
- * Has no effect if file logging is disabled.
+ * Has no effect if nothing is queued.
  *
  * @param logger  Pointer to an initialised Logger. Must not be NULL.
- * @return        0 on success, -1 on flush failure.
+ * @return        0 on success, -1 on invalid arguments.
  */
 int logger_flush(Logger *logger);
 
 /**
- * @brief Flushes and closes the log file handle.
+ * @brief Sets the maximum time a queued message waits before being written.
+ *
+ * @param logger       Pointer to an initialised Logger. Must not be NULL.
+ * @param interval_ms  Flush interval in milliseconds; 0 selects
+ *                     @ref LOGGER_FLUSH_INTERVAL_MS.
+ */
+void logger_set_flush_interval(Logger *logger, unsigned interval_ms);
+
+/**
+ * @brief Returns the number of messages dropped so far.
+ *
+ * Messages are dropped when the ring is full or when writing a batch to
+ * the log file fails.
+ *
+ * @param logger  Pointer to an initialised Logger. Must not be NULL.
+ * @return        Number of dropped messages.
+ */
+uint64_t logger_dropped(Logger *logger);
+
+/**
+ * @brief Drains queued messages, stops the writer thread, and closes the log file.
  *
  * After this call the Logger must not be used until re-initialised with
- * @ref logger_init. Has no effect on the file handle if it is already NULL.
+ * @ref logger_init. Has no effect on the file if it is already closed.
  *
  * @param logger  Pointer to an initialised Logger. Must not be NULL.
  * @return        0 on success, -1 if closing the file fails.
@@ -0,0 +1,100 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Outcome of a single probe.
+ */
+typedef enum {
+    PROBE_OK       = 0, /* Answered with a 2xx status. */
+    PROBE_BAD      = 1, /* Answered, but not with a 2xx status; see @c status. */
+    PROBE_REFUSED  = 2, /* Connection refused or reset. */
+    PROBE_TIMEOUT  = 3, /* No complete answer within @c timeout_ms. */
+    PROBE_ERROR    = 4  /* Local failure (e.g. out of descriptors) or a malformed answer. */
+} ProbeResult;
+
+/**
+ * @brief An HTTP GET, or a bare TCP connect, against a local port.
+ */
+typedef struct Probe {
+    uint16_t    port;       /* Port on 127.0.0.1 to probe. */
+    const char *path;       /* Request path, e.g. "/actuator/health"; NULL or empty
+                               passes as soon as the connection is accepted. */
+    const char *method;     /* Request method, e.g. "POST"; NULL sends a GET. */
+    unsigned    timeout_ms; /* Deadline for connect, request and status line together. */
+    ProbeResult result;     /* Out: outcome. */
+    int         status;     /* Out: HTTP status code, or 0 if none was received. */
+} Probe;
+
+/**
+ * @brief Runs a batch of probes concurrently.
+ *
+ * Every probe connects without blocking, sends
+ * `GET <path> HTTP/1.0` (or its @c method, without a body) and reads only
+ * the status line; a probe without a
+ * path only checks that the port accepts connections. All probes are
+ * driven from a single @c poll loop, so a batch takes about as long as its
+ * slowest probe (at most its longest timeout), not the sum of them, and no
+ * thread is created.
+ *
+ * @param probes  Probes to run; @c result and @c status are filled in.
+ * @param count   Number of probes.
+ * @return        Number of probes that returned @c PROBE_OK.
+ */
+size_t probe_run(Probe *probes, size_t count);
+
+/**
+ * @brief Probes of @ref probe_begin still in flight.
+ */
+typedef struct ProbeBatch ProbeBatch;
+
+/**
+ * @brief Starts a batch of probes without waiting for any of them.
+ *
+ * For callers with their own @c poll loop, such as the daemon: the batch's
+ * sockets are added to the loop with @ref probe_pollfds, and
+ * @ref probe_advance moves the probes on whenever the loop wakes.
+ * @ref probe_run is this, driven to the end.
+ *
+ * @param probes  Probes to run; must stay valid until @ref probe_end.
+ * @param count   Number of probes.
+ * @return        The batch, or NULL if out of memory.
+ */
+ProbeBatch *probe_begin(Probe *probes, size_t count);
+
+/**
+ * @brief Lists the sockets the batch waits on.
+ *
+ * @param batch  Batch in flight.
+ * @param pfds   Receives one entry per probe not done yet (at most the
+ *               number of probes).
+ * @param wake   Lowered to the nearest probe deadline, or to now once every
+ *               probe is done, in milliseconds of @c CLOCK_MONOTONIC.
+ * @return       Number of entries written.
+ */
+size_t probe_pollfds(const ProbeBatch *batch, struct pollfd *pfds, long long *wake);
+
+/**
+ * @brief Moves every probe of the batch on as far as it can go without blocking.
+ *
+ * @return  @c true once every probe has its result.
+ */
+bool probe_advance(ProbeBatch *batch);
+
+/**
+ * @brief Frees a batch. Probes still in flight fail with @c PROBE_ERROR.
+ *
+ * @return  Number of probes that returned @c PROBE_OK.
+ */
+size_t probe_end(ProbeBatch *batch);
+
+/**
+ * @brief Returns a short description of a probe result (e.g. "timeout").
+ */
+const char *probe_result_str(ProbeResult result);
+
+#endif // PROBE_H
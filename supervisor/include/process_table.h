@@ -7,9 +7,15 @@
 #include <time.h>
 #include "logger.h"
 
-/** @brief Path to the binary file used to persist the process table across runs. */
+/** @brief Path to the binary snapshot used to persist the process table across runs. */
 #define PROCESS_PATH "state/processes.dat"
 
+/** @brief Path to the append-only journal of changes made since the last snapshot. */
+#define PROCESS_JOURNAL_PATH "state/processes.journal"
+
+/** @brief Path of the advisory lock file held by the process that may write the table. */
+#define PROCESS_LOCK_PATH "state/processes.lock"
+
 /**
  * @brief Defines when the supervisor should attempt to restart a managed process.
  */
@@ -20,10 +26,175 @@ typedef enum {
 } RestartPolicy;
 
 /**
- * @brief A node in the singly-linked process table.
+ * @brief Describes how the most recent run of a managed process ended.
+ */
+typedef enum {
+    EXIT_UNKNOWN    = 0, /* Still running, or exited while not a child of the supervisor. */
+    EXIT_NORMAL     = 1, /* Exited on its own; exit_status holds the exit code. */
+    EXIT_SIGNALED   = 2, /* Killed by a signal; exit_status holds the signal number. */
+    EXIT_STOPPED    = 3, /* Stopped on request via the supervisor; never auto-restarted. */
+    EXIT_OOM_KILLED = 4  /* Killed by the OOM killer at its cgroup's memory.max; exit_status holds the signal. */
+} ExitReason;
+
+/**
+ * @brief Rotation settings for a service's stdout/stderr log file.
+ */
+typedef struct LogRotation {
+    uint64_t max_bytes;    /* Rotate once the file reaches this size (0 = no size limit). */
+    uint32_t max_age_secs; /* Rotate once the file has been written to for this long (0 = no age limit). */
+    uint16_t keep;         /* Rotated segments to keep; older ones are deleted (0 = keep all). */
+    bool     compress;     /* gzip rotated segments in the background. */
+} LogRotation;
+
+/**
+ * @brief What the supervisor does when a service stays over a soft limit.
+ */
+typedef enum {
+    LIMIT_ALERT   = 0, /* Log an alert only. */
+    LIMIT_RESTART = 1  /* Log an alert and restart the service gracefully. */
+} LimitAction;
+
+/**
+ * @brief Soft resource limits of a service, checked against its resource samples.
+ */
+typedef struct ResourceLimits {
+    uint64_t    rss_max_bytes;   /* Resident set size limit (0 = none). */
+    uint32_t    cpu_max_percent; /* CPU limit in percent of one core (0 = none). */
+    uint16_t    checks;          /* Consecutive passes over a limit before acting. */
+    LimitAction action;          /* What to do once a limit is breached. */
+} ResourceLimits;
+
+/**
+ * @brief Hard resource limits of a service, enforced by the kernel through
+ *        the service's cgroup (see cgroup.h).
+ */
+typedef struct CgroupLimits {
+    uint64_t memory_max;  /* memory.max: OOM-kill the service above this many bytes (0 = none). */
+    uint64_t memory_high; /* memory.high: throttle and reclaim above this many bytes (0 = none). */
+    uint32_t cpu_quota;   /* cpu.max in percent of one core (0 = none). */
+    uint16_t cpu_weight;  /* cpu.weight, 1-10000 (0 = the default of 100). */
+    uint16_t io_weight;   /* io.weight, 1-10000 (0 = the default of 100). */
+} CgroupLimits;
+
+/**
+ * @brief Active HTTP health check of a service.
+ */
+typedef struct HealthCheck {
+    char     path[96];   /* Path probed on the service's port, e.g. /actuator/health (empty = no check). */
+    uint16_t timeout_ms; /* Time allowed for each probe. */
+    uint16_t failures;   /* Consecutive failed probes before the service is restarted. */
+    uint16_t grace_secs; /* Uptime before the first probe, to let the JVM boot. */
+} HealthCheck;
+
+/** @brief Signal steps in a stop sequence, not counting the final SIGKILL. */
+#define STOP_MAX_STEPS 3
+
+/** @brief Services a service can depend on. */
+#define MAX_DEPENDENCIES 8
+
+/**
+ * @brief One step of a stop sequence: send a signal, then wait for the exit.
+ */
+typedef struct StopStep {
+    uint8_t  signal;     /* Signal to send, e.g. SIGTERM. */
+    uint32_t timeout_ms; /* Time to wait for the exit before the next step. */
+} StopStep;
+
+/**
+ * @brief How a service is stopped.
+ *
+ * The optional pre-stop hook is an HTTP POST to @c pre_stop_path on the
+ * service's port (e.g. Spring's /actuator/shutdown). The signal steps
+ * follow, and SIGKILL always ends the sequence.
+ */
+typedef struct StopSpec {
+    char     pre_stop_path[96];   /* Path POSTed to before any signal (empty = no hook). */
+    uint32_t pre_stop_timeout_ms; /* Time the hook, and the exit it triggers, may take. */
+    uint8_t  step_count;          /* Valid entries in steps (0 = the default SIGTERM step). */
+    StopStep steps[STOP_MAX_STEPS];
+} StopSpec;
+
+/**
+ * @brief Whether a running service should receive traffic.
+ */
+typedef enum {
+    READINESS_STARTING = 0, /* Launched, readiness probe not passed yet. */
+    READINESS_READY    = 1, /* Readiness probe passed; receives traffic. */
+    READINESS_DRAINING = 2  /* Being stopped; no new traffic. */
+} Readiness;
+
+/**
+ * @brief How a started service is found ready for traffic.
+ */
+typedef struct ReadinessProbe {
+    char     path[96];    /* HTTP path probed on the service's port (empty = TCP connect only). */
+    uint16_t interval_ms; /* Time between probes while starting. */
+    uint16_t timeout_ms;  /* Time allowed for each probe. */
+} ReadinessProbe;
+
+/**
+ * @brief Garbage collector selected on the JVM command line.
+ */
+typedef enum {
+    JVM_GC_DEFAULT    = 0, /* Let the JVM choose. */
+    JVM_GC_G1         = 1, /* -XX:+UseG1GC */
+    JVM_GC_PARALLEL   = 2, /* -XX:+UseParallelGC */
+    JVM_GC_SERIAL     = 3, /* -XX:+UseSerialGC */
+    JVM_GC_ZGC        = 4, /* -XX:+UseZGC */
+    JVM_GC_SHENANDOAH = 5  /* -XX:+UseShenandoahGC */
+} JvmGc;
+
+/**
+ * @brief How a service's JVM is sized and tuned at launch.
+ */
+typedef struct JvmProfile {
+    uint32_t heap_min_mb;   /* -Xms in MiB (0 = JVM default). */
+    uint32_t heap_max_mb;   /* -Xmx in MiB (0 = JVM default, or derived in auto mode). */
+    uint16_t cpus;          /* -XX:ActiveProcessorCount (0 = JVM default, or derived in auto mode). */
+    JvmGc    gc;            /* Garbage collector. */
+    bool     auto_size;     /* Derive unset heap_max_mb and cpus from a weighted share of the host. */
+    uint16_t weight;        /* Share of the host in auto mode (0 counts as 1). */
+    char     jvm_args[256]; /* Extra JVM options, whitespace-separated, placed before -jar. */
+    char     app_args[256]; /* Extra application arguments, whitespace-separated, placed after the JAR. */
+} JvmProfile;
+
+/** @brief Number of resource samples kept per service. */
+#define RESOURCE_RING_SIZE 16
+
+/**
+ * @brief One resource usage sample of a managed process.
+ */
+typedef struct ResourceSample {
+    int64_t  at_ms;     /* Monotonic time the sample was taken, in milliseconds. */
+    uint64_t cpu_usec;  /* User plus system CPU time consumed so far, in microseconds. */
+    uint64_t rss_bytes; /* Resident set size, or memory.current (page cache included) of the cgroup. */
+    uint32_t threads;   /* Number of threads, or pids.current of the cgroup. */
+    uint32_t fds;       /* Number of open file descriptors. */
+} ResourceSample;
+
+/**
+ * @brief Recent resource samples of a managed process, plus the open
+ *        descriptors used to take them. Runtime only; see sampler.h.
+ */
+typedef struct ResourceStats {
+    ResourceSample samples[RESOURCE_RING_SIZE]; /* Ring of the most recent samples. */
+    uint32_t       next;     /* Ring position the next sample is written to. */
+    uint32_t       count;    /* Valid samples, at most RESOURCE_RING_SIZE. */
+    pid_t          pid;      /* Process the descriptors below belong to (0 = none open). */
+    int            stat_fd;  /* /proc/<pid>/stat */
+    int            statm_fd; /* /proc/<pid>/statm */
+    int            fd_dir;   /* /proc/<pid>/fd */
+    int            cg_cpu_fd;    /* cpu.stat of the process's cgroup (-1 = read stat_fd instead). */
+    int            cg_memory_fd; /* memory.current of the cgroup (-1 = read statm_fd instead). */
+    int            cg_pids_fd;   /* pids.current of the cgroup (-1 = read stat_fd instead). */
+} ResourceStats;
+
+/**
+ * @brief A fixed-size record in the process table.
  *
  * Each node represents a single managed Spring Boot process and holds
  * all runtime state required for supervision, monitoring, and persistence.
+ * Nodes live by value in the contiguous @ref ProcessTable array.
  */
 typedef struct ProcessNode {
     char          name[64];       /* Human-readable service name. */
@@ -36,68 +207,210 @@ typedef struct ProcessNode {
     uint32_t      restart_count;  /* Number of times the process has been restarted. */
     bool          running;        /* Whether the process is currently alive. */
     time_t        start_time;     /* Unix timestamp of the most recent process start. */
-    struct ProcessNode *next;     /* Pointer to the next node in the list, or NULL. */
+    ExitReason    exit_reason;    /* How the last run ended, as observed by waitpid(). */
+    int           exit_status;    /* Exit code or terminating signal, depending on exit_reason. */
+    uint32_t      restart_budget; /* Consecutive failures tolerated before giving up (0 = unlimited). */
+    uint32_t      stable_secs;    /* Uptime after which the failure count is reset. */
+    uint32_t      failure_count;  /* Consecutive failed runs since the service was last stable. */
+    time_t        next_restart_time; /* Earliest time the next automatic restart may happen (0 = none pending). */
+    bool          crash_loop;     /* Set once restart_budget is exhausted; cleared by an explicit start. */
+    LogRotation   log_rotation;   /* How log_path is rotated by the service's log pump. */
+    ResourceLimits limits;        /* Soft memory/CPU limits. */
+    CgroupLimits  cgroup;         /* Hard CPU, memory and IO limits of the service's cgroup. */
+    uint16_t      rss_strikes;    /* Consecutive monitor passes spent over limits.rss_max_bytes. */
+    uint16_t      cpu_strikes;    /* Consecutive monitor passes spent over limits.cpu_max_percent. */
+    char          service[64];    /* Service this node is a replica of (empty = its own name). */
+    uint16_t      lb_port;        /* Public port the daemon balances across the service's replicas (0 = none). */
+    bool          listen_socket;  /* Supervisor binds port itself and passes it down via LISTEN_FDS. */
+    JvmProfile    jvm;            /* JVM sizing and extra arguments used at launch. */
+    HealthCheck   health;         /* HTTP health check applied while the service runs. */
+    uint16_t      health_failures; /* Consecutive failed health probes. */
+    ReadinessProbe ready_probe;   /* How readiness is determined after a start. */
+    StopSpec      stop;           /* Pre-stop hook and signal sequence used to stop the service. */
+    Readiness     readiness;      /* Starting, ready or draining; meaningful while running. */
+    char          previous_path[256]; /* JAR that ran before the latest deploy, used for rollback. */
+    char          deploy_path[256];   /* JAR being rolled out (empty = no deploy in progress). */
+    pid_t         deploy_pid;     /* Replacement launched by an unfinished deploy (0 = none). */
+    uint16_t      deploy_port;    /* Spare port deploy_pid was started on. */
+    char          depends_on[MAX_DEPENDENCIES][64]; /* Services that must be ready before this one
+                                                       is started (empty = unused slot). */
+    bool          owned;          /* Runtime only: process is a child of this invocation, so its
+                                     exit is delivered via SIGCHLD instead of polled. */
+    uint64_t      persisted_hash; /* Runtime only: hash of the record last written to disk (0 = unsaved). */
+    ResourceStats stats;          /* Runtime only: recent CPU, memory, thread and fd samples. */
+    int           listen_fd;      /* Runtime only: held listening socket, valid while listen_port != 0. */
+    uint16_t      listen_port;    /* Runtime only: port listen_fd is bound to (0 = no socket held). */
+    bool          busy;           /* Runtime only: a bulk operation is stopping or starting the
+                                     node, so monitor passes, reaping and probes leave it alone. */
 } ProcessNode;
 
 /**
- * @brief Loads the process table from a binary file into a linked list.
+ * @brief The in-memory process table.
  *
- * Reads all serialized @ref ProcessNode records from @p path and appends
- * them to the list at @p head. If the file does not exist, the function
- * returns @c true without modifying the list.
+ * Nodes are stored contiguously in @c nodes and looked up in O(1) through
+ * two open-addressing hash indexes, one keyed on service name and one on
+ * pid. Index slots hold a node position plus one (0 marks an empty slot).
  *
- * @param head  Address of the list head pointer. Must not be NULL.
- * @param path  Path to the binary state file to read from. Must not be NULL.
- * @return      @c true on success or if the file does not yet exist,
- *              @c false if a memory allocation or read error occurs.
+ * Pointers into @c nodes are invalidated by @ref process_append (the array
+ * may grow) and @ref process_remove (the last node is moved into the hole).
+ * Zero-initialise before first use and release with @ref process_table_free.
  */
-bool process_load(ProcessNode **head, const char *path);
+typedef struct ProcessTable {
+    ProcessNode *nodes;       /* Contiguous node storage, @c count used out of @c capacity. */
+    size_t       count;       /* Number of registered services. */
+    size_t       capacity;    /* Allocated length of @c nodes. */
+    uint32_t    *name_index;  /* Open-addressing index on name, @c index_size slots. */
+    uint32_t    *pid_index;   /* Open-addressing index on pid, @c index_size slots. */
+    size_t       index_size;  /* Slots per index; a power of two, at least twice @c capacity. */
+    size_t       pid_used;    /* Occupied pid slots, including stale ones left by pid changes. */
+    size_t       journal_entries; /* Valid entries in the journal since the last snapshot. */
+    off_t        journal_size;    /* Valid journal bytes; anything beyond is a torn write. */
+    bool         locked;      /* Holds the writer lock (see process_table_lock); otherwise read-only. */
+    int          lock_fd;     /* Descriptor the writer lock is held on, valid while @c locked. */
+} ProcessTable;
+
+
+
+/**
+ * @brief Takes the advisory lock that serialises writers of the table.
+ *
+ * Places an exclusive @c flock on @ref PROCESS_LOCK_PATH and keeps it until
+ * the process exits or the table is freed, so that loading, modifying and
+ * saving the table is never interleaved with another command doing the
+ * same: without it, two commands could append to the journal at the same
+ * offset or replace each other's snapshot. Call it before @ref process_load. A table loaded
+ * without the lock is read-only: saves, compactions and the journal writes
+ * of @ref process_remove are skipped.
+ *
+ * @param table  Table about to be loaded. Must not be NULL.
+ * @param wait   If @c true, block while another process holds the lock;
+ *               otherwise fail at once.
+ * @return       @c true if the lock is now held, @c false if it is held
+ *               elsewhere (and @p wait is @c false) or the file could not
+ *               be opened.
+ */
+bool process_table_lock(ProcessTable *table, bool wait);
 
 /**
- * @brief Appends a new node to the tail of the process table.
+ * @brief Loads the process table from a binary file.
+ *
+ * Maps the snapshot at @p path with @c mmap, validates its header (magic,
+ * format version, record size, count, and checksum), and decodes its
+ * fixed-width little-endian records straight into a single allocation
+ * sized from the header, then replays @ref PROCESS_JOURNAL_PATH on top of
+ * it and builds the name and pid indexes. Replay stops at the first torn
+ * or corrupt journal entry. There is no per-record allocation or buffered
+ * reading. If neither file exists, the function returns @c true without
+ * modifying the table.
  *
- * Inserts @p new_node at the end of the linked list. If @p fsave is
- * @c true, the entire list is immediately serialized to @ref PROCESS_PATH.
+ * A snapshot or journal in the raw layout of earlier releases, or in an
+ * older format version, is loaded and immediately rewritten in the current
+ * format. A headerless snapshot in no known layout is renamed to
+ * @c <path>.unrecognised and the table starts empty, so that a stale file
+ * cannot keep every command from running.
  *
- * @param head      Address of the list head pointer. Must not be NULL.
- * @param new_node  The node to append. Must not be NULL. Ownership is
- *                  transferred to the list.
- * @param fsave     If @c true, persist the updated list to disk.
- * @return          @c true on success, @c false if any argument is invalid.
+ * @param table  Table to load into. Must not be NULL.
+ * @param path   Path to the binary state file to read from. Must not be NULL.
+ * @return       @c true on success or if the file does not yet exist,
+ *               @c false if a memory allocation fails or a versioned
+ *               snapshot is corrupt or from a newer format version.
  */
-bool process_append(ProcessNode **head, ProcessNode *new_node, bool fsave);
+bool process_load(ProcessTable *table, const char *path);
 
 /**
- * @brief Removes the node with the given PID from the process table.
+ * @brief Copies a node into the process table.
  *
- * Finds the first node whose @c pid matches @p pid, unlinks it from the
- * list, frees its memory, and persists the updated list to disk.
+ * Stores a copy of @p node at the end of the table and indexes it by name
+ * and pid. If @p fsave is @c true, the table is immediately persisted as
+ * with @ref process_table_save.
  *
- * @param head  Address of the list head pointer. Must not be NULL.
- * @param pid   PID of the process to remove.
- * @return      @c true if the node was found and removed,
- *              @c false if the list is empty or no matching node exists.
+ * @param table  Table to append to. Must not be NULL.
+ * @param node   Node to copy in. Must not be NULL; its name must not already be registered.
+ * @param fsave  If @c true, persist the updated table to disk.
+ * @return       Pointer to the stored node, or NULL on invalid arguments,
+ *               a duplicate name, or allocation failure.
  */
-bool process_remove(ProcessNode **head, pid_t pid);
+ProcessNode *process_append(ProcessTable *table, const ProcessNode *node, bool fsave);
 
 /**
- * @brief Checks whether a process with the given PID exists in the table.
+ * @brief Removes the service with the given name from the process table.
+ *
+ * Moves the last node into the freed position, rebuilds the indexes, and
+ * journals the removal.
  *
- * @param head  Address of the list head pointer.
- * @param pid   PID to search for.
- * @return      @c true if a node with @p pid was found, @c false otherwise.
+ * @param table  Table to remove from. Must not be NULL.
+ * @param name   Name of the service to remove.
+ * @return       @c true if the node was found and removed, @c false otherwise.
  */
-bool process_find(ProcessNode **head, pid_t pid);
+bool process_remove(ProcessTable *table, const char *name);
 
 /**
- * @brief Persists the current in-memory process table to @ref PROCESS_PATH.
+ * @brief Looks up the node currently running under @p pid.
+ *
+ * @param table  Table to search.
+ * @param pid    PID to search for. Must be positive.
+ * @return       The matching node, or NULL if none has that pid.
+ */
+ProcessNode *process_find(ProcessTable *table, pid_t pid);
+
+/**
+ * @brief Looks up a node by service name.
+ *
+ * @param table  Table to search.
+ * @param name   Service name to search for.
+ * @return       The matching node, or NULL if no service has that name.
+ */
+ProcessNode *process_find_by_name(ProcessTable *table, const char *name);
+
+/**
+ * @brief Assigns a new pid to a node and updates the pid index.
+ *
+ * All pid changes of a node stored in the table must go through this
+ * function so that @ref process_find stays accurate. A node that is not
+ * part of @p table just has its field updated.
+ *
+ * @param table  Table that owns @p node. May be NULL.
+ * @param node   Node to update. Must not be NULL.
+ * @param pid    New pid.
+ */
+void process_set_pid(ProcessTable *table, ProcessNode *node, pid_t pid);
+
+/**
+ * @brief Persists the records that changed since they were last written.
  *
  * Useful after in-place mutation of node fields (e.g. marking a process
- * as stopped) without needing to remove and re-insert the node.
+ * as stopped) without needing to remove and re-insert the node. Each node's
+ * persisted fields are hashed and compared against the last written
+ * version; changed records are appended to @ref PROCESS_JOURNAL_PATH in a
+ * single write followed by one @c fsync. A save with no changes performs
+ * no I/O. Once the journal grows past its compaction threshold, a new
+ * snapshot is written as with @ref process_table_compact. The live state
+ * of every node is then published in the status page (see status_page.h).
+ * Does nothing if the table is read-only (see @ref process_table_lock).
+ *
+ * @param table  Table to persist. Must not be NULL.
+ */
+void process_table_save(ProcessTable *table);
+
+/**
+ * @brief Writes a full snapshot of the table and empties the journal.
+ *
+ * The snapshot is written to a temporary file, fsynced, and atomically
+ * renamed over @ref PROCESS_PATH, so a crash leaves either the old or the
+ * new snapshot intact, never a truncated one.
+ *
+ * @param table  Table to persist. Must not be NULL.
+ * @return       @c true on success, @c false if the snapshot could not be written.
+ */
+bool process_table_compact(ProcessTable *table);
+
+/**
+ * @brief Releases all memory held by the table, and its writer lock, and
+ *        resets it to empty.
  *
- * @param head  Address of the list head pointer. Must not be NULL.
+ * @param table  Table to free. Must not be NULL.
  */
-void process_table_save(ProcessNode **head);
+void process_table_free(ProcessTable *table);
 
 /**
  * @brief Initialises the module-level logger used by all process table functions.
@@ -0,0 +1,67 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include "process_table.h"
+
+/** @brief Milliseconds between resource samples in the daemon unless configured otherwise. */
+#define DEFAULT_SAMPLE_INTERVAL_MS 1000
+
+/**
+ * @brief Takes one resource sample of a node's process.
+ *
+ * On Linux, a process in its own cgroup (see cgroup.h) is sampled from
+ * its leaf: @c cpu.stat (CPU time), @c memory.current (memory, page cache
+ * included) and @c pids.current (tasks), which cover every process of the
+ * service in one read each. Whatever the leaf lacks, e.g. without the
+ * memory controller, is read from @c /proc/<pid>/stat (CPU time, threads)
+ * and @c /proc/<pid>/statm (RSS) instead. The entries of
+ * @c /proc/<pid>/fd are counted in both cases. The descriptors are
+ * opened on the first sample of a pid and reused with @c pread afterwards;
+ * parsing happens in stack buffers, so a sample performs no heap allocation.
+ * The sample is appended to @c node->stats. If the pid changed since the
+ * last sample, the old descriptors are closed and the ring is cleared first.
+ * Other platforms have no backend yet and always fail.
+ *
+ * @param node  Node to sample. Must not be NULL.
+ * @return      @c true if a sample was recorded, @c false if the process
+ *              is gone or could not be read.
+ */
+bool sampler_sample(ProcessNode *node);
+
+/**
+ * @brief Samples every running node in the table.
+ *
+ * @param table  Table to sample. Must not be NULL.
+ * @return       Number of nodes sampled.
+ */
+int sampler_sample_all(ProcessTable *table);
+
+/**
+ * @brief Returns the most recent sample of a node.
+ *
+ * @param node  Node to inspect. Must not be NULL.
+ * @return      The latest sample, or NULL if none has been taken.
+ */
+const ResourceSample *sampler_latest(const ProcessNode *node);
+
+/**
+ * @brief Computes CPU usage between the two most recent samples.
+ *
+ * Like @c top, 100% means one fully busy core, so a multithreaded JVM can
+ * exceed 100%.
+ *
+ * @param node  Node to inspect. Must not be NULL.
+ * @return      CPU usage in percent, or a negative value if fewer than two
+ *              samples of the current pid are available.
+ */
+double sampler_cpu_percent(const ProcessNode *node);
+
+/**
+ * @brief Closes a node's sampling descriptors and clears its samples.
+ *
+ * @param node  Node to release. Must not be NULL.
+ */
+void sampler_release(ProcessNode *node);
+
+#endif // SAMPLER_H
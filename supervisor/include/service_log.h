@@ -0,0 +1,62 @@
+#ifndef SERVICE_LOG_H
+#define SERVICE_LOG_H
+
+#include "process_table.h"
+
+/** @brief Size at which a service log is rotated unless configured otherwise (100 MiB). */
+#define DEFAULT_LOG_MAX_BYTES (100ull * 1024 * 1024)
+
+/** @brief Rotated segments kept per service unless configured otherwise. */
+#define DEFAULT_LOG_KEEP 5
+
+/** @brief Hidden command under which the supervisor's binary runs a log pump. */
+#define SERVICE_LOG_PUMP_COMMAND "__log-pump"
+
+/**
+ * @brief Sets up a supervisor-owned pipe for a service's stdout/stderr.
+ *
+ * Opens @c node->log_path, creates a pipe, and starts a detached log pump
+ * that streams everything written to the pipe into the log file (with
+ * @c splice where available, otherwise through a large buffer). The pump
+ * rotates the file according to @c node->log_rotation: the current file is
+ * renamed to @c <log_path>.<YYYYmmdd-HHMMSS> and a new one is started. A
+ * background thread in the pump gzips rotated segments, if requested, and
+ * deletes the oldest ones beyond @c keep, so the copy loop never waits on
+ * either. The pump exits once every holder of the write end has closed it,
+ * i.e. when the service exits.
+ *
+ * The pump is the supervisor's own binary run with posix_spawn() under
+ * @ref SERVICE_LOG_PUMP_COMMAND, so nothing is forked from the caller,
+ * whose threads and heap the pump would otherwise inherit.
+ *
+ * @param node  Node with a non-empty @c log_path. Must not be NULL.
+ * @return      Close-on-exec write end of the pipe, to be installed as the
+ *              service's stdout and stderr and then closed by the caller;
+ *              -1 if the log file, the pipe, or the pump could not be created.
+ */
+int service_log_open(const ProcessNode *node);
+
+/**
+ * @brief Initialises the module-level logger used by @ref service_log_open.
+ *
+ * If never called, errors setting up a service's log are silently discarded.
+ *
+ * @param logfile_path   Path to the log file opened in append mode. May be NULL
+ *                       to disable file logging.
+ * @param stdout_enabled If @c true, errors are also written to stdout.
+ * @return               0 on success, -1 if the log file could not be opened.
+ */
+int service_log_logger_init(const char *logfile_path, bool stdout_enabled);
+
+/**
+ * @brief Runs a log pump started by @ref service_log_open.
+ *
+ * Called by @c main when the binary is started as
+ * `supervisor __log-pump <path> <max-bytes> <max-age-secs> <keep> <compress>`,
+ * with the service's pipe as stdin and the opened log file as stdout.
+ *
+ * @return  Only on bad arguments; the pump exits once the pipe is closed.
+ */
+int service_log_pump(int argc, char **argv);
+
+#endif // SERVICE_LOG_H
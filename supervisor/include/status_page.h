@@ -0,0 +1,139 @@
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "process_table.h"
+
+/** @brief File the live status of every service is published in. */
+#define STATUS_PAGE_PATH "state/status.page"
+
+/** @brief First four bytes of a published page ("FSPG"). */
+#define STATUS_PAGE_MAGIC 0x46535047u
+
+/** @brief Layout version; bumped whenever a field changes. */
+#define STATUS_PAGE_VERSION 1
+
+/** @brief Services a page has room for; any beyond are not published. */
+#define STATUS_PAGE_CAPACITY 1024
+
+/** @brief Attempts a reader makes at a record that keeps changing under it. */
+#define STATUS_PAGE_READ_TRIES 1000
+
+/**
+ * @brief Live state of one service, as published.
+ *
+ * Fixed-width fields in host byte order, so that agents in any language can
+ * read the page with the same layout.
+ */
+typedef struct StatusEntry {
+    char     name[64];
+    int64_t  start_time;        /* Unix time of the most recent start. */
+    int64_t  next_restart_time; /* Unix time of a pending restart (0 = none). */
+    uint64_t rss_bytes;         /* Latest resident set size (0 = not sampled). */
+    int32_t  pid;
+    uint32_t restart_count;
+    int32_t  exit_status;       /* Exit code or signal, per exit_reason. */
+    int32_t  cpu_centipercent;  /* CPU usage in 1/100 % (-1 = not sampled). */
+    uint16_t port;
+    uint8_t  running;
+    uint8_t  exit_reason;       /* An ExitReason. */
+    uint8_t  restart_policy;    /* A RestartPolicy. */
+    uint8_t  readiness;         /* A Readiness. */
+    uint8_t  crash_loop;
+    uint8_t  reserved[9];
+} StatusEntry;
+
+/**
+ * @brief One slot of the page: an entry guarded by a sequence lock.
+ *
+ * @c seq is odd while the publisher rewrites @c entry. A reader copies the
+ * entry between two reads of @c seq and retries if they differ or were odd
+ * (see @ref status_page_read). Slots are one cache line each.
+ */
+typedef struct StatusRecord {
+    _Atomic uint32_t seq;
+    uint32_t         reserved;
+    StatusEntry      entry;
+} StatusRecord;
+
+/**
+ * @brief The mapped page: a header followed by @c capacity records.
+ */
+typedef struct StatusPage {
+    _Atomic uint32_t magic;       /* STATUS_PAGE_MAGIC once the page is initialised. */
+    uint16_t         version;     /* STATUS_PAGE_VERSION. */
+    uint16_t         record_size; /* sizeof(StatusRecord). */
+    uint32_t         capacity;    /* Records in the page. */
+    _Atomic uint32_t count;       /* Records currently published, from the first. */
+    _Atomic int64_t  updated_ms;  /* Unix time of the latest publication, in milliseconds. */
+    uint8_t          reserved[40];
+    StatusRecord     records[];
+} StatusPage;
+
+/**
+ * @brief Publishes the table's live state in @ref STATUS_PAGE_PATH.
+ *
+ * Creates and maps the page on first use. Records are published in table
+ * order and only rewritten if they changed, each under its sequence lock,
+ * so readers never wait and never see a half-written record. The
+ * publisher must be the only one: it is called by @ref process_table_save
+ * in the process holding the table's writer lock.
+ *
+ * @param table  Table to publish. Must not be NULL.
+ * @return       Number of records rewritten, or -1 if the page is unavailable.
+ */
+int status_page_publish(const ProcessTable *table);
+
+/**
+ * @brief Fills an entry with the live state of a node, as it is published.
+ *
+ * @param entry  Receives the state; unused fields are zeroed.
+ * @param node   Node to describe.
+ */
+void status_entry_fill(StatusEntry *entry, const ProcessNode *node);
+
+/**
+ * @brief Copies the live state of an entry into a node, for display.
+ *
+ * The node's settings and name are left alone. Its resource samples are
+ * replaced by ones from which the sampler reports the entry's RSS and CPU
+ * usage.
+ *
+ * @param entry  State to copy.
+ * @param node   Node to update.
+ */
+void status_entry_apply(const StatusEntry *entry, ProcessNode *node);
+
+/**
+ * @brief Maps a published page read-only.
+ *
+ * @param path  Page file, normally @ref STATUS_PAGE_PATH.
+ * @return      The page, or NULL if there is none or it has another layout.
+ *              Release with @ref status_page_unmap.
+ */
+const StatusPage *status_page_map(const char *path);
+
+/**
+ * @brief Copies one record consistently.
+ *
+ * Performs no system call and takes no lock, so it never blocks the
+ * publisher. A record removed from the table while it is read may briefly
+ * show the service moved into its slot, so readers match entries by name.
+ *
+ * @param page   Mapped page.
+ * @param index  Record to read, below the page's @c count.
+ * @param entry  Receives the record.
+ * @return       @c true on success, @c false if the record was rewritten
+ *               on each of @ref STATUS_PAGE_READ_TRIES attempts or the
+ *               publisher died mid-write.
+ */
+bool status_page_read(const StatusPage *page, uint32_t index, StatusEntry *entry);
+
+/**
+ * @brief Unmaps a page returned by @ref status_page_map.
+ */
+void status_page_unmap(const StatusPage *page);
+
+#endif // STATUS_PAGE_H
@@ -1,26 +1,114 @@
 #ifndef SUPERVISOR_H
 #define SUPERVISOR_H
 
+#include <poll.h>
 #include "process_table.h"
 #include "logger.h"
 
+/** @brief Consecutive failed restarts tolerated before a service is marked as crash-looping. */
+#define DEFAULT_RESTART_BUDGET 10
+
+/** @brief Seconds a service must stay up before its consecutive-failure count is reset. */
+#define DEFAULT_STABLE_SECS 60
+
+/** @brief Milliseconds allowed for a health probe unless configured otherwise. */
+#define DEFAULT_HEALTH_TIMEOUT_MS 2000
+
+/** @brief Consecutive failed health probes before a restart unless configured otherwise. */
+#define DEFAULT_HEALTH_FAILURES 3
+
+/** @brief Seconds after start before a service is first health-checked unless configured otherwise. */
+#define DEFAULT_HEALTH_GRACE_SECS 60
+
+/** @brief Milliseconds a stop step waits for the exit unless configured otherwise; also
+ *  the wait after SIGTERM in the default stop sequence. */
+#define DEFAULT_STOP_TIMEOUT_MS 5000
+
+/** @brief Milliseconds a pre-stop hook, and the exit it triggers, may take unless configured otherwise. */
+#define DEFAULT_PRE_STOP_TIMEOUT_MS 10000
+
+/** @brief Milliseconds between readiness probes of a starting service unless configured otherwise. */
+#define DEFAULT_READY_INTERVAL_MS 1000
+
+/** @brief Milliseconds allowed for a readiness probe unless configured otherwise. */
+#define DEFAULT_READY_TIMEOUT_MS 1000
+
+/** @brief Seconds `start --wait-ready` waits for readiness unless given a timeout. */
+#define DEFAULT_READY_WAIT_SECS 120
+
+/** @brief Consecutive checks over a soft limit before a service is considered in breach. */
+#define DEFAULT_LIMIT_CHECKS 3
+
+/** @brief Services a bulk command works on at a time unless configured otherwise. */
+#define DEFAULT_BULK_PARALLEL 16
+
+/** @brief Hidden command under which the supervisor's binary execs a service once it is in its cgroup. */
+#define SUPERVISOR_EXEC_COMMAND "__exec"
+
+/**
+ * @brief Operation applied by @ref supervisor_bulk.
+ */
+typedef enum {
+    BULK_START   = 0, /* Start the nodes that are not running. */
+    BULK_STOP    = 1, /* Stop the nodes as @ref supervisor_stop does. */
+    BULK_RESTART = 2  /* Restart the nodes as @ref supervisor_restart does. */
+} BulkAction;
+
 /**
  * @brief Initialises the supervisor module.
  *
  * Must be called once before any other supervisor function. Stores a
  * reference to the process table and sets up the module-level logger.
  *
- * @param head           Address of the process table head pointer.
+ * @param table          The process table managed by this supervisor.
  * @param logfile_path   Path to the log file opened in append mode. May be NULL.
  * @param stdout_enabled If @c true, log messages are also written to stdout.
  */
-void supervisor_init(ProcessNode **head, const char *logfile_path, bool stdout_enabled);
+void supervisor_init(ProcessTable *table, const char *logfile_path, bool stdout_enabled);
+
+/**
+ * @brief Returns the path under which the supervisor's own binary can be
+ *        executed, for the helpers it runs as separate processes.
+ *
+ * @return  e.g. @c /proc/self/exe on Linux, or NULL if the platform cannot
+ *          tell.
+ */
+const char *supervisor_self_path(void);
+
+/**
+ * @brief Runs the gate a service is launched behind when it gets a cgroup.
+ *
+ * Called by @c main when the binary is started as
+ * `supervisor __exec <executable> <argv0> [args...]`. Waits until the
+ * supervisor closes the write end of the pipe found on descriptor 3, which
+ * it does once it has moved the process into its leaf cgroup, then execs
+ * the service in the same process. Anything the service forks thus starts
+ * in the leaf. If the exec fails, its @c errno is written to descriptor 4,
+ * which a successful exec closes, so that @ref supervisor_start fails as it
+ * does when the service cannot be spawned.
+ *
+ * @return  Only if the exec failed.
+ */
+int supervisor_exec_gate(int argc, char **argv);
 
 /**
  * @brief Launches the process described by @p node.
  *
- * Forks a child process and executes `java -jar <node->path>`. On success
- * the node's @c pid, @c running, and @c start_time fields are updated.
+ * Forks a child process and executes `java -jar <node->path>`, with heap,
+ * GC, processor count and extra arguments taken from the node's JVM
+ * profile (see @ref jvm_build_command). If the node
+ * has a @c log_path, the child's stdout/stderr are connected to a log pump
+ * that rotates the file (see @ref service_log_open). With @c listen_socket
+ * set, the supervisor binds @c node->port itself (with @c SO_REUSEPORT
+ * where available), keeps the socket in @c listen_fd, and passes it to the
+ * child as fd 3 with @c LISTEN_FDS=1, @c LISTEN_PID and @c LISTEN_FDNAMES
+ * set as in systemd socket activation; @c --server.port is passed as well.
+ * A held socket is reused by later starts, so connections arriving while
+ * the service restarts are queued by the kernel instead of refused. The
+ * new process is moved into a cgroup with the node's @c cgroup limits
+ * (see @ref cgroup_attach); if that fails it runs without them. On success
+ * the node's @c pid, @c running, and @c start_time fields are updated; the
+ * pid is re-indexed in the table passed to @ref supervisor_init.
  *
  * @param node  Process node to start. Must not be NULL.
  * @return      0 on success, -1 on fork or exec failure.
@@ -28,27 +116,258 @@ void supervisor_init(ProcessNode **head, const char *logfile_path, bool stdout_e
 int supervisor_start(ProcessNode *node);
 
 /**
- * @brief Sends SIGTERM to the process and waits for it to exit.
+ * @brief Stops the process by running its stop spec, waiting for it to exit.
  *
- * Marks @c node->running as @c false after the process terminates.
- * If the process does not exit within a grace period, SIGKILL is sent.
+ * If @c stop.pre_stop_path is set, it is POSTed to on the service's port
+ * and the process gets @c stop.pre_stop_timeout_ms (hook included) to exit;
+ * if the hook fails, the signals follow at once.
+ * Then each of the @c stop.steps signals is sent in turn, each followed by
+ * a wait of its @c timeout_ms; without steps, SIGTERM is followed by
+ * @ref DEFAULT_STOP_TIMEOUT_MS. SIGKILL ends the sequence. Deadlines have
+ * millisecond resolution; the exit is reported by the kernel (see
+ * @ref supervisor_wait_exit), so a stop takes as long as the process takes
+ * to exit and no longer.
+ *
+ * Marks @c node->running as @c false after the process terminates and
+ * sets @c exit_reason to @c EXIT_STOPPED so that no restart policy brings
+ * it back; a backoff restart still pending is cancelled. Processes the service left in its cgroup are killed and the
+ * cgroup is removed. A listening socket held for the service is closed.
  *
  * @param node  Process node to stop. Must not be NULL.
  * @return      0 on success, -1 if the process could not be signalled.
  */
 int supervisor_stop(ProcessNode *node);
 
+/**
+ * @brief Waits for a process to exit, whether or not it is a child of this one.
+ *
+ * The exit is reported by the kernel through a pidfd (@c pidfd_open and
+ * @c poll) on Linux, or an @c EVFILT_PROC kqueue filter on the BSDs and
+ * macOS, so the wait ends the moment the process is gone. Where neither is
+ * available the process is polled, first after a millisecond and then at
+ * doubling intervals of up to 50 ms. A zombie counts as exited; a child of
+ * this process is reaped.
+ *
+ * @param pid         Process to wait for.
+ * @param timeout_ms  Milliseconds to wait at most.
+ * @return            @c true if the process has exited, @c false on timeout.
+ */
+bool supervisor_wait_exit(pid_t pid, unsigned timeout_ms);
+
+/**
+ * @brief Parses a stop sequence as accepted on the command line.
+ *
+ * The text is a comma-separated list of `<signal>[:<ms>]` steps, e.g.
+ * "TERM:30000,INT:5000". Signals are TERM, INT, QUIT, HUP, USR1 and USR2,
+ * optionally prefixed with "SIG"; a step without a timeout waits
+ * @ref DEFAULT_STOP_TIMEOUT_MS. A KILL step ends the list, since SIGKILL
+ * always follows the last step.
+ *
+ * @param text  Sequence to parse. Must not be NULL.
+ * @param spec  Receives the steps; the pre-stop hook is left alone. Must not be NULL.
+ * @return      0 on success, -1 if a signal is unknown or there are more than
+ *              @ref STOP_MAX_STEPS steps; @p spec is unchanged then.
+ */
+int supervisor_parse_stop_sequence(const char *text, StopSpec *spec);
+
+/**
+ * @brief Formats a stop spec's signal steps, e.g. "TERM:5000,KILL".
+ *
+ * @return  @p buf.
+ */
+const char *supervisor_format_stop_sequence(const StopSpec *spec, char *buf, size_t size);
+
+/**
+ * @brief Returns the longest a stop by a spec can take.
+ *
+ * @return  Milliseconds of the pre-stop hook's budget, every signal step and
+ *          the wait for the exit after SIGKILL.
+ */
+unsigned supervisor_stop_budget_ms(const StopSpec *spec);
+
 /**
  * @brief Stops then restarts a process, incrementing its restart counter.
  *
  * Calls @ref supervisor_stop followed by @ref supervisor_start and
- * increments @c node->restart_count on a successful restart.
+ * increments @c node->restart_count on a successful restart. A service
+ * with @c listen_socket keeps its listening socket across the restart; the
+ * socket is bound before the old process is stopped.
  *
  * @param node  Process node to restart. Must not be NULL.
  * @return      0 on success, -1 if stop or start fails.
  */
 int supervisor_restart(ProcessNode *node);
 
+/**
+ * @brief Starts, stops or restarts many nodes concurrently.
+ *
+ * Up to @p parallel nodes are worked on at a time; as soon as one is done
+ * the next one takes its slot. Each node runs the same stop spec as in
+ * @ref supervisor_stop, but instead of waiting for one process at a time,
+ * every pending exit, stop-step deadline and readiness probe is driven
+ * from a single @c poll loop over the processes' exit descriptors (see
+ * @ref supervisor_wait_exit), and the pre-stop hooks of nodes admitted
+ * together are called together. A bulk therefore takes about as long as
+ * its slowest node per @p parallel nodes, not the sum of all of them.
+ *
+ * With @p ready_timeout_secs, a started node keeps its slot until it
+ * passes its readiness probe, so at most @p parallel nodes are down or
+ * warming up at once; without it, a node's slot is freed once it is
+ * launched. Restarted nodes get their @c restart_count incremented, and
+ * nodes already running are left alone by @c BULK_START, except that with
+ * @p ready_timeout_secs one still starting keeps its slot until it is ready.
+ *
+ * Dependencies (@c depends_on) order the work. A node is started or
+ * restarted only once each of its dependencies is running and ready. When
+ * a dependency is part of the same bulk, its dependents wait for it to
+ * pass its readiness probe (a TCP connect unless it has a
+ * @c ready_probe.path), even without @p ready_timeout_secs. Independent
+ * nodes therefore start in parallel waves, one dependency level after
+ * another. A node whose dependency failed, or is down and not part of the
+ * bulk, is not touched and counts as failed. Stops run in reverse order: a
+ * node is stopped only after every node of the bulk that depends on it.
+ *
+ * @param nodes               Nodes to work on, in order. Must not be NULL if @p count > 0.
+ * @param count               Number of nodes.
+ * @param action              Operation to apply.
+ * @param parallel            Nodes worked on at a time; 0 for all at once.
+ * @param ready_timeout_secs  Time each started node has to become ready; 0 to not wait.
+ * @return                    Number of nodes that failed (could not be started
+ *                            or stopped, exited or were not ready in time),
+ *                            or -1 if out of memory.
+ */
+int supervisor_bulk(ProcessNode **nodes, size_t count, BulkAction action,
+                    unsigned parallel, unsigned ready_timeout_secs);
+
+/**
+ * @brief Called once a bulk started by @ref supervisor_bulk_background is done.
+ *
+ * @param arg     As passed to @ref supervisor_bulk_background.
+ * @param failed  As returned by @ref supervisor_bulk.
+ */
+typedef void (*BulkDone)(void *arg, int failed);
+
+/**
+ * @brief Makes probes and restarts run in the background of the caller's poll loop.
+ *
+ * Once enabled (by the daemon), health and readiness probes sent by
+ * @ref supervisor_monitor_all and @ref supervisor_check_readiness, and the
+ * restarts of unhealthy nodes and of nodes over their limits, no longer
+ * block the caller: they are sent off and moved on by
+ * @ref supervisor_background_advance whenever the loop wakes for one of
+ * the descriptors of @ref supervisor_background_pollfds. A new round of
+ * health or readiness probes is only sent once the last one is done.
+ *
+ * While background work is in flight, nodes must not be added to or removed
+ * from the table; call @ref supervisor_background_wait first, or do it from
+ * work that runs alone (see @ref BackgroundWork).
+ *
+ * @param enabled  @c true to run in the background, @c false to block as by default.
+ */
+void supervisor_set_background(bool enabled);
+
+/**
+ * @brief Starts a bulk operation in the background.
+ *
+ * Works as @ref supervisor_bulk, but returns at once; the bulk is moved on
+ * by @ref supervisor_background_advance. Its nodes are @c busy until their
+ * part is done. They may be copies of nodes that are not in the table,
+ * such as the replacements of a deploy.
+ *
+ * @param nodes               Nodes to work on; none of them may be @c busy.
+ * @param count               Number of nodes.
+ * @param action              Operation to apply.
+ * @param parallel            Nodes worked on at a time; 0 for all at once.
+ * @param ready_timeout_secs  Time each started node has to become ready; 0 to not wait.
+ * @param done                Called when the bulk is done; may be NULL.
+ * @param arg                 Passed to @p done.
+ * @return                    0 if the bulk was started, -1 if out of memory.
+ */
+int supervisor_bulk_background(ProcessNode **nodes, size_t count, BulkAction action,
+                               unsigned parallel, unsigned ready_timeout_secs,
+                               BulkDone done, void *arg);
+
+/**
+ * @brief Work of another module moved on by the background loop, such as a deploy.
+ *
+ * The work waits on descriptors of its own or on background bulks it
+ * starts, and is advanced with the rest of the background work.
+ */
+typedef struct BackgroundWork {
+    /** Number of descriptors @c pollfds may list. */
+    size_t (*fds)(void *arg);
+    /** Lists the descriptors the work waits on and lowers @p wake to its
+     *  nearest deadline, as @ref supervisor_background_pollfds does; returns
+     *  the number listed. */
+    size_t (*pollfds)(void *arg, struct pollfd *pfds, long long *wake);
+    /** Moves the work on without blocking, adding the number of nodes whose
+     *  state changed to @p changed; returns @c true once the work is done. */
+    bool   (*advance)(void *arg, int *changed);
+    /** Whether the next step adds nodes to or removes them from the table, so
+     *  that it must wait until all other background work is done or waiting
+     *  too. Work that waits holds no node pointers. May be NULL. */
+    bool   (*exclusive)(void *arg);
+    /** Called once the work is done; frees @p arg. */
+    void   (*end)(void *arg);
+} BackgroundWork;
+
+/**
+ * @brief Adds work to the background loop.
+ *
+ * @param work  What to call; must outlive the work.
+ * @param arg   Passed to each call.
+ * @return      0 on success, -1 if out of memory.
+ */
+int supervisor_background_add(const BackgroundWork *work, void *arg);
+
+/**
+ * @brief Returns how many descriptors @ref supervisor_background_pollfds may list.
+ */
+size_t supervisor_background_fds(void);
+
+/**
+ * @brief Lists the descriptors the background work waits on.
+ *
+ * @param pfds  Receives the descriptors, with room for
+ *              @ref supervisor_background_fds of them.
+ * @param wake  Lowered to the nearest deadline of the background work, in
+ *              milliseconds of @c CLOCK_MONOTONIC.
+ * @return      Number of descriptors listed.
+ */
+size_t supervisor_background_pollfds(struct pollfd *pfds, long long *wake);
+
+/**
+ * @brief Moves the background work on as far as it goes without blocking.
+ *
+ * Finished probe rounds are applied as their blocking counterparts would
+ * be, except that a probe whose node has since exited, been restarted or
+ * become @c busy is ignored; finished bulks call their @c done callback,
+ * and finished @ref BackgroundWork its @c end.
+ *
+ * @param ready  Set to @c true if a node became ready; may be NULL.
+ * @return       Number of nodes whose state changed.
+ */
+int supervisor_background_advance(bool *ready);
+
+/**
+ * @brief Blocks until all background work is done.
+ *
+ * @return  Number of nodes whose state changed.
+ */
+int supervisor_background_wait(void);
+
+/**
+ * @brief Validates the dependencies of every node in the table.
+ *
+ * @param table  The process table to check.
+ * @param error  Receives a description of the first problem found, e.g.
+ *               "dependency cycle: api -> cache -> api".
+ * @param size   Size of @p error.
+ * @return       0 if every dependency names a service in the table and
+ *               there is no cycle, -1 otherwise.
+ */
+int supervisor_check_dependencies(ProcessTable *table, char *error, size_t size);
+
 /**
  * @brief Checks whether the process is alive and logs its current status.
  *
@@ -65,8 +384,124 @@ int supervisor_status(ProcessNode *node);
  *
  * For each node, checks liveness and, if the process is dead, applies
  * its @c restart_policy: restarts on failure or always as configured.
+ * @c on-failure uses the recorded @c exit_reason, so a clean exit (status 0
+ * or a SIGTERM shutdown) is not restarted; an unobserved exit counts as a
+ * failure. Services stopped via @ref supervisor_stop are never restarted.
+ *
+ * Restarts back off exponentially: the first failure is restarted at once,
+ * later consecutive failures wait 1s, 2s, 4s, ... up to 5 minutes, as
+ * recorded in @c next_restart_time. A service with a dependency that is
+ * not running and ready waits for it instead of being restarted; the
+ * daemon retries as soon as a service becomes ready. A service that stays up for
+ * @c stable_secs has its @c failure_count reset; one that exceeds its
+ * @c restart_budget is flagged @c crash_loop and left down.
+ * Running nodes that are children of this process (@c owned) are skipped,
+ * since their exit is picked up by @ref supervisor_reap instead.
+ * Starting nodes are then probed for readiness (see
+ * @ref supervisor_check_readiness). Afterwards, every running node with a
+ * @c health.path that has been up
+ * for @c health.grace_secs is probed with an HTTP GET on its port; all
+ * probes run concurrently (see @ref probe_run). A node that fails
+ * @c health.failures probes in a row is considered hung and restarted,
+ * unless its policy is @c never; such restarts run concurrently (see
+ * @ref supervisor_bulk). In the background (see
+ * @ref supervisor_set_background) the probes and restarts are only sent off
+ * here, and nodes that are @c busy are left alone.
  * Intended to be called periodically from a monitoring loop.
+ *
+ * @param table  The process table to check.
+ * @return       Number of nodes whose state changed (went down or were restarted).
+ */
+int supervisor_monitor_all(ProcessTable *table);
+
+/**
+ * @brief Reaps every exited child and applies restart policies to them.
+ *
+ * Calls @c waitpid(-1, ..., WNOHANG) until no more children are pending.
+ * Each reaped pid that belongs to an owned node has its exit code or
+ * terminating signal recorded in @c exit_reason / @c exit_status, and its
+ * @c restart_policy is applied with the same backoff rules as
+ * @ref supervisor_monitor_all. Intended to be called after SIGCHLD is delivered.
+ *
+ * @return  Number of managed processes that were reaped.
+ */
+int supervisor_reap(void);
+
+/**
+ * @brief Checks every running node's latest resource sample against its soft limits.
+ *
+ * A node that is over its @c limits.rss_max_bytes or @c limits.cpu_max_percent
+ * on @c limits.checks consecutive calls is logged as an alert when the limit
+ * is first breached and, with @c LIMIT_RESTART, restarted gracefully; all
+ * such restarts run concurrently via @ref supervisor_bulk, in the background
+ * if enabled. Strike counts live in the node, so they survive
+ * between cron runs. Intended to be called right after
+ * @ref sampler_sample_all; the CPU limit needs two samples of the same
+ * process and is only checked once they exist.
+ *
+ * @param table  The process table to check.
+ * @return       Number of nodes whose strike counts changed or that were restarted.
+ */
+int supervisor_enforce_limits(ProcessTable *table);
+
+/**
+ * @brief Probes every running node that is still starting and marks those that pass as ready.
+ *
+ * A node's readiness probe is an HTTP GET of @c ready_probe.path on its
+ * port that must answer 2xx, or, with an empty path, a TCP connect to the
+ * port. All probes run concurrently (see @ref probe_run). A node without a
+ * port is ready as soon as it is started. The daemon calls this every
+ * @ref supervisor_readiness_interval milliseconds while any node is starting.
+ * In the background, the probes are only sent off and the nodes that pass
+ * are reported by @ref supervisor_background_advance.
+ *
+ * @param table  The process table to check.
+ * @return       Number of nodes that became ready (without a probe, in the
+ *               background).
+ */
+int supervisor_check_readiness(ProcessTable *table);
+
+/**
+ * @brief Returns how often starting nodes should be probed for readiness.
+ *
+ * @param table  The process table to scan.
+ * @return       The smallest @c ready_probe.interval_ms of a running node
+ *               that is still starting, or 0 if there is none.
+ */
+unsigned supervisor_readiness_interval(ProcessTable *table);
+
+/**
+ * @brief Blocks until a freshly started node passes its readiness probe.
+ *
+ * Probes the node every @c ready_probe.interval_ms. If the process exits
+ * meanwhile, its exit is recorded and the wait ends.
+ *
+ * @param node          Node started by this process. Must not be NULL.
+ * @param timeout_secs  Seconds to wait at most.
+ * @return              0 once ready, -1 if the process exited, 1 on timeout.
+ */
+int supervisor_wait_ready(ProcessNode *node, unsigned timeout_secs);
+
+/**
+ * @brief Clears a node's failure count, pending restart, and crash-loop flag.
+ *
+ * Called when an operator explicitly starts or restarts a service, giving
+ * it a fresh restart budget, and when a node's restart policy declines to
+ * restart it, so that no stale backoff restart stays scheduled.
+ *
+ * @param node  Process node to reset. Must not be NULL.
+ */
+void supervisor_reset_backoff(ProcessNode *node);
+
+/**
+ * @brief Returns the earliest pending backoff restart time in the table.
+ *
+ * Services waiting for a dependency to become ready, and services stopped
+ * on request, are not counted.
+ *
+ * @param table  The process table to scan.
+ * @return       Unix timestamp of the next scheduled restart, or 0 if none is pending.
  */
-void supervisor_monitor_all(ProcessNode **head);
+time_t supervisor_next_restart(ProcessTable *table);
 
 #endif // SUPERVISOR_H
@@ -0,0 +1,337 @@
+#include "cgroup.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char cg_root[PATH_MAX];
+static int  cg_state = 0; /* 0 = not probed yet, 1 = available, -1 = unavailable. */
+
+static bool write_file(const char *path, const char *text) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    size_t  len = strlen(text);
+    ssize_t n   = write(fd, text, len);
+    int     saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return n == (ssize_t)len;
+}
+
+/* Reads a small control file into buf, NUL-terminated. */
+static ssize_t read_file(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* Value of a "key value" line of a flat-keyed file such as memory.events. */
+static unsigned long long keyed_value(const char *text, const char *key) {
+    size_t      len = strlen(key);
+    const char *p   = text;
+    while (p != NULL && *p != '\0') {
+        if (strncmp(p, key, len) == 0 && p[len] == ' ') {
+            return strtoull(p + len + 1, NULL, 10);
+        }
+        p = strchr(p, '\n');
+        if (p != NULL) p++;
+    }
+    return 0;
+}
+
+/* Finds where the cgroup v2 hierarchy is mounted. Lines of mountinfo read
+ * "id parent major:minor root mount-point options ... - fstype source ...". */
+static bool find_mount(char *out, size_t size) {
+    FILE *f = fopen("/proc/self/mountinfo", "re");
+    if (f == NULL) return false;
+
+    char line[1024];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        const char *sep = strstr(line, " - ");
+        if (sep == NULL || strncmp(sep + 3, "cgroup2 ", 8) != 0) continue;
+
+        char mount[PATH_MAX];
+        if (sscanf(line, "%*s %*s %*s %*s %4095s", mount) == 1 && strlen(mount) < size) {
+            strcpy(out, mount);
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* Makes the controllers available to a cgroup's children. Each is enabled
+ * on its own, so that one the host lacks does not block the others. */
+static void enable_controllers(const char *dir) {
+    static const char *const controllers[] = { "+cpu", "+memory", "+io", "+pids" };
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/cgroup.subtree_control", dir) >= (int)sizeof(path)) return;
+    for (size_t i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+        write_file(path, controllers[i]);
+    }
+}
+
+const char *cgroup_root(void) {
+    if (cg_state != 0) {
+        return cg_state > 0 ? cg_root : NULL;
+    }
+    cg_state = -1;
+
+    char mount[PATH_MAX];
+    if (!find_mount(mount, sizeof(mount)) ||
+        snprintf(cg_root, sizeof(cg_root), "%s/%s", mount, CGROUP_PARENT) >= (int)sizeof(cg_root)) {
+        return NULL;
+    }
+    if (mkdir(cg_root, 0755) != 0 && errno != EEXIST) {
+        return NULL;
+    }
+    /* A child's controllers must be enabled in every ancestor. */
+    enable_controllers(mount);
+    enable_controllers(cg_root);
+    cg_state = 1;
+    return cg_root;
+}
+
+/* Rejects names that are not a single directory component. */
+static bool valid_name(const char *name) {
+    return name[0] != '\0' && name[0] != '.' && strchr(name, '/') == NULL;
+}
+
+static bool service_path(const char *name, char *out, size_t size) {
+    const char *root = cgroup_root();
+    return root != NULL && valid_name(name) &&
+           snprintf(out, size, "%s/%s", root, name) < (int)size;
+}
+
+bool cgroup_leaf_path(const char *name, pid_t pid, const char *file, char *out, size_t size) {
+    const char *root = cgroup_root();
+    return root != NULL && valid_name(name) && pid > 0 &&
+           snprintf(out, size, "%s/%s/%d%s%s", root, name, (int)pid,
+                    file[0] != '\0' ? "/" : "", file) < (int)size;
+}
+
+/* Writes one limit. A failure is only reported for a limit that was asked
+ * for: resetting an unset one fails harmlessly without its controller. */
+static void write_limit(const char *leaf, const char *file, const char *value,
+                        bool requested, char *unset, size_t size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", leaf, file);
+    if (write_file(path, value) || !requested || size == 0) return;
+
+    size_t len = strlen(unset);
+    snprintf(unset + len, size - len, "%s%s", len > 0 ? ", " : "", file);
+}
+
+static void write_limits(const char *leaf, const CgroupLimits *limits, char *unset, size_t size) {
+    char value[64];
+    if (size > 0) unset[0] = '\0';
+
+    if (limits->cpu_quota > 0) {
+        snprintf(value, sizeof(value), "%llu %u",
+                 (unsigned long long)limits->cpu_quota * CGROUP_CPU_PERIOD_US / 100, CGROUP_CPU_PERIOD_US);
+    } else {
+        snprintf(value, sizeof(value), "max %u", CGROUP_CPU_PERIOD_US);
+    }
+    write_limit(leaf, "cpu.max", value, limits->cpu_quota > 0, unset, size);
+
+    snprintf(value, sizeof(value), "%u", limits->cpu_weight > 0 ? limits->cpu_weight : CGROUP_DEFAULT_WEIGHT);
+    write_limit(leaf, "cpu.weight", value, limits->cpu_weight > 0, unset, size);
+
+    /* memory.high is applied first so that lowering both never leaves
+     * memory.high above memory.max. */
+    if (limits->memory_high > 0) snprintf(value, sizeof(value), "%llu", (unsigned long long)limits->memory_high);
+    else                         strcpy(value, "max");
+    write_limit(leaf, "memory.high", value, limits->memory_high > 0, unset, size);
+
+    if (limits->memory_max > 0) snprintf(value, sizeof(value), "%llu", (unsigned long long)limits->memory_max);
+    else                        strcpy(value, "max");
+    write_limit(leaf, "memory.max", value, limits->memory_max > 0, unset, size);
+    write_limit(leaf, "memory.oom.group", "1", false, unset, size);
+
+    snprintf(value, sizeof(value), "default %u", limits->io_weight > 0 ? limits->io_weight : CGROUP_DEFAULT_WEIGHT);
+    write_limit(leaf, "io.weight", value, limits->io_weight > 0, unset, size);
+}
+
+/* Kills every process left in a leaf and removes it. Returns the number of
+ * processes that were in it. Never waits: while killed processes are still
+ * being torn down, rmdir fails with EBUSY and the leaf is left for the next
+ * sweep_leaves() of the service. */
+static int release_leaf(const char *leaf) {
+    char path[PATH_MAX];
+    char procs[4096];
+    int  count = 0;
+
+    snprintf(path, sizeof(path), "%s/cgroup.procs", leaf);
+    if (read_file(path, procs, sizeof(procs)) > 0) {
+        for (const char *p = procs; *p != '\0'; p++) {
+            if (*p == '\n') count++;
+        }
+    }
+    if (count > 0) {
+        /* cgroup.kill (Linux 5.14) also catches processes forked meanwhile. */
+        snprintf(path, sizeof(path), "%s/cgroup.kill", leaf);
+        if (!write_file(path, "1")) {
+            for (char *p = procs, *end; *p != '\0'; p = end) {
+                long pid = strtol(p, &end, 10);
+                if (end == p) break;
+                if (pid > 0) kill((pid_t)pid, SIGKILL);
+            }
+        }
+    }
+
+    rmdir(leaf);
+    return count;
+}
+
+/* Releases the leaves of processes of the service that are gone. */
+static void sweep_leaves(const char *dir, pid_t keep) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        char *end;
+        long  pid = strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0' || pid <= 0 || (pid_t)pid == keep) continue;
+        if (kill((pid_t)pid, 0) == 0 || errno == EPERM) continue;
+
+        char leaf[PATH_MAX];
+        if (snprintf(leaf, sizeof(leaf), "%s/%s", dir, entry->d_name) < (int)sizeof(leaf)) {
+            release_leaf(leaf);
+        }
+    }
+    closedir(d);
+}
+
+int cgroup_attach(const ProcessNode *node, pid_t pid, char *unset, size_t size) {
+    char dir[PATH_MAX];
+    char leaf[PATH_MAX];
+    char procs[PATH_MAX];
+    if (size > 0) unset[0] = '\0';
+
+    if (cgroup_root() == NULL) {
+        return 1;
+    }
+    if (!service_path(node->name, dir, sizeof(dir)) ||
+        !cgroup_leaf_path(node->name, pid, "", leaf, sizeof(leaf)) ||
+        !cgroup_leaf_path(node->name, pid, "cgroup.procs", procs, sizeof(procs))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (mkdir(dir, 0755) == 0) {
+        enable_controllers(dir);
+    } else if (errno != EEXIST) {
+        return -1;
+    }
+    sweep_leaves(dir, pid);
+
+    if (mkdir(leaf, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    write_limits(leaf, &node->cgroup, unset, size);
+
+    char text[16];
+    snprintf(text, sizeof(text), "%d", (int)pid);
+    if (!write_file(procs, text)) {
+        int saved_errno = errno;
+        rmdir(leaf);
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+int cgroup_apply_limits(const ProcessNode *node, char *unset, size_t size) {
+    char        leaf[PATH_MAX];
+    struct stat st;
+    if (size > 0) unset[0] = '\0';
+
+    if (!cgroup_leaf_path(node->name, node->pid, "", leaf, sizeof(leaf)) || stat(leaf, &st) != 0) {
+        return -1;
+    }
+    write_limits(leaf, &node->cgroup, unset, size);
+    return 0;
+}
+
+bool cgroup_oom_killed(const ProcessNode *node) {
+    char path[PATH_MAX];
+    char events[512];
+    return cgroup_leaf_path(node->name, node->pid, "memory.events", path, sizeof(path)) &&
+           read_file(path, events, sizeof(events)) > 0 &&
+           keyed_value(events, "oom_kill") > 0;
+}
+
+int cgroup_release(const ProcessNode *node) {
+    char        leaf[PATH_MAX];
+    struct stat st;
+    if (!cgroup_leaf_path(node->name, node->pid, "", leaf, sizeof(leaf)) || stat(leaf, &st) != 0) {
+        return -1;
+    }
+    return release_leaf(leaf);
+}
+
+void cgroup_remove(const char *name) {
+    char dir[PATH_MAX];
+    if (service_path(name, dir, sizeof(dir))) {
+        sweep_leaves(dir, 0);
+        rmdir(dir);
+    }
+}
+
+#else
+
+/* Other platforms have no cgroups; services run without kernel-enforced limits. */
+
+const char *cgroup_root(void) {
+    return NULL;
+}
+
+bool cgroup_leaf_path(const char *name, pid_t pid, const char *file, char *out, size_t size) {
+    (void)name; (void)pid; (void)file; (void)out; (void)size;
+    return false;
+}
+
+int cgroup_attach(const ProcessNode *node, pid_t pid, char *unset, size_t size) {
+    (void)node; (void)pid;
+    if (size > 0) unset[0] = '\0';
+    return 1;
+}
+
+int cgroup_apply_limits(const ProcessNode *node, char *unset, size_t size) {
+    (void)node;
+    if (size > 0) unset[0] = '\0';
+    return -1;
+}
+
+bool cgroup_oom_killed(const ProcessNode *node) {
+    (void)node;
+    return false;
+}
+
+int cgroup_release(const ProcessNode *node) {
+    (void)node;
+    return -1;
+}
+
+void cgroup_remove(const char *name) {
+    (void)name;
+}
+
+#endif
@@ -0,0 +1,449 @@
+#include "config.h"
+#include "cgroup.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Deepest nesting of block mappings understood. */
+#define CONFIG_MAX_DEPTH 8
+
+/* A block mapping key whose value is on the following, deeper, lines. */
+typedef struct Level {
+    size_t indent;
+    char   key[64];
+} Level;
+
+typedef struct Parser {
+    Config *config;
+    Level   levels[CONFIG_MAX_DEPTH];
+    size_t  depth;
+    size_t  line;
+    char   *error;
+    size_t  size;
+} Parser;
+
+static int fail(Parser *p, const char *format, ...) {
+    int n = snprintf(p->error, p->size, "line %zu: ", p->line);
+    if (n >= 0 && (size_t)n < p->size) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(p->error + n, p->size - (size_t)n, format, args);
+        va_end(args);
+    }
+    return -1;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ') s++;
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t')) s[--len] = '\0';
+    return s;
+}
+
+/* ------------------------------------------------------------------ */
+/* Scalars                                                            */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Reads the scalar at the start of @p text into @p out: a single-quoted
+ * ('' for a quote), double-quoted (\" and \\ escapes) or plain one; a plain
+ * scalar ends at @p stop characters or at a comment. Returns a pointer
+ * past the scalar, or NULL after reporting an error.
+ */
+static const char *scalar(Parser *p, const char *text, const char *stop, char *out, size_t size) {
+    size_t used = 0;
+    char   quote = *text == '\'' || *text == '"' ? *text : '\0';
+
+    if (quote != '\0') {
+        const char *c = text + 1;
+        for (;; c++) {
+            if (*c == '\0') {
+                fail(p, "unterminated quoted string");
+                return NULL;
+            }
+            char ch = *c;
+            if (ch == quote) {
+                if (quote == '\'' && c[1] == '\'') {
+                    c++;
+                } else {
+                    break;
+                }
+            } else if (quote == '"' && ch == '\\' && (c[1] == '"' || c[1] == '\\')) {
+                ch = *++c;
+            }
+            if (used + 1 >= size) {
+                fail(p, "value is longer than %zu characters", size - 1);
+                return NULL;
+            }
+            out[used++] = ch;
+        }
+        out[used] = '\0';
+        return c + 1;
+    }
+
+    const char *c = text;
+    while (*c != '\0' && strchr(stop, *c) == NULL && !(*c == '#' && (c == text || c[-1] == ' '))) {
+        c++;
+    }
+    size_t len = (size_t)(c - text);
+    while (len > 0 && text[len - 1] == ' ') len--;
+    if (len >= size) {
+        fail(p, "value is longer than %zu characters", size - 1);
+        return NULL;
+    }
+    memcpy(out, text, len);
+    out[len] = '\0';
+    return c;
+}
+
+/* Whether only spaces or a comment follow. */
+static bool at_end(const char *text) {
+    while (*text == ' ') text++;
+    return *text == '\0' || *text == '#';
+}
+
+/* ------------------------------------------------------------------ */
+/* Mapping onto services                                              */
+/* ------------------------------------------------------------------ */
+
+static ServiceConfig *find_service(Config *config, const char *name) {
+    for (size_t i = 0; i < config->count; i++) {
+        if (strcmp(config->services[i].name, name) == 0) return &config->services[i];
+    }
+    return NULL;
+}
+
+static ServiceConfig *add_service(Parser *p, const char *name) {
+    Config *config = p->config;
+    if (find_service(config, name) != NULL) {
+        fail(p, "service '%s' is defined twice", name);
+        return NULL;
+    }
+    if (strlen(name) >= sizeof(config->services[0].name)) {
+        fail(p, "service name '%s' is too long", name);
+        return NULL;
+    }
+    ServiceConfig *grown = realloc(config->services, (config->count + 1) * sizeof(*grown));
+    if (grown == NULL) {
+        fail(p, "out of memory");
+        return NULL;
+    }
+    config->services = grown;
+
+    ServiceConfig *service = &config->services[config->count++];
+    memset(service, 0, sizeof(*service));
+    strcpy(service->name, name);
+    service->restart_policy = RESTART_ON_FAILURE;
+    service->line           = p->line;
+    return service;
+}
+
+static int copy_value(Parser *p, const char *value, char *out, size_t size, const char *key) {
+    if (strlen(value) >= size) {
+        return fail(p, "'%s' is longer than %zu characters", key, size - 1);
+    }
+    strcpy(out, value);
+    return 0;
+}
+
+static int parse_number(Parser *p, const char *value, unsigned long max, const char *key, unsigned long *out) {
+    char *end;
+    errno = 0;
+    *out  = strtoul(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || *out == 0 || *out > max) {
+        return fail(p, "'%s' must be a number from 1 to %lu, not '%s'", key, max, value);
+    }
+    return 0;
+}
+
+/* Parses a byte count with an optional K, M or G suffix. */
+static int parse_bytes(Parser *p, const char *value, const char *key, uint64_t *out) {
+    char *end;
+    errno = 0;
+    unsigned long long bytes = strtoull(value, &end, 10);
+    int                shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+    }
+    if (errno != 0 || end == value || *end != '\0' || bytes == 0 || bytes > (UINT64_MAX >> shift)) {
+        return fail(p, "'%s' must be a size such as 512M, not '%s'", key, value);
+    }
+    *out = (uint64_t)bytes << shift;
+    return 0;
+}
+
+static int add_dependency(Parser *p, ServiceConfig *service, const char *name) {
+    if (strcmp(name, service->name) == 0) {
+        return fail(p, "service '%s' cannot depend on itself", name);
+    }
+    for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+        if (strcmp(service->dependencies[d], name) == 0) return 0;
+        if (service->dependencies[d][0] == '\0') {
+            return copy_value(p, name, service->dependencies[d], sizeof(service->dependencies[d]),
+                              "dependencies");
+        }
+    }
+    return fail(p, "service '%s' has more than %d dependencies", service->name, MAX_DEPENDENCIES);
+}
+
+/*
+ * Applies one value found at @p path (the keys from the top level down).
+ * @p value is NULL where a key opens a nested block; @p item is set for a
+ * sequence entry of the key at the end of @p path.
+ */
+static int apply(Parser *p, const char *const *path, size_t depth, const char *value, bool item) {
+    if (strcmp(path[0], "services") != 0) {
+        return fail(p, "unknown top-level key '%s'", path[0]);
+    }
+    if (depth == 1) {
+        return value == NULL ? 0 : fail(p, "'services' must be a mapping of service names");
+    }
+    if (depth == 2) {
+        if (value != NULL) return fail(p, "service '%s' must be a mapping", path[1]);
+        return add_service(p, path[1]) != NULL ? 0 : -1;
+    }
+
+    ServiceConfig *service = find_service(p->config, path[1]);
+    const char    *key     = path[2];
+    if (service == NULL) {
+        return fail(p, "unexpected key '%s'", key);
+    }
+    if (strcmp(key, "metrics") == 0) {
+        return 0;
+    }
+    if (value == NULL) {
+        bool block = strcmp(key, "logging") == 0 || strcmp(key, "lb") == 0 ||
+                     strcmp(key, "resources") == 0 || strcmp(key, "dependencies") == 0;
+        return block && depth == 3 ? 0 : fail(p, "'%s' of service '%s' needs a value", key, service->name);
+    }
+    if (strcmp(key, "dependencies") == 0) {
+        if (depth != 3 || !item) return fail(p, "'dependencies' must be a list of services");
+        return add_dependency(p, service, value);
+    }
+    if (item) {
+        return fail(p, "'%s' of service '%s' is not a list", key, service->name);
+    }
+
+    if (depth == 3) {
+        if (strcmp(key, "jar") == 0) {
+            return copy_value(p, value, service->jar, sizeof(service->jar), key);
+        }
+        if (strcmp(key, "envFile") == 0) {
+            return copy_value(p, value, service->env_file, sizeof(service->env_file), key);
+        }
+        if (strcmp(key, "port") == 0) {
+            unsigned long port;
+            if (parse_number(p, value, UINT16_MAX, key, &port) != 0) return -1;
+            service->port = (uint16_t)port;
+            return 0;
+        }
+        if (strcmp(key, "restartPolicy") == 0) {
+            if      (strcmp(value, "never")      == 0) service->restart_policy = RESTART_NEVER;
+            else if (strcmp(value, "on-failure") == 0) service->restart_policy = RESTART_ON_FAILURE;
+            else if (strcmp(value, "always")     == 0) service->restart_policy = RESTART_ALWAYS;
+            else return fail(p, "'restartPolicy' must be never, on-failure or always, not '%s'", value);
+            return 0;
+        }
+    } else if (depth == 4 && strcmp(key, "logging") == 0) {
+        if (strcmp(path[3], "file") == 0) {
+            return copy_value(p, value, service->log_file, sizeof(service->log_file), path[3]);
+        }
+        if (strcmp(path[3], "stdout") == 0) {
+            return 0;
+        }
+    } else if (depth == 4 && strcmp(key, "lb") == 0) {
+        if (strcmp(path[3], "replicas") == 0) {
+            unsigned long replicas;
+            if (parse_number(p, value, 999, path[3], &replicas) != 0) return -1;
+            service->replicas = (uint16_t)replicas;
+            return 0;
+        }
+        if (strcmp(path[3], "strategy") == 0) {
+            return strcmp(value, "round-robin") == 0
+                 ? 0 : fail(p, "only the round-robin strategy is supported, not '%s'", value);
+        }
+    } else if (depth == 4 && strcmp(key, "resources") == 0) {
+        CgroupLimits *limits = &service->resources;
+        unsigned long number;
+        if (strcmp(path[3], "memoryMax") == 0) {
+            return parse_bytes(p, value, path[3], &limits->memory_max);
+        }
+        if (strcmp(path[3], "memoryHigh") == 0) {
+            return parse_bytes(p, value, path[3], &limits->memory_high);
+        }
+        if (strcmp(path[3], "cpuQuota") == 0) {
+            if (parse_number(p, value, UINT16_MAX, path[3], &number) != 0) return -1;
+            limits->cpu_quota = (uint32_t)number;
+            return 0;
+        }
+        if (strcmp(path[3], "cpuWeight") == 0) {
+            if (parse_number(p, value, CGROUP_MAX_WEIGHT, path[3], &number) != 0) return -1;
+            limits->cpu_weight = (uint16_t)number;
+            return 0;
+        }
+        if (strcmp(path[3], "ioWeight") == 0) {
+            if (parse_number(p, value, CGROUP_MAX_WEIGHT, path[3], &number) != 0) return -1;
+            limits->io_weight = (uint16_t)number;
+            return 0;
+        }
+    }
+    return fail(p, "unknown key '%s' in service '%s'", path[depth - 1], service->name);
+}
+
+/* ------------------------------------------------------------------ */
+/* Lines                                                              */
+/* ------------------------------------------------------------------ */
+
+static int apply_at(Parser *p, const char *key, const char *value, bool item) {
+    const char *path[CONFIG_MAX_DEPTH + 1];
+    size_t      depth = 0;
+    for (; depth < p->depth; depth++) path[depth] = p->levels[depth].key;
+    if (key != NULL) path[depth++] = key;
+    return apply(p, path, depth, value, item);
+}
+
+/* Applies each scalar of a flow sequence ("[a, b]") as an item of @p key. */
+static int flow_sequence(Parser *p, const char *key, const char *text) {
+    const char *c = text + 1;
+    for (;;) {
+        while (*c == ' ') c++;
+        if (*c == ']') break;
+        char item[256];
+        c = scalar(p, c, ",]", item, sizeof(item));
+        if (c == NULL) return -1;
+        while (*c == ' ') c++;
+        if (item[0] != '\0' && apply_at(p, key, item, true) != 0) return -1;
+        if (*c == ',') {
+            c++;
+        } else if (*c != ']') {
+            return fail(p, "unterminated list");
+        }
+    }
+    return at_end(c + 1) ? 0 : fail(p, "unexpected text after list");
+}
+
+static int parse_line(Parser *p, char *line) {
+    size_t indent = strspn(line, " ");
+    char  *text   = trim(line + indent);
+    if (*text == '\0' || *text == '#' || strcmp(text, "---") == 0) {
+        return 0;
+    }
+    if (*text == '\t') {
+        return fail(p, "tabs cannot be used for indentation");
+    }
+
+    /* "- item": an entry of the sequence under the innermost open key. */
+    if (text[0] == '-' && (text[1] == ' ' || text[1] == '\0')) {
+        while (p->depth > 0 && p->levels[p->depth - 1].indent > indent) p->depth--;
+        if (p->depth == 0) {
+            return fail(p, "list item outside of a key");
+        }
+        char        item[256];
+        const char *rest = text + 1;
+        while (*rest == ' ') rest++;
+        rest = scalar(p, rest, "", item, sizeof(item));
+        if (rest == NULL) return -1;
+        if (item[0] == '\0' || strchr(item, ':') != NULL) {
+            return fail(p, "only lists of plain values are supported");
+        }
+        return apply_at(p, NULL, item, true);
+    }
+
+    /* "key: value" or "key:" opening a nested block. */
+    char        key[64];
+    const char *rest = scalar(p, text, ":", key, sizeof(key));
+    if (rest == NULL) return -1;
+    if (*rest != ':' || (rest[1] != ' ' && rest[1] != '\0') || key[0] == '\0') {
+        return fail(p, "expected 'key: value'");
+    }
+    rest++;
+    while (*rest == ' ') rest++;
+
+    while (p->depth > 0 && p->levels[p->depth - 1].indent >= indent) p->depth--;
+    if (at_end(rest)) {
+        if (p->depth == CONFIG_MAX_DEPTH) {
+            return fail(p, "nested too deeply");
+        }
+        if (apply_at(p, key, NULL, false) != 0) return -1;
+        p->levels[p->depth].indent = indent;
+        strcpy(p->levels[p->depth].key, key);
+        p->depth++;
+        return 0;
+    }
+    if (*rest == '[') {
+        return flow_sequence(p, key, rest);
+    }
+    if (*rest == '{' || *rest == '|' || *rest == '>' || *rest == '&' || *rest == '*') {
+        return fail(p, "flow mappings, block scalars, anchors and aliases are not supported");
+    }
+
+    char value[256];
+    rest = scalar(p, rest, "", value, sizeof(value));
+    if (rest == NULL) return -1;
+    if (!at_end(rest)) {
+        return fail(p, "unexpected text after value");
+    }
+    return apply_at(p, key, value, false);
+}
+
+/* Checks what a single line cannot: required keys and value combinations. */
+static int validate(Parser *p) {
+    Config *config = p->config;
+    if (config->count == 0) {
+        snprintf(p->error, p->size, "no services defined");
+        return -1;
+    }
+    for (size_t i = 0; i < config->count; i++) {
+        const ServiceConfig *s = &config->services[i];
+        p->line = s->line;
+        if (s->jar[0] == '\0') {
+            return fail(p, "service '%s' has no 'jar'", s->name);
+        }
+        if (s->replicas > 0 && s->port == 0) {
+            return fail(p, "service '%s' has replicas but no 'port' to balance", s->name);
+        }
+        if (s->replicas > 0 && (uint32_t)s->port + s->replicas > UINT16_MAX) {
+            return fail(p, "service '%s' has no room for %u replica ports after %u",
+                        s->name, s->replicas, s->port);
+        }
+    }
+    return 0;
+}
+
+int config_load(const char *path, Config *config, char *error, size_t size) {
+    memset(config, 0, sizeof(*config));
+    Parser p = { .config = config, .error = error, .size = size };
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        snprintf(error, size, "cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    char   *line = NULL;
+    size_t  cap  = 0;
+    ssize_t len;
+    int     rc   = 0;
+    while (rc == 0 && (len = getline(&line, &cap, f)) >= 0) {
+        p.line++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        rc = parse_line(&p, line);
+    }
+    free(line);
+    fclose(f);
+
+    if (rc == 0) rc = validate(&p);
+    if (rc != 0) config_free(config);
+    return rc;
+}
+
+void config_free(Config *config) {
+    free(config->services);
+    config->services = NULL;
+    config->count    = 0;
+}
@@ -0,0 +1,446 @@
+#include "control.h"
+#include "config.h"
+#include "sampler.h"
+#include "supervisor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(ControlRecord) == 144, "ControlRecord must not be padded");
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set on the socket instead. */
+#endif
+
+/* Monotonic clock in milliseconds. */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* Close-on-exec, no SIGPIPE on BSD, and non-blocking if @p nonblock. */
+static int socket_options(int fd, bool nonblock) {
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) return -1;
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, nonblock ? fl | O_NONBLOCK : fl & ~O_NONBLOCK) != 0) return -1;
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return 0;
+}
+
+/* Sends or receives exactly @p len bytes on a non-blocking socket, giving
+ * up at @p deadline (LLONG_MAX for none). */
+static int transfer(int fd, void *buf, size_t len, bool sending, long long deadline) {
+    unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = sending ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+        if (n > 0) {
+            p   += n;
+            len -= (size_t)n;
+            continue;
+        }
+        if (n == 0) return -1; /* Peer closed. */
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+
+        long long     left = deadline - now_ms();
+        struct pollfd pfd  = { .fd = fd, .events = sending ? POLLOUT : POLLIN, .revents = 0 };
+        if (left <= 0 || poll(&pfd, 1, left > INT_MAX ? INT_MAX : (int)left) == 0) return -1;
+    }
+    return 0;
+}
+
+int control_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr, path) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    /* A daemon that died leaves its socket file behind; the pid file lock
+     * guarantees no live daemon is listening on it. */
+    unlink(path);
+    mode_t mask = umask(077);
+    int    rc   = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0 || socket_options(fd, true) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    return fd;
+}
+
+void control_close(int listen_fd, const char *path) {
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    unlink(path);
+}
+
+/* A stop or restart running in the background, whose client waits on
+ * @c fd for the final reply. */
+typedef struct Pending {
+    int           fd;
+    ProcessTable *table;
+    char          name[64];
+} Pending;
+
+/* A deploy or config running in the background, whose client waits on
+ * @c fd for the final reply. */
+typedef struct Rollout {
+    int      fd;
+    uint32_t op; /* A ControlOp. */
+} Rollout;
+
+/* Fills the wire record of a node. */
+static void record_fill(ControlRecord *record, const ProcessNode *node) {
+    memset(record, 0, sizeof(*record));
+    status_entry_fill(&record->entry, node);
+    const ResourceSample *sample = sampler_latest(node);
+    if (node->running && sample != NULL) {
+        record->threads = sample->threads;
+        record->fds     = sample->fds;
+    }
+    record->failure_count   = node->failure_count;
+    record->health_failures = node->health_failures;
+    record->rss_strikes     = node->rss_strikes;
+    record->cpu_strikes     = node->cpu_strikes;
+}
+
+/* Copies the live state of a wire record into a node. */
+static void record_apply(const ControlRecord *record, ProcessNode *node) {
+    status_entry_apply(&record->entry, node);
+    for (uint32_t i = 0; i < node->stats.count; i++) {
+        node->stats.samples[i].threads = record->threads;
+        node->stats.samples[i].fds     = record->fds;
+    }
+    node->failure_count   = record->failure_count;
+    node->health_failures = record->health_failures;
+    node->rss_strikes     = record->rss_strikes;
+    node->cpu_strikes     = record->cpu_strikes;
+}
+
+/* Sends a reply and the records of its @c count nodes from @p nodes. */
+static void reply_send(int fd, ControlReply *reply, const ProcessNode *nodes) {
+    ControlRecord *records = reply->count > 0 ? malloc(reply->count * sizeof(*records)) : NULL;
+    if (reply->count > 0 && records == NULL) {
+        reply->count  = 0;
+        reply->status = CONTROL_FAILED;
+        snprintf(reply->message, sizeof(reply->message), "out of memory");
+    }
+    for (uint32_t i = 0; i < reply->count; i++) {
+        record_fill(&records[i], &nodes[i]);
+    }
+
+    long long deadline = now_ms() + CONTROL_IO_TIMEOUT_MS;
+    if (transfer(fd, reply, sizeof(*reply), true, deadline) == 0 && reply->count > 0) {
+        transfer(fd, records, reply->count * sizeof(*records), true, deadline);
+    }
+    free(records);
+}
+
+/* Called when a background stop or restart is done: sends the final reply. */
+static void finish(void *arg, int failed) {
+    Pending     *pending = arg;
+    ProcessNode *node    = process_find_by_name(pending->table, pending->name);
+    ControlReply reply;
+    memset(&reply, 0, sizeof(reply));
+    if (failed > 0) {
+        reply.status = CONTROL_FAILED;
+        snprintf(reply.message, sizeof(reply.message), "failed for '%s'", pending->name);
+    }
+    reply.count = node != NULL ? 1 : 0;
+    reply_send(pending->fd, &reply, node);
+    close(pending->fd);
+    free(pending);
+}
+
+/* Fills in the outcome of a deploy or config as returned by deploy_run()
+ * or deploy_apply(). */
+static void rollout_result(ControlReply *reply, uint32_t op, int rc) {
+    if (rc < 0) {
+        reply->status = CONTROL_FAILED;
+        snprintf(reply->message, sizeof(reply->message), "could not %s; see logs/deploy.log",
+                 op == CONTROL_DEPLOY ? "deploy" : "apply the config");
+    } else if (rc > 0) {
+        reply->status = CONTROL_FAILED;
+        snprintf(reply->message, sizeof(reply->message), "%s; see logs/deploy.log",
+                 op == CONTROL_DEPLOY ? "failed and was rolled back" : "some services failed");
+    }
+}
+
+/* Called when a background deploy or config is done: sends the final reply. */
+static void rolled_out(void *arg, int rc) {
+    Rollout     *rollout = arg;
+    ControlReply reply;
+    memset(&reply, 0, sizeof(reply));
+    rollout_result(&reply, rollout->op, rc);
+    reply_send(rollout->fd, &reply, NULL);
+    close(rollout->fd);
+    free(rollout);
+}
+
+/* Starts a deploy or config in the daemon, so that its balancer follows
+ * every replica moved. It runs in the background and is answered by
+ * rolled_out() on @p fd, which is then no longer the caller's to close.
+ * Returns the number of nodes that may have changed. */
+static int start_rollout(ProcessTable *table, const ControlRequest *request, int fd, ControlReply *reply) {
+    char name[sizeof(request->name)];
+    char path[sizeof(request->path)];
+    memcpy(name, request->name, sizeof(name));
+    memcpy(path, request->path, sizeof(path));
+    name[sizeof(name) - 1] = '\0';
+    path[sizeof(path) - 1] = '\0';
+
+    Rollout *rollout = malloc(sizeof(*rollout));
+    if (rollout == NULL) {
+        rollout_result(reply, request->op, -1);
+        return 0;
+    }
+    rollout->fd = fd;
+    rollout->op = request->op;
+
+    int rc;
+    if (request->op == CONTROL_DEPLOY) {
+        rc = deploy_run_background(table, name, path, &request->deploy, rolled_out, rollout);
+    } else {
+        Config config;
+        char   error[256];
+        if (config_load(path, &config, error, sizeof(error)) != 0) {
+            free(rollout);
+            reply->status = CONTROL_FAILED;
+            snprintf(reply->message, sizeof(reply->message), "%.64s: %.60s", path, error);
+            return 0;
+        }
+        rc = deploy_apply_background(table, &config, &request->apply, rolled_out, rollout);
+        config_free(&config);
+    }
+    if (rc != 0) {
+        free(rollout);
+        rollout_result(reply, request->op, -1);
+        return 0;
+    }
+    reply->status  = CONTROL_ACCEPTED;
+    reply->wait_ms = 0; /* a rollout takes as long as its replicas take to warm up */
+    return (int)table->count;
+}
+
+/* Runs one request against the table. Sets @p subject to the node a
+ * command applied to and returns the number of nodes it changed. A stop,
+ * restart, deploy or config is started in the background and answered by
+ * finish() or rolled_out() on @p fd, which is then no longer the caller's
+ * to close. */
+static int execute(ProcessTable *table, const ControlRequest *request, int fd,
+                   ControlReply *reply, ProcessNode **subject) {
+    if (request->version != CONTROL_VERSION || request->record_size != sizeof(ControlRecord)) {
+        reply->status = CONTROL_BAD_REQUEST;
+        snprintf(reply->message, sizeof(reply->message),
+                 "the daemon runs a different build; restart it");
+        return 0;
+    }
+    if (request->op == CONTROL_SNAPSHOT) {
+        reply->count = (uint32_t)table->count;
+        return 0;
+    }
+    if (request->op == CONTROL_DEPLOY || request->op == CONTROL_APPLY) {
+        return start_rollout(table, request, fd, reply);
+    }
+
+    char name[sizeof(request->name)];
+    memcpy(name, request->name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+    ProcessNode *node = process_find_by_name(table, name);
+    if (node == NULL) {
+        reply->status = CONTROL_NOT_FOUND;
+        snprintf(reply->message, sizeof(reply->message), "service '%s' not found", name);
+        return 0;
+    }
+    if (node->busy) {
+        reply->status = CONTROL_FAILED;
+        snprintf(reply->message, sizeof(reply->message),
+                 "service '%s' is already being stopped or started", name);
+        return 0;
+    }
+    *subject     = node;
+    reply->count = 1;
+
+    switch ((ControlOp)request->op) {
+        case CONTROL_START:
+            /* Processes the daemon adopted are only polled on its ticks. */
+            if (supervisor_status(node) == 0) {
+                reply->status = CONTROL_FAILED;
+                snprintf(reply->message, sizeof(reply->message),
+                         "service '%s' is already running (pid %d)", name, node->pid);
+                return 0;
+            }
+            supervisor_reset_backoff(node);
+            if (supervisor_start(node) != 0) {
+                reply->status = CONTROL_FAILED;
+                snprintf(reply->message, sizeof(reply->message), "failed to launch '%s'", name);
+            }
+            return 1;
+
+        case CONTROL_STOP:
+        case CONTROL_RESTART: {
+            Pending *pending = malloc(sizeof(*pending));
+            if (pending != NULL) {
+                pending->fd    = fd;
+                pending->table = table;
+                memcpy(pending->name, name, sizeof(pending->name));
+            }
+            if (request->op == CONTROL_RESTART) supervisor_reset_backoff(node);
+            BulkAction action = request->op == CONTROL_STOP ? BULK_STOP : BULK_RESTART;
+            if (pending == NULL || supervisor_bulk_background(&node, 1, action, 1, 0, finish, pending) != 0) {
+                free(pending);
+                reply->status = CONTROL_FAILED;
+                snprintf(reply->message, sizeof(reply->message), "out of memory");
+                return 0;
+            }
+            *subject       = NULL;
+            reply->count   = 0;
+            reply->status  = CONTROL_ACCEPTED;
+            reply->wait_ms = supervisor_stop_budget_ms(&node->stop) + CONTROL_IO_TIMEOUT_MS;
+            return 1;
+        }
+
+        case CONTROL_SNAPSHOT:
+        case CONTROL_DEPLOY:
+        case CONTROL_APPLY:
+            break;
+    }
+    *subject      = NULL;
+    reply->count  = 0;
+    reply->status = CONTROL_BAD_REQUEST;
+    snprintf(reply->message, sizeof(reply->message), "unknown command %u", request->op);
+    return 0;
+}
+
+/* Answers the request on one accepted connection, and closes it unless a
+ * final reply is still to come. */
+static int serve(int fd, ProcessTable *table) {
+    ControlRequest request;
+    if (socket_options(fd, true) != 0 ||
+        transfer(fd, &request, sizeof(request), false, now_ms() + CONTROL_IO_TIMEOUT_MS) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    ControlReply reply;
+    ProcessNode *subject = NULL;
+    memset(&reply, 0, sizeof(reply));
+    int changed = execute(table, &request, fd, &reply, &subject);
+    reply_send(fd, &reply, subject != NULL ? subject : table->nodes);
+    if (reply.status != CONTROL_ACCEPTED) {
+        close(fd);
+    }
+    return changed;
+}
+
+int control_serve(int listen_fd, ProcessTable *table) {
+    int changed = 0;
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break; /* EAGAIN: every pending connection was answered. */
+        }
+        changed += serve(fd, table);
+    }
+    return changed;
+}
+
+/* Receives a reply header by @p deadline. */
+static int reply_receive(int fd, ControlReply *reply, long long deadline) {
+    if (transfer(fd, reply, sizeof(*reply), false, deadline) != 0) return -1;
+    reply->message[sizeof(reply->message) - 1] = '\0';
+    return 0;
+}
+
+/* Exchanges one request and its reply on a connected, non-blocking socket. */
+static int exchange(int fd, const ControlRequest *request, ControlReply *reply, ProcessTable *nodes) {
+    if (transfer(fd, (void *)request, sizeof(*request), true, now_ms() + CONTROL_IO_TIMEOUT_MS) != 0) {
+        return -1;
+    }
+    long long deadline = now_ms() + CONTROL_REPLY_TIMEOUT_MS;
+    if (reply_receive(fd, reply, deadline) != 0) return -1;
+    if (reply->status == CONTROL_ACCEPTED) {
+        /* Without a limit, a daemon that dies closes the connection. */
+        deadline = reply->wait_ms > 0 ? now_ms() + reply->wait_ms : LLONG_MAX;
+        if (reply_receive(fd, reply, deadline) != 0) return -1;
+    }
+    if (reply->count == 0) {
+        return 0;
+    }
+
+    ControlRecord *records = malloc((size_t)reply->count * sizeof(*records));
+    if (records == NULL ||
+        transfer(fd, records, (size_t)reply->count * sizeof(*records), false, deadline) != 0) {
+        free(records);
+        return -1;
+    }
+    for (uint32_t i = 0; i < reply->count; i++) {
+        records[i].entry.name[sizeof(records[i].entry.name) - 1] = '\0';
+        ProcessNode *node = process_find_by_name(nodes, records[i].entry.name);
+        if (node == NULL) {
+            ProcessNode fresh;
+            memset(&fresh, 0, sizeof(fresh));
+            memcpy(fresh.name, records[i].entry.name, sizeof(fresh.name));
+            node = process_append(nodes, &fresh, false);
+        }
+        if (node == NULL) {
+            free(records);
+            return -1;
+        }
+        record_apply(&records[i], node);
+    }
+    free(records);
+    return 0;
+}
+
+int control_call(const char *path, ControlRequest *request, ControlReply *reply, ProcessTable *nodes) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr, path) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (socket_options(fd, false) != 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd); /* ENOENT or ECONNREFUSED: no daemon listens. */
+        return -1;
+    }
+    if (socket_options(fd, true) != 0) {
+        close(fd);
+        return -2;
+    }
+
+    request->version     = CONTROL_VERSION;
+    request->record_size = (uint32_t)sizeof(ControlRecord);
+
+    int rc = exchange(fd, request, reply, nodes);
+    close(fd);
+    return rc == 0 ? 0 : -2;
+}
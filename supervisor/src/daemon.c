@@ -0,0 +1,274 @@
+#include "daemon.h"
+#include "control.h"
+#include "deploy.h"
+#include "lb.h"
+#include "sampler.h"
+#include "status_page.h"
+#include "supervisor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Module state. */
+static Logger dm_logger;
+static bool   dm_logger_ready = false;
+static int    dm_sig_pipe[2]  = { -1, -1 };
+
+#define DM_LOG(fmt, ...) \
+    do { if (dm_logger_ready) logger_write(&dm_logger, fmt, ##__VA_ARGS__); } while (0)
+
+/* Signal handler: forwards the signal number through the self-pipe so that
+ * all real work happens in the poll loop, outside of signal context. */
+static void on_signal(int signo) {
+    int saved_errno = errno;
+    unsigned char b = (unsigned char)signo;
+    (void)!write(dm_sig_pipe[1], &b, 1);
+    errno = saved_errno;
+}
+
+/* Monotonic clock in milliseconds. */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int set_cloexec_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) return -1;
+    return 0;
+}
+
+static int install_signals(void) {
+    if (pipe(dm_sig_pipe) != 0) return -1;
+    if (set_cloexec_nonblock(dm_sig_pipe[0]) != 0 ||
+        set_cloexec_nonblock(dm_sig_pipe[1]) != 0) {
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+    if (sigaction(SIGCHLD, &sa, NULL) != 0) return -1;
+    if (sigaction(SIGTERM, &sa, NULL) != 0) return -1;
+    if (sigaction(SIGINT,  &sa, NULL) != 0) return -1;
+    signal(SIGHUP, SIG_IGN);
+    return 0;
+}
+
+/* Opens and locks the pid file. Returns the held fd, or -1 if another
+ * daemon owns the lock or the file could not be opened. */
+static int acquire_pid_file(void) {
+    int fd = open(DAEMON_PID_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "daemon: could not open %s: %s\n", DAEMON_PID_PATH, strerror(errno));
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        pid_t other = 0;
+        daemon_running(&other);
+        fprintf(stderr, "daemon: already running (pid %d)\n", other);
+        close(fd);
+        return -1;
+    }
+
+    char buf[32];
+    int  len = snprintf(buf, sizeof(buf), "%d\n", (int)getpid());
+    if (ftruncate(fd, 0) != 0 || write(fd, buf, (size_t)len) != len) {
+        fprintf(stderr, "daemon: could not write %s: %s\n", DAEMON_PID_PATH, strerror(errno));
+    }
+    return fd;
+}
+
+bool daemon_running(pid_t *pid) {
+    int fd = open(DAEMON_PID_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    bool running = false;
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK) {
+        running = true;
+        if (pid != NULL) {
+            char    buf[32] = {0};
+            ssize_t n       = read(fd, buf, sizeof(buf) - 1);
+            *pid = n > 0 ? (pid_t)strtol(buf, NULL, 10) : 0;
+        }
+    }
+    close(fd);
+    return running;
+}
+
+int daemon_run(ProcessTable *table, const DaemonOptions *options) {
+    if (table == NULL) {
+        fprintf(stderr, "daemon: table argument is NULL\n");
+        return -1;
+    }
+
+    DaemonOptions defaults = { .sample_interval_ms = DEFAULT_SAMPLE_INTERVAL_MS };
+    if (options == NULL) {
+        options = &defaults;
+    }
+
+    if (logger_init(&dm_logger, "logs/daemon.log", true) == 0) {
+        dm_logger_ready = true;
+    }
+
+    int pid_fd = acquire_pid_file();
+    if (pid_fd < 0) return -1;
+
+    if (install_signals() != 0) {
+        fprintf(stderr, "daemon: could not install signal handlers: %s\n", strerror(errno));
+        close(pid_fd);
+        return -1;
+    }
+
+    DM_LOG("daemon: started (pid %d)", (int)getpid());
+
+    if (lb_start("logs/lb.log") != 0) {
+        DM_LOG("daemon: load balancer unavailable, services are reachable on their own ports only");
+    }
+    deploy_logger_init("logs/deploy.log", false); /* deploys sent by clients */
+
+    /* Once the control socket listens, clients are served from memory. */
+    int control_fd = control_listen(CONTROL_SOCKET_PATH);
+    if (control_fd < 0) {
+        DM_LOG("daemon: no control socket at %s (%s), clients fall back to the table file",
+               CONTROL_SOCKET_PATH, strerror(errno));
+    }
+
+    /* Probes and the restarts they lead to run alongside the loop, so they
+     * never hold up reaping or clients. */
+    supervisor_set_background(true);
+
+    /* Adopt already-running services and launch the ones that are down. */
+    if (supervisor_monitor_all(table) > 0) {
+        process_table_save(table);
+    }
+    lb_update(table);
+
+    struct pollfd *pfds        = NULL;
+    size_t         pfds_size   = 0;
+    bool           stop        = false;
+    long long      next_tick   = now_ms() + DAEMON_TICK_MS;
+    long long      next_sample = now_ms();
+    long long      next_ready  = 0;
+
+    while (!stop) {
+        /* Wake for the next tick, sample or readiness probe, or earlier if a
+         * backed-off restart falls due. */
+        long long wait = next_tick - now_ms();
+        if (options->sample_interval_ms > 0 && next_sample - now_ms() < wait) {
+            wait = next_sample - now_ms();
+        }
+        if (supervisor_readiness_interval(table) > 0 && next_ready - now_ms() < wait) {
+            wait = next_ready - now_ms();
+        }
+        time_t    due  = supervisor_next_restart(table);
+        if (due != 0) {
+            long long until = ((long long)due - (long long)time(NULL)) * 1000;
+            if (until < wait) wait = until;
+        }
+
+        /* The signal pipe and control socket come first, then whatever the
+         * background probes and stops wait on. */
+        size_t need = 2 + supervisor_background_fds();
+        if (need > pfds_size) {
+            struct pollfd *grown = realloc(pfds, need * sizeof(*pfds));
+            if (grown == NULL) {
+                DM_LOG("daemon: out of memory for %zu descriptors", need);
+                break;
+            }
+            pfds      = grown;
+            pfds_size = need;
+        }
+        pfds[0] = (struct pollfd){ .fd = dm_sig_pipe[0], .events = POLLIN, .revents = 0 };
+        pfds[1] = (struct pollfd){ .fd = control_fd,     .events = POLLIN, .revents = 0 };
+        long long wake = LLONG_MAX;
+        nfds_t    nfds = 2 + (nfds_t)supervisor_background_pollfds(&pfds[2], &wake);
+        if (wake != LLONG_MAX && wake - now_ms() < wait) {
+            wait = wake - now_ms();
+        }
+        int rc = poll(pfds, nfds, wait > 0 ? (int)wait : 0);
+        if (rc < 0 && errno != EINTR) {
+            DM_LOG("daemon: poll failed: %s", strerror(errno));
+            break;
+        }
+
+        int  changed = 0;
+        bool ready   = false;
+        changed += supervisor_background_advance(&ready);
+        if (ready) next_tick = now_ms(); /* start services that waited for them */
+
+        if (rc > 0 && (pfds[0].revents & POLLIN)) {
+            unsigned char sigs[64];
+            ssize_t       n;
+            bool          child = false;
+            while ((n = read(dm_sig_pipe[0], sigs, sizeof(sigs))) > 0) {
+                for (ssize_t i = 0; i < n; i++) {
+                    if (sigs[i] == SIGCHLD) child = true;
+                    else if (sigs[i] == SIGTERM || sigs[i] == SIGINT) stop = true;
+                }
+            }
+            if (child) {
+                changed += supervisor_reap();
+            }
+        }
+
+        if (rc > 0 && (pfds[1].revents & POLLIN)) {
+            changed += control_serve(control_fd, table);
+        }
+
+        if (now_ms() >= next_tick || (due != 0 && time(NULL) >= due)) {
+            /* Tick: probe processes we did not launch ourselves and
+             * perform restarts whose backoff has expired. */
+            changed += supervisor_monitor_all(table);
+            next_tick = now_ms() + DAEMON_TICK_MS;
+        }
+
+        if (options->sample_interval_ms > 0 && now_ms() >= next_sample) {
+            sampler_sample_all(table);
+            changed += supervisor_enforce_limits(table);
+            /* Fresh CPU and RSS figures reach the status page without a save. */
+            status_page_publish(table);
+            next_sample = now_ms() + options->sample_interval_ms;
+        }
+
+        /* Starting services are probed on their own, shorter, interval so
+         * they join their load balancer as soon as they are warm, and
+         * services waiting for them to be ready are started on the next pass. */
+        unsigned ready_every = supervisor_readiness_interval(table);
+        if (ready_every > 0 && now_ms() >= next_ready) {
+            int ready = supervisor_check_readiness(table);
+            if (ready > 0) next_tick = now_ms();
+            changed += ready;
+            next_ready = now_ms() + ready_every;
+        }
+
+        if (changed > 0) {
+            process_table_save(table);
+            lb_update(table);
+        }
+    }
+
+    DM_LOG("daemon: shutting down, managed processes keep running");
+    control_close(control_fd, CONTROL_SOCKET_PATH);
+    supervisor_background_wait(); /* finish stops and restarts under way */
+    free(pfds);
+    process_table_save(table);
+    process_table_compact(table);
+    lb_stop();
+    logger_close(&dm_logger);
+    close(pid_fd);
+    return 0;
+}
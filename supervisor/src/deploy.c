@@ -0,0 +1,1224 @@
+#include "deploy.h"
+#include "cgroup.h"
+#include "lb.h"
+#include "logger.h"
+#include "probe.h"
+#include "service_log.h"
+#include "supervisor.h"
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Milliseconds a replacement left behind by an interrupted deploy gets to
+ * exit on SIGTERM before it is killed. */
+#define STALE_GRACE_MS 5000
+
+/* Module state. */
+static Logger dp_logger;
+static bool   dp_logger_ready = false;
+
+#define DP_LOG(fmt, ...) \
+    do { if (dp_logger_ready) logger_write(&dp_logger, fmt, ##__VA_ARGS__); } while (0)
+
+int deploy_logger_init(const char *logfile_path, bool stdout_enabled) {
+    int rc = logger_init(&dp_logger, logfile_path, stdout_enabled);
+    if (rc == 0) {
+        dp_logger_ready = true;
+    }
+    return rc;
+}
+
+/* ------------------------------------------------------------------ */
+/* Spare ports                                                        */
+/* ------------------------------------------------------------------ */
+
+static bool port_taken(const ProcessTable *table, uint16_t port) {
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *n = &table->nodes[i];
+        if (n->port == port || n->deploy_port == port || n->lb_port == port) return true;
+    }
+    return false;
+}
+
+/* Whether nothing on the host listens on @p port. */
+static bool port_bindable(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bool ok = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    return ok;
+}
+
+/* Lowest port from @p from upwards that is free to start a replacement on,
+ * or 0 if there is none. */
+static uint16_t spare_port(const ProcessTable *table, uint16_t from) {
+    for (uint32_t port = from > 0 ? from : 1; port <= UINT16_MAX; port++) {
+        if (!port_taken(table, (uint16_t)port) && port_bindable((uint16_t)port)) {
+            return (uint16_t)port;
+        }
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Replacing one replica                                              */
+/* ------------------------------------------------------------------ */
+
+/* Starts a copy of @p node running @p jar on a spare port, and records it
+ * in the node so that an interrupted deploy can clean it up. */
+static int launch(ProcessTable *table, ProcessNode *node, const char *jar, uint16_t from,
+                  ProcessNode *next) {
+    uint16_t port = spare_port(table, from);
+    if (port == 0) {
+        DP_LOG("deploy: no spare port for a replacement of '%s'", node->name);
+        return -1;
+    }
+
+    *next = *node;
+    memset(&next->stats, 0, sizeof(next->stats));
+    memset(next->path, 0, sizeof(next->path));
+    strncpy(next->path, jar, sizeof(next->path) - 1);
+    next->port        = port;
+    next->listen_fd   = -1;
+    next->listen_port = 0;
+    next->busy        = false;
+    if (supervisor_start(next) != 0) {
+        DP_LOG("deploy: could not launch a replacement of '%s'", node->name);
+        return -1;
+    }
+
+    node->deploy_pid  = next->pid;
+    node->deploy_port = port;
+    process_table_save(table);
+    DP_LOG("deploy: started replacement of '%s' (pid %d) on port %hu running %s",
+           node->name, next->pid, port, jar);
+    return 0;
+}
+
+/* Moves the node onto its replacement. Its old process is kept in @p old,
+ * to be drained and stopped. */
+static void adopt(ProcessTable *table, ProcessNode *node, ProcessNode *next, ProcessNode *old) {
+    *old      = *node;
+    old->busy = false;
+
+    memcpy(node->path, next->path, sizeof(node->path));
+    node->port            = next->port;
+    process_set_pid(table, node, next->pid);
+    node->running         = true;
+    node->owned           = next->owned;
+    node->start_time      = next->start_time;
+    node->exit_reason     = next->exit_reason;
+    node->exit_status     = next->exit_status;
+    node->readiness       = next->readiness;
+    node->rss_strikes     = 0;
+    node->cpu_strikes     = 0;
+    node->health_failures = 0;
+    node->listen_fd       = next->listen_fd;
+    node->listen_port     = next->listen_port;
+    node->deploy_pid      = 0;
+    node->deploy_port     = 0;
+    DP_LOG("deploy: draining '%s' (pid %d) on port %hu", old->name, old->pid, old->port);
+}
+
+/* Takes over the replacement left by a deploy that died after stopping
+ * the node's old process, since it is all that is left. Returns true if
+ * the node took it over. */
+static bool take_over(ProcessTable *table, ProcessNode *node) {
+    pid_t pid = node->deploy_pid;
+    if (node->running || kill(pid, 0) != 0) {
+        return false;
+    }
+    DP_LOG("deploy: '%s' was stopped by an interrupted deploy, taking over its replacement "
+           "(pid %d) on port %hu", node->name, pid, node->deploy_port);
+    memmove(node->path, node->deploy_path, sizeof(node->path));
+    node->port        = node->deploy_port;
+    process_set_pid(table, node, pid);
+    node->running     = true;
+    node->owned       = false;
+    node->start_time  = time(NULL);
+    node->exit_reason = EXIT_UNKNOWN;
+    node->exit_status = 0;
+    node->readiness   = READINESS_STARTING;
+    node->deploy_pid  = 0;
+    node->deploy_port = 0;
+    return true;
+}
+
+/* Sets @p stale up to stop the replacement an interrupted deploy left
+ * running next to the node, which is then replaced again. Returns false
+ * if the replacement is gone. */
+static bool stale_copy(const ProcessNode *node, ProcessNode *stale) {
+    if (kill(node->deploy_pid, 0) != 0) {
+        return false;
+    }
+    *stale = *node;
+    memset(&stale->stats, 0, sizeof(stale->stats));
+    memset(&stale->stop, 0, sizeof(stale->stop));
+    stale->pid             = node->deploy_pid;
+    stale->port            = node->deploy_port;
+    stale->running         = true;
+    stale->owned           = false;
+    stale->busy            = false;
+    stale->listen_fd       = -1;
+    stale->listen_port     = 0;
+    stale->stop.step_count = 1;
+    stale->stop.steps[0]   = (StopStep){ .signal = SIGTERM, .timeout_ms = STALE_GRACE_MS };
+    DP_LOG("deploy: stopping replacement of '%s' (pid %d) left by an interrupted deploy",
+           node->name, stale->pid);
+    return true;
+}
+
+/* ------------------------------------------------------------------ */
+/* Rolling                                                            */
+/* ------------------------------------------------------------------ */
+
+/* Where a deploy stands. In every phase but ROLL_BATCH it waits for a
+ * background bulk or for health probes of its own. */
+typedef enum {
+    ROLL_RECOVER,    /* Stopping replacements left by an interrupted deploy. */
+    ROLL_BATCH,      /* Picking and launching the next batch. */
+    ROLL_STARTING,   /* Waiting for the batch's replacements to be ready. */
+    ROLL_VERIFYING,  /* Probing the health of the replacements. */
+    ROLL_DRAINING,   /* Stopping the old processes of the moved replicas. */
+    ROLL_DISCARDING, /* Stopping the replacements of a failed batch. */
+    ROLL_DONE
+} RollPhase;
+
+/* A deploy in progress; see deploy_run_background(). */
+typedef struct Deploy {
+    ProcessTable  *table;
+    char           service[64];
+    char           jar[256];
+    unsigned       batch;
+    unsigned       timeout_secs;
+    ProcessNode  **replicas;
+    bool          *pending;     /* Replicas the current pass moves. */
+    size_t         count;
+    bool           back;        /* The pass rolls back. */
+    bool           failed;      /* The forward pass failed. */
+    int            rc;          /* 0, or -1 once a batch of the pass failed. */
+    size_t         cursor;      /* Next replica the pass looks at. */
+    uint16_t       from;        /* Lowest port replacements are started on. */
+    RollPhase      phase;
+    bool           waiting;     /* A bulk of the deploy is in progress... */
+    int            bulk_failed; /* ...and how many of its nodes failed. */
+    ProcessNode  **nodes;       /* Replicas of the batch... */
+    ProcessNode   *next;        /* ...their replacements... */
+    ProcessNode   *old;         /* ...and their old or stale processes. */
+    size_t         n;
+    size_t         launched;    /* Replacements started. */
+    Probe         *probes;      /* Health probes of the replacements... */
+    size_t        *probed;      /* ...the replacement each one is aimed at... */
+    size_t         probe_count;
+    ProbeBatch    *probe_batch; /* ...while they are in flight. */
+    DeployDone     done;
+    void          *arg;
+} Deploy;
+
+/* Monotonic clock in milliseconds. */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void deploy_free(Deploy *d) {
+    if (d == NULL) return;
+    if (d->probe_batch != NULL) probe_end(d->probe_batch);
+    free(d->replicas);
+    free(d->pending);
+    free(d->nodes);
+    free(d->next);
+    free(d->old);
+    free(d->probes);
+    free(d->probed);
+    free(d);
+}
+
+/* JAR a replica is moved to: the deployed one, or its previous one when rolling back. */
+static const char *target_of(const ProcessNode *node, bool back) {
+    return back ? node->previous_path : node->deploy_path;
+}
+
+/* Marks a replica as moved. Going forward, an empty deploy_path is what
+ * records that the replica is done, so that a resumed deploy skips it. */
+static void switched(ProcessTable *table, ProcessNode *node, bool back) {
+    if (!back) memset(node->deploy_path, 0, sizeof(node->deploy_path));
+    process_table_save(table);
+}
+
+static uint16_t lowest_port(const Deploy *d) {
+    uint16_t from = UINT16_MAX;
+    for (size_t i = 0; i < d->count; i++) {
+        if (d->replicas[i]->port != 0 && d->replicas[i]->port < from) from = d->replicas[i]->port;
+    }
+    return from;
+}
+
+/* Called when a bulk of the deploy is done. */
+static void deploy_bulk_done(void *arg, int failed) {
+    Deploy *d      = arg;
+    d->waiting     = false;
+    d->bulk_failed = failed;
+}
+
+/* Starts or stops @p count copies in the background, waiting for starts
+ * to be ready; the deploy waits for the bulk. If memory is short the bulk
+ * runs before returning instead. */
+static void deploy_bulk(Deploy *d, ProcessNode *copies, size_t count, BulkAction action) {
+    ProcessNode **nodes   = calloc(count, sizeof(*nodes));
+    unsigned      timeout = action == BULK_START ? d->timeout_secs : 0;
+    for (size_t k = 0; nodes != NULL && k < count; k++) {
+        nodes[k] = &copies[k];
+    }
+    d->waiting = true;
+    if (nodes == NULL ||
+        supervisor_bulk_background(nodes, count, action, 0, timeout, deploy_bulk_done, d) != 0) {
+        d->waiting     = false;
+        d->bulk_failed = nodes != NULL ? supervisor_bulk(nodes, count, action, 0, timeout) : (int)count;
+    }
+    free(nodes);
+}
+
+/* Ends a pass over the replicas. A failed deploy turns back exactly the
+ * replicas that were moved, in this run or an earlier one. */
+static void pass_end(Deploy *d) {
+    if (!d->back && d->rc != 0) {
+        DP_LOG("deploy: deploy of %s to '%s' failed, rolling back", d->jar, d->service);
+        for (size_t i = 0; i < d->count; i++) {
+            d->pending[i] = d->replicas[i]->deploy_path[0] == '\0';
+        }
+        d->failed = true;
+        d->back   = true;
+        d->rc     = 0;
+        d->cursor = 0;
+        d->from   = lowest_port(d);
+        d->phase  = ROLL_BATCH;
+        return;
+    }
+    if (d->rc != 0) {
+        DP_LOG("deploy: rollback of '%s' failed; check its replicas", d->service);
+    }
+    d->phase = ROLL_DONE;
+}
+
+/* Stops the replacements of a batch that did not make it; the batch keeps
+ * its old processes. */
+static void discard(Deploy *d) {
+    d->rc    = -1;
+    d->phase = ROLL_DISCARDING;
+    if (d->launched > 0) deploy_bulk(d, d->next, d->launched, BULK_STOP);
+}
+
+static void discarded(Deploy *d) {
+    for (size_t k = 0; k < d->launched; k++) {
+        d->nodes[k]->deploy_pid  = 0;
+        d->nodes[k]->deploy_port = 0;
+    }
+    process_table_save(d->table);
+    pass_end(d);
+}
+
+/* Moves the batch's replicas onto their replacements, then drains and
+ * stops their old processes. The balancer, if the daemon runs one, sends
+ * new connections to the replacements before the old processes are
+ * signalled. */
+static void adopt_batch(Deploy *d) {
+    for (size_t k = 0; k < d->launched; k++) {
+        adopt(d->table, d->nodes[k], &d->next[k], &d->old[k]);
+    }
+    lb_update(d->table);
+    d->phase = ROLL_DRAINING;
+    deploy_bulk(d, d->old, d->launched, BULK_STOP);
+}
+
+/* Saved only once the old processes are gone, so that a deploy that dies
+ * while draining is resumed from them. */
+static void drained(Deploy *d) {
+    process_table_save(d->table);
+    for (size_t k = 0; k < d->launched; k++) {
+        ProcessNode *node = d->nodes[k];
+        DP_LOG("deploy: '%s' now runs %s (pid %d) on port %hu",
+               node->name, node->path, node->pid, node->port);
+        switched(d->table, node, d->back);
+    }
+    d->phase = ROLL_BATCH;
+}
+
+/* Fills the next batch with running replicas not yet on their target and
+ * starts a replacement of each; replicas that are down are only switched. */
+static void batch_launch(Deploy *d) {
+    d->n        = 0;
+    d->launched = 0;
+    for (; d->cursor < d->count && d->n < d->batch; d->cursor++) {
+        ProcessNode *node   = d->replicas[d->cursor];
+        const char  *target = target_of(node, d->back);
+        if (!d->pending[d->cursor]) continue;
+        if (!node->running || node->port == 0) {
+            memmove(node->path, target, sizeof(node->path));
+            switched(d->table, node, d->back);
+            DP_LOG("deploy: '%s' is not running, switched it to %s", node->name, node->path);
+            continue;
+        }
+        d->nodes[d->n++] = node;
+    }
+    if (d->n == 0) {
+        pass_end(d);
+        return;
+    }
+
+    for (; d->launched < d->n; d->launched++) {
+        ProcessNode *node = d->nodes[d->launched];
+        if (launch(d->table, node, target_of(node, d->back), d->from, &d->next[d->launched]) != 0) {
+            discard(d);
+            return;
+        }
+    }
+    d->phase = ROLL_STARTING;
+    deploy_bulk(d, d->next, d->launched, BULK_START);
+}
+
+/* Once the replacements are ready, probes the health check of those that
+ * have one. */
+static void started(Deploy *d) {
+    if (d->bulk_failed != 0) {
+        for (size_t k = 0; k < d->launched; k++) {
+            const ProcessNode *next = &d->next[k];
+            if (next->running && next->readiness == READINESS_READY) continue;
+            DP_LOG("deploy: replacement of '%s' %s", next->name,
+                   !next->running ? "exited before becoming ready" : "did not become ready in time");
+        }
+        discard(d);
+        return;
+    }
+
+    d->probe_count = 0;
+    for (size_t k = 0; k < d->launched; k++) {
+        const ProcessNode *next = &d->next[k];
+        if (next->health.path[0] == '\0') continue;
+        d->probes[d->probe_count] = (Probe){
+            .port       = next->port,
+            .path       = next->health.path,
+            .timeout_ms = next->health.timeout_ms > 0 ? next->health.timeout_ms
+                                                      : DEFAULT_HEALTH_TIMEOUT_MS,
+        };
+        d->probed[d->probe_count++] = k;
+    }
+    if (d->probe_count == 0) {
+        adopt_batch(d);
+        return;
+    }
+    d->phase       = ROLL_VERIFYING;
+    d->probe_batch = probe_begin(d->probes, d->probe_count);
+    if (d->probe_batch == NULL) probe_run(d->probes, d->probe_count);
+}
+
+static void verified(Deploy *d) {
+    for (size_t p = 0; p < d->probe_count; p++) {
+        const Probe *probe = &d->probes[p];
+        if (probe->result == PROBE_OK) continue;
+        DP_LOG("deploy: replacement of '%s' failed its health check (%s, status %d)",
+               d->next[d->probed[p]].name, probe_result_str(probe->result), probe->status);
+        d->rc = -1;
+    }
+    if (d->rc != 0) {
+        discard(d);
+    } else {
+        adopt_batch(d);
+    }
+}
+
+/* Clears the replacements an interrupted deploy left once they are stopped. */
+static void recovered(Deploy *d) {
+    for (size_t k = 0; k < d->n; k++) {
+        d->nodes[k]->deploy_pid  = 0;
+        d->nodes[k]->deploy_port = 0;
+    }
+    process_table_save(d->table);
+    d->phase = ROLL_BATCH;
+}
+
+/* Moves the deploy on until it waits for a bulk or probes, or is done.
+ * Returns the number of steps taken. */
+static int deploy_step(Deploy *d) {
+    int steps = 0;
+    while (d->phase != ROLL_DONE && !d->waiting && d->probe_batch == NULL) {
+        switch (d->phase) {
+            case ROLL_RECOVER:    recovered(d);    break;
+            case ROLL_BATCH:      batch_launch(d); break;
+            case ROLL_STARTING:   started(d);      break;
+            case ROLL_VERIFYING:  verified(d);     break;
+            case ROLL_DRAINING:   drained(d);      break;
+            case ROLL_DISCARDING: discarded(d);    break;
+            case ROLL_DONE:                        break;
+        }
+        steps++;
+    }
+    return steps;
+}
+
+static size_t deploy_fds(void *arg) {
+    const Deploy *d = arg;
+    return d->probe_batch != NULL ? d->probe_count : 0;
+}
+
+static size_t deploy_pollfds(void *arg, struct pollfd *pfds, long long *wake) {
+    const Deploy *d = arg;
+    if (d->probe_batch != NULL) {
+        return probe_pollfds(d->probe_batch, pfds, wake);
+    }
+    if (d->phase == ROLL_DONE && now_ms() < *wake) {
+        *wake = now_ms(); /* done: nothing to wait for before deploy_advance() */
+    }
+    return 0;
+}
+
+static bool deploy_advance(void *arg, int *changed) {
+    Deploy *d = arg;
+    if (d->probe_batch != NULL && probe_advance(d->probe_batch)) {
+        probe_end(d->probe_batch);
+        d->probe_batch = NULL;
+    }
+    *changed += deploy_step(d);
+    return d->phase == ROLL_DONE;
+}
+
+static void deploy_end(void *arg) {
+    Deploy *d = arg;
+    for (size_t i = 0; i < d->count; i++) {
+        memset(d->replicas[i]->deploy_path, 0, sizeof(d->replicas[i]->deploy_path));
+        d->replicas[i]->busy = false;
+    }
+    supervisor_check_readiness(d->table); /* a replacement taken over on resume */
+    process_table_save(d->table);
+    DP_LOG("deploy: '%s' %s", d->service, d->failed ? "rolled back" : "deployed");
+    if (d->done != NULL) d->done(d->arg, d->failed ? 1 : 0);
+    deploy_free(d);
+}
+
+static const BackgroundWork deploy_work = {
+    .fds     = deploy_fds,
+    .pollfds = deploy_pollfds,
+    .advance = deploy_advance,
+    .end     = deploy_end,
+};
+
+int deploy_run_background(ProcessTable *table, const char *service, const char *jar,
+                          const DeployOptions *options, DeployDone done, void *arg) {
+    DeployOptions defaults = { .batch = DEFAULT_DEPLOY_BATCH, .ready_timeout_secs = DEFAULT_READY_WAIT_SECS };
+    if (options == NULL) options = &defaults;
+
+    Deploy *d = calloc(1, sizeof(*d));
+    if (d == NULL || (d->replicas = calloc(table->count > 0 ? table->count : 1, sizeof(*d->replicas))) == NULL) {
+        DP_LOG("deploy: out of memory");
+        deploy_free(d);
+        return -1;
+    }
+    bool in_progress = false;
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+        if (strcmp(lb_service_of(node), service) != 0) continue;
+        if (node->busy) {
+            DP_LOG("deploy: '%s' is being stopped, started or deployed; try again once it is done",
+                   node->name);
+            deploy_free(d);
+            return -1;
+        }
+        supervisor_status(node); /* refresh live state before choosing what to replace */
+        d->replicas[d->count++] = node;
+        if (node->deploy_path[0] != '\0') {
+            if (strcmp(node->deploy_path, jar) != 0) {
+                DP_LOG("deploy: a deploy of %s to '%s' is in progress; run it again to resume it",
+                       node->deploy_path, service);
+                deploy_free(d);
+                return -1;
+            }
+            in_progress = true;
+        }
+    }
+    if (d->count == 0) {
+        DP_LOG("deploy: no replica of '%s' is registered", service);
+        deploy_free(d);
+        return -1;
+    }
+
+    d->pending = calloc(d->count, sizeof(*d->pending));
+    d->nodes   = calloc(d->count, sizeof(*d->nodes));
+    d->next    = calloc(d->count, sizeof(*d->next));
+    d->old     = calloc(d->count, sizeof(*d->old));
+    d->probes  = calloc(d->count, sizeof(*d->probes));
+    d->probed  = calloc(d->count, sizeof(*d->probed));
+    if (d->pending == NULL || d->nodes == NULL || d->next == NULL || d->old == NULL ||
+        d->probes == NULL || d->probed == NULL || supervisor_background_add(&deploy_work, d) != 0) {
+        DP_LOG("deploy: out of memory");
+        deploy_free(d);
+        return -1;
+    }
+    d->table        = table;
+    d->batch        = options->batch > 0 ? options->batch : DEFAULT_DEPLOY_BATCH;
+    d->timeout_secs = options->ready_timeout_secs > 0 ? options->ready_timeout_secs
+                                                      : DEFAULT_READY_WAIT_SECS;
+    d->done         = done;
+    d->arg          = arg;
+    strncpy(d->service, service, sizeof(d->service) - 1);
+    strncpy(d->jar, jar, sizeof(d->jar) - 1);
+
+    d->phase = ROLL_BATCH;
+    if (in_progress) {
+        DP_LOG("deploy: resuming deploy of %s to '%s'", jar, service);
+        for (size_t i = 0; i < d->count; i++) {
+            ProcessNode *node = d->replicas[i];
+            if (node->deploy_pid <= 0) continue;
+            if (take_over(table, node)) {
+                switched(table, node, false);
+            } else if (stale_copy(node, &d->old[d->n])) {
+                d->nodes[d->n++] = node;
+            } else {
+                node->deploy_pid  = 0;
+                node->deploy_port = 0;
+            }
+        }
+        process_table_save(table);
+        if (d->n > 0) {
+            d->phase = ROLL_RECOVER;
+            deploy_bulk(d, d->old, d->n, BULK_STOP);
+        }
+    } else {
+        DP_LOG("deploy: deploying %s to %zu replica(s) of '%s', %u at a time",
+               jar, d->count, service, d->batch);
+        for (size_t i = 0; i < d->count; i++) {
+            ProcessNode *node = d->replicas[i];
+            memcpy(node->previous_path, node->path, sizeof(node->previous_path));
+            memset(node->deploy_path, 0, sizeof(node->deploy_path));
+            strncpy(node->deploy_path, jar, sizeof(node->deploy_path) - 1);
+        }
+        process_table_save(table);
+    }
+
+    for (size_t i = 0; i < d->count; i++) {
+        d->pending[i]        = d->replicas[i]->deploy_path[0] != '\0';
+        d->replicas[i]->busy = true;
+    }
+    d->from = lowest_port(d);
+    deploy_step(d);
+    return 0;
+}
+
+/* Records the result of a deploy or apply waited for in the foreground. */
+static void store_result(void *arg, int rc) {
+    *(int *)arg = rc;
+}
+
+int deploy_run(ProcessTable *table, const char *service, const char *jar, const DeployOptions *options) {
+    int rc = -1;
+    if (deploy_run_background(table, service, jar, options, store_result, &rc) != 0) {
+        return -1;
+    }
+    supervisor_background_wait();
+    return rc;
+}
+
+/* ------------------------------------------------------------------ */
+/* Applying a config                                                  */
+/* ------------------------------------------------------------------ */
+
+/* What applying the config does to one node. */
+typedef enum {
+    CHANGE_NONE,    /* Matches the config and runs. */
+    CHANGE_UPDATE,  /* Only fields read while it is down or by the daemon, or its cgroup limits, differ. */
+    CHANGE_START,   /* Matches the config but is down. */
+    CHANGE_RESTART, /* Its command line or environment differs. */
+    CHANGE_ROLL,    /* A running replica whose JAR differs; rolled via deploy_run(). */
+    CHANGE_CREATE   /* Not registered yet. */
+} Change;
+
+/* A node the config asks for. */
+typedef struct Desired {
+    const ServiceConfig *config;
+    char     name[64];
+    char     service[64];  /* Service it is a replica of (empty = its own). */
+    uint16_t port;
+    uint16_t lb_port;
+    char     depends_on[MAX_DEPENDENCIES][64];
+    Change   change;
+    char     diff[128];    /* Fields that differ, for the report. */
+} Desired;
+
+static const ServiceConfig *config_service(const Config *config, const char *name) {
+    for (size_t i = 0; i < config->count; i++) {
+        if (strcmp(config->services[i].name, name) == 0) return &config->services[i];
+    }
+    return NULL;
+}
+
+/* Name of replica @p index (from 0) of a load-balanced service. */
+static bool replica_name(char *out, size_t size, const char *service, unsigned index) {
+    return (size_t)snprintf(out, size, "%s-%u", service, index + 1) < size;
+}
+
+/* Turns the config into one Desired per node: a service with `lb.replicas`
+ * becomes replicas named <service>-1.. on the ports after its own, which
+ * is the balanced one, and a dependency on it becomes one on each replica. */
+static Desired *expand(const Config *config, size_t *count) {
+    size_t total = 0;
+    for (size_t i = 0; i < config->count; i++) {
+        total += config->services[i].replicas > 0 ? config->services[i].replicas : 1;
+    }
+    Desired *desired = calloc(total, sizeof(*desired));
+    if (desired == NULL) {
+        DP_LOG("deploy: out of memory for %zu services", total);
+        return NULL;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < config->count; i++) {
+        const ServiceConfig *s      = &config->services[i];
+        unsigned             copies = s->replicas > 0 ? s->replicas : 1;
+        for (unsigned r = 0; r < copies; r++) {
+            Desired *d = &desired[n++];
+            d->config  = s;
+            if (s->replicas > 0) {
+                if (!replica_name(d->name, sizeof(d->name), s->name, r)) {
+                    DP_LOG("deploy: replica names of '%s' are too long", s->name);
+                    free(desired);
+                    return NULL;
+                }
+                strcpy(d->service, s->name);
+                d->port    = (uint16_t)(s->port + r + 1);
+                d->lb_port = s->port;
+            } else {
+                strcpy(d->name, s->name);
+                d->port = s->port;
+            }
+
+            size_t slot = 0;
+            for (size_t k = 0; k < MAX_DEPENDENCIES && s->dependencies[k][0] != '\0'; k++) {
+                const ServiceConfig *dep  = config_service(config, s->dependencies[k]);
+                unsigned             each = dep != NULL && dep->replicas > 0 ? dep->replicas : 0;
+                for (unsigned c = 0; c < (each > 0 ? each : 1); c++, slot++) {
+                    if (slot == MAX_DEPENDENCIES) {
+                        DP_LOG("deploy: '%s' has more than %d dependencies once replicas are counted",
+                               s->name, MAX_DEPENDENCIES);
+                        free(desired);
+                        return NULL;
+                    }
+                    if (each == 0) {
+                        strcpy(d->depends_on[slot], s->dependencies[k]);
+                    } else if (!replica_name(d->depends_on[slot], sizeof(d->depends_on[slot]), dep->name, c)) {
+                        DP_LOG("deploy: replica names of '%s' are too long", dep->name);
+                        free(desired);
+                        return NULL;
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            if (strcmp(desired[i].name, desired[j].name) == 0) {
+                DP_LOG("deploy: the config defines '%s' twice", desired[i].name);
+                free(desired);
+                return NULL;
+            }
+        }
+    }
+    *count = n;
+    return desired;
+}
+
+/* Whether @p path was modified after @p since, i.e. while the process ran. */
+static bool modified_since(const char *path, time_t since) {
+    struct stat st;
+    return path[0] != '\0' && stat(path, &st) == 0 && st.st_mtime > since;
+}
+
+static void note(char *diff, size_t size, const char *field) {
+    size_t used = strlen(diff);
+    snprintf(diff + used, size - used, "%s%s", used > 0 ? ", " : "", field);
+}
+
+/* Compares a registered node with what the config asks for. */
+static Change compare(const ProcessNode *node, Desired *want) {
+    const ServiceConfig *s       = want->config;
+    bool                 restart = false;
+    bool                 jar     = false;
+    bool                 update  = false;
+
+    if (strcmp(node->path, s->jar) != 0) {
+        note(want->diff, sizeof(want->diff), "jar");
+        jar = true;
+    } else if (node->running && modified_since(s->jar, node->start_time)) {
+        note(want->diff, sizeof(want->diff), "jar rebuilt");
+        jar = true;
+    }
+    if (want->service[0] != '\0') {
+        want->port = node->port; /* Replicas move between ports on every deploy_run(). */
+    } else if (node->port != want->port) {
+        note(want->diff, sizeof(want->diff), "port");
+        restart = true;
+    }
+    if (strcmp(node->env_path, s->env_file) != 0) {
+        note(want->diff, sizeof(want->diff), "envFile");
+        restart = true;
+    } else if (node->running && modified_since(s->env_file, node->start_time)) {
+        note(want->diff, sizeof(want->diff), "envFile edited");
+        restart = true;
+    }
+    if (strcmp(node->log_path, s->log_file) != 0) {
+        note(want->diff, sizeof(want->diff), "logging");
+        restart = true;
+    }
+    if (node->restart_policy != s->restart_policy) {
+        note(want->diff, sizeof(want->diff), "restartPolicy");
+        update = true;
+    }
+    if (strcmp(node->service, want->service) != 0 || node->lb_port != want->lb_port) {
+        note(want->diff, sizeof(want->diff), "lb");
+        update = true;
+    }
+    if (memcmp(node->depends_on, want->depends_on, sizeof(want->depends_on)) != 0) {
+        note(want->diff, sizeof(want->diff), "dependencies");
+        update = true;
+    }
+    if (memcmp(&node->cgroup, &s->resources, sizeof(s->resources)) != 0) {
+        note(want->diff, sizeof(want->diff), "resources");
+        update = true;
+    }
+
+    if (!node->running) return jar || restart ? CHANGE_RESTART : CHANGE_START;
+    if (restart)        return CHANGE_RESTART;
+    if (jar)            return want->service[0] != '\0' ? CHANGE_ROLL : CHANGE_RESTART;
+    return update ? CHANGE_UPDATE : CHANGE_NONE;
+}
+
+/* Sets the fields the config controls; the JAR of a rolled replica is
+ * left to deploy_run(). */
+static void assign(ProcessNode *node, const Desired *want) {
+    const ServiceConfig *s = want->config;
+    if (want->change != CHANGE_ROLL) {
+        memset(node->path, 0, sizeof(node->path));
+        strncpy(node->path, s->jar, sizeof(node->path) - 1);
+    }
+    memset(node->env_path, 0, sizeof(node->env_path));
+    strncpy(node->env_path, s->env_file, sizeof(node->env_path) - 1);
+    memset(node->log_path, 0, sizeof(node->log_path));
+    strncpy(node->log_path, s->log_file, sizeof(node->log_path) - 1);
+    memcpy(node->service, want->service, sizeof(node->service));
+    memcpy(node->depends_on, want->depends_on, sizeof(node->depends_on));
+    node->port           = want->port;
+    node->lb_port        = want->lb_port;
+    node->restart_policy = s->restart_policy;
+    node->cgroup         = s->resources;
+}
+
+/* A new node with the same defaults as `supervisor start`. */
+static void create(ProcessNode *node, const Desired *want) {
+    memset(node, 0, sizeof(*node));
+    strcpy(node->name, want->name);
+    node->restart_budget        = DEFAULT_RESTART_BUDGET;
+    node->stable_secs           = DEFAULT_STABLE_SECS;
+    node->log_rotation          = (LogRotation){ .max_bytes = DEFAULT_LOG_MAX_BYTES, .keep = DEFAULT_LOG_KEEP };
+    node->limits                = (ResourceLimits){ .checks = DEFAULT_LIMIT_CHECKS, .action = LIMIT_ALERT };
+    node->health                = (HealthCheck){ .timeout_ms = DEFAULT_HEALTH_TIMEOUT_MS,
+                                                 .failures = DEFAULT_HEALTH_FAILURES,
+                                                 .grace_secs = DEFAULT_HEALTH_GRACE_SECS };
+    node->ready_probe           = (ReadinessProbe){ .interval_ms = DEFAULT_READY_INTERVAL_MS,
+                                                    .timeout_ms = DEFAULT_READY_TIMEOUT_MS };
+    node->stop.pre_stop_timeout_ms = DEFAULT_PRE_STOP_TIMEOUT_MS;
+    assign(node, want);
+}
+
+/* Checks the dependencies the table would have with the config applied.
+ * They are checked on a copy, so that a rejected config leaves the table
+ * alone. Returns 0 if they are valid. */
+static int check_desired(const ProcessTable *table, const Desired *desired, size_t count) {
+    ProcessTable scratch = {0};
+    int          rc      = 0;
+    for (size_t i = 0; rc == 0 && i < table->count; i++) {
+        if (process_append(&scratch, &table->nodes[i], false) == NULL) rc = -1;
+    }
+    for (size_t i = 0; rc == 0 && i < count; i++) {
+        const Desired *want = &desired[i];
+        if (want->change == CHANGE_CREATE) {
+            ProcessNode node;
+            create(&node, want);
+            if (process_append(&scratch, &node, false) == NULL) rc = -1;
+        } else if (want->change != CHANGE_NONE) {
+            assign(process_find_by_name(&scratch, want->name), want);
+        }
+    }
+    if (rc != 0) {
+        DP_LOG("deploy: out of memory");
+    } else {
+        char error[256];
+        if (supervisor_check_dependencies(&scratch, error, sizeof(error)) != 0) {
+            DP_LOG("deploy: %s", error);
+            rc = -1;
+        }
+    }
+    process_table_free(&scratch);
+    return rc;
+}
+
+static const char *const change_names[] = {
+    [CHANGE_NONE]    = "unchanged",
+    [CHANGE_UPDATE]  = "updating",
+    [CHANGE_START]   = "down, starting",
+    [CHANGE_RESTART] = "restarting",
+    [CHANGE_ROLL]    = "rolling",
+    [CHANGE_CREATE]  = "creating",
+};
+
+/* Where an apply stands. */
+typedef enum {
+    APPLY_PLAN,      /* Diffing the config and registering new nodes; runs alone. */
+    APPLY_ROLL,      /* Rolling replicated services whose JAR changed, one after another. */
+    APPLY_RESTART,   /* (Re)starting everything else in one bulk... */
+    APPLY_RESTARTED, /* ...and counting its failures. */
+    APPLY_PRUNE,     /* Stopping the nodes that are not in the config... */
+    APPLY_REMOVE,    /* ...and removing them; runs alone. */
+    APPLY_DONE
+} ApplyPhase;
+
+/* A config being applied; see deploy_apply_background(). The table may
+ * move between phases, so nodes are looked up by name in each. */
+typedef struct Apply {
+    ProcessTable *table;
+    Config        config;     /* Own copy of the services. */
+    ApplyOptions  options;
+    Desired      *desired;
+    size_t        count;
+    size_t        stale;      /* Registered nodes not in the config. */
+    char        (*gone)[64];  /* Names of the ones pruned. */
+    size_t        gone_count;
+    ApplyPhase    phase;
+    bool          waiting;    /* A deploy or bulk of the apply is in progress... */
+    int           result;     /* ...and the failures of that bulk... */
+    size_t        bulk_count; /* ...out of this many nodes. */
+    size_t        service;    /* Next service of the config to roll. */
+    bool          applied;    /* The table had to change. */
+    int           failed;
+    int           rc;         /* -1 once the config cannot be applied. */
+    DeployDone    done;
+    void         *arg;
+} Apply;
+
+static void apply_free(Apply *a) {
+    if (a == NULL) return;
+    free(a->config.services);
+    free(a->desired);
+    free(a->gone);
+    free(a);
+}
+
+/* Whether the table still holds a node the config does not ask for. */
+static bool wanted(const Apply *a, const char *name) {
+    for (size_t j = 0; j < a->count; j++) {
+        if (strcmp(name, a->desired[j].name) == 0) return true;
+    }
+    return false;
+}
+
+/* Called when a deploy of the apply is done. */
+static void apply_deployed(void *arg, int rc) {
+    Apply *a   = arg;
+    a->waiting = false;
+    if (rc != 0) a->failed++;
+}
+
+/* Called when a bulk of the apply is done. */
+static void apply_bulk_done(void *arg, int failed) {
+    Apply *a   = arg;
+    a->waiting = false;
+    a->result  = failed;
+}
+
+/* Runs a bulk over @p count nodes in the background; the apply waits for
+ * it. If memory is short the bulk runs before returning instead. */
+static void apply_bulk(Apply *a, ProcessNode **nodes, size_t count, BulkAction action) {
+    a->bulk_count = count;
+    a->result     = 0;
+    if (count == 0) {
+        return;
+    }
+    a->waiting = true;
+    if (supervisor_bulk_background(nodes, count, action, a->options.parallel, 0,
+                                   apply_bulk_done, a) != 0) {
+        a->waiting = false;
+        a->result  = supervisor_bulk(nodes, count, action, a->options.parallel, 0);
+    }
+}
+
+/* Diffs the config against the table, then registers and updates nodes
+ * once the dependencies they form are known to be valid. */
+static void plan(Apply *a) {
+    ProcessTable *table = a->table;
+    a->phase   = APPLY_DONE;
+    a->desired = expand(&a->config, &a->count);
+    if (a->desired == NULL) {
+        a->rc = -1;
+        return;
+    }
+
+    size_t unchanged = 0, changes = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        Desired     *want = &a->desired[i];
+        ProcessNode *node = process_find_by_name(table, want->name);
+        if (node == NULL) {
+            want->change = CHANGE_CREATE;
+        } else {
+            supervisor_status(node);
+            want->change = compare(node, want);
+        }
+        if (want->change == CHANGE_NONE) {
+            unchanged++;
+            continue;
+        }
+        changes++;
+        DP_LOG("deploy: '%s' %s%s%s%s", want->name, change_names[want->change],
+               want->diff[0] != '\0' ? " (" : "", want->diff, want->diff[0] != '\0' ? ")" : "");
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        if (wanted(a, table->nodes[i].name)) continue;
+        a->stale++;
+        DP_LOG("deploy: '%s' is not in the config%s", table->nodes[i].name,
+               a->options.prune ? ", removing" : "; --prune removes it");
+    }
+    DP_LOG("deploy: %zu to change, %zu unchanged, %zu not in the config",
+           changes, unchanged, a->stale);
+    if (a->options.dry_run || (changes == 0 && (a->stale == 0 || !a->options.prune))) {
+        return;
+    }
+
+    if (check_desired(table, a->desired, a->count) != 0) {
+        a->rc = -1;
+        return;
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        Desired *want = &a->desired[i];
+        if (want->change == CHANGE_CREATE) {
+            ProcessNode node;
+            create(&node, want);
+            if (process_append(table, &node, false) == NULL) {
+                DP_LOG("deploy: could not register '%s'", want->name);
+                a->rc = -1;
+                return;
+            }
+        } else if (want->change != CHANGE_NONE) {
+            ProcessNode *node = process_find_by_name(table, want->name);
+            assign(node, want);
+
+            /* The kernel applies new limits to a running service at once. */
+            char unset[128];
+            if (want->change == CHANGE_UPDATE && cgroup_apply_limits(node, unset, sizeof(unset)) == 0 &&
+                unset[0] != '\0') {
+                DP_LOG("deploy: could not set %s of '%s' (controller not enabled?)", unset, node->name);
+            }
+        }
+    }
+    a->applied = true;
+    a->phase   = APPLY_ROLL;
+}
+
+/* Replicated services whose JAR changed are rolled one replica at a time,
+ * and one service after another. */
+static void roll_next(Apply *a) {
+    while (a->service < a->config.count) {
+        const ServiceConfig *s    = &a->config.services[a->service++];
+        bool                 roll = false;
+        for (size_t j = 0; j < a->count; j++) {
+            if (a->desired[j].config == s && a->desired[j].change == CHANGE_ROLL) roll = true;
+        }
+        if (!roll) continue;
+        a->waiting = true;
+        if (deploy_run_background(a->table, s->name, s->jar, NULL, apply_deployed, a) == 0) {
+            return;
+        }
+        a->waiting = false;
+        a->failed++;
+    }
+    a->phase = APPLY_RESTART;
+}
+
+/* Everything else that has to (re)start goes through one bulk, which
+ * starts dependencies first. */
+static void restart_changed(Apply *a) {
+    ProcessNode **nodes = calloc(a->count > 0 ? a->count : 1, sizeof(*nodes));
+    size_t        todo  = 0;
+    if (nodes == NULL) {
+        a->rc    = -1;
+        a->phase = APPLY_DONE;
+        return;
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        Change change = a->desired[i].change;
+        if (change != CHANGE_CREATE && change != CHANGE_START && change != CHANGE_RESTART) continue;
+        ProcessNode *node = process_find_by_name(a->table, a->desired[i].name);
+        if (node == NULL || node->busy) {
+            DP_LOG("deploy: not restarting '%s': it is being stopped or started", a->desired[i].name);
+            a->failed++;
+            continue;
+        }
+        supervisor_reset_backoff(node);
+        nodes[todo++] = node;
+    }
+    a->phase = APPLY_RESTARTED;
+    apply_bulk(a, nodes, todo, BULK_RESTART);
+    free(nodes);
+}
+
+static void restarted(Apply *a) {
+    a->failed += a->result < 0 ? (int)a->bulk_count : a->result;
+    for (size_t i = 0; i < a->count; i++) {
+        ProcessNode *node = process_find_by_name(a->table, a->desired[i].name);
+        if (a->desired[i].change == CHANGE_CREATE && node != NULL) {
+            node->restart_count = 0; /* started, not restarted */
+        }
+    }
+    a->phase = APPLY_PRUNE;
+}
+
+/* With --prune, stops the nodes that are not in the config. */
+static void prune(Apply *a) {
+    ProcessTable *table = a->table;
+    if (!a->options.prune || a->stale == 0) {
+        a->phase = APPLY_DONE;
+        return;
+    }
+    ProcessNode **nodes = calloc(table->count > 0 ? table->count : 1, sizeof(*nodes));
+    a->gone             = calloc(table->count > 0 ? table->count : 1, sizeof(*a->gone));
+    if (nodes == NULL || a->gone == NULL) {
+        free(nodes);
+        a->rc    = -1;
+        a->phase = APPLY_DONE;
+        return;
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+        if (wanted(a, node->name)) continue;
+        if (node->busy) {
+            DP_LOG("deploy: not removing '%s': it is being stopped or started", node->name);
+            a->failed++;
+            continue;
+        }
+        memcpy(a->gone[a->gone_count], node->name, sizeof(a->gone[a->gone_count]));
+        nodes[a->gone_count++] = node;
+    }
+    a->phase = APPLY_REMOVE;
+    apply_bulk(a, nodes, a->gone_count, BULK_STOP);
+    free(nodes);
+}
+
+static void removed(Apply *a) {
+    a->failed += a->result < 0 ? (int)a->bulk_count : a->result;
+    for (size_t i = 0; i < a->gone_count; i++) {
+        cgroup_remove(a->gone[i]);
+        process_remove(a->table, a->gone[i]);
+    }
+    a->phase = APPLY_DONE;
+}
+
+static bool apply_exclusive(void *arg) {
+    const Apply *a = arg;
+    return !a->waiting && (a->phase == APPLY_PLAN || a->phase == APPLY_REMOVE);
+}
+
+static size_t apply_fds(void *arg) {
+    (void)arg;
+    return 0;
+}
+
+static size_t apply_pollfds(void *arg, struct pollfd *pfds, long long *wake) {
+    const Apply *a = arg;
+    (void)pfds;
+    if (!a->waiting && now_ms() < *wake) {
+        *wake = now_ms(); /* a step to take, or done */
+    }
+    return 0;
+}
+
+/* Moves the apply on until it waits for a deploy or bulk, or its next
+ * step must run alone; it is only called for such a step once it may. */
+static bool apply_advance(void *arg, int *changed) {
+    Apply *a = arg;
+    while (a->phase != APPLY_DONE && !a->waiting) {
+        switch (a->phase) {
+            case APPLY_PLAN:      plan(a);            break;
+            case APPLY_ROLL:      roll_next(a);       break;
+            case APPLY_RESTART:   restart_changed(a); break;
+            case APPLY_RESTARTED: restarted(a);       break;
+            case APPLY_PRUNE:     prune(a);           break;
+            case APPLY_REMOVE:    removed(a);         break;
+            case APPLY_DONE:                          break;
+        }
+        (*changed)++;
+        if (apply_exclusive(a)) break;
+    }
+    return a->phase == APPLY_DONE;
+}
+
+static void apply_end(void *arg) {
+    Apply *a  = arg;
+    int    rc = a->rc < 0 ? -1 : a->failed > 0 ? 1 : 0;
+    if (a->applied && a->rc == 0) {
+        DP_LOG("deploy: config applied, %d failure(s)", a->failed);
+    }
+    if (a->done != NULL) a->done(a->arg, rc);
+    apply_free(a);
+}
+
+static const BackgroundWork apply_work = {
+    .fds       = apply_fds,
+    .pollfds   = apply_pollfds,
+    .advance   = apply_advance,
+    .exclusive = apply_exclusive,
+    .end       = apply_end,
+};
+
+int deploy_apply_background(ProcessTable *table, const Config *config, const ApplyOptions *options,
+                            DeployDone done, void *arg) {
+    ApplyOptions defaults = { .parallel = DEFAULT_BULK_PARALLEL };
+    Apply       *a        = calloc(1, sizeof(*a));
+    if (a != NULL) {
+        a->config.services = calloc(config->count > 0 ? config->count : 1, sizeof(*a->config.services));
+    }
+    if (a == NULL || a->config.services == NULL || supervisor_background_add(&apply_work, a) != 0) {
+        DP_LOG("deploy: out of memory");
+        apply_free(a);
+        return -1;
+    }
+    memcpy(a->config.services, config->services, config->count * sizeof(*config->services));
+    a->config.count = config->count;
+    a->table        = table;
+    a->options      = options != NULL ? *options : defaults;
+    a->phase        = APPLY_PLAN;
+    a->done         = done;
+    a->arg          = arg;
+    return 0;
+}
+
+int deploy_apply(ProcessTable *table, const Config *config, const ApplyOptions *options) {
+    int rc = -1;
+    if (deploy_apply_background(table, config, options, store_result, &rc) != 0) {
+        return -1;
+    }
+    supervisor_background_wait();
+    return rc;
+}
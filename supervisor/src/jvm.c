@@ -0,0 +1,137 @@
+#include "jvm.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *const gc_names[] = {
+    [JVM_GC_DEFAULT]    = "default",
+    [JVM_GC_G1]         = "g1",
+    [JVM_GC_PARALLEL]   = "parallel",
+    [JVM_GC_SERIAL]     = "serial",
+    [JVM_GC_ZGC]        = "zgc",
+    [JVM_GC_SHENANDOAH] = "shenandoah",
+};
+
+static const char *const gc_flags[] = {
+    [JVM_GC_DEFAULT]    = NULL,
+    [JVM_GC_G1]         = "-XX:+UseG1GC",
+    [JVM_GC_PARALLEL]   = "-XX:+UseParallelGC",
+    [JVM_GC_SERIAL]     = "-XX:+UseSerialGC",
+    [JVM_GC_ZGC]        = "-XX:+UseZGC",
+    [JVM_GC_SHENANDOAH] = "-XX:+UseShenandoahGC",
+};
+
+#define GC_COUNT (sizeof(gc_names) / sizeof(gc_names[0]))
+
+const char *jvm_gc_name(JvmGc gc) {
+    return (size_t)gc < GC_COUNT ? gc_names[gc] : "unknown";
+}
+
+int jvm_parse_gc(const char *name, JvmGc *gc) {
+    for (size_t i = 0; i < GC_COUNT; i++) {
+        if (strcmp(name, gc_names[i]) == 0) {
+            *gc = (JvmGc)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint32_t weight_of(const ProcessNode *node) {
+    return node->jvm.weight > 0 ? node->jvm.weight : 1;
+}
+
+void jvm_effective_profile(const ProcessTable *table, const ProcessNode *node, JvmProfile *out) {
+    *out = node->jvm;
+    if (!node->jvm.auto_size) {
+        return;
+    }
+
+    long     pages    = sysconf(_SC_PHYS_PAGES);
+    long     pagesize = sysconf(_SC_PAGESIZE);
+    long     online   = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t memory   = pages > 0 && pagesize > 0 ? (uint64_t)pages * (uint64_t)pagesize : 0;
+    uint32_t cores    = online > 0 ? (uint32_t)online : 1;
+
+    /* Memory left for auto-mode heaps, and the weights sharing it. */
+    uint64_t budget = memory / 100 * (100 - JVM_HOST_RESERVE_PERCENT);
+    uint64_t total  = weight_of(node);
+    if (table != NULL) {
+        for (size_t i = 0; i < table->count; i++) {
+            const ProcessNode *n = &table->nodes[i];
+            if (strcmp(n->name, node->name) == 0) {
+                continue; /* Counted above; a new node is not in the table yet. */
+            }
+            if (n->jvm.auto_size) {
+                total += weight_of(n);
+            } else {
+                uint64_t fixed = (uint64_t)n->jvm.heap_max_mb << 20;
+                budget = budget > fixed ? budget - fixed : 0;
+            }
+        }
+    }
+
+    if (out->heap_max_mb == 0) {
+        uint64_t share = budget / total * weight_of(node);
+        uint64_t heap  = (share / 100 * JVM_HEAP_PERCENT) >> 20;
+        out->heap_max_mb = heap > JVM_MIN_HEAP_MB ? (uint32_t)heap : JVM_MIN_HEAP_MB;
+        if (out->heap_min_mb > out->heap_max_mb) out->heap_min_mb = out->heap_max_mb;
+    }
+    if (out->cpus == 0) {
+        uint64_t share = ((uint64_t)cores * weight_of(node) + total - 1) / total;
+        out->cpus = (uint16_t)(share < 1 ? 1 : share > cores ? cores : share);
+    }
+}
+
+/* Appends one formatted argument to the command line. */
+static int push_arg(JvmCommand *cmd, size_t *argc, size_t *used, const char *format, ...) {
+    if (*argc >= JVM_MAX_ARGS) {
+        return -1;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(cmd->storage + *used, sizeof(cmd->storage) - *used, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= sizeof(cmd->storage) - *used) {
+        return -1;
+    }
+    cmd->argv[(*argc)++] = cmd->storage + *used;
+    *used += (size_t)n + 1;
+    return 0;
+}
+
+/* Appends each whitespace-separated word of @p words. */
+static int push_words(JvmCommand *cmd, size_t *argc, size_t *used, const char *words) {
+    const char *p = words;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t') p++;
+        size_t len = strcspn(p, " \t");
+        if (len == 0) break;
+        if (push_arg(cmd, argc, used, "%.*s", (int)len, p) != 0) return -1;
+        p += len;
+    }
+    return 0;
+}
+
+int jvm_build_command(const ProcessTable *table, const ProcessNode *node, JvmCommand *cmd) {
+    JvmProfile profile;
+    jvm_effective_profile(table, node, &profile);
+
+    size_t argc = 0, used = 0;
+    int    rc   = push_arg(cmd, &argc, &used, "java");
+    if (profile.heap_min_mb > 0) rc |= push_arg(cmd, &argc, &used, "-Xms%um", profile.heap_min_mb);
+    if (profile.heap_max_mb > 0) rc |= push_arg(cmd, &argc, &used, "-Xmx%um", profile.heap_max_mb);
+    if (profile.cpus > 0)        rc |= push_arg(cmd, &argc, &used, "-XX:ActiveProcessorCount=%u", profile.cpus);
+    if ((size_t)profile.gc < GC_COUNT && gc_flags[profile.gc] != NULL) {
+        rc |= push_arg(cmd, &argc, &used, "%s", gc_flags[profile.gc]);
+    }
+    rc |= push_words(cmd, &argc, &used, profile.jvm_args);
+    rc |= push_arg(cmd, &argc, &used, "-jar");
+    rc |= push_arg(cmd, &argc, &used, "%s", node->path);
+    rc |= push_arg(cmd, &argc, &used, "--server.port=%hu", node->port);
+    rc |= push_words(cmd, &argc, &used, profile.app_args);
+
+    cmd->argv[argc] = NULL;
+    return rc == 0 ? 0 : -1;
+}
@@ -0,0 +1,714 @@
+#include "lb.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set on the socket instead. */
+#endif
+
+/* Listen backlog of a balancer's public socket. */
+#define LB_BACKLOG 511
+
+/* Events handled per wakeup of the proxy thread. */
+#define LB_EVENT_BATCH 64
+
+/* Idle buffers and connection records kept for reuse; the rest are freed. */
+#define LB_POOL_IDLE_MAX 256
+
+/* Module state. */
+static Logger lb_logger;
+static bool   lb_logger_ready = false;
+
+#define LB_LOG(fmt, ...) \
+    do { if (lb_logger_ready) logger_write(&lb_logger, fmt, ##__VA_ARGS__); } while (0)
+
+/* What a registered descriptor belongs to; first member of every object
+ * whose address is stored as event user data. */
+typedef enum { HANDLE_WAKE, HANDLE_LISTENER, HANDLE_CONN } HandleKind;
+
+/* One balancer as derived from the process table by lb_update(). */
+typedef struct LbTarget {
+    char     service[64];
+    uint16_t port;
+    uint16_t backends[LB_MAX_BACKENDS];
+    size_t   backend_count;
+} LbTarget;
+
+typedef struct Balancer {
+    HandleKind kind;
+    LbTarget   target;
+    int        listen_fd;   /* -1 while the slot is unused or the port could not be bound. */
+    uint32_t   generation;  /* Bumped whenever the slot is (re)assigned to a port. */
+    size_t     next;        /* Round-robin cursor into target.backends. */
+    bool       warned_empty;
+} Balancer;
+
+typedef struct LbBuffer {
+    struct LbBuffer *next_free;
+    size_t           off;  /* First byte not yet written to the other side. */
+    size_t           len;  /* Bytes read into data. */
+    unsigned char    data[LB_BUFFER_SIZE];
+} LbBuffer;
+
+enum { SIDE_CLIENT = 0, SIDE_BACKEND = 1 };
+
+typedef struct LbConn {
+    HandleKind     kind;
+    int            fd[2];        /* Indexed by SIDE_*. */
+    LbBuffer      *buf[2];       /* buf[s] holds bytes read from fd[s], bound for fd[!s]. */
+    bool           read_eof[2];  /* fd[s] has nothing more to send. */
+    bool           shut_wr[2];   /* Write side of fd[s] has been shut down. */
+    bool           connecting;   /* Non-blocking connect to the backend in progress. */
+    bool           closed;       /* Closed during the current batch; recycled after it. */
+    Balancer      *balancer;
+    uint32_t       generation;   /* balancer->generation at accept time. */
+    size_t         attempts;     /* Backends tried so far. */
+    struct LbConn *next_free;
+} LbConn;
+
+/* Configuration handed over from the daemon thread, guarded by lb_lock. */
+static pthread_mutex_t lb_lock           = PTHREAD_MUTEX_INITIALIZER;
+static LbTarget        lb_pending[LB_MAX_BALANCERS];
+static size_t          lb_pending_count  = 0;
+static bool            lb_pending_dirty  = false;
+static bool            lb_stopping       = false;
+
+/* Proxy thread state. */
+static pthread_t   lb_thread;
+static bool        lb_running         = false;
+static int         lb_poll_fd         = -1;
+static int         lb_wake_pipe[2]    = { -1, -1 };
+static HandleKind  lb_wake_handle     = HANDLE_WAKE;
+static Balancer    lb_balancers[LB_MAX_BALANCERS];
+static LbBuffer   *lb_free_buffers    = NULL;
+static size_t      lb_free_buffer_count = 0;
+static LbConn     *lb_free_conns      = NULL;
+static size_t      lb_free_conn_count = 0;
+static LbConn     *lb_graveyard       = NULL;
+
+const char *lb_service_of(const ProcessNode *node) {
+    return node->service[0] != '\0' ? node->service : node->name;
+}
+
+/* ------------------------------------------------------------------ */
+/* Pools                                                              */
+/* ------------------------------------------------------------------ */
+
+static LbBuffer *buffer_get(void) {
+    LbBuffer *b = lb_free_buffers;
+    if (b != NULL) {
+        lb_free_buffers = b->next_free;
+        lb_free_buffer_count--;
+    } else if ((b = malloc(sizeof(*b))) == NULL) {
+        return NULL;
+    }
+    b->off = 0;
+    b->len = 0;
+    return b;
+}
+
+static void buffer_put(LbBuffer *b) {
+    if (b == NULL) return;
+    if (lb_free_buffer_count >= LB_POOL_IDLE_MAX) {
+        free(b);
+        return;
+    }
+    b->next_free    = lb_free_buffers;
+    lb_free_buffers = b;
+    lb_free_buffer_count++;
+}
+
+static LbConn *conn_get(void) {
+    LbConn *c = lb_free_conns;
+    if (c != NULL) {
+        lb_free_conns = c->next_free;
+        lb_free_conn_count--;
+    } else if ((c = malloc(sizeof(*c))) == NULL) {
+        return NULL;
+    }
+    memset(c, 0, sizeof(*c));
+    c->kind             = HANDLE_CONN;
+    c->fd[SIDE_CLIENT]  = -1;
+    c->fd[SIDE_BACKEND] = -1;
+    c->buf[SIDE_CLIENT]  = buffer_get();
+    c->buf[SIDE_BACKEND] = buffer_get();
+    if (c->buf[SIDE_CLIENT] == NULL || c->buf[SIDE_BACKEND] == NULL) {
+        buffer_put(c->buf[SIDE_CLIENT]);
+        buffer_put(c->buf[SIDE_BACKEND]);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void conn_put(LbConn *c) {
+    buffer_put(c->buf[SIDE_CLIENT]);
+    buffer_put(c->buf[SIDE_BACKEND]);
+    if (lb_free_conn_count >= LB_POOL_IDLE_MAX) {
+        free(c);
+        return;
+    }
+    c->next_free  = lb_free_conns;
+    lb_free_conns = c;
+    lb_free_conn_count++;
+}
+
+/* ------------------------------------------------------------------ */
+/* Poller: epoll on Linux, kqueue elsewhere                           */
+/* ------------------------------------------------------------------ */
+
+static int poller_open(void) {
+#ifdef __linux__
+    return epoll_create1(EPOLL_CLOEXEC);
+#else
+    int fd = kqueue();
+    if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+#endif
+}
+
+/* Registers @p fd for readability only, level-triggered. */
+static int poller_add_reader(int fd, void *ptr) {
+#ifdef __linux__
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = ptr };
+    return epoll_ctl(lb_poll_fd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    struct kevent ev;
+    EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, ptr);
+    return kevent(lb_poll_fd, &ev, 1, NULL, 0, NULL);
+#endif
+}
+
+/* Registers @p fd for readability and writability, edge-triggered: the
+ * owner must read and write until EAGAIN before waiting again. */
+static int poller_add_stream(int fd, void *ptr) {
+#ifdef __linux__
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = ptr };
+    return epoll_ctl(lb_poll_fd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    struct kevent ev[2];
+    EV_SET(&ev[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, ptr);
+    EV_SET(&ev[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, ptr);
+    return kevent(lb_poll_fd, ev, 2, NULL, 0, NULL);
+#endif
+}
+
+/* Waits for events and stores the user data of each ready descriptor in
+ * @p ready. Closing a descriptor removes its registration. */
+static int poller_wait(void **ready, int max) {
+#ifdef __linux__
+    struct epoll_event ev[LB_EVENT_BATCH];
+    int n = epoll_wait(lb_poll_fd, ev, max < LB_EVENT_BATCH ? max : LB_EVENT_BATCH, -1);
+    for (int i = 0; i < n; i++) ready[i] = ev[i].data.ptr;
+#else
+    struct kevent ev[LB_EVENT_BATCH];
+    int n = kevent(lb_poll_fd, NULL, 0, ev, max < LB_EVENT_BATCH ? max : LB_EVENT_BATCH, NULL);
+    for (int i = 0; i < n; i++) ready[i] = ev[i].udata;
+#endif
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Sockets                                                            */
+/* ------------------------------------------------------------------ */
+
+static int set_nonblock_cloexec(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) return -1;
+    return 0;
+}
+
+static int stream_socket(void) {
+#ifdef SOCK_NONBLOCK
+    return socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && set_nonblock_cloexec(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+static int accept_stream(int listen_fd) {
+#ifdef SOCK_NONBLOCK
+    return accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd >= 0 && set_nonblock_cloexec(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+/* Options for proxied sockets: no Nagle delay, no SIGPIPE on BSD. */
+static void tune_stream(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+static int open_listener(uint16_t port) {
+    int fd = stream_socket();
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, LB_BACKLOG) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* ------------------------------------------------------------------ */
+/* Connections                                                        */
+/* ------------------------------------------------------------------ */
+
+static void conn_close(LbConn *c) {
+    if (c->closed) return;
+    for (int s = 0; s < 2; s++) {
+        if (c->fd[s] >= 0) close(c->fd[s]);
+        c->fd[s] = -1;
+    }
+    c->closed = true;
+    /* Other events of this batch may still point at c; recycle it afterwards. */
+    c->next_free = lb_graveyard;
+    lb_graveyard = c;
+}
+
+/* Starts a non-blocking connect to the balancer's next backend, skipping
+ * backends that refuse immediately. Returns 0 if a connect is underway or
+ * done, -1 once every backend has been tried. */
+static int conn_connect(LbConn *c) {
+    Balancer *b = c->balancer;
+    if (b->generation != c->generation) {
+        return -1; /* The balancer was removed or reassigned since accept. */
+    }
+
+    while (c->attempts < b->target.backend_count) {
+        uint16_t port = b->target.backends[b->next++ % b->target.backend_count];
+        c->attempts++;
+
+        int fd = stream_socket();
+        if (fd < 0) return -1;
+        tune_stream(fd);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+        if (poller_add_stream(fd, c) != 0) {
+            close(fd);
+            return -1;
+        }
+        c->fd[SIDE_BACKEND] = fd;
+        c->connecting       = true;
+        return 0;
+    }
+    return -1;
+}
+
+/* Resolves a pending connect. Returns 1 if connected, 0 if still in
+ * progress, -1 if it failed. */
+static int connect_result(int fd) {
+    struct sockaddr_storage peer;
+    socklen_t               len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &len) == 0) {
+        return 1;
+    }
+    int       err    = 0;
+    socklen_t errlen = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen);
+    return err == 0 ? 0 : -1;
+}
+
+/* Moves bytes from fd[s] to fd[!s] until either side would block. Returns
+ * -1 if the connection failed. */
+static int pump(LbConn *c, int s) {
+    LbBuffer *b   = c->buf[s];
+    int       src = c->fd[s];
+    int       dst = c->fd[!s];
+
+    for (;;) {
+        if (b->off < b->len) {
+            ssize_t n = send(dst, b->data + b->off, b->len - b->off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                return -1;
+            }
+            b->off += (size_t)n;
+            if (b->off < b->len) continue;
+            b->off = 0;
+            b->len = 0;
+        }
+
+        if (c->read_eof[s]) {
+            if (!c->shut_wr[!s]) {
+                shutdown(dst, SHUT_WR);
+                c->shut_wr[!s] = true;
+            }
+            return 0;
+        }
+
+        ssize_t n = recv(src, b->data, sizeof(b->data), 0);
+        if (n > 0) {
+            b->len = (size_t)n;
+        } else if (n == 0) {
+            c->read_eof[s] = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+}
+
+static void conn_handle(LbConn *c) {
+    if (c->closed) return;
+
+    /* Until the backend connect resolves, client bytes wait in the kernel;
+     * the backend's writability event triggers the first pump. */
+    if (c->connecting) {
+        int rc = connect_result(c->fd[SIDE_BACKEND]);
+        if (rc == 0) return;
+        if (rc < 0) {
+            close(c->fd[SIDE_BACKEND]);
+            c->fd[SIDE_BACKEND] = -1;
+            c->connecting       = false;
+            if (conn_connect(c) != 0) {
+                LB_LOG("lb: no replica of '%s' accepted a connection on port %hu",
+                       c->balancer->target.service, c->balancer->target.port);
+                conn_close(c);
+            }
+            return;
+        }
+        c->connecting = false;
+    }
+
+    if (pump(c, SIDE_CLIENT) != 0 || pump(c, SIDE_BACKEND) != 0) {
+        conn_close(c);
+        return;
+    }
+    if (c->read_eof[SIDE_CLIENT] && c->read_eof[SIDE_BACKEND] &&
+        c->buf[SIDE_CLIENT]->len == 0 && c->buf[SIDE_BACKEND]->len == 0) {
+        conn_close(c);
+    }
+}
+
+static void accept_all(Balancer *b) {
+    for (;;) {
+        int fd = accept_stream(b->listen_fd);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LB_LOG("lb: accept on port %hu failed: %s", b->target.port, strerror(errno));
+            }
+            return;
+        }
+
+        if (b->target.backend_count == 0) {
+            if (!b->warned_empty) {
+                LB_LOG("lb: no ready replica of '%s', refusing connections on port %hu",
+                       b->target.service, b->target.port);
+                b->warned_empty = true;
+            }
+            close(fd);
+            continue;
+        }
+
+        LbConn *c = conn_get();
+        if (c == NULL) {
+            close(fd);
+            continue;
+        }
+        tune_stream(fd);
+        c->fd[SIDE_CLIENT] = fd;
+        c->balancer        = b;
+        c->generation      = b->generation;
+
+        if (conn_connect(c) != 0) {
+            LB_LOG("lb: no replica of '%s' accepted a connection on port %hu",
+                   b->target.service, b->target.port);
+            close(fd);
+            c->fd[SIDE_CLIENT] = -1;
+            conn_put(c);
+            continue;
+        }
+        if (poller_add_stream(fd, c) != 0) {
+            conn_close(c);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Proxy thread                                                       */
+/* ------------------------------------------------------------------ */
+
+static void close_balancer(Balancer *b) {
+    if (b->listen_fd >= 0) {
+        close(b->listen_fd);
+        LB_LOG("lb: stopped balancing '%s' on port %hu", b->target.service, b->target.port);
+    }
+    memset(&b->target, 0, sizeof(b->target));
+    b->listen_fd = -1;
+    b->generation++;
+}
+
+/* Makes the balancers match the targets last handed over by lb_update(). */
+static void apply_targets(void) {
+    LbTarget targets[LB_MAX_BALANCERS];
+    size_t   count;
+
+    pthread_mutex_lock(&lb_lock);
+    count = lb_pending_count;
+    memcpy(targets, lb_pending, count * sizeof(targets[0]));
+    lb_pending_dirty = false;
+    pthread_mutex_unlock(&lb_lock);
+
+    /* Close balancers whose port is gone. */
+    for (size_t i = 0; i < LB_MAX_BALANCERS; i++) {
+        Balancer *b = &lb_balancers[i];
+        if (b->target.port == 0) continue;
+        bool keep = false;
+        for (size_t t = 0; t < count && !keep; t++) {
+            keep = targets[t].port == b->target.port;
+        }
+        if (!keep) close_balancer(b);
+    }
+
+    for (size_t t = 0; t < count; t++) {
+        Balancer *b         = NULL;
+        Balancer *free_slot = NULL;
+        for (size_t i = 0; i < LB_MAX_BALANCERS; i++) {
+            if (lb_balancers[i].target.port == targets[t].port) b = &lb_balancers[i];
+            else if (lb_balancers[i].target.port == 0 && free_slot == NULL) free_slot = &lb_balancers[i];
+        }
+        if (b == NULL) {
+            if (free_slot == NULL) break;
+            b = free_slot;
+            b->generation++;
+            b->next = 0;
+        }
+
+        if (b->target.backend_count != targets[t].backend_count ||
+            memcmp(b->target.backends, targets[t].backends,
+                   targets[t].backend_count * sizeof(targets[t].backends[0])) != 0) {
+            LB_LOG("lb: '%s' on port %hu now has %zu ready replica(s)",
+                   targets[t].service, targets[t].port, targets[t].backend_count);
+        }
+        b->target = targets[t];
+        if (b->target.backend_count > 0) b->warned_empty = false;
+
+        /* Retry ports that could not be bound earlier, e.g. still in use. */
+        if (b->listen_fd < 0) {
+            b->listen_fd = open_listener(b->target.port);
+            if (b->listen_fd < 0) {
+                LB_LOG("lb: could not listen on port %hu for '%s': %s",
+                       b->target.port, b->target.service, strerror(errno));
+            } else if (poller_add_reader(b->listen_fd, b) != 0) {
+                LB_LOG("lb: could not watch port %hu: %s", b->target.port, strerror(errno));
+                close(b->listen_fd);
+                b->listen_fd = -1;
+            } else {
+                LB_LOG("lb: balancing '%s' on port %hu", b->target.service, b->target.port);
+            }
+        }
+    }
+}
+
+static void *lb_main(void *arg) {
+    (void)arg;
+    void *ready[LB_EVENT_BATCH];
+
+    for (;;) {
+        int n = poller_wait(ready, LB_EVENT_BATCH);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LB_LOG("lb: waiting for events failed: %s", strerror(errno));
+            break;
+        }
+
+        bool wake = false;
+        for (int i = 0; i < n; i++) {
+            switch (*(HandleKind *)ready[i]) {
+                case HANDLE_WAKE:     wake = true;           break;
+                case HANDLE_LISTENER: accept_all(ready[i]);  break;
+                case HANDLE_CONN:     conn_handle(ready[i]); break;
+            }
+        }
+
+        while (lb_graveyard != NULL) {
+            LbConn *c    = lb_graveyard;
+            lb_graveyard = c->next_free;
+            conn_put(c);
+        }
+
+        if (wake) {
+            unsigned char drain[64];
+            while (read(lb_wake_pipe[0], drain, sizeof(drain)) > 0) {}
+
+            pthread_mutex_lock(&lb_lock);
+            bool stop  = lb_stopping;
+            bool dirty = lb_pending_dirty;
+            pthread_mutex_unlock(&lb_lock);
+
+            if (stop) break;
+            if (dirty) apply_targets();
+        }
+    }
+    return NULL;
+}
+
+int lb_start(const char *logfile_path) {
+    if (lb_running) {
+        return 0;
+    }
+    if (logger_init(&lb_logger, logfile_path, false) == 0) {
+        lb_logger_ready = true;
+    }
+
+    for (size_t i = 0; i < LB_MAX_BALANCERS; i++) {
+        lb_balancers[i].kind      = HANDLE_LISTENER;
+        lb_balancers[i].listen_fd = -1;
+    }
+
+    lb_poll_fd = poller_open();
+    if (lb_poll_fd < 0 || pipe(lb_wake_pipe) != 0 ||
+        set_nonblock_cloexec(lb_wake_pipe[0]) != 0 || set_nonblock_cloexec(lb_wake_pipe[1]) != 0 ||
+        poller_add_reader(lb_wake_pipe[0], &lb_wake_handle) != 0) {
+        LB_LOG("lb: could not set up event loop: %s", strerror(errno));
+        return -1;
+    }
+
+    /* Signals stay with the daemon's own thread. */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    lb_running = pthread_create(&lb_thread, NULL, lb_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (!lb_running) {
+        LB_LOG("lb: could not start proxy thread");
+        return -1;
+    }
+    return 0;
+}
+
+void lb_update(const ProcessTable *table) {
+    if (!lb_running || table == NULL) {
+        return;
+    }
+
+    LbTarget targets[LB_MAX_BALANCERS];
+    size_t   count = 0;
+    memset(targets, 0, sizeof(targets));
+
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *node    = &table->nodes[i];
+        const char        *service = lb_service_of(node);
+        if (node->lb_port == 0) continue;
+
+        size_t t = 0;
+        while (t < count && targets[t].port != node->lb_port) t++;
+        if (t < count) {
+            if (strcmp(targets[t].service, service) != 0) {
+                LB_LOG("lb: port %hu is claimed by both '%s' and '%s', keeping '%s'",
+                       node->lb_port, targets[t].service, service, targets[t].service);
+            }
+            continue;
+        }
+        if (count == LB_MAX_BALANCERS) {
+            LB_LOG("lb: more than %d balancers, ignoring port %hu", LB_MAX_BALANCERS, node->lb_port);
+            continue;
+        }
+        strncpy(targets[count].service, service, sizeof(targets[count].service) - 1);
+        targets[count].port = node->lb_port;
+        count++;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *node = &table->nodes[i];
+        if (!node->running || node->port == 0 || node->readiness != READINESS_READY) continue;
+
+        for (size_t t = 0; t < count; t++) {
+            LbTarget *target = &targets[t];
+            if (strcmp(target->service, lb_service_of(node)) != 0) continue;
+            if (target->backend_count == LB_MAX_BACKENDS) continue;
+            target->backends[target->backend_count++] = node->port;
+        }
+    }
+
+    pthread_mutex_lock(&lb_lock);
+    memcpy(lb_pending, targets, sizeof(lb_pending));
+    lb_pending_count = count;
+    lb_pending_dirty = true;
+    pthread_mutex_unlock(&lb_lock);
+
+    unsigned char b = 1;
+    (void)!write(lb_wake_pipe[1], &b, 1);
+}
+
+void lb_stop(void) {
+    if (!lb_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&lb_lock);
+    lb_stopping = true;
+    pthread_mutex_unlock(&lb_lock);
+
+    unsigned char b = 1;
+    (void)!write(lb_wake_pipe[1], &b, 1);
+    pthread_join(lb_thread, NULL);
+    lb_running = false;
+
+    for (size_t i = 0; i < LB_MAX_BALANCERS; i++) {
+        close_balancer(&lb_balancers[i]);
+    }
+    close(lb_poll_fd);
+    close(lb_wake_pipe[0]);
+    close(lb_wake_pipe[1]);
+    lb_poll_fd      = -1;
+    lb_wake_pipe[0] = -1;
+    lb_wake_pipe[1] = -1;
+    logger_close(&lb_logger);
+    lb_logger_ready = false;
+}
@@ -1,16 +1,182 @@
 #include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <time.h>
+#include <unistd.h>
 
-/* Maximum length of one formatted log line (excluding timestamp prefix). */
-#define LOG_BUF_SIZE 1024
+/* Ring position -> slot index. */
+#define RING_MASK (LOGGER_RING_SLOTS - 1)
+
+/* Maximum number of lines handed to one writev() call. */
+#define WRITE_BATCH 64
+
+/* Loggers closed automatically at exit; see close_all_at_exit(). */
+#define MAX_LIVE_LOGGERS 16
+
+static Logger         *live_loggers[MAX_LIVE_LOGGERS];
+static pthread_mutex_t live_lock       = PTHREAD_MUTEX_INITIALIZER;
+static bool            atexit_hooked   = false;
+
+/*
+ * Writes "[YYYY-MM-DD HH:MM:SS] <message>\n" into buf and returns its length.
+ * The timestamp prefix is cached per thread and reformatted only when the
+ * second changes.
+ */
+static size_t format_line(char *buf, size_t size, const char *format, va_list args) {
+    static _Thread_local time_t cached_sec = (time_t)-1;
+    static _Thread_local char   cached_ts[32];
+    static _Thread_local size_t cached_len;
 
-/* Writes an ISO-8601 timestamp ("YYYY-MM-DD HH:MM:SS") into buf. */
-static void timestamp(char *buf, size_t size) {
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(buf, size, "%Y-%m-%d %H:%M:%S", tm_info);
+    if (now != cached_sec) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        cached_len = strftime(cached_ts, sizeof(cached_ts), "[%Y-%m-%d %H:%M:%S] ", &tm_info);
+        cached_sec = now;
+    }
+    memcpy(buf, cached_ts, cached_len);
+
+    /* Leave room for the newline, which replaces vsnprintf's terminator. */
+    size_t room = size - cached_len - 1;
+    int    n    = vsnprintf(buf + cached_len, room, format, args);
+    size_t len  = cached_len + (n < 0 ? 0 : ((size_t)n < room ? (size_t)n : room - 1));
+    buf[len++]  = '\n';
+    return len;
+}
+
+/* Writes every iovec, retrying on short writes. */
+static bool writev_all(int fd, const struct iovec *src, int count) {
+    struct iovec iov[WRITE_BATCH];
+    memcpy(iov, src, (size_t)count * sizeof(*iov));
+
+    struct iovec *p = iov;
+    while (count > 0) {
+        ssize_t n = writev(fd, p, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (count > 0 && (size_t)n >= p->iov_len) {
+            n -= (ssize_t)p->iov_len;
+            p++;
+            count--;
+        }
+        if (count > 0) {
+            p->iov_base = (char *)p->iov_base + n;
+            p->iov_len -= (size_t)n;
+        }
+    }
+    return true;
+}
+
+/* Writes out one batch of published lines and hands their slots back to
+ * producers. Returns the number of lines written. Writer thread only. */
+static size_t drain(Logger *logger) {
+    struct iovec iov[WRITE_BATCH];
+    size_t       head = atomic_load_explicit(&logger->head, memory_order_relaxed);
+    int          n    = 0;
+
+    while (n < WRITE_BATCH) {
+        LogSlot *slot = &logger->ring[(head + (size_t)n) & RING_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != head + (size_t)n + 1) {
+            break;
+        }
+        iov[n].iov_base = slot->line;
+        iov[n].iov_len  = slot->len;
+        n++;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    if (logger->fd >= 0 && !writev_all(logger->fd, iov, n)) {
+        atomic_fetch_add(&logger->dropped, (uint_least64_t)n);
+    }
+    if (logger->stdout_enabled) {
+        writev_all(STDOUT_FILENO, iov, n);
+    }
+
+    for (int i = 0; i < n; i++) {
+        atomic_store_explicit(&logger->ring[(head + (size_t)i) & RING_MASK].seq,
+                              head + (size_t)i + LOGGER_RING_SLOTS, memory_order_release);
+    }
+    atomic_store_explicit(&logger->head, head + (size_t)n, memory_order_release);
+    return (size_t)n;
+}
+
+static bool ring_empty(Logger *logger) {
+    return atomic_load(&logger->head) == atomic_load(&logger->tail);
+}
+
+static void *writer_main(void *arg) {
+    Logger *logger = arg;
+
+    pthread_mutex_lock(&logger->lock);
+    for (;;) {
+        pthread_mutex_unlock(&logger->lock);
+        while (drain(logger) > 0) {}
+        pthread_mutex_lock(&logger->lock);
+        pthread_cond_broadcast(&logger->drained);
+
+        if (!ring_empty(logger)) {
+            /* A producer has claimed a slot but not published it yet. */
+            continue;
+        }
+        if (atomic_load(&logger->stop)) {
+            break;
+        }
+
+        unsigned        interval = atomic_load(&logger->flush_interval_ms);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += interval / 1000;
+        deadline.tv_nsec += (long)(interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&logger->wake, &logger->lock, &deadline);
+    }
+    pthread_mutex_unlock(&logger->lock);
+    return NULL;
+}
+
+static void close_all_at_exit(void) {
+    Logger *open[MAX_LIVE_LOGGERS];
+
+    pthread_mutex_lock(&live_lock);
+    memcpy(open, live_loggers, sizeof(open));
+    pthread_mutex_unlock(&live_lock);
+
+    for (size_t i = 0; i < MAX_LIVE_LOGGERS; i++) {
+        if (open[i] != NULL) {
+            logger_close(open[i]);
+        }
+    }
+}
+
+static void track_logger(Logger *logger, bool live) {
+    pthread_mutex_lock(&live_lock);
+    if (live && !atexit_hooked) {
+        atexit(close_all_at_exit);
+        atexit_hooked = true;
+    }
+    for (size_t i = 0; i < MAX_LIVE_LOGGERS; i++) {
+        if (live && live_loggers[i] == NULL) {
+            live_loggers[i] = logger;
+            break;
+        }
+        if (!live && live_loggers[i] == logger) {
+            live_loggers[i] = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&live_lock);
 }
 
 int logger_init(Logger *logger, const char *logfile_path, bool stdout_enabled) {
@@ -21,18 +187,43 @@ int logger_init(Logger *logger, const char *logfile_path, bool stdout_enabled) {
 
     memset(logger, 0, sizeof(Logger));
     logger->stdout_enabled = stdout_enabled;
-    logger->logfile        = NULL;
+    logger->fd             = -1;
+
+    for (size_t i = 0; i < LOGGER_RING_SLOTS; i++) {
+        atomic_init(&logger->ring[i].seq, i);
+    }
+    atomic_init(&logger->tail, 0);
+    atomic_init(&logger->head, 0);
+    atomic_init(&logger->dropped, 0);
+    atomic_init(&logger->flush_interval_ms, LOGGER_FLUSH_INTERVAL_MS);
+    atomic_init(&logger->stop, false);
 
     if (logfile_path != NULL && logfile_path[0] != '\0') {
         strncpy(logger->logfile_path, logfile_path, sizeof(logger->logfile_path) - 1);
 
-        logger->logfile = fopen(logfile_path, "a");
-        if (logger->logfile == NULL) {
+        logger->fd = open(logfile_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (logger->fd < 0) {
             fprintf(stderr, "logger_init: could not open log file '%s'\n", logfile_path);
             return -1;
         }
     }
 
+    pthread_mutex_init(&logger->lock, NULL);
+    pthread_cond_init(&logger->wake, NULL);
+    pthread_cond_init(&logger->drained, NULL);
+
+    /* Keep signals on the caller's threads; the daemon relies on its own
+     * handlers running there. */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    logger->threaded = pthread_create(&logger->thread, NULL, writer_main, logger) == 0;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (!logger->threaded) {
+        fprintf(stderr, "logger_init: could not start writer thread, logging synchronously\n");
+    }
+    track_logger(logger, true);
     return 0;
 }
 
@@ -42,26 +233,54 @@ int logger_write(Logger *logger, const char *format, ...) {
         return -1;
     }
 
-    char ts[32];
-    timestamp(ts, sizeof(ts));
-
-    char message[LOG_BUF_SIZE];
     va_list args;
     va_start(args, format);
-    vsnprintf(message, sizeof(message), format, args);
-    va_end(args);
 
-    if (logger->logfile != NULL) {
-        if (fprintf(logger->logfile, "[%s] %s\n", ts, message) < 0) {
+    if (!logger->threaded) {
+        char         line[LOGGER_LINE_SIZE];
+        struct iovec iov = { .iov_base = line, .iov_len = format_line(line, sizeof(line), format, args) };
+        va_end(args);
+
+        if (logger->fd >= 0 && !writev_all(logger->fd, &iov, 1)) {
             fprintf(stderr, "logger_write: failed to write to log file '%s'\n", logger->logfile_path);
             return -1;
         }
+        if (logger->stdout_enabled) {
+            writev_all(STDOUT_FILENO, &iov, 1);
+        }
+        return 0;
     }
 
-    if (logger->stdout_enabled) {
-        printf("[%s] %s\n", ts, message);
+    /* Claim a slot: a free slot's seq equals the ring position being claimed. */
+    size_t   pos = atomic_load_explicit(&logger->tail, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;) {
+        slot = &logger->ring[pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&logger->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos + 1) {
+            /* The writer has not handed this slot back yet: the ring is full. */
+            va_end(args);
+            atomic_fetch_add(&logger->dropped, 1);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&logger->tail, memory_order_relaxed);
+        }
     }
 
+    slot->len = format_line(slot->line, sizeof(slot->line), format, args);
+    va_end(args);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    /* Wake the writer early once half the ring is in use. */
+    if (pos - atomic_load_explicit(&logger->head, memory_order_relaxed) >= LOGGER_RING_SLOTS / 2) {
+        pthread_cond_signal(&logger->wake);
+    }
     return 0;
 }
 
@@ -71,29 +290,63 @@ int logger_flush(Logger *logger) {
         return -1;
     }
 
-    if (logger->logfile != NULL) {
-        if (fflush(logger->logfile) != 0) {
-            fprintf(stderr, "logger_flush: failed to flush log file '%s'\n", logger->logfile_path);
-            return -1;
-        }
+    if (!logger->threaded) {
+        return 0;
     }
 
+    pthread_mutex_lock(&logger->lock);
+    size_t target = atomic_load(&logger->tail);
+    pthread_cond_signal(&logger->wake);
+    while (atomic_load(&logger->head) < target) {
+        pthread_cond_wait(&logger->drained, &logger->lock);
+    }
+    pthread_mutex_unlock(&logger->lock);
     return 0;
 }
 
+void logger_set_flush_interval(Logger *logger, unsigned interval_ms) {
+    if (logger == NULL) {
+        return;
+    }
+    atomic_store(&logger->flush_interval_ms,
+                 interval_ms > 0 ? interval_ms : LOGGER_FLUSH_INTERVAL_MS);
+    if (logger->threaded) {
+        pthread_cond_signal(&logger->wake);
+    }
+}
+
+uint64_t logger_dropped(Logger *logger) {
+    return logger != NULL ? (uint64_t)atomic_load(&logger->dropped) : 0;
+}
+
 int logger_close(Logger *logger) {
     if (logger == NULL) {
         fprintf(stderr, "logger_close: logger argument is NULL\n");
         return -1;
     }
 
-    if (logger->logfile != NULL) {
-        logger_flush(logger);
-        if (fclose(logger->logfile) != 0) {
+    track_logger(logger, false);
+
+    if (logger->threaded) {
+        pthread_mutex_lock(&logger->lock);
+        atomic_store(&logger->stop, true);
+        pthread_cond_signal(&logger->wake);
+        pthread_mutex_unlock(&logger->lock);
+        pthread_join(logger->thread, NULL);
+        logger->threaded = false;
+
+        pthread_cond_destroy(&logger->wake);
+        pthread_cond_destroy(&logger->drained);
+        pthread_mutex_destroy(&logger->lock);
+    }
+
+    if (logger->fd >= 0) {
+        if (close(logger->fd) != 0) {
             fprintf(stderr, "logger_close: failed to close log file '%s'\n", logger->logfile_path);
+            logger->fd = -1;
             return -1;
         }
-        logger->logfile = NULL;
+        logger->fd = -1;
     }
 
     return 0;
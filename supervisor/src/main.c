@@ -5,56 +5,134 @@
  * arguments and dispatches to the appropriate lifecycle command.
  *
  * The supervisor manages Spring Boot JAR processes on a Fiore host.
- * Each managed service is represented as a node in a persistent
- * linked-list process table, serialized to disk so that state survives
- * across invocations.
+ * Each managed service is represented as a fixed-size record in a
+ * persistent, hash-indexed process table, serialized to disk so that
+ * state survives across invocations.
  *
  * Commands
  * --------
  *   start   <name> <jar> [--port <p>] [--restart <policy>]
  *                        [--env <file>] [--log <file>]
- *             Fork and exec a JAR as a detached background process.
+ *                        [--max-restarts <n>] [--stable-after <secs>]
+ *                        [--log-max-size <bytes>[K|M|G]] [--log-rotate <secs>]
+ *                        [--log-keep <n>] [--log-compress]
+ *                        [--max-rss <bytes>[K|M|G]] [--max-cpu <percent>]
+ *                        [--limit-checks <n>] [--on-limit alert|restart]
+ *                        [--memory-max <size>] [--memory-high <size>]
+ *                        [--cpu-quota <percent>] [--cpu-weight <n>]
+ *                        [--io-weight <n>]
+ *                        [--replica-of <service>] [--lb-port <port>]
+ *                        [--listen-socket]
+ *                        [--heap-min <size>] [--heap-max <size>] [--gc <gc>]
+ *                        [--cpus <n>] [--jvm-auto] [--weight <n>]
+ *                        [--jvm-opts "<opts>"] [--app-args "<args>"]
+ *                        [--health-path <path>] [--health-timeout <ms>]
+ *                        [--health-failures <n>] [--health-grace <secs>]
+ *                        [--ready-path <path>] [--ready-interval <ms>]
+ *                        [--ready-timeout <ms>] [--wait-ready [<secs>]]
+ *                        [--stop-sequence <sig>[:<ms>],...]
+ *                        [--pre-stop <path>] [--pre-stop-timeout <ms>]
+ *                        [--depends-on <service>[,<service>...]]
+ *             Fork and exec a JAR as a detached background process. With
+ *             --wait-ready, return only once it passes its readiness probe.
+ *             On Linux the process runs in its own cgroup v2, which
+ *             enforces the --memory-*, --cpu-* and --io-weight limits.
+ *
+ *   start   <name>
+ *             Launch a registered service with its recorded settings.
  *
  *   stop    <name>
- *             Send SIGTERM, escalating to SIGKILL after a grace period.
+ *             Run the service's stop sequence: an optional pre-stop HTTP
+ *             hook, then its signals (default SIGTERM) with their timeouts,
+ *             then SIGKILL.
  *
  *   restart <name>
  *             Stop then re-launch the service, incrementing its restart counter.
  *
+ *   start-all   [<glob>...] [--parallel <n>] [--wait-ready [<secs>]]
+ *   stop-all    [<glob>...] [--parallel <n>]
+ *   restart-all [<glob>...] [--parallel <n>] [--wait-ready [<secs>]]
+ *             Start, stop or restart every service (or those whose name
+ *             matches a glob), n at a time (default 16), all waited on in
+ *             one event loop. With --wait-ready, a service holds its slot
+ *             until it is ready. Services start once their dependencies
+ *             are ready and stop before them.
+ *
+ *   deploy  <service> <jar> [--batch <n>] [--ready-timeout <secs>]
+ *             Replace the service's replicas with a new JAR, n at a time,
+ *             each on a spare port once its replacement is ready; roll
+ *             back if a replacement fails. Rerun to resume after a crash.
+ *
+ *   deploy  <config.yml> [--prune] [--dry-run] [--parallel <n>]
+ *             Make the registered services match a YAML config: create
+ *             missing ones, restart those whose JAR, port, env or log
+ *             file changed, and leave the rest alone. With --prune,
+ *             services not in the config are stopped and removed.
+ *
  *   status  [<name>]
- *             Live status for one service, or a formatted table for all.
+ *             Live status for one service, or a formatted table for all,
+ *             including current CPU% and RSS.
  *
  *   list
  *             List all registered services with their current running state.
  *
  *   monitor
  *             Check every process once and restart any that are down,
- *             according to their configured restart policy. Intended to
- *             be called periodically (e.g. from cron).
+ *             according to their configured restart policy, then check
+ *             running services against their soft RSS/CPU limits.
+ *             Starting services are probed for readiness, and services
+ *             with a health check are probed concurrently and restarted
+ *             once they fail it repeatedly.
+ *             Intended to be called periodically (e.g. from cron).
+ *
+ *   daemon  [--sample-interval <ms>]
+ *             Stay resident as the parent of every launched JAR, reaping
+ *             exits via SIGCHLD and applying restart policies immediately.
+ *             status, list, start <name>, stop and restart are sent to it
+ *             over state/supervisor.sock and answered from its in-memory
+ *             table; other mutating commands are refused while it runs so
+ *             that table stays authoritative.
  *
  *   remove  <name>
- *             Stop the service (if running) and remove it from the table.
+ *             Stop the service (if running), remove its cgroup, and remove
+ *             it from the table.
  *
  * Persistence
  * -----------
- *   The process table is stored as a binary file at state/processes.dat.
- *   It is loaded at startup and written back after every mutating command.
+ *   The process table is stored as a binary snapshot at state/processes.dat
+ *   plus an append-only journal at state/processes.journal, both in a
+ *   versioned, little-endian, fixed-width format. Both are loaded
+ *   at startup; after each command only the records that changed are
+ *   appended to the journal, and the journal is periodically folded into
+ *   a new snapshot that atomically replaces the old one.
  *
  * Logging
  * -------
  *   Internal supervisor events  →  logs/supervisor.log
  *   Process table operations    →  logs/process_table.log
- *   Managed process output      →  path supplied via --log (per service)
+ *   Managed process output      →  path supplied via --log (per service),
+ *                                  rotated by a per-service log pump
  * ============================================================
  */
 
+#include <ctype.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include "cgroup.h"
+#include "control.h"
+#include "daemon.h"
+#include "deploy.h"
+#include "jvm.h"
 #include "process_table.h"
+#include "sampler.h"
+#include "service_log.h"
+#include "status_page.h"
 #include "supervisor.h"
 
 /* ------------------------------------------------------------------ */
@@ -65,13 +143,30 @@ static void usage(const char *argv0) {
     fprintf(stderr,
         "Usage:\n"
         "  %s start   <name> <jar> [--restart never|on-failure|always] [--port <port>] [--env <file>] [--log <file>]\n"
+        "                [--max-restarts <n>] [--stable-after <secs>]\n"
+        "                [--log-max-size <bytes>[K|M|G]] [--log-rotate <secs>] [--log-keep <n>] [--log-compress]\n"
+        "                [--max-rss <bytes>[K|M|G]] [--max-cpu <percent>] [--limit-checks <n>] [--on-limit alert|restart]\n"
+        "                [--memory-max <size>] [--memory-high <size>] [--cpu-quota <percent>]\n"
+        "                [--cpu-weight <n>] [--io-weight <n>]\n"
+        "                [--replica-of <service>] [--lb-port <port>] [--listen-socket]\n"
+        "                [--heap-min <size>] [--heap-max <size>] [--gc default|g1|parallel|serial|zgc|shenandoah]\n"
+        "                [--cpus <n>] [--jvm-auto] [--weight <n>] [--jvm-opts \"<opts>\"] [--app-args \"<args>\"]\n"
+        "                [--health-path <path>] [--health-timeout <ms>] [--health-failures <n>] [--health-grace <secs>]\n"
+        "                [--ready-path <path>] [--ready-interval <ms>] [--ready-timeout <ms>] [--wait-ready [<secs>]]\n"
+        "                [--stop-sequence <sig>[:<ms>],...] [--pre-stop <path>] [--pre-stop-timeout <ms>]\n"
+        "                [--depends-on <service>[,<service>...]]\n"
+        "  %s start   <name>\n"
         "  %s stop    <name>\n"
         "  %s restart <name>\n"
+        "  %s start-all | stop-all | restart-all [<glob>...] [--parallel <n>] [--wait-ready [<secs>]]\n"
+        "  %s deploy  <service> <jar> [--batch <n>] [--ready-timeout <secs>]\n"
+        "  %s deploy  <config.yml> [--prune] [--dry-run] [--parallel <n>]\n"
         "  %s status  [<name>]\n"
         "  %s list\n"
         "  %s monitor\n"
-        "  %s remove  <name>\n",
-        argv0, argv0, argv0, argv0, argv0, argv0, argv0);
+        "  %s remove  <name>\n"
+        "  %s daemon  [--sample-interval <ms>]\n",
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
 }
 
 static RestartPolicy parse_policy(const char *s) {
@@ -83,6 +178,35 @@ static RestartPolicy parse_policy(const char *s) {
     return RESTART_ON_FAILURE;
 }
 
+static LimitAction parse_limit_action(const char *s) {
+    if (strcmp(s, "alert")   == 0) return LIMIT_ALERT;
+    if (strcmp(s, "restart") == 0) return LIMIT_RESTART;
+    fprintf(stderr, "Unknown limit action '%s', defaulting to alert\n", s);
+    return LIMIT_ALERT;
+}
+
+/* Parses a byte count with an optional K, M or G suffix. */
+static uint64_t parse_size(const char *s) {
+    char              *end   = NULL;
+    unsigned long long value = strtoull(s, &end, 10);
+    switch (end != NULL ? *end : '\0') {
+        case 'K': case 'k': return (uint64_t)value << 10;
+        case 'M': case 'm': return (uint64_t)value << 20;
+        case 'G': case 'g': return (uint64_t)value << 30;
+    }
+    return (uint64_t)value;
+}
+
+/* Parses a cpu.weight or io.weight, clamped to what the kernel accepts. */
+static uint16_t parse_weight(const char *s) {
+    unsigned long weight = strtoul(s, NULL, 10);
+    if (weight > CGROUP_MAX_WEIGHT) {
+        fprintf(stderr, "Weight %lu is above the maximum, using %d\n", weight, CGROUP_MAX_WEIGHT);
+        weight = CGROUP_MAX_WEIGHT;
+    }
+    return (uint16_t)weight;
+}
+
 static const char *policy_str(RestartPolicy p) {
     switch (p) {
         case RESTART_NEVER:      return "never";
@@ -92,37 +216,163 @@ static const char *policy_str(RestartPolicy p) {
     return "unknown";
 }
 
-/* Find a node by service name. Returns NULL if not found. */
-static ProcessNode *find_by_name(ProcessNode *head, const char *name) {
-    for (ProcessNode *n = head; n != NULL; n = n->next) {
-        if (strcmp(n->name, name) == 0) return n;
+/* Live state for display: starting (not ready yet), running, draining,
+ * stopped, backoff (restart pending) or crash-loop. */
+static const char *state_str(const ProcessNode *n, bool alive) {
+    if (alive && n->readiness == READINESS_STARTING) return "starting";
+    if (alive && n->readiness == READINESS_DRAINING) return "draining";
+    if (alive)                      return "running";
+    if (n->crash_loop)              return "crash-loop";
+    if (n->next_restart_time != 0)  return "backoff";
+    return "stopped";
+}
+
+/* Formats how the last run ended, e.g. "exit=1", "signal=9", "stopped". */
+static const char *exit_str(const ProcessNode *n, char *buf, size_t size) {
+    if (n->running) return "-";
+    switch (n->exit_reason) {
+        case EXIT_NORMAL:     snprintf(buf, size, "exit=%d", n->exit_status);   return buf;
+        case EXIT_SIGNALED:   snprintf(buf, size, "signal=%d", n->exit_status); return buf;
+        case EXIT_STOPPED:    return "stopped";
+        case EXIT_OOM_KILLED: return "oom-killed";
+        case EXIT_UNKNOWN:    break;
     }
-    return NULL;
+    return "unknown";
 }
 
-static ProcessNode *make_node(const char *name, const char *path, RestartPolicy policy, const uint16_t port, const char *log_path) {
-    ProcessNode *node = calloc(1, sizeof(ProcessNode));
-    if (node == NULL) {
-        fprintf(stderr, "out of memory\n");
-        exit(EXIT_FAILURE);
+/* Formats CPU usage between the last two samples, e.g. "12.5". */
+static const char *cpu_str(const ProcessNode *n, char *buf, size_t size) {
+    double cpu = sampler_cpu_percent(n);
+    if (!n->running || cpu < 0) return "-";
+    snprintf(buf, size, "%.1f", cpu);
+    return buf;
+}
+
+/* Formats the latest resident set size, e.g. "512.3M". */
+static const char *rss_str(const ProcessNode *n, char *buf, size_t size) {
+    const ResourceSample *s = sampler_latest(n);
+    if (!n->running || s == NULL) return "-";
+    double      v     = (double)s->rss_bytes;
+    const char *units = "KMGT";
+    int         u     = -1;
+    while (v >= 1024.0 && u < 3) {
+        v /= 1024.0;
+        u++;
     }
+    if (u < 0) snprintf(buf, size, "%.0fB", v);
+    else       snprintf(buf, size, "%.1f%c", v, units[u]);
+    return buf;
+}
+
+/* Samples @p node (or every running node if NULL) twice, STATUS_SAMPLE_MS
+ * apart, so that CPU usage can be computed over that window. */
+#define STATUS_SAMPLE_MS 200
+static void sample_window(ProcessTable *table, ProcessNode *node) {
+    int sampled = node != NULL ? sampler_sample(node) : sampler_sample_all(table);
+    if (sampled == 0) return;
+
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = STATUS_SAMPLE_MS * 1000000L };
+    nanosleep(&ts, NULL);
+    if (node != NULL) sampler_sample(node);
+    else              sampler_sample_all(table);
+}
+
+static void make_node(ProcessNode *node, const char *name, const char *path, RestartPolicy policy, const uint16_t port, const char *log_path) {
+    memset(node, 0, sizeof(*node));
     strncpy(node->name, name, sizeof(node->name) - 1);
     strncpy(node->path, path, sizeof(node->path) - 1);
     node->restart_policy = policy;
     node->port = port;
     if (log_path != NULL)
         strncpy(node->log_path, log_path, sizeof(node->log_path) - 1);
-    return node;
+}
+
+/* Adds the comma-separated services of @p list to the free slots of
+ * @p deps. Returns -1 if they do not fit. */
+static int parse_dependencies(const char *list, char deps[MAX_DEPENDENCIES][64]) {
+    const char *p = list;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        if (len > 0) {
+            size_t slot = 0;
+            while (slot < MAX_DEPENDENCIES && deps[slot][0] != '\0') slot++;
+            if (slot == MAX_DEPENDENCIES || len >= sizeof(deps[slot])) return -1;
+            memcpy(deps[slot], p, len);
+            deps[slot][len] = '\0';
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    return 0;
+}
+
+/* Checks that @p name may depend on @p deps, printing why not. */
+static bool dependencies_valid(ProcessTable *table, const char *name, char deps[MAX_DEPENDENCIES][64]) {
+    for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+        if (deps[d][0] == '\0') continue;
+        if (strcmp(deps[d], name) == 0) {
+            fprintf(stderr, "start: '%s' cannot depend on itself\n", name);
+            return false;
+        }
+        if (process_find_by_name(table, deps[d]) == NULL) {
+            fprintf(stderr, "start: '%s' depends on unknown service '%s'\n", name, deps[d]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Blocks until a service just started by this process is ready, reporting
+ * the outcome. Returns the exit code of the start command. */
+static int wait_until_ready(ProcessTable *table, ProcessNode *node, unsigned secs) {
+    int rc = supervisor_wait_ready(node, secs);
+    process_table_save(table);
+    if (rc == 0) {
+        printf("'%s' is ready after %lds\n", node->name, (long)(time(NULL) - node->start_time));
+        return 0;
+    }
+    char last_exit[32];
+    if (rc < 0) {
+        fprintf(stderr, "start: '%s' exited before becoming ready (%s)\n",
+                node->name, exit_str(node, last_exit, sizeof(last_exit)));
+    } else {
+        fprintf(stderr, "start: '%s' is not ready after %us\n", node->name, secs);
+    }
+    return 1;
 }
 
 /* ------------------------------------------------------------------ */
 /* Commands                                                            */
 /* ------------------------------------------------------------------ */
 
-static int cmd_start(ProcessNode **head, int argc, char **argv) {
+/* `start <name>`: launches a registered service with its recorded settings. */
+static int cmd_start_registered(ProcessTable *table, const char *name) {
+    ProcessNode *node = process_find_by_name(table, name);
+    if (node == NULL) {
+        fprintf(stderr, "start: service '%s' not found; pass its <jar> to register it\n", name);
+        return 1;
+    }
+    if (supervisor_status(node) == 0) {
+        fprintf(stderr, "start: service '%s' is already running (pid %d)\n", name, node->pid);
+        return 1;
+    }
+    supervisor_reset_backoff(node);
+    if (supervisor_start(node) != 0) {
+        fprintf(stderr, "start: failed to launch '%s'\n", name);
+        return 1;
+    }
+    process_table_save(table);
+    printf("Started '%s' (pid %d, restart=%s)\n", name, node->pid, policy_str(node->restart_policy));
+    return 0;
+}
+
+static int cmd_start(ProcessTable *table, int argc, char **argv) {
     /* start <name> <jar> [--restart <policy>] [--port <port>] [--env <file>] */
+    if (argc == 3) {
+        return cmd_start_registered(table, argv[2]);
+    }
     if (argc < 4) {
-        fprintf(stderr, "start: expected <name> <jar>\n");
+        fprintf(stderr, "start: expected <name> [<jar>]\n");
         return 1;
     }
 
@@ -132,8 +382,52 @@ static int cmd_start(ProcessNode **head, int argc, char **argv) {
     uint16_t       port     = 0;
     const char     *env_path = NULL;
     const char     *log_path = NULL;
+    const char     *service  = NULL;
+    uint16_t       lb_port  = 0;
+    bool           listen   = false;
+    JvmProfile     jvm;
+    memset(&jvm, 0, sizeof(jvm));
+    HealthCheck    health   = { .timeout_ms = DEFAULT_HEALTH_TIMEOUT_MS, .failures = DEFAULT_HEALTH_FAILURES,
+                                .grace_secs = DEFAULT_HEALTH_GRACE_SECS };
+    ReadinessProbe ready    = { .interval_ms = DEFAULT_READY_INTERVAL_MS, .timeout_ms = DEFAULT_READY_TIMEOUT_MS };
+    StopSpec       stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.pre_stop_timeout_ms = DEFAULT_PRE_STOP_TIMEOUT_MS;
+    char           deps[MAX_DEPENDENCIES][64];
+    memset(deps, 0, sizeof(deps));
+    bool           wait     = false;
+    unsigned       wait_secs = DEFAULT_READY_WAIT_SECS;
+    uint32_t       budget   = DEFAULT_RESTART_BUDGET;
+    uint32_t       stable   = DEFAULT_STABLE_SECS;
+    LogRotation    rotation = { .max_bytes = DEFAULT_LOG_MAX_BYTES, .keep = DEFAULT_LOG_KEEP };
+    ResourceLimits limits   = { .checks = DEFAULT_LIMIT_CHECKS, .action = LIMIT_ALERT };
+    CgroupLimits   cgroup;
+    memset(&cgroup, 0, sizeof(cgroup));
 
-    for (int i = 4; i < argc - 1; i++) {
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--log-compress") == 0) {
+            rotation.compress = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--listen-socket") == 0) {
+            listen = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--jvm-auto") == 0) {
+            jvm.auto_size = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--wait-ready") == 0) {
+            /* The timeout is optional. */
+            wait = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                wait_secs = (unsigned) strtoul(argv[++i], NULL, 10);
+            }
+            continue;
+        }
+        if (i + 1 >= argc) {
+            break;
+        }
         if (strcmp(argv[i], "--restart") == 0) {
             policy = parse_policy(argv[i + 1]);
         } else if (strcmp(argv[i], "--port") == 0) {
@@ -142,10 +436,88 @@ static int cmd_start(ProcessNode **head, int argc, char **argv) {
             env_path = argv[i + 1];
         } else if (strcmp(argv[i], "--log") == 0) {
             log_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--max-restarts") == 0) {
+            budget = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--stable-after") == 0) {
+            stable = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--log-max-size") == 0) {
+            rotation.max_bytes = parse_size(argv[i + 1]);
+        } else if (strcmp(argv[i], "--log-rotate") == 0) {
+            rotation.max_age_secs = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--log-keep") == 0) {
+            rotation.keep = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--max-rss") == 0) {
+            limits.rss_max_bytes = parse_size(argv[i + 1]);
+        } else if (strcmp(argv[i], "--max-cpu") == 0) {
+            limits.cpu_max_percent = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--limit-checks") == 0) {
+            limits.checks = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--on-limit") == 0) {
+            limits.action = parse_limit_action(argv[i + 1]);
+        } else if (strcmp(argv[i], "--memory-max") == 0) {
+            cgroup.memory_max = parse_size(argv[i + 1]);
+        } else if (strcmp(argv[i], "--memory-high") == 0) {
+            cgroup.memory_high = parse_size(argv[i + 1]);
+        } else if (strcmp(argv[i], "--cpu-quota") == 0) {
+            cgroup.cpu_quota = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--cpu-weight") == 0) {
+            cgroup.cpu_weight = parse_weight(argv[i + 1]);
+        } else if (strcmp(argv[i], "--io-weight") == 0) {
+            cgroup.io_weight = parse_weight(argv[i + 1]);
+        } else if (strcmp(argv[i], "--replica-of") == 0) {
+            service = argv[i + 1];
+        } else if (strcmp(argv[i], "--lb-port") == 0) {
+            lb_port = (uint16_t) atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--heap-min") == 0) {
+            jvm.heap_min_mb = (uint32_t)(parse_size(argv[i + 1]) >> 20);
+        } else if (strcmp(argv[i], "--heap-max") == 0) {
+            jvm.heap_max_mb = (uint32_t)(parse_size(argv[i + 1]) >> 20);
+        } else if (strcmp(argv[i], "--gc") == 0) {
+            if (jvm_parse_gc(argv[i + 1], &jvm.gc) != 0) {
+                fprintf(stderr, "Unknown garbage collector '%s', leaving the JVM default\n", argv[i + 1]);
+            }
+        } else if (strcmp(argv[i], "--cpus") == 0) {
+            jvm.cpus = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--weight") == 0) {
+            jvm.weight = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--jvm-opts") == 0) {
+            strncpy(jvm.jvm_args, argv[i + 1], sizeof(jvm.jvm_args) - 1);
+        } else if (strcmp(argv[i], "--app-args") == 0) {
+            strncpy(jvm.app_args, argv[i + 1], sizeof(jvm.app_args) - 1);
+        } else if (strcmp(argv[i], "--health-path") == 0) {
+            strncpy(health.path, argv[i + 1], sizeof(health.path) - 1);
+        } else if (strcmp(argv[i], "--health-timeout") == 0) {
+            health.timeout_ms = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--health-failures") == 0) {
+            health.failures = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--health-grace") == 0) {
+            health.grace_secs = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--ready-path") == 0) {
+            strncpy(ready.path, argv[i + 1], sizeof(ready.path) - 1);
+        } else if (strcmp(argv[i], "--ready-interval") == 0) {
+            ready.interval_ms = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--ready-timeout") == 0) {
+            ready.timeout_ms = (uint16_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--stop-sequence") == 0) {
+            if (supervisor_parse_stop_sequence(argv[i + 1], &stop) != 0) {
+                fprintf(stderr, "Invalid stop sequence '%s', keeping SIGTERM then SIGKILL\n", argv[i + 1]);
+            }
+        } else if (strcmp(argv[i], "--pre-stop") == 0) {
+            strncpy(stop.pre_stop_path, argv[i + 1], sizeof(stop.pre_stop_path) - 1);
+        } else if (strcmp(argv[i], "--pre-stop-timeout") == 0) {
+            stop.pre_stop_timeout_ms = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--depends-on") == 0) {
+            if (parse_dependencies(argv[i + 1], deps) != 0) {
+                fprintf(stderr, "start: at most %d dependencies are supported\n", MAX_DEPENDENCIES);
+                return 1;
+            }
         }
     }
+    if (!dependencies_valid(table, name, deps)) {
+        return 1;
+    }
 
-    ProcessNode *existing = find_by_name(*head, name);
+    ProcessNode *existing = process_find_by_name(table, name);
     if (existing != NULL) {
         supervisor_status(existing); /* refresh live state before checking */
         if (existing->running) {
@@ -164,160 +536,653 @@ static int cmd_start(ProcessNode **head, int argc, char **argv) {
         memset(existing->log_path, 0, sizeof(existing->log_path));
         if (log_path != NULL)
             strncpy(existing->log_path, log_path, sizeof(existing->log_path) - 1);
+        existing->restart_budget = budget;
+        existing->stable_secs    = stable;
+        existing->log_rotation   = rotation;
+        existing->limits         = limits;
+        existing->cgroup         = cgroup;
+        existing->lb_port        = lb_port;
+        existing->listen_socket  = listen;
+        existing->jvm            = jvm;
+        existing->health         = health;
+        existing->ready_probe    = ready;
+        existing->stop           = stop;
+        memcpy(existing->depends_on, deps, sizeof(existing->depends_on));
+        char error[256];
+        if (supervisor_check_dependencies(table, error, sizeof(error)) != 0) {
+            fprintf(stderr, "start: %s\n", error);
+            return 1;
+        }
+        memset(existing->service, 0, sizeof(existing->service));
+        if (service != NULL)
+            strncpy(existing->service, service, sizeof(existing->service) - 1);
+        supervisor_reset_backoff(existing);
 
         if (supervisor_start(existing) != 0) {
             fprintf(stderr, "start: failed to re-launch '%s'\n", name);
             return 1;
         }
-        process_table_save(head);
+        process_table_save(table);
         printf("Started '%s' (pid %d, restart=%s%s%s%s%s)\n",
                name, existing->pid, policy_str(policy),
                env_path ? ", env=" : "",
                env_path ? env_path : "",
                log_path ? ", log=" : "",
                log_path ? log_path : "");
-        return 0;
+        return wait ? wait_until_ready(table, existing, wait_secs) : 0;
     }
 
-    ProcessNode *node = make_node(name, jar, policy, port, log_path);
+    ProcessNode node;
+    make_node(&node, name, jar, policy, port, log_path);
     if (env_path != NULL) {
-        strncpy(node->env_path, env_path, sizeof(node->env_path) - 1);
+        strncpy(node.env_path, env_path, sizeof(node.env_path) - 1);
+    }
+    node.restart_budget = budget;
+    node.stable_secs    = stable;
+    node.log_rotation   = rotation;
+    node.limits         = limits;
+    node.cgroup         = cgroup;
+    node.lb_port        = lb_port;
+    node.listen_socket  = listen;
+    node.jvm            = jvm;
+    node.health         = health;
+    node.ready_probe    = ready;
+    node.stop           = stop;
+    memcpy(node.depends_on, deps, sizeof(node.depends_on));
+    if (service != NULL) {
+        strncpy(node.service, service, sizeof(node.service) - 1);
     }
 
     /* Start first so that fork() fills in pid, running, and start_time. */
-    if (supervisor_start(node) != 0) {
+    if (supervisor_start(&node) != 0) {
         fprintf(stderr, "start: failed to launch '%s'\n", name);
-        free(node);
         return 1;
     }
 
     /* Append and persist now that all fields are populated. */
-    process_append(head, node, true);
+    process_append(table, &node, true);
 
     printf("Started '%s' (pid %d, restart=%s%s%s%s%s)\n",
-           name, node->pid, policy_str(policy),
+           name, node.pid, policy_str(policy),
            env_path ? ", env=" : "",
            env_path ? env_path : "",
            log_path ? ", log=" : "",
            log_path ? log_path : "");
-    return 0;
+    return wait ? wait_until_ready(table, process_find_by_name(table, name), wait_secs) : 0;
 }
 
-static int cmd_stop(ProcessNode **head, int argc, char **argv) {
+static int cmd_stop(ProcessTable *table, int argc, char **argv) {
     if (argc < 3) { fprintf(stderr, "stop: expected <name>\n"); return 1; }
     const char *name = argv[2];
 
-    ProcessNode *node = find_by_name(*head, name);
+    ProcessNode *node = process_find_by_name(table, name);
     if (node == NULL) {
         fprintf(stderr, "stop: service '%s' not found\n", name);
         return 1;
     }
 
     supervisor_stop(node);
-    process_table_save(head);
+    process_table_save(table);
 
     printf("Stopped '%s'\n", name);
     return 0;
 }
 
-static int cmd_restart(ProcessNode **head, int argc, char **argv) {
+static int cmd_restart(ProcessTable *table, int argc, char **argv) {
     if (argc < 3) { fprintf(stderr, "restart: expected <name>\n"); return 1; }
     const char *name = argv[2];
 
-    ProcessNode *node = find_by_name(*head, name);
+    ProcessNode *node = process_find_by_name(table, name);
     if (node == NULL) {
         fprintf(stderr, "restart: service '%s' not found\n", name);
         return 1;
     }
 
+    supervisor_reset_backoff(node);
     if (supervisor_restart(node) != 0) {
         fprintf(stderr, "restart: failed for '%s'\n", name);
         return 1;
     }
 
-    process_table_save(head);
+    process_table_save(table);
     printf("Restarted '%s' (pid %d, restarts=%u)\n", name, node->pid, node->restart_count);
     return 0;
 }
 
-static int cmd_status(ProcessNode **head, int argc, char **argv) {
-    if (argc >= 3) {
-        ProcessNode *node = find_by_name(*head, argv[2]);
-        if (node == NULL) {
-            fprintf(stderr, "status: service '%s' not found\n", argv[2]);
-            return 1;
+static int cmd_bulk(ProcessTable *table, int argc, char **argv, BulkAction action) {
+    /* start-all|stop-all|restart-all [<glob>...] [--parallel <n>] [--wait-ready [<secs>]] */
+    const char *cmd       = argv[1];
+    unsigned    parallel  = DEFAULT_BULK_PARALLEL;
+    unsigned    wait_secs = 0;
+    char      **globs     = calloc((size_t)argc, sizeof(*globs));
+    size_t      nglobs    = 0;
+    if (globs == NULL) {
+        fprintf(stderr, "%s: out of memory\n", cmd);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--wait-ready") == 0 && action != BULK_STOP) {
+            wait_secs = DEFAULT_READY_WAIT_SECS;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                wait_secs = (unsigned) strtoul(argv[++i], NULL, 10);
+            }
+        } else if (strcmp(argv[i], "--parallel") == 0 && i + 1 < argc) {
+            parallel = (unsigned) strtoul(argv[++i], NULL, 10);
+        } else {
+            globs[nglobs++] = argv[i];
+        }
+    }
+
+    ProcessNode **nodes = calloc(table->count > 0 ? table->count : 1, sizeof(*nodes));
+    size_t        count = 0;
+    if (nodes == NULL) {
+        fprintf(stderr, "%s: out of memory\n", cmd);
+        free(globs);
+        return 1;
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node  = &table->nodes[i];
+        bool         match = nglobs == 0;
+        for (size_t g = 0; !match && g < nglobs; g++) {
+            match = fnmatch(globs[g], node->name, 0) == 0;
+        }
+        if (!match) continue;
+        if (action != BULK_STOP) supervisor_reset_backoff(node);
+        nodes[count++] = node;
+    }
+    free(globs);
+    char error[256];
+    if (count > 0 && supervisor_check_dependencies(table, error, sizeof(error)) != 0) {
+        fprintf(stderr, "%s: %s\n", cmd, error);
+        free(nodes);
+        return 1;
+    }
+    if (count == 0) {
+        fprintf(stderr, "%s: no service matches\n", cmd);
+        free(nodes);
+        return 1;
+    }
+
+    time_t began  = time(NULL);
+    int    failed = supervisor_bulk(nodes, count, action, parallel, wait_secs);
+    process_table_save(table);
+
+    for (size_t i = 0; i < count; i++) {
+        char last_exit[32];
+        printf("%-20s pid=%-6d %-10s last-exit=%s\n", nodes[i]->name, nodes[i]->pid,
+               state_str(nodes[i], nodes[i]->running),
+               exit_str(nodes[i], last_exit, sizeof(last_exit)));
+    }
+    free(nodes);
+    if (failed != 0) {
+        fprintf(stderr, "%s: %d of %zu services failed; see logs/supervisor.log\n",
+                cmd, failed < 0 ? (int)count : failed, count);
+        return 1;
+    }
+    printf("%s: %zu services done in %lds\n", cmd, count, (long)(time(NULL) - began));
+    return 0;
+}
+
+/* Parses the options of `deploy <config.yml>`. Returns -1 on an unknown one. */
+static int parse_apply_options(int argc, char **argv, ApplyOptions *options) {
+    *options = (ApplyOptions){ .parallel = DEFAULT_BULK_PARALLEL };
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--prune") == 0) {
+            options->prune = true;
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            options->dry_run = true;
+        } else if (strcmp(argv[i], "--parallel") == 0 && i + 1 < argc) {
+            options->parallel = (unsigned) strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "deploy: unknown option '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Parses the options of `deploy <service> <jar>`. */
+static void parse_deploy_options(int argc, char **argv, DeployOptions *options) {
+    *options = (DeployOptions){ .batch = DEFAULT_DEPLOY_BATCH, .ready_timeout_secs = DEFAULT_READY_WAIT_SECS };
+    for (int i = 4; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            options->batch = (unsigned) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ready-timeout") == 0) {
+            options->ready_timeout_secs = (unsigned) strtoul(argv[++i], NULL, 10);
+        }
+    }
+}
+
+/* `deploy <config.yml>`: reconciles the table with a deploy config. */
+static int cmd_deploy_config(ProcessTable *table, int argc, char **argv) {
+    ApplyOptions options;
+    if (parse_apply_options(argc, argv, &options) != 0) {
+        return 1;
+    }
+
+    Config config;
+    char   error[256];
+    if (config_load(argv[2], &config, error, sizeof(error)) != 0) {
+        fprintf(stderr, "deploy: %s: %s\n", argv[2], error);
+        return 1;
+    }
+
+    deploy_logger_init("logs/deploy.log", true);
+    int rc = deploy_apply(table, &config, &options);
+    config_free(&config);
+    if (rc < 0) {
+        fprintf(stderr, "deploy: could not apply %s; see logs/deploy.log\n", argv[2]);
+        return 1;
+    }
+    if (!options.dry_run) process_table_save(table);
+    if (rc > 0) {
+        fprintf(stderr, "deploy: some services failed; see logs/deploy.log\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_deploy(ProcessTable *table, int argc, char **argv) {
+    if (argc < 3) { fprintf(stderr, "deploy: expected <service> <jar> or <config.yml>\n"); return 1; }
+    if (argc < 4 || argv[3][0] == '-') return cmd_deploy_config(table, argc, argv);
+    const char *service = argv[2];
+    const char *jar     = argv[3];
+
+    DeployOptions options;
+    parse_deploy_options(argc, argv, &options);
+
+    deploy_logger_init("logs/deploy.log", true);
+    int rc = deploy_run(table, service, jar, &options);
+    if (rc < 0) {
+        fprintf(stderr, "deploy: could not deploy '%s'; see logs/deploy.log\n", service);
+        return 1;
+    }
+    if (rc > 0) {
+        fprintf(stderr, "deploy: '%s' failed and was rolled back; see logs/deploy.log\n", service);
+        return 1;
+    }
+    printf("Deployed %s to '%s'\n", jar, service);
+    return 0;
+}
+
+/* Prints the status line of one node from its recorded state. */
+static void print_status(ProcessTable *table, ProcessNode *node) {
+    char last_exit[32];
+    printf("%-20s pid=%-6d %-10s restarts=%-4u port=%hu restart-policy=%s last-exit=%s failures=%u",
+           node->name, node->pid,
+           state_str(node, node->running),
+           node->restart_count,
+           node->port,
+           policy_str(node->restart_policy),
+           exit_str(node, last_exit, sizeof(last_exit)),
+           node->failure_count);
+    if (!node->running && node->next_restart_time != 0 && !node->crash_loop) {
+        printf(" next-restart-in=%lds", (long)(node->next_restart_time - time(NULL)));
+    }
+    const ResourceSample *sample = sampler_latest(node);
+    if (node->running && sample != NULL) {
+        char cpu[16], rss[16];
+        printf(" cpu=%s%% rss=%s threads=%u fds=%u",
+               cpu_str(node, cpu, sizeof(cpu)), rss_str(node, rss, sizeof(rss)),
+               sample->threads, sample->fds);
+    }
+    if (node->service[0] != '\0') {
+        printf(" replica-of=%s", node->service);
+    }
+    if (node->lb_port != 0) {
+        printf(" lb-port=%hu", node->lb_port);
+    }
+    if (node->listen_socket) {
+        printf(" listen-socket=yes");
+    }
+    if (node->stop.pre_stop_path[0] != '\0') {
+        printf(" pre-stop=%s/%ums", node->stop.pre_stop_path, node->stop.pre_stop_timeout_ms);
+    }
+    char stop[64];
+    printf(" stop=%s", supervisor_format_stop_sequence(&node->stop, stop, sizeof(stop)));
+    for (size_t d = 0, n = 0; d < MAX_DEPENDENCIES; d++) {
+        if (node->depends_on[d][0] == '\0') continue;
+        printf("%s%s", n++ == 0 ? " depends-on=" : ",", node->depends_on[d]);
+    }
+    if (node->deploy_path[0] != '\0') {
+        printf(" deploying=%s", node->deploy_path);
+    }
+    if (node->previous_path[0] != '\0' && strcmp(node->previous_path, node->path) != 0) {
+        printf(" previous=%s", node->previous_path);
+    }
+    if (node->health.path[0] != '\0') {
+        if (node->health_failures == 0) printf(" health=ok");
+        else printf(" health=failing(%u/%u)", node->health_failures, node->health.failures);
+    }
+    JvmProfile jvm;
+    jvm_effective_profile(table, node, &jvm);
+    if (jvm.heap_max_mb > 0 || jvm.cpus > 0 || jvm.gc != JVM_GC_DEFAULT) {
+        printf(" jvm=");
+        if (jvm.heap_min_mb > 0) printf("Xms%um,", jvm.heap_min_mb);
+        if (jvm.heap_max_mb > 0) printf("Xmx%um,", jvm.heap_max_mb);
+        if (jvm.cpus > 0)        printf("cpus=%u,", jvm.cpus);
+        printf("gc=%s%s", jvm_gc_name(jvm.gc), node->jvm.auto_size ? ",auto" : "");
+    }
+    if (node->limits.rss_max_bytes > 0 || node->limits.cpu_max_percent > 0) {
+        printf(" limits=");
+        if (node->limits.rss_max_bytes > 0) {
+            printf("rss<=%lluK", (unsigned long long)(node->limits.rss_max_bytes >> 10));
+        }
+        if (node->limits.cpu_max_percent > 0) {
+            printf("%scpu<=%u%%", node->limits.rss_max_bytes > 0 ? "," : "",
+                   node->limits.cpu_max_percent);
+        }
+        printf("/%u-checks/%s strikes=%u/%u",
+               node->limits.checks,
+               node->limits.action == LIMIT_RESTART ? "restart" : "alert",
+               node->rss_strikes, node->cpu_strikes);
+    }
+    const CgroupLimits *cg = &node->cgroup;
+    if (cg->memory_max > 0 || cg->memory_high > 0 || cg->cpu_quota > 0 ||
+        cg->cpu_weight > 0 || cg->io_weight > 0) {
+        const char *sep = "";
+        printf(" cgroup=");
+        if (cg->memory_max > 0) {
+            printf("mem<=%lluK", (unsigned long long)(cg->memory_max >> 10));
+            sep = ",";
+        }
+        if (cg->memory_high > 0) {
+            printf("%smem-high=%lluK", sep, (unsigned long long)(cg->memory_high >> 10));
+            sep = ",";
+        }
+        if (cg->cpu_quota > 0) {
+            printf("%scpu<=%u%%", sep, cg->cpu_quota);
+            sep = ",";
+        }
+        if (cg->cpu_weight > 0) {
+            printf("%scpu-weight=%u", sep, cg->cpu_weight);
+            sep = ",";
+        }
+        if (cg->io_weight > 0) {
+            printf("%sio-weight=%u", sep, cg->io_weight);
         }
-        int rc = supervisor_status(node);
-        process_table_save(head);
-        printf("%-20s pid=%-6d %-10s restarts=%-4u port=%hu restart-policy=%s\n",
-               node->name, node->pid,
-               rc == 0 ? "running" : "stopped",
-               node->restart_count,
-               node->port,
-               policy_str(node->restart_policy));
-        return 0;
     }
+    putchar('\n');
+}
 
-    /* Status for all. */
-    if (*head == NULL) { printf("No services registered.\n"); return 0; }
-    printf("%-20s %-8s %-10s %-10s %-6s %s\n", "NAME", "PID", "RUNNING", "RESTARTS", "PORT", "RESTART POLICY");
-    printf("%-20s %-8s %-10s %-10s %-6s %s\n", "----", "---", "-------", "--------", "-----", "--------------");
-    for (ProcessNode *n = *head; n != NULL; n = n->next) {
-        int rc = supervisor_status(n);
-        printf("%-20s %-8d %-10s %-10u %-6hu %s\n",
+/* Prints the status table of every node from its recorded state. */
+static void print_status_all(ProcessTable *table) {
+    if (table->count == 0) { printf("No services registered.\n"); return; }
+    printf("%-20s %-8s %-10s %-10s %-6s %-7s %-8s %-15s %s\n", "NAME", "PID", "STATE", "RESTARTS", "PORT", "CPU%", "RSS", "RESTART POLICY", "LAST EXIT");
+    printf("%-20s %-8s %-10s %-10s %-6s %-7s %-8s %-15s %s\n", "----", "---", "-----", "--------", "-----", "----", "---", "--------------", "---------");
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *n = &table->nodes[i];
+        char last_exit[32], cpu[16], rss[16];
+        printf("%-20s %-8d %-10s %-10u %-6hu %-7s %-8s %-15s %s\n",
                n->name, n->pid,
-               rc == 0 ? "running" : "stopped",
+               state_str(n, n->running),
                n->restart_count,
                n->port,
-               policy_str(n->restart_policy));
+               cpu_str(n, cpu, sizeof(cpu)),
+               rss_str(n, rss, sizeof(rss)),
+               policy_str(n->restart_policy),
+               exit_str(n, last_exit, sizeof(last_exit)));
     }
-    process_table_save(head);
-    return 0;
 }
 
-static int cmd_list(ProcessNode **head) {
-    if (*head == NULL) { printf("No services registered.\n"); return 0; }
+/* Prints the list of every node from its recorded state. */
+static void print_list(ProcessTable *table) {
+    if (table->count == 0) { printf("No services registered.\n"); return; }
     printf("%-20s %-8s %-10s %-10s %s\n", "NAME", "PID", "RUNNING", "RESTARTS", "RESTART POLICY");
     printf("%-20s %-8s %-10s %-10s %s\n", "----", "---", "-------", "--------", "--------------");
-    for (ProcessNode *n = *head; n != NULL; n = n->next) {
-        supervisor_status(n); /* refresh running state via kill(pid, 0) */
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *n = &table->nodes[i];
         printf("%-20s %-8d %-10s %-10u %s\n",
                n->name, n->pid,
                n->running ? "yes" : "no",
                n->restart_count,
                policy_str(n->restart_policy));
     }
-    process_table_save(head);
+}
+
+static int cmd_status(ProcessTable *table, int argc, char **argv) {
+    if (argc >= 3) {
+        ProcessNode *node = process_find_by_name(table, argv[2]);
+        if (node == NULL) {
+            fprintf(stderr, "status: service '%s' not found\n", argv[2]);
+            return 1;
+        }
+        int rc = supervisor_status(node);
+        process_table_save(table);
+        if (rc == 0) sample_window(table, node);
+        print_status(table, node);
+        return 0;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        supervisor_status(&table->nodes[i]);
+    }
+    sample_window(table, NULL);
+    print_status_all(table);
+    process_table_save(table);
+    return 0;
+}
+
+static int cmd_list(ProcessTable *table) {
+    for (size_t i = 0; i < table->count; i++) {
+        supervisor_status(&table->nodes[i]); /* refresh running state via kill(pid, 0) */
+    }
+    print_list(table);
+    process_table_save(table);
     return 0;
 }
 
-static int cmd_monitor(ProcessNode **head) {
-    supervisor_monitor_all(head);
-    process_table_save(head);
+static int cmd_monitor(ProcessTable *table) {
+    supervisor_monitor_all(table);
+    sample_window(table, NULL);
+    supervisor_enforce_limits(table);
+    process_table_save(table);
     return 0;
 }
 
-static int cmd_remove(ProcessNode **head, int argc, char **argv) {
+static int cmd_daemon(ProcessTable *table, int argc, char **argv) {
+    DaemonOptions options = { .sample_interval_ms = DEFAULT_SAMPLE_INTERVAL_MS };
+
+    for (int i = 2; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--sample-interval") == 0) {
+            options.sample_interval_ms = (unsigned) strtoul(argv[i + 1], NULL, 10);
+        }
+    }
+    return daemon_run(table, &options) == 0 ? 0 : 1;
+}
+
+static int cmd_remove(ProcessTable *table, int argc, char **argv) {
     if (argc < 3) { fprintf(stderr, "remove: expected <name>\n"); return 1; }
     const char *name = argv[2];
 
-    ProcessNode *node = find_by_name(*head, name);
+    ProcessNode *node = process_find_by_name(table, name);
     if (node == NULL) {
         fprintf(stderr, "remove: service '%s' not found\n", name);
         return 1;
     }
 
     if (node->running) supervisor_stop(node);
-    process_remove(head, node->pid);
+    cgroup_remove(name);
+    process_remove(table, name);
     printf("Removed '%s'\n", name);
     return 0;
 }
 
+/* Runs `status`, `list`, `start <name>`, `stop` or `restart` through a
+ * running daemon's control socket, so the table file is never rewritten.
+ * Returns the exit code, or -1 if no daemon answered and the command
+ * should run directly. */
+static int cmd_remote(int argc, char **argv) {
+    const char *cmd  = argv[1];
+    const char *name = argc >= 3 ? argv[2] : NULL;
+    ControlOp   op;
+    if      (strcmp(cmd, "status")  == 0 || strcmp(cmd, "list") == 0) op = CONTROL_SNAPSHOT;
+    else if (strcmp(cmd, "start")   == 0 && argc == 3) op = CONTROL_START;
+    else if (strcmp(cmd, "stop")    == 0 && argc >= 3) op = CONTROL_STOP;
+    else if (strcmp(cmd, "restart") == 0 && argc >= 3) op = CONTROL_RESTART;
+    else return -1;
+
+    /* The daemon sends live state only; `status <name>` also shows the
+     * settings, read from the table without taking its lock. */
+    ControlRequest request;
+    ControlReply   reply;
+    ProcessTable   nodes = {0};
+    memset(&request, 0, sizeof(request));
+    request.op = (uint32_t)op;
+    if (op != CONTROL_SNAPSHOT) {
+        strncpy(request.name, name, sizeof(request.name) - 1);
+    } else if (name != NULL && strcmp(cmd, "status") == 0 && !process_load(&nodes, PROCESS_PATH)) {
+        process_table_free(&nodes);
+    }
+    int called = control_call(CONTROL_SOCKET_PATH, &request, &reply, &nodes);
+    if (called != 0) {
+        process_table_free(&nodes);
+        if (called == -1 || op == CONTROL_SNAPSHOT) {
+            return -1; /* no daemon, or a busy one: show the table or status page */
+        }
+        fprintf(stderr, "%s: no reply from the supervisor daemon; see logs/daemon.log\n", cmd);
+        return 1;
+    }
+
+    int          rc   = 0;
+    ProcessNode *node = nodes.count > 0 ? &nodes.nodes[0] : NULL;
+    if (reply.status != CONTROL_OK) {
+        fprintf(stderr, "%s: %s\n", cmd, reply.message);
+        rc = 1;
+    } else if (op == CONTROL_SNAPSHOT && strcmp(cmd, "list") == 0) {
+        print_list(&nodes);
+    } else if (op == CONTROL_SNAPSHOT && name == NULL) {
+        print_status_all(&nodes);
+    } else if (op == CONTROL_SNAPSHOT) {
+        node = process_find_by_name(&nodes, name);
+        if (node == NULL) {
+            fprintf(stderr, "status: service '%s' not found\n", name);
+            rc = 1;
+        } else {
+            print_status(&nodes, node);
+        }
+    } else if (op == CONTROL_STOP) {
+        printf("Stopped '%s'\n", name);
+    } else if (node == NULL) {
+        /* The daemon sends no record once the node is gone, e.g. removed meanwhile. */
+        printf("%s '%s'\n", op == CONTROL_START ? "Started" : "Restarted", name);
+    } else if (op == CONTROL_START) {
+        printf("Started '%s' (pid %d, restart=%s)\n", name, node->pid, policy_str(node->restart_policy));
+    } else {
+        printf("Restarted '%s' (pid %d, restarts=%u)\n", name, node->pid, node->restart_count);
+    }
+    process_table_free(&nodes);
+    return rc;
+}
+
+/* Runs `deploy` in a running daemon, so that its load balancer follows the
+ * replicas as they move. A dry run only reads the table, so it runs here. */
+static int cmd_deploy_remote(int argc, char **argv) {
+    if (argc < 3) { fprintf(stderr, "deploy: expected <service> <jar> or <config.yml>\n"); return 1; }
+
+    ControlRequest request;
+    memset(&request, 0, sizeof(request));
+    const char *path = argv[2];
+    if (argc < 4 || argv[3][0] == '-') {
+        request.op = CONTROL_APPLY;
+        if (parse_apply_options(argc, argv, &request.apply) != 0) {
+            return 1;
+        }
+        if (request.apply.dry_run) {
+            ProcessTable table = {0};
+            supervisor_init(&table, "logs/supervisor.log", false);
+            int rc = 1;
+            if (!process_load(&table, PROCESS_PATH)) {
+                fprintf(stderr, "could not load %s; see logs/process_table.log\n", PROCESS_PATH);
+            } else {
+                rc = cmd_deploy_config(&table, argc, argv); /* read-only: never saved */
+            }
+            process_table_free(&table);
+            return rc;
+        }
+    } else {
+        request.op = CONTROL_DEPLOY;
+        strncpy(request.name, argv[2], sizeof(request.name) - 1);
+        path = argv[3];
+        parse_deploy_options(argc, argv, &request.deploy);
+    }
+    if (strlen(path) >= sizeof(request.path)) {
+        fprintf(stderr, "deploy: path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(request.path, path);
+
+    printf("deploy: running in the supervisor daemon; progress is logged to logs/deploy.log\n");
+    fflush(stdout);
+    ControlReply reply;
+    ProcessTable nodes = {0};
+    int          rc    = control_call(CONTROL_SOCKET_PATH, &request, &reply, &nodes);
+    process_table_free(&nodes);
+    if (rc != 0) {
+        fprintf(stderr, "deploy: no reply from the supervisor daemon; see logs/daemon.log\n");
+        return 1;
+    }
+    if (reply.status != CONTROL_OK) {
+        fprintf(stderr, "deploy: %s\n", reply.message);
+        return 1;
+    }
+    if (request.op == CONTROL_DEPLOY) printf("Deployed %s to '%s'\n", path, request.name);
+    else                              printf("Applied %s\n", path);
+    return 0;
+}
+
+/* Runs `status` or `list` from the status page, for when another command
+ * holds the table. The page has no CPU history or settings, so `status`
+ * shows the table row of each service. Returns the exit code, or -1 if
+ * there is no page. */
+static int cmd_page(int argc, char **argv) {
+    const StatusPage *page = status_page_map(STATUS_PAGE_PATH);
+    if (page == NULL) {
+        return -1;
+    }
+
+    ProcessTable nodes = {0};
+    uint32_t     count = atomic_load_explicit(&page->count, memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+        StatusEntry entry;
+        if (!status_page_read(page, i, &entry)) continue;
+        if (argc >= 3 && strcmp(argv[1], "status") == 0 && strcmp(entry.name, argv[2]) != 0) continue;
+
+        ProcessNode node;
+        memset(&node, 0, sizeof(node));
+        memcpy(node.name, entry.name, sizeof(node.name));
+        status_entry_apply(&entry, &node);
+        process_append(&nodes, &node, false);
+    }
+    status_page_unmap(page);
+
+    int rc = 0;
+    if (argc >= 3 && strcmp(argv[1], "status") == 0 && nodes.count == 0) {
+        fprintf(stderr, "status: service '%s' not found\n", argv[2]);
+        rc = 1;
+    } else if (strcmp(argv[1], "list") == 0) {
+        print_list(&nodes);
+    } else {
+        print_status_all(&nodes);
+    }
+    process_table_free(&nodes);
+    return rc;
+}
+
 /* ------------------------------------------------------------------ */
 /* Entry point                                                        */
 /* ------------------------------------------------------------------ */
 
 int main(int argc, char **argv) {
+    /* Helper processes the supervisor starts from its own binary. */
+    if (argc >= 2 && strcmp(argv[1], SERVICE_LOG_PUMP_COMMAND) == 0) {
+        return service_log_pump(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], SUPERVISOR_EXEC_COMMAND) == 0) {
+        return supervisor_exec_gate(argc, argv);
+    }
+
     puts("\n=============================== FIORE SUPERVISOR ===============================\n");
     if (argc < 2) { usage(argv[0]); return 1; }
 
@@ -325,22 +1190,65 @@ int main(int argc, char **argv) {
         printf("arg[%d] = %s\n", i, argv[i]);
     } puts("");
 
-    ProcessNode *head = NULL;
+    /* A running daemon answers from memory in one round trip. */
+    int remote = cmd_remote(argc, argv);
+    if (remote >= 0) {
+        return remote;
+    }
+
+    const char *cmd       = argv[1];
+    bool        read_only = strcmp(cmd, "status") == 0 || strcmp(cmd, "list") == 0;
+
+    /* A running daemon owns the table in memory; direct mutations would be lost. */
+    if (!read_only) {
+        pid_t dpid = 0;
+        if (daemon_running(&dpid)) {
+            if (strcmp(cmd, "deploy") == 0) return cmd_deploy_remote(argc, argv);
+            fprintf(stderr, "%s: supervisor daemon is running (pid %d); stop it first\n",
+                    cmd, dpid);
+            return 1;
+        }
+    }
+
+    ProcessTable table = {0};
 
     process_table_logger_init("logs/process_table.log", false);
-    supervisor_init(&head, "logs/supervisor.log", false);
+    service_log_logger_init("logs/service_log.log", false);
+    supervisor_init(&table, "logs/supervisor.log", false);
 
-    process_load(&head, PROCESS_PATH);
+    /* Writers take turns on the table. status and list never wait for one:
+     * they show the status page it publishes, or the table read-only. */
+    if (!process_table_lock(&table, false)) {
+        if (read_only) {
+            int rc = cmd_page(argc, argv);
+            if (rc >= 0) return rc;
+        } else {
+            fprintf(stderr, "%s: waiting for another command to finish\n", cmd);
+            if (!process_table_lock(&table, true)) {
+                fprintf(stderr, "could not lock %s; see logs/process_table.log\n", PROCESS_LOCK_PATH);
+                return 1;
+            }
+        }
+    }
 
-    const char *cmd = argv[1];
+    /* Never run against a table that failed validation: the next save would overwrite it. */
+    if (!process_load(&table, PROCESS_PATH)) {
+        fprintf(stderr, "could not load %s; see logs/process_table.log\n", PROCESS_PATH);
+        return 1;
+    }
 
-    if      (strcmp(cmd, "start")   == 0) return cmd_start(&head, argc, argv);
-    else if (strcmp(cmd, "stop")    == 0) return cmd_stop(&head, argc, argv);
-    else if (strcmp(cmd, "restart") == 0) return cmd_restart(&head, argc, argv);
-    else if (strcmp(cmd, "status")  == 0) return cmd_status(&head, argc, argv);
-    else if (strcmp(cmd, "list")    == 0) return cmd_list(&head);
-    else if (strcmp(cmd, "monitor") == 0) return cmd_monitor(&head);
-    else if (strcmp(cmd, "remove")  == 0) return cmd_remove(&head, argc, argv);
+    if      (strcmp(cmd, "start")   == 0) return cmd_start(&table, argc, argv);
+    else if (strcmp(cmd, "stop")    == 0) return cmd_stop(&table, argc, argv);
+    else if (strcmp(cmd, "restart") == 0) return cmd_restart(&table, argc, argv);
+    else if (strcmp(cmd, "start-all")   == 0) return cmd_bulk(&table, argc, argv, BULK_START);
+    else if (strcmp(cmd, "stop-all")    == 0) return cmd_bulk(&table, argc, argv, BULK_STOP);
+    else if (strcmp(cmd, "restart-all") == 0) return cmd_bulk(&table, argc, argv, BULK_RESTART);
+    else if (strcmp(cmd, "deploy")  == 0) return cmd_deploy(&table, argc, argv);
+    else if (strcmp(cmd, "status")  == 0) return cmd_status(&table, argc, argv);
+    else if (strcmp(cmd, "list")    == 0) return cmd_list(&table);
+    else if (strcmp(cmd, "monitor") == 0) return cmd_monitor(&table);
+    else if (strcmp(cmd, "remove")  == 0) return cmd_remove(&table, argc, argv);
+    else if (strcmp(cmd, "daemon")  == 0) return cmd_daemon(&table, argc, argv);
     else {
         fprintf(stderr, "Unknown command '%s'\n\n", cmd);
         usage(argv[0]);
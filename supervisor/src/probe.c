@@ -0,0 +1,311 @@
+#include "probe.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef enum { PHASE_CONNECTING, PHASE_SENDING, PHASE_READING, PHASE_DONE } Phase;
+
+/* Per-probe state of a batch. */
+typedef struct ProbeState {
+    int       fd;
+    Phase     phase;
+    long long deadline;
+    char      request[256];
+    size_t    request_len;
+    size_t    sent;
+    char      response[32]; /* "HTTP/1.1 200" is all that is read. */
+    size_t    received;
+} ProbeState;
+
+/* Monotonic clock in milliseconds. */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+const char *probe_result_str(ProbeResult result) {
+    switch (result) {
+        case PROBE_OK:      return "ok";
+        case PROBE_BAD:     return "bad-status";
+        case PROBE_REFUSED: return "refused";
+        case PROBE_TIMEOUT: return "timeout";
+        case PROBE_ERROR:   return "error";
+    }
+    return "unknown";
+}
+
+static void finish(Probe *probe, ProbeState *state, ProbeResult result) {
+    if (state->fd >= 0) close(state->fd);
+    state->fd     = -1;
+    state->phase  = PHASE_DONE;
+    probe->result = result;
+}
+
+static bool tcp_only(const Probe *probe) {
+    return probe->path == NULL || probe->path[0] == '\0';
+}
+
+static void start(Probe *probe, ProbeState *state, long long now) {
+    state->deadline    = now + probe->timeout_ms;
+    state->sent        = 0;
+    state->received    = 0;
+    state->request_len = (size_t)snprintf(state->request, sizeof(state->request),
+                                          "%s %s HTTP/1.0\r\nHost: localhost\r\n"
+                                          "User-Agent: fiore-supervisor\r\nContent-Length: 0\r\n\r\n",
+                                          probe->method != NULL ? probe->method : "GET",
+                                          tcp_only(probe) ? "/" : probe->path);
+    if (state->request_len >= sizeof(state->request)) {
+        finish(probe, state, PROBE_ERROR);
+        return;
+    }
+
+    state->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (state->fd < 0 || fcntl(state->fd, F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(state->fd, F_SETFD, FD_CLOEXEC) != 0) {
+        finish(probe, state, PROBE_ERROR);
+        return;
+    }
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(state->fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(probe->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(state->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        state->phase = PHASE_SENDING;
+        if (tcp_only(probe)) finish(probe, state, PROBE_OK);
+    } else if (errno == EINPROGRESS) {
+        state->phase = PHASE_CONNECTING;
+    } else {
+        finish(probe, state, errno == ECONNREFUSED ? PROBE_REFUSED : PROBE_ERROR);
+    }
+}
+
+/* Parses "HTTP/x.y NNN" once enough of the status line has arrived, or
+ * at end of stream. */
+static void check_status(Probe *probe, ProbeState *state, bool eof) {
+    char *sp = memchr(state->response, ' ', state->received);
+    if (sp == NULL || state->response + state->received - sp < 4) {
+        if (eof || state->received == sizeof(state->response)) {
+            finish(probe, state, PROBE_ERROR);
+        }
+        return;
+    }
+    if (strncmp(state->response, "HTTP/", 5) != 0) {
+        finish(probe, state, PROBE_ERROR);
+        return;
+    }
+    probe->status = atoi(sp + 1);
+    finish(probe, state, probe->status >= 200 && probe->status < 300 ? PROBE_OK : PROBE_BAD);
+}
+
+/* Advances one probe after poll() reported @p revents on it. */
+static void step(Probe *probe, ProbeState *state, short revents) {
+    if (state->phase == PHASE_CONNECTING) {
+        int       err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(state->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            finish(probe, state, err == ECONNREFUSED ? PROBE_REFUSED : PROBE_ERROR);
+            return;
+        }
+        if (!(revents & POLLOUT)) return;
+        state->phase = PHASE_SENDING;
+        if (tcp_only(probe)) {
+            finish(probe, state, PROBE_OK);
+            return;
+        }
+    }
+
+    if (state->phase == PHASE_SENDING) {
+        ssize_t n = send(state->fd, state->request + state->sent,
+                         state->request_len - state->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                finish(probe, state, PROBE_REFUSED);
+            }
+            return;
+        }
+        state->sent += (size_t)n;
+        if (state->sent == state->request_len) {
+            state->phase = PHASE_READING;
+        }
+        return;
+    }
+
+    if (state->phase == PHASE_READING) {
+        ssize_t n = recv(state->fd, state->response + state->received,
+                         sizeof(state->response) - state->received, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                finish(probe, state, PROBE_REFUSED);
+            }
+            return;
+        }
+        state->received += (size_t)n;
+        check_status(probe, state, n == 0);
+    }
+}
+
+/* Probes of a batch in flight. */
+struct ProbeBatch {
+    Probe      *probes;
+    ProbeState *states;
+    size_t      count;
+    size_t      active; /* Probes not done yet. */
+};
+
+ProbeBatch *probe_begin(Probe *probes, size_t count) {
+    ProbeBatch *batch = calloc(1, sizeof(*batch));
+    ProbeState *states = calloc(count > 0 ? count : 1, sizeof(*states));
+    if (batch == NULL || states == NULL) {
+        free(batch);
+        free(states);
+        return NULL;
+    }
+    batch->probes = probes;
+    batch->states = states;
+    batch->count  = count;
+
+    long long now = now_ms();
+    for (size_t i = 0; i < count; i++) {
+        probes[i].status = 0;
+        states[i].fd     = -1;
+        start(&probes[i], &states[i], now);
+        if (states[i].phase != PHASE_DONE) batch->active++;
+    }
+    return batch;
+}
+
+size_t probe_pollfds(const ProbeBatch *batch, struct pollfd *pfds, long long *wake) {
+    if (batch->active == 0) {
+        long long now = now_ms(); /* done: nothing to wait for before probe_advance() */
+        if (now < *wake) *wake = now;
+        return 0;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        const ProbeState *s = &batch->states[i];
+        if (s->phase == PHASE_DONE) continue;
+        pfds[n].fd      = s->fd;
+        pfds[n].events  = s->phase == PHASE_READING ? POLLIN : POLLOUT;
+        pfds[n].revents = 0;
+        n++;
+        if (s->deadline < *wake) *wake = s->deadline;
+    }
+    return n;
+}
+
+bool probe_advance(ProbeBatch *batch) {
+    if (batch->active == 0) {
+        return true;
+    }
+
+    /* Look at every socket without waiting; the caller already did. */
+    struct pollfd *pfds  = calloc(batch->active, sizeof(*pfds));
+    size_t        *index = calloc(batch->active, sizeof(*index));
+    if (pfds == NULL || index == NULL) {
+        for (size_t i = 0; i < batch->count; i++) {
+            if (batch->states[i].phase != PHASE_DONE) finish(&batch->probes[i], &batch->states[i], PROBE_ERROR);
+        }
+        batch->active = 0;
+        free(pfds);
+        free(index);
+        return true;
+    }
+
+    long long now    = now_ms();
+    size_t    active = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        ProbeState *s = &batch->states[i];
+        if (s->phase == PHASE_DONE) continue;
+        if (now >= s->deadline) {
+            finish(&batch->probes[i], s, PROBE_TIMEOUT);
+            continue;
+        }
+        pfds[active].fd      = s->fd;
+        pfds[active].events  = s->phase == PHASE_READING ? POLLIN : POLLOUT;
+        pfds[active].revents = 0;
+        index[active++]      = i;
+    }
+
+    int rc = active > 0 ? poll(pfds, (nfds_t)active, 0) : 0;
+    for (size_t a = 0; rc > 0 && a < active; a++) {
+        if (pfds[a].revents != 0) {
+            step(&batch->probes[index[a]], &batch->states[index[a]], pfds[a].revents);
+        }
+    }
+
+    batch->active = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->states[i].phase != PHASE_DONE) batch->active++;
+    }
+    free(pfds);
+    free(index);
+    return batch->active == 0;
+}
+
+size_t probe_end(ProbeBatch *batch) {
+    if (batch == NULL) {
+        return 0;
+    }
+    size_t ok = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->states[i].phase != PHASE_DONE) finish(&batch->probes[i], &batch->states[i], PROBE_ERROR);
+        if (batch->probes[i].result == PROBE_OK) ok++;
+    }
+    free(batch->states);
+    free(batch);
+    return ok;
+}
+
+size_t probe_run(Probe *probes, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    ProbeBatch    *batch = probe_begin(probes, count);
+    struct pollfd *pfds  = calloc(count, sizeof(*pfds));
+    if (batch == NULL || pfds == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            probes[i].result = PROBE_ERROR;
+            probes[i].status = 0;
+        }
+        if (batch != NULL) probe_end(batch);
+        free(pfds);
+        return 0;
+    }
+
+    /* Sleep until a socket is ready or the nearest deadline, then advance. */
+    while (!probe_advance(batch)) {
+        long long wake   = LLONG_MAX;
+        size_t    active = probe_pollfds(batch, pfds, &wake);
+        long long wait   = wake - now_ms();
+        if (wait > 0 && poll(pfds, (nfds_t)active, wait > INT_MAX ? INT_MAX : (int)wait) < 0 &&
+            errno != EINTR) {
+            break;
+        }
+    }
+
+    free(pfds);
+    return probe_end(batch);
+}
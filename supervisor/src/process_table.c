@@ -1,7 +1,21 @@
 #include "process_table.h"
+#include "status_page.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Initial node capacity of an empty table. */
+#define TABLE_MIN_CAPACITY 16
+
+/* Marks an empty index slot. Occupied slots hold node position + 1. */
+#define SLOT_EMPTY 0u
 
 /* Module-level logger — initialised via process_table_logger_init(). */
 static Logger pt_logger;
@@ -11,19 +25,201 @@ static bool   pt_logger_ready = false;
 #define PT_LOG(fmt, ...) \
     do { if (pt_logger_ready) logger_write(&pt_logger, fmt, ##__VA_ARGS__); } while (0)
 
-/* On-disk record layout — excludes the linked-list pointer. */
+/* ------------------------------------------------------------------ */
+/* On-disk format                                                     */
+/* ------------------------------------------------------------------ */
+
+/*
+ * processes.dat is a header followed by `count` records of `record_size`
+ * bytes each. Every field has a fixed width and is stored little-endian,
+ * so the file reads the same whatever the compiler's padding, time_t, pid_t
+ * or enum width. Later versions only ever append fields to a record: a
+ * record shorter than RECORD_SIZE is zero-extended on load.
+ *
+ *   header   0 magic u32          4 version u16       6 header_size u16
+ *            8 record_size u32   12 count u32        16 checksum u64
+ *           24 reserved (zero)
+ *
+ * The checksum is FNV-1a 64 over all record bytes.
+ */
+#define SNAPSHOT_MAGIC       0x5450467fu /* "\x7f" "FPT" */
+#define FORMAT_VERSION       12u
+#define SNAPSHOT_HEADER_SIZE 32u
+
+/* Field offsets within a record. Version 2 appended the log rotation
+ * fields, version 3 the soft resource limits, version 4 the load
+ * balancer fields, version 5 the listen socket flag, version 6 the JVM
+ * launch profile, version 7 the health check, version 8 readiness,
+ * version 9 rolling deploys, version 10 the stop sequence, version 11
+ * dependencies, version 12 the cgroup limits. */
+enum {
+    REC_NAME              = 0,   /* char[64]  */
+    REC_PATH              = 64,  /* char[256] */
+    REC_ENV_PATH          = 320, /* char[256] */
+    REC_LOG_PATH          = 576, /* char[256] */
+    REC_PID               = 832, /* i32 */
+    REC_PORT              = 836, /* u16 */
+    REC_RESTART_POLICY    = 838, /* u8  */
+    REC_RUNNING           = 839, /* u8  */
+    REC_START_TIME        = 840, /* i64 */
+    REC_RESTART_COUNT     = 848, /* u32 */
+    REC_EXIT_REASON       = 852, /* u8  */
+    REC_CRASH_LOOP        = 853, /* u8; 854..855 reserved */
+    REC_EXIT_STATUS       = 856, /* i32 */
+    REC_RESTART_BUDGET    = 860, /* u32 */
+    REC_STABLE_SECS       = 864, /* u32 */
+    REC_FAILURE_COUNT     = 868, /* u32 */
+    REC_NEXT_RESTART_TIME = 872, /* i64 */
+    REC_LOG_MAX_BYTES     = 880, /* u64 */
+    REC_LOG_MAX_AGE_SECS  = 888, /* u32 */
+    REC_LOG_KEEP          = 892, /* u16 */
+    REC_LOG_COMPRESS      = 894, /* u8; 895 reserved */
+    REC_RSS_MAX_BYTES     = 896, /* u64 */
+    REC_CPU_MAX_PERCENT   = 904, /* u32 */
+    REC_LIMIT_CHECKS      = 908, /* u16 */
+    REC_LIMIT_ACTION      = 910, /* u8; 911 reserved */
+    REC_RSS_STRIKES       = 912, /* u16 */
+    REC_CPU_STRIKES       = 914, /* u16 */
+    REC_SERVICE           = 916, /* char[64] */
+    REC_LB_PORT           = 980, /* u16 */
+    REC_LISTEN_SOCKET     = 982, /* u8; 983 reserved */
+    REC_HEAP_MIN_MB       = 984, /* u32 */
+    REC_HEAP_MAX_MB       = 988, /* u32 */
+    REC_JVM_CPUS          = 992, /* u16 */
+    REC_JVM_GC            = 994, /* u8  */
+    REC_JVM_AUTO          = 995, /* u8  */
+    REC_JVM_WEIGHT        = 996, /* u16; 998..999 reserved */
+    REC_JVM_ARGS          = 1000, /* char[256] */
+    REC_APP_ARGS          = 1256, /* char[256] */
+    REC_HEALTH_PATH       = 1512, /* char[96] */
+    REC_HEALTH_TIMEOUT_MS = 1608, /* u16 */
+    REC_HEALTH_FAILURES   = 1610, /* u16 */
+    REC_HEALTH_GRACE_SECS = 1612, /* u16 */
+    REC_HEALTH_STRIKES    = 1614, /* u16 */
+    REC_READY_PATH        = 1616, /* char[96] */
+    REC_READY_INTERVAL_MS = 1712, /* u16 */
+    REC_READY_TIMEOUT_MS  = 1714, /* u16 */
+    REC_READINESS         = 1716, /* u8; 1717 reserved */
+    REC_PREVIOUS_PATH     = 1718, /* char[256] */
+    REC_DEPLOY_PATH       = 1974, /* char[256] */
+    REC_DEPLOY_PID        = 2230, /* i32 */
+    REC_DEPLOY_PORT       = 2234, /* u16 */
+    REC_PRE_STOP_PATH     = 2236, /* char[96] */
+    REC_PRE_STOP_TIMEOUT  = 2332, /* u32 */
+    REC_STOP_STEP_COUNT   = 2336, /* u8; 2337 reserved */
+    REC_STOP_STEPS        = 2338, /* 3 x { u8 signal, u8 reserved, u32 timeout_ms } */
+    REC_DEPENDS_ON        = 2356, /* 8 x char[64] */
+    REC_CG_MEMORY_MAX     = 2868, /* u64 */
+    REC_CG_MEMORY_HIGH    = 2876, /* u64 */
+    REC_CG_CPU_QUOTA      = 2884, /* u32 */
+    REC_CG_CPU_WEIGHT     = 2888, /* u16 */
+    REC_CG_IO_WEIGHT      = 2890, /* u16 */
+    RECORD_SIZE           = 2892
+};
+
+/* One encoded record — excludes runtime-only fields. */
+typedef struct {
+    unsigned char bytes[RECORD_SIZE];
+} ProcessRecord;
+
+/* Journal operations. */
+#define JOURNAL_PUT 1u /* Insert or overwrite the record with this name. */
+#define JOURNAL_DEL 2u /* Remove the record with this name. */
+
+/* Marks the start of every journal entry ("\x7f" "FJN"). */
+#define JOURNAL_MAGIC 0x4e4a467fu
+
+/* The journal is folded into a fresh snapshot once it holds more than this
+ * many entries and more than twice as many entries as the table has nodes. */
+#define JOURNAL_COMPACT_MIN 64
+
+/*
+ * One journal entry: a full record plus a checksum, so that replay can
+ * detect a torn write at the tail and applying an entry twice is harmless.
+ *
+ *   entry    0 magic u32          4 op u16            6 record_size u16
+ *            8 checksum u64      16 record
+ *
+ * The checksum covers op, record_size and the record bytes.
+ */
+#define JOURNAL_HEADER_SIZE 16u
+
+typedef struct {
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    ProcessRecord record;
+} JournalEntry;
+
+_Static_assert(sizeof(ProcessRecord) == RECORD_SIZE, "ProcessRecord must not be padded");
+_Static_assert(REC_STOP_STEPS + STOP_MAX_STEPS * 6 == REC_DEPENDS_ON, "stop steps must not overlap");
+_Static_assert(REC_DEPENDS_ON + MAX_DEPENDENCIES * 64 == REC_CG_MEMORY_MAX, "dependencies must not overlap");
+_Static_assert(REC_CG_IO_WEIGHT + 2 == RECORD_SIZE, "cgroup limits must fill the record");
+_Static_assert(sizeof(JournalEntry) == JOURNAL_HEADER_SIZE + RECORD_SIZE,
+               "JournalEntry must not be padded");
+
+/*
+ * Raw layouts written before the versioned format: native struct dumps,
+ * only read so that an existing table can be upgraded in place. They carry
+ * no version, so the layout is inferred from the file (see snapshot_load).
+ */
+
+/* Fields every raw layout starts with, in their declaration order. */
+#define LEGACY_COMMON_FIELDS        \
+    char          name[64];         \
+    char          path[256];        \
+    char          env_path[256];    \
+    char          log_path[256];    \
+    uint16_t      port;             \
+    pid_t         pid;              \
+    RestartPolicy restart_policy;   \
+    bool          running;          \
+    time_t        start_time;       \
+    uint32_t      restart_count;
+
+/* Layout of the released supervisor (864 bytes on LP64). */
+typedef struct {
+    LEGACY_COMMON_FIELDS
+} LegacyRecord;
+
+/* Layout of development builds that appended the exit status. */
+typedef struct {
+    LEGACY_COMMON_FIELDS
+    ExitReason    exit_reason;
+    int           exit_status;
+} LegacyExitRecord;
+
+/* Layout of development builds that added exit status and restart backoff
+ * to the raw dump; also the record of their journal entries. */
+typedef struct {
+    LEGACY_COMMON_FIELDS
+    ExitReason    exit_reason;
+    int           exit_status;
+    uint32_t      restart_budget;
+    uint32_t      stable_secs;
+    uint32_t      failure_count;
+    time_t        next_restart_time;
+    bool          crash_loop;
+} LegacyBackoffRecord;
+
+/* Layout of the first development builds, which dumped the list node
+ * itself, next pointer included (352 bytes on LP64). */
 typedef struct {
     char          name[64];
     char          path[256];
-    char          env_path[256];
-    char          log_path[256];
-    uint16_t      port;
     pid_t         pid;
     RestartPolicy restart_policy;
     bool          running;
     time_t        start_time;
-    uint32_t      restart_count;
-} ProcessRecord;
+    void         *next;
+} LegacyNodeRecord;
+
+#define LEGACY_JOURNAL_MAGIC 0x4c4e4a46u /* "FJNL" */
+
+typedef struct {
+    uint32_t            magic;
+    uint32_t            op;
+    uint64_t            checksum;
+    LegacyBackoffRecord record;
+} LegacyJournalEntry;
 
 int process_table_logger_init(const char *logfile_path, bool stdout_enabled) {
     int rc = logger_init(&pt_logger, logfile_path, stdout_enabled);
@@ -33,173 +229,1012 @@ int process_table_logger_init(const char *logfile_path, bool stdout_enabled) {
     return rc;
 }
 
-static void file_update_content(ProcessNode **head) {
-    FILE *fptr = fopen(PROCESS_PATH, "wb");
-    if (fptr == NULL) {
-        PT_LOG("file_update_content: could not open %s for writing", PROCESS_PATH);
-        return;
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint16_t get_u16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static void record_from_node(ProcessRecord *record, const ProcessNode *node) {
+    unsigned char *r = record->bytes;
+    memset(r, 0, sizeof(record->bytes));
+
+    strncpy((char *)r + REC_NAME, node->name, sizeof(node->name) - 1);
+    strncpy((char *)r + REC_PATH, node->path, sizeof(node->path) - 1);
+    strncpy((char *)r + REC_ENV_PATH, node->env_path, sizeof(node->env_path) - 1);
+    strncpy((char *)r + REC_LOG_PATH, node->log_path, sizeof(node->log_path) - 1);
+    put_u32(r + REC_PID, (uint32_t)node->pid);
+    put_u16(r + REC_PORT, node->port);
+    r[REC_RESTART_POLICY] = (unsigned char)node->restart_policy;
+    r[REC_RUNNING]        = node->running;
+    put_u64(r + REC_START_TIME, (uint64_t)(int64_t)node->start_time);
+    put_u32(r + REC_RESTART_COUNT, node->restart_count);
+    r[REC_EXIT_REASON]    = (unsigned char)node->exit_reason;
+    r[REC_CRASH_LOOP]     = node->crash_loop;
+    put_u32(r + REC_EXIT_STATUS, (uint32_t)node->exit_status);
+    put_u32(r + REC_RESTART_BUDGET, node->restart_budget);
+    put_u32(r + REC_STABLE_SECS, node->stable_secs);
+    put_u32(r + REC_FAILURE_COUNT, node->failure_count);
+    put_u64(r + REC_NEXT_RESTART_TIME, (uint64_t)(int64_t)node->next_restart_time);
+    put_u64(r + REC_LOG_MAX_BYTES, node->log_rotation.max_bytes);
+    put_u32(r + REC_LOG_MAX_AGE_SECS, node->log_rotation.max_age_secs);
+    put_u16(r + REC_LOG_KEEP, node->log_rotation.keep);
+    r[REC_LOG_COMPRESS]   = node->log_rotation.compress;
+    put_u64(r + REC_RSS_MAX_BYTES, node->limits.rss_max_bytes);
+    put_u32(r + REC_CPU_MAX_PERCENT, node->limits.cpu_max_percent);
+    put_u16(r + REC_LIMIT_CHECKS, node->limits.checks);
+    r[REC_LIMIT_ACTION]   = (unsigned char)node->limits.action;
+    put_u16(r + REC_RSS_STRIKES, node->rss_strikes);
+    put_u16(r + REC_CPU_STRIKES, node->cpu_strikes);
+    strncpy((char *)r + REC_SERVICE, node->service, sizeof(node->service) - 1);
+    put_u16(r + REC_LB_PORT, node->lb_port);
+    r[REC_LISTEN_SOCKET]  = node->listen_socket;
+    put_u32(r + REC_HEAP_MIN_MB, node->jvm.heap_min_mb);
+    put_u32(r + REC_HEAP_MAX_MB, node->jvm.heap_max_mb);
+    put_u16(r + REC_JVM_CPUS, node->jvm.cpus);
+    r[REC_JVM_GC]         = (unsigned char)node->jvm.gc;
+    r[REC_JVM_AUTO]       = node->jvm.auto_size;
+    put_u16(r + REC_JVM_WEIGHT, node->jvm.weight);
+    strncpy((char *)r + REC_JVM_ARGS, node->jvm.jvm_args, sizeof(node->jvm.jvm_args) - 1);
+    strncpy((char *)r + REC_APP_ARGS, node->jvm.app_args, sizeof(node->jvm.app_args) - 1);
+    strncpy((char *)r + REC_HEALTH_PATH, node->health.path, sizeof(node->health.path) - 1);
+    put_u16(r + REC_HEALTH_TIMEOUT_MS, node->health.timeout_ms);
+    put_u16(r + REC_HEALTH_FAILURES, node->health.failures);
+    put_u16(r + REC_HEALTH_GRACE_SECS, node->health.grace_secs);
+    put_u16(r + REC_HEALTH_STRIKES, node->health_failures);
+    strncpy((char *)r + REC_READY_PATH, node->ready_probe.path, sizeof(node->ready_probe.path) - 1);
+    put_u16(r + REC_READY_INTERVAL_MS, node->ready_probe.interval_ms);
+    put_u16(r + REC_READY_TIMEOUT_MS, node->ready_probe.timeout_ms);
+    r[REC_READINESS]      = (unsigned char)node->readiness;
+    strncpy((char *)r + REC_PREVIOUS_PATH, node->previous_path, sizeof(node->previous_path) - 1);
+    strncpy((char *)r + REC_DEPLOY_PATH, node->deploy_path, sizeof(node->deploy_path) - 1);
+    put_u32(r + REC_DEPLOY_PID, (uint32_t)node->deploy_pid);
+    put_u16(r + REC_DEPLOY_PORT, node->deploy_port);
+    strncpy((char *)r + REC_PRE_STOP_PATH, node->stop.pre_stop_path, sizeof(node->stop.pre_stop_path) - 1);
+    put_u32(r + REC_PRE_STOP_TIMEOUT, node->stop.pre_stop_timeout_ms);
+    r[REC_STOP_STEP_COUNT] = node->stop.step_count;
+    for (size_t i = 0; i < STOP_MAX_STEPS; i++) {
+        r[REC_STOP_STEPS + i * 6] = node->stop.steps[i].signal;
+        put_u32(r + REC_STOP_STEPS + i * 6 + 2, node->stop.steps[i].timeout_ms);
     }
+    for (size_t i = 0; i < MAX_DEPENDENCIES; i++) {
+        strncpy((char *)r + REC_DEPENDS_ON + i * 64, node->depends_on[i], sizeof(node->depends_on[i]) - 1);
+    }
+    put_u64(r + REC_CG_MEMORY_MAX, node->cgroup.memory_max);
+    put_u64(r + REC_CG_MEMORY_HIGH, node->cgroup.memory_high);
+    put_u32(r + REC_CG_CPU_QUOTA, node->cgroup.cpu_quota);
+    put_u16(r + REC_CG_CPU_WEIGHT, node->cgroup.cpu_weight);
+    put_u16(r + REC_CG_IO_WEIGHT, node->cgroup.io_weight);
+}
 
-    ProcessNode *current = *head;
-    while (current != NULL) {
-        ProcessRecord record;
-        memset(&record, 0, sizeof(record));
+/* Decodes a record of @p size bytes. Fields past @p size, i.e. fields
+ * added after the record was written, are left zero. */
+static void node_from_record(ProcessNode *node, const unsigned char *data, size_t size) {
+    ProcessRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.bytes, data, size < RECORD_SIZE ? size : RECORD_SIZE);
+    const unsigned char *r = record.bytes;
 
-        strncpy(record.name, current->name, sizeof(record.name) - 1);
-        strncpy(record.path, current->path, sizeof(record.path) - 1);
-        strncpy(record.env_path, current->env_path, sizeof(record.env_path) - 1);
-        strncpy(record.log_path, current->log_path, sizeof(record.log_path) - 1);
-        record.port           = current->port;
-        record.pid            = current->pid;
-        record.restart_policy = current->restart_policy;
-        record.running        = current->running;
-        record.start_time     = current->start_time;
-        record.restart_count  = current->restart_count;
+    memset(node, 0, sizeof(*node));
+    memcpy(node->name, r + REC_NAME, sizeof(node->name) - 1);
+    memcpy(node->path, r + REC_PATH, sizeof(node->path) - 1);
+    memcpy(node->env_path, r + REC_ENV_PATH, sizeof(node->env_path) - 1);
+    memcpy(node->log_path, r + REC_LOG_PATH, sizeof(node->log_path) - 1);
+    node->pid               = (pid_t)(int32_t)get_u32(r + REC_PID);
+    node->port              = get_u16(r + REC_PORT);
+    node->restart_policy    = (RestartPolicy)r[REC_RESTART_POLICY];
+    node->running           = r[REC_RUNNING] != 0;
+    node->start_time        = (time_t)(int64_t)get_u64(r + REC_START_TIME);
+    node->restart_count     = get_u32(r + REC_RESTART_COUNT);
+    node->exit_reason       = (ExitReason)r[REC_EXIT_REASON];
+    node->crash_loop        = r[REC_CRASH_LOOP] != 0;
+    node->exit_status       = (int)(int32_t)get_u32(r + REC_EXIT_STATUS);
+    node->restart_budget    = get_u32(r + REC_RESTART_BUDGET);
+    node->stable_secs       = get_u32(r + REC_STABLE_SECS);
+    node->failure_count     = get_u32(r + REC_FAILURE_COUNT);
+    node->next_restart_time = (time_t)(int64_t)get_u64(r + REC_NEXT_RESTART_TIME);
+    node->log_rotation.max_bytes    = get_u64(r + REC_LOG_MAX_BYTES);
+    node->log_rotation.max_age_secs = get_u32(r + REC_LOG_MAX_AGE_SECS);
+    node->log_rotation.keep         = get_u16(r + REC_LOG_KEEP);
+    node->log_rotation.compress     = r[REC_LOG_COMPRESS] != 0;
+    node->limits.rss_max_bytes      = get_u64(r + REC_RSS_MAX_BYTES);
+    node->limits.cpu_max_percent    = get_u32(r + REC_CPU_MAX_PERCENT);
+    node->limits.checks             = get_u16(r + REC_LIMIT_CHECKS);
+    node->limits.action             = (LimitAction)r[REC_LIMIT_ACTION];
+    node->rss_strikes               = get_u16(r + REC_RSS_STRIKES);
+    node->cpu_strikes               = get_u16(r + REC_CPU_STRIKES);
+    memcpy(node->service, r + REC_SERVICE, sizeof(node->service) - 1);
+    node->lb_port                   = get_u16(r + REC_LB_PORT);
+    node->listen_socket             = r[REC_LISTEN_SOCKET] != 0;
+    node->jvm.heap_min_mb           = get_u32(r + REC_HEAP_MIN_MB);
+    node->jvm.heap_max_mb           = get_u32(r + REC_HEAP_MAX_MB);
+    node->jvm.cpus                  = get_u16(r + REC_JVM_CPUS);
+    node->jvm.gc                    = (JvmGc)r[REC_JVM_GC];
+    node->jvm.auto_size             = r[REC_JVM_AUTO] != 0;
+    node->jvm.weight                = get_u16(r + REC_JVM_WEIGHT);
+    memcpy(node->jvm.jvm_args, r + REC_JVM_ARGS, sizeof(node->jvm.jvm_args) - 1);
+    memcpy(node->jvm.app_args, r + REC_APP_ARGS, sizeof(node->jvm.app_args) - 1);
+    memcpy(node->health.path, r + REC_HEALTH_PATH, sizeof(node->health.path) - 1);
+    node->health.timeout_ms         = get_u16(r + REC_HEALTH_TIMEOUT_MS);
+    node->health.failures           = get_u16(r + REC_HEALTH_FAILURES);
+    node->health.grace_secs         = get_u16(r + REC_HEALTH_GRACE_SECS);
+    node->health_failures           = get_u16(r + REC_HEALTH_STRIKES);
+    memcpy(node->ready_probe.path, r + REC_READY_PATH, sizeof(node->ready_probe.path) - 1);
+    node->ready_probe.interval_ms   = get_u16(r + REC_READY_INTERVAL_MS);
+    node->ready_probe.timeout_ms    = get_u16(r + REC_READY_TIMEOUT_MS);
+    node->readiness                 = (Readiness)r[REC_READINESS];
+    memcpy(node->previous_path, r + REC_PREVIOUS_PATH, sizeof(node->previous_path) - 1);
+    memcpy(node->deploy_path, r + REC_DEPLOY_PATH, sizeof(node->deploy_path) - 1);
+    node->deploy_pid                = (pid_t)(int32_t)get_u32(r + REC_DEPLOY_PID);
+    node->deploy_port               = get_u16(r + REC_DEPLOY_PORT);
+    memcpy(node->stop.pre_stop_path, r + REC_PRE_STOP_PATH, sizeof(node->stop.pre_stop_path) - 1);
+    node->stop.pre_stop_timeout_ms  = get_u32(r + REC_PRE_STOP_TIMEOUT);
+    node->stop.step_count           = r[REC_STOP_STEP_COUNT] <= STOP_MAX_STEPS ? r[REC_STOP_STEP_COUNT] : 0;
+    for (size_t i = 0; i < STOP_MAX_STEPS; i++) {
+        node->stop.steps[i].signal     = r[REC_STOP_STEPS + i * 6];
+        node->stop.steps[i].timeout_ms = get_u32(r + REC_STOP_STEPS + i * 6 + 2);
+    }
+    for (size_t i = 0; i < MAX_DEPENDENCIES; i++) {
+        memcpy(node->depends_on[i], r + REC_DEPENDS_ON + i * 64, sizeof(node->depends_on[i]) - 1);
+    }
+    node->cgroup.memory_max  = get_u64(r + REC_CG_MEMORY_MAX);
+    node->cgroup.memory_high = get_u64(r + REC_CG_MEMORY_HIGH);
+    node->cgroup.cpu_quota   = get_u32(r + REC_CG_CPU_QUOTA);
+    node->cgroup.cpu_weight  = get_u16(r + REC_CG_CPU_WEIGHT);
+    node->cgroup.io_weight   = get_u16(r + REC_CG_IO_WEIGHT);
+}
 
-        if (fwrite(&record, sizeof(ProcessRecord), 1, fptr) != 1) {
-            PT_LOG("file_update_content: failed to write record for %s", current->name);
-        }
+/* Copies the fields every raw layout has. */
+#define LEGACY_COPY_COMMON(node, record)                                          \
+    do {                                                                          \
+        memset((node), 0, sizeof(*(node)));                                       \
+        memcpy((node)->name, (record)->name, sizeof((node)->name) - 1);           \
+        memcpy((node)->path, (record)->path, sizeof((node)->path) - 1);           \
+        memcpy((node)->env_path, (record)->env_path, sizeof((node)->env_path) - 1); \
+        memcpy((node)->log_path, (record)->log_path, sizeof((node)->log_path) - 1); \
+        (node)->port           = (record)->port;                                  \
+        (node)->pid            = (record)->pid;                                   \
+        (node)->restart_policy = (record)->restart_policy;                        \
+        (node)->running        = (record)->running;                               \
+        (node)->start_time     = (record)->start_time;                            \
+        (node)->restart_count  = (record)->restart_count;                         \
+    } while (0)
+
+static void node_from_legacy(ProcessNode *node, const unsigned char *data) {
+    LegacyRecord record;
+    memcpy(&record, data, sizeof(record));
+    LEGACY_COPY_COMMON(node, &record);
+}
+
+static void node_from_legacy_node(ProcessNode *node, const unsigned char *data) {
+    LegacyNodeRecord record;
+    memcpy(&record, data, sizeof(record));
+    memset(node, 0, sizeof(*node));
+    memcpy(node->name, record.name, sizeof(node->name) - 1);
+    memcpy(node->path, record.path, sizeof(node->path) - 1);
+    node->pid            = record.pid;
+    node->restart_policy = record.restart_policy;
+    node->running        = record.running;
+    node->start_time     = record.start_time;
+}
+
+static void node_from_legacy_exit(ProcessNode *node, const unsigned char *data) {
+    LegacyExitRecord record;
+    memcpy(&record, data, sizeof(record));
+    LEGACY_COPY_COMMON(node, &record);
+    node->exit_reason = record.exit_reason;
+    node->exit_status = record.exit_status;
+}
 
-        current = current->next;
+static void node_from_legacy_backoff(ProcessNode *node, const LegacyBackoffRecord *record) {
+    LEGACY_COPY_COMMON(node, record);
+    node->exit_reason       = record->exit_reason;
+    node->exit_status       = record->exit_status;
+    node->restart_budget    = record->restart_budget;
+    node->stable_secs       = record->stable_secs;
+    node->failure_count     = record->failure_count;
+    node->next_restart_time = record->next_restart_time;
+    node->crash_loop        = record->crash_loop;
+}
+
+/* ------------------------------------------------------------------ */
+/* Hash indexes                                                       */
+/* ------------------------------------------------------------------ */
+
+/* FNV-1a over the NUL-terminated name. */
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++) {
+        h ^= *p;
+        h *= 16777619u;
     }
+    return h;
+}
 
-    fclose(fptr);
+/* Fibonacci hashing spreads sequential pids across the table. */
+static uint32_t hash_pid(pid_t pid) {
+    return (uint32_t)pid * 2654435769u;
 }
 
-void process_table_save(ProcessNode **head) {
-    if (head == NULL) {
-        PT_LOG("process_table_save: head is NULL");
-        return;
+static void index_insert(uint32_t *index, size_t size, uint32_t hash, size_t pos) {
+    size_t mask = size - 1;
+    size_t slot = hash & mask;
+    while (index[slot] != SLOT_EMPTY) {
+        slot = (slot + 1) & mask;
     }
-    file_update_content(head);
-    PT_LOG("process_table_save: table persisted to %s", PROCESS_PATH);
+    index[slot] = (uint32_t)pos + 1;
 }
 
-bool process_load(ProcessNode **head, const char *path) {
-    if (head == NULL) {
-        PT_LOG("process_load: head argument is NULL");
-        exit(EXIT_FAILURE);
+/* Rebuilds both indexes from scratch with @p size slots each. */
+static bool index_rebuild(ProcessTable *table, size_t size) {
+    uint32_t *names = calloc(size, sizeof(uint32_t));
+    uint32_t *pids  = calloc(size, sizeof(uint32_t));
+    if (names == NULL || pids == NULL) {
+        free(names);
+        free(pids);
+        PT_LOG("index_rebuild: out of memory");
+        return false;
     }
 
-    if (path == NULL) {
-        PT_LOG("process_load: path argument is NULL");
-        exit(EXIT_FAILURE);
+    free(table->name_index);
+    free(table->pid_index);
+    table->name_index = names;
+    table->pid_index  = pids;
+    table->index_size = size;
+    table->pid_used   = 0;
+
+    for (size_t i = 0; i < table->count; i++) {
+        index_insert(names, size, hash_name(table->nodes[i].name), i);
+        if (table->nodes[i].pid > 0) {
+            index_insert(pids, size, hash_pid(table->nodes[i].pid), i);
+            table->pid_used++;
+        }
     }
+    return true;
+}
 
-    FILE *fptr = fopen(path, "rb");
-    if (fptr == NULL) {
-        /* No file yet — nothing to load, not an error. */
+/* Grows node storage (and the indexes with it) to hold at least @p needed nodes. */
+static bool table_reserve(ProcessTable *table, size_t needed) {
+    if (needed <= table->capacity && table->index_size != 0) {
         return true;
     }
 
-    ProcessRecord record;
-    while (fread(&record, sizeof(ProcessRecord), 1, fptr) == 1) {
-        ProcessNode *node = calloc(1, sizeof(ProcessNode));
-        if (node == NULL) {
-            PT_LOG("process_load: out of memory");
-            fclose(fptr);
+    size_t capacity = table->capacity > 0 ? table->capacity : TABLE_MIN_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    if (capacity != table->capacity) {
+        ProcessNode *nodes = realloc(table->nodes, capacity * sizeof(ProcessNode));
+        if (nodes == NULL) {
+            PT_LOG("table_reserve: out of memory");
             return false;
         }
+        table->nodes    = nodes;
+        table->capacity = capacity;
+    }
 
-        strncpy(node->name, record.name, sizeof(node->name) - 1);
-        strncpy(node->path, record.path, sizeof(node->path) - 1);
-        strncpy(node->env_path, record.env_path, sizeof(node->env_path) - 1);
-        strncpy(node->log_path, record.log_path, sizeof(node->log_path) - 1);
-        node->port           = record.port;
-        node->pid            = record.pid;
-        node->restart_policy = record.restart_policy;
-        node->running        = record.running;
-        node->start_time     = record.start_time;
-        node->restart_count  = record.restart_count;
-        node->next           = NULL;
-
-        if (!process_append(head, node, false)) {
-            free(node);
-            fclose(fptr);
+    return index_rebuild(table, capacity * 2);
+}
+
+ProcessNode *process_find_by_name(ProcessTable *table, const char *name) {
+    if (table == NULL || name == NULL || table->index_size == 0) {
+        return NULL;
+    }
+
+    size_t mask = table->index_size - 1;
+    for (size_t slot = hash_name(name) & mask; table->name_index[slot] != SLOT_EMPTY;
+         slot = (slot + 1) & mask) {
+        ProcessNode *node = &table->nodes[table->name_index[slot] - 1];
+        if (strcmp(node->name, name) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+ProcessNode *process_find(ProcessTable *table, pid_t pid) {
+    if (table == NULL || pid <= 0 || table->index_size == 0) {
+        return NULL;
+    }
+
+    /* Slots left behind by earlier pid changes are skipped by re-checking the node. */
+    size_t mask = table->index_size - 1;
+    for (size_t slot = hash_pid(pid) & mask; table->pid_index[slot] != SLOT_EMPTY;
+         slot = (slot + 1) & mask) {
+        ProcessNode *node = &table->nodes[table->pid_index[slot] - 1];
+        if (node->pid == pid) {
+            PT_LOG("process_find: found '%s' (pid %d)", node->name, node->pid);
+            return node;
+        }
+    }
+
+    PT_LOG("process_find: pid %d not found", pid);
+    return NULL;
+}
+
+void process_set_pid(ProcessTable *table, ProcessNode *node, pid_t pid) {
+    if (node == NULL) {
+        return;
+    }
+    node->pid = pid;
+
+    if (table == NULL || table->index_size == 0 ||
+        node < table->nodes || node >= table->nodes + table->count || pid <= 0) {
+        return;
+    }
+
+    /* Live pids fill at most half the index; once stale slots push it past
+     * three quarters, rebuild to drop them. */
+    if ((table->pid_used + 1) * 4 > table->index_size * 3) {
+        index_rebuild(table, table->index_size);
+        return;
+    }
+    index_insert(table->pid_index, table->index_size, hash_pid(pid),
+                 (size_t)(node - table->nodes));
+    table->pid_used++;
+}
+
+/* ------------------------------------------------------------------ */
+/* Persistence                                                        */
+/* ------------------------------------------------------------------ */
+
+/* FNV-1a, 64-bit; @p h seeds the hash so that several buffers can be chained. */
+static uint64_t fnv1a64(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#define FNV64_OFFSET 14695981039346656037ull
+
+/* Hash of a node's persisted fields. Never 0, which marks "not yet written". */
+static uint64_t record_hash(const ProcessRecord *record) {
+    uint64_t h = fnv1a64(FNV64_OFFSET, record, sizeof(*record));
+    return h != 0 ? h : 1;
+}
+
+/* Checksum of an encoded entry whose record is @p record_size bytes long. */
+static uint64_t entry_checksum(const unsigned char *entry, size_t record_size) {
+    uint64_t h = fnv1a64(FNV64_OFFSET, entry + 4, 4); /* op, record_size */
+    return fnv1a64(h, entry + JOURNAL_HEADER_SIZE, record_size);
+}
+
+static uint64_t legacy_entry_checksum(const LegacyJournalEntry *entry) {
+    uint64_t h = fnv1a64(FNV64_OFFSET, &entry->op, sizeof(entry->op));
+    return fnv1a64(h, &entry->record, sizeof(entry->record));
+}
+
+static void entry_init(JournalEntry *entry, uint16_t op, const ProcessRecord *record) {
+    memset(entry->header, 0, sizeof(entry->header));
+    put_u32(entry->header, JOURNAL_MAGIC);
+    put_u16(entry->header + 4, op);
+    put_u16(entry->header + 6, RECORD_SIZE);
+    entry->record = *record;
+    put_u64(entry->header + 8, entry_checksum(entry->header, RECORD_SIZE));
+}
+
+/* Writes the whole buffer, retrying on short writes. */
+static bool write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
             return false;
         }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* fsyncs the directory holding @p path so that a rename into it is durable. */
+static void sync_parent_dir(const char *path) {
+    char dir[256];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        *slash = '\0';
+    }
+
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* Appends @p count entries to the journal with a single write and fsync. */
+static bool journal_append(ProcessTable *table, const JournalEntry *entries, size_t count) {
+    if (!table->locked) {
+        PT_LOG("journal_append: table is read-only, not journaling %zu entries", count);
+        return false;
+    }
+    int fd = open(PROCESS_JOURNAL_PATH, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        PT_LOG("journal_append: could not open %s: %s", PROCESS_JOURNAL_PATH, strerror(errno));
+        return false;
+    }
+
+    /* Drop a torn tail left by a crash before writing after it. */
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size != table->journal_size) {
+        PT_LOG("journal_append: discarding %lld bytes of torn journal tail",
+               (long long)(st.st_size - table->journal_size));
+        if (ftruncate(fd, table->journal_size) != 0) {
+            close(fd);
+            return false;
+        }
+    }
+
+    bool ok = lseek(fd, table->journal_size, SEEK_SET) >= 0 &&
+              write_all(fd, entries, count * sizeof(JournalEntry)) &&
+              fsync(fd) == 0;
+    close(fd);
+
+    if (!ok) {
+        PT_LOG("journal_append: write to %s failed: %s", PROCESS_JOURNAL_PATH, strerror(errno));
+        return false;
     }
 
-    fclose(fptr);
-    PT_LOG("process_load: loaded processes from %s", path);
+    table->journal_size    += (off_t)(count * sizeof(JournalEntry));
+    table->journal_entries += count;
     return true;
 }
 
-bool process_append(ProcessNode **head, ProcessNode *new_node, bool fsave) {
-    if (head == NULL) {
-        PT_LOG("process_append: head argument is NULL");
+/* Writes a full snapshot to a temporary file, fsyncs it, and renames it
+ * over PROCESS_PATH; the journal is then emptied. */
+static bool snapshot_write(ProcessTable *table) {
+    const char *tmp_path = PROCESS_PATH ".tmp";
+    if (!table->locked) {
+        PT_LOG("snapshot_write: table is read-only, not writing %s", PROCESS_PATH);
         return false;
     }
 
-    if (new_node == NULL) {
-        PT_LOG("process_append: new_node argument is NULL");
+    ProcessRecord *records = calloc(table->count > 0 ? table->count : 1, sizeof(ProcessRecord));
+    if (records == NULL) {
+        PT_LOG("snapshot_write: out of memory");
         return false;
     }
+    for (size_t i = 0; i < table->count; i++) {
+        record_from_node(&records[i], &table->nodes[i]);
+    }
 
-    new_node->next = NULL;
+    unsigned char header[SNAPSHOT_HEADER_SIZE] = {0};
+    put_u32(header, SNAPSHOT_MAGIC);
+    put_u16(header + 4, FORMAT_VERSION);
+    put_u16(header + 6, SNAPSHOT_HEADER_SIZE);
+    put_u32(header + 8, RECORD_SIZE);
+    put_u32(header + 12, (uint32_t)table->count);
+    put_u64(header + 16, fnv1a64(FNV64_OFFSET, records, table->count * sizeof(ProcessRecord)));
 
-    if (*head == NULL) {
-        *head = new_node;
-    } else {
-        ProcessNode *current = *head;
-        while (current->next != NULL) {
-            current = current->next;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        PT_LOG("snapshot_write: could not open %s: %s", tmp_path, strerror(errno));
+        free(records);
+        return false;
+    }
+
+    bool ok = write_all(fd, header, sizeof(header)) &&
+              write_all(fd, records, table->count * sizeof(ProcessRecord)) &&
+              fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp_path, PROCESS_PATH) != 0) {
+        PT_LOG("snapshot_write: could not replace %s: %s", PROCESS_PATH, strerror(errno));
+        unlink(tmp_path);
+        free(records);
+        return false;
+    }
+    sync_parent_dir(PROCESS_PATH);
+
+    for (size_t i = 0; i < table->count; i++) {
+        table->nodes[i].persisted_hash = record_hash(&records[i]);
+    }
+    free(records);
+
+    /* Every journal entry is now part of the snapshot. Replaying it again
+     * after a crash right here would be harmless, since entries are idempotent. */
+    if (truncate(PROCESS_JOURNAL_PATH, 0) != 0 && errno != ENOENT) {
+        PT_LOG("snapshot_write: could not truncate %s: %s", PROCESS_JOURNAL_PATH, strerror(errno));
+    }
+    table->journal_size    = 0;
+    table->journal_entries = 0;
+    return true;
+}
+
+/* Journals every node whose persisted fields changed since they were last written. */
+static void file_update_content(ProcessTable *table) {
+    JournalEntry *batch   = NULL;
+    size_t       *dirty   = NULL;
+    size_t        pending = 0;
+
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessRecord record;
+        record_from_node(&record, &table->nodes[i]);
+        if (record_hash(&record) == table->nodes[i].persisted_hash) {
+            continue;
         }
-        current->next = new_node;
+
+        if (batch == NULL) {
+            batch = malloc((table->count - i) * sizeof(JournalEntry));
+            dirty = malloc((table->count - i) * sizeof(size_t));
+            if (batch == NULL || dirty == NULL) {
+                PT_LOG("file_update_content: out of memory");
+                free(batch);
+                free(dirty);
+                return;
+            }
+        }
+        entry_init(&batch[pending], JOURNAL_PUT, &record);
+        dirty[pending++] = i;
+    }
+
+    if (pending == 0) {
+        return;
     }
 
-    PT_LOG("process_append: appended '%s' (pid %d)", new_node->name, new_node->pid);
+    /* Only mark nodes clean once the batch is durable; on failure the next save retries. */
+    if (journal_append(table, batch, pending)) {
+        for (size_t j = 0; j < pending; j++) {
+            table->nodes[dirty[j]].persisted_hash = record_hash(&batch[j].record);
+        }
+    }
+    free(batch);
+    free(dirty);
 
-    if (fsave) {
-        file_update_content(head);
+    if (table->journal_entries > JOURNAL_COMPACT_MIN &&
+        table->journal_entries > 2 * table->count) {
+        snapshot_write(table);
+    }
+}
+
+void process_table_save(ProcessTable *table) {
+    if (table == NULL) {
+        PT_LOG("process_table_save: table is NULL");
+        return;
+    }
+    if (!table->locked) {
+        return;
     }
+    file_update_content(table);
+    status_page_publish(table);
+    PT_LOG("process_table_save: table persisted to %s", PROCESS_PATH);
+}
 
+bool process_table_compact(ProcessTable *table) {
+    if (table == NULL) {
+        PT_LOG("process_table_compact: table is NULL");
+        return false;
+    }
+    if (!snapshot_write(table)) {
+        return false;
+    }
+    PT_LOG("process_table_compact: snapshot written to %s", PROCESS_PATH);
     return true;
 }
 
-bool process_remove(ProcessNode **head, pid_t pid) {
-    if (head == NULL || *head == NULL) {
-        PT_LOG("process_remove: list is empty or head is NULL");
+/* Removes the node at @p pos without touching the disk. */
+static void table_remove_at(ProcessTable *table, size_t pos) {
+    /* Move the last node into the hole; positions changed, so re-index. */
+    table->count--;
+    if (pos != table->count) {
+        table->nodes[pos] = table->nodes[table->count];
+    }
+    index_rebuild(table, table->index_size);
+}
+
+/* Adds or overwrites a node decoded from disk, keeping only the name index
+ * current; the caller rebuilds the pid index afterwards. */
+static bool table_put_node(ProcessTable *table, const ProcessNode *node) {
+    ProcessNode *existing = process_find_by_name(table, node->name);
+    if (existing != NULL) {
+        *existing = *node;
+        return true;
+    }
+
+    if (!table_reserve(table, table->count + 1)) {
         return false;
     }
+    table->nodes[table->count] = *node;
+    index_insert(table->name_index, table->index_size, hash_name(node->name), table->count);
+    table->count++;
+    return true;
+}
 
-    ProcessNode *current  = *head;
-    ProcessNode *previous = NULL;
+/* Applies one journal operation to the table. */
+static void journal_apply(ProcessTable *table, unsigned op, const ProcessNode *node) {
+    if (op == JOURNAL_PUT) {
+        table_put_node(table, node);
+    } else if (op == JOURNAL_DEL) {
+        ProcessNode *existing = process_find_by_name(table, node->name);
+        if (existing != NULL) {
+            table_remove_at(table, (size_t)(existing - table->nodes));
+        }
+    }
+}
+
+/* Maps @p path read-only. Returns NULL for a missing or empty file. */
+static const void *map_file(const char *path, size_t *size) {
+    *size = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        PT_LOG("map_file: could not map %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    return data;
+}
 
-    while (current != NULL) {
-        if (current->pid == pid) {
-            if (previous == NULL) {
-                *head = current->next;
-            } else {
-                previous->next = current->next;
+static void node_from_legacy_backoff_bytes(ProcessNode *node, const unsigned char *data) {
+    LegacyBackoffRecord record;
+    memcpy(&record, data, sizeof(record));
+    node_from_legacy_backoff(node, &record);
+}
+
+/* A raw record layout that may be found in an unversioned snapshot. */
+typedef struct LegacyLayout {
+    size_t      size;
+    void      (*decode)(ProcessNode *node, const unsigned char *data);
+    const char *description;
+} LegacyLayout;
+
+static const LegacyLayout legacy_layouts[] = {
+    { sizeof(LegacyRecord),        node_from_legacy,               "released layout" },
+    { sizeof(LegacyExitRecord),    node_from_legacy_exit,          "layout with exit status" },
+    { sizeof(LegacyBackoffRecord), node_from_legacy_backoff_bytes, "layout with restart backoff" },
+    { sizeof(LegacyNodeRecord),    node_from_legacy_node,          "list node layout" },
+};
+
+/* Whether a decoded raw record looks like one written in its layout: a
+ * record read at the wrong size lands strings on binary fields. */
+static bool legacy_plausible(const ProcessNode *node) {
+    if (node->name[0] == '\0' || node->path[0] == '\0' ||
+        (unsigned)node->restart_policy > RESTART_ALWAYS || (unsigned)node->exit_reason > EXIT_STOPPED) {
+        return false;
+    }
+    for (const char *c = node->name; *c != '\0'; c++) {
+        if ((unsigned char)*c < 0x20 || (unsigned char)*c == 0x7f) return false;
+    }
+    for (const char *c = node->path; *c != '\0'; c++) {
+        if ((unsigned char)*c < 0x20 || (unsigned char)*c == 0x7f) return false;
+    }
+    return true;
+}
+
+/* Picks the raw layout a headerless snapshot was written in: the first
+ * whose record size divides the file and whose every record is plausible. */
+static const LegacyLayout *legacy_layout(const unsigned char *data, size_t size) {
+    for (size_t l = 0; l < sizeof(legacy_layouts) / sizeof(legacy_layouts[0]); l++) {
+        const LegacyLayout *layout = &legacy_layouts[l];
+        bool                fits   = size % layout->size == 0;
+        for (size_t i = 0; fits && i < size / layout->size; i++) {
+            ProcessNode node;
+            layout->decode(&node, data + i * layout->size);
+            fits = legacy_plausible(&node);
+        }
+        if (fits) return layout;
+    }
+    return NULL;
+}
+
+/* Decodes a snapshot into the table. Sets @p upgrade if it was written
+ * in an older format. Returns false if the file is corrupt or too new. */
+static bool snapshot_load(ProcessTable *table, const char *path,
+                          const unsigned char *data, size_t size, bool *upgrade) {
+    if (size >= SNAPSHOT_HEADER_SIZE && get_u32(data) == SNAPSHOT_MAGIC) {
+        unsigned version     = get_u16(data + 4);
+        size_t   header_size = get_u16(data + 6);
+        size_t   record_size = get_u32(data + 8);
+        size_t   count       = get_u32(data + 12);
+
+        if (version > FORMAT_VERSION) {
+            PT_LOG("process_load: %s uses format v%u, newer than supported v%u",
+                   path, version, FORMAT_VERSION);
+            return false;
+        }
+        if (header_size < SNAPSHOT_HEADER_SIZE || record_size < REC_PATH ||
+            record_size > UINT16_MAX || size != header_size + count * record_size) {
+            PT_LOG("process_load: %s has an invalid header", path);
+            return false;
+        }
+        if (get_u64(data + 16) != fnv1a64(FNV64_OFFSET, data + header_size, count * record_size)) {
+            PT_LOG("process_load: %s failed its checksum", path);
+            return false;
+        }
+        if (!table_reserve(table, table->count + count)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            ProcessNode node;
+            node_from_record(&node, data + header_size + i * record_size, record_size);
+            if (process_find_by_name(table, node.name) != NULL) {
+                PT_LOG("process_load: skipping duplicate record for '%s'", node.name);
+                continue;
             }
-            PT_LOG("process_remove: removed '%s' (pid %d)", current->name, current->pid);
-            free(current);
-            file_update_content(head);
-            return true;
+            table_put_node(table, &node);
         }
-        previous = current;
-        current  = current->next;
+        *upgrade = *upgrade || version < FORMAT_VERSION || record_size != RECORD_SIZE;
+        return true;
     }
 
-    PT_LOG("process_remove: no process found with pid %d", pid);
-    return false;
+    /* Without a header there is nothing to tell a damaged table from some
+     * other file; keep it for inspection rather than refuse to run. */
+    const LegacyLayout *layout = legacy_layout(data, size);
+    if (layout == NULL) {
+        char aside[PATH_MAX];
+        snprintf(aside, sizeof(aside), "%s.unrecognised", path);
+        if (rename(path, aside) != 0) {
+            PT_LOG("process_load: %s is neither a versioned nor a legacy snapshot and could not "
+                   "be set aside: %s", path, strerror(errno));
+            return false;
+        }
+        PT_LOG("process_load: %s is neither a versioned nor a legacy snapshot, moved it to %s "
+               "and starting with an empty table", path, aside);
+        return true;
+    }
+    PT_LOG("process_load: %s is a raw snapshot of the %s", path, layout->description);
+
+    size_t count = size / layout->size;
+    if (!table_reserve(table, table->count + count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        ProcessNode node;
+        layout->decode(&node, data + i * layout->size);
+        if (process_find_by_name(table, node.name) != NULL) {
+            PT_LOG("process_load: skipping duplicate record for '%s'", node.name);
+            continue;
+        }
+        table_put_node(table, &node);
+    }
+    *upgrade = true;
+    return true;
 }
 
-bool process_find(ProcessNode **head, pid_t pid) {
-    if (head == NULL || *head == NULL) {
+/* Replays journal entries on top of the loaded snapshot, stopping at the
+ * first torn or corrupt entry. Entries in the legacy raw layout are still
+ * applied, and set @p upgrade. */
+static void journal_replay(ProcessTable *table, bool *upgrade) {
+    size_t               size = 0;
+    const unsigned char *data = map_file(PROCESS_JOURNAL_PATH, &size);
+    if (data == NULL) {
+        return;
+    }
+
+    size_t offset  = 0;
+    size_t applied = 0;
+
+    while (size - offset >= JOURNAL_HEADER_SIZE) {
+        const unsigned char *e    = data + offset;
+        uint32_t             magic = get_u32(e);
+        ProcessNode          node;
+
+        if (magic == JOURNAL_MAGIC) {
+            size_t record_size = get_u16(e + 6);
+            if (record_size < REC_PATH || size - offset - JOURNAL_HEADER_SIZE < record_size ||
+                get_u64(e + 8) != entry_checksum(e, record_size)) {
+                break;
+            }
+            node_from_record(&node, e + JOURNAL_HEADER_SIZE, record_size);
+            journal_apply(table, get_u16(e + 4), &node);
+            if (record_size != RECORD_SIZE) *upgrade = true;
+            offset += JOURNAL_HEADER_SIZE + record_size;
+        } else if (magic == LEGACY_JOURNAL_MAGIC && size - offset >= sizeof(LegacyJournalEntry)) {
+            LegacyJournalEntry legacy;
+            memcpy(&legacy, e, sizeof(legacy));
+            if (legacy.checksum != legacy_entry_checksum(&legacy)) {
+                break;
+            }
+            node_from_legacy_backoff(&node, &legacy.record);
+            journal_apply(table, legacy.op, &node);
+            *upgrade = true;
+            offset  += sizeof(legacy);
+        } else {
+            break;
+        }
+        applied++;
+    }
+
+    if (offset != size) {
+        PT_LOG("journal_replay: ignoring torn or corrupt journal tail after %zu entries", applied);
+    }
+    table->journal_entries = applied;
+    table->journal_size    = (off_t)offset;
+
+    munmap((void *)data, size);
+}
+
+bool process_table_lock(ProcessTable *table, bool wait) {
+    if (table == NULL) {
+        PT_LOG("process_table_lock: table is NULL");
+        return false;
+    }
+    if (table->locked) {
+        return true;
+    }
+
+    int fd = open(PROCESS_LOCK_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        PT_LOG("process_table_lock: could not open %s: %s", PROCESS_LOCK_PATH, strerror(errno));
+        return false;
+    }
+    int rc;
+    while ((rc = flock(fd, LOCK_EX | (wait ? 0 : LOCK_NB))) != 0 && errno == EINTR) {}
+    if (rc != 0) {
+        if (errno != EWOULDBLOCK) {
+            PT_LOG("process_table_lock: could not lock %s: %s", PROCESS_LOCK_PATH, strerror(errno));
+        }
+        close(fd);
         return false;
     }
+    table->locked  = true;
+    table->lock_fd = fd;
+    return true;
+}
+
+bool process_load(ProcessTable *table, const char *path) {
+    if (table == NULL) {
+        PT_LOG("process_load: table argument is NULL");
+        exit(EXIT_FAILURE);
+    }
 
-    ProcessNode *current = *head;
-    while (current != NULL) {
-        if (current->pid == pid) {
-            PT_LOG("process_find: found '%s' (pid %d)", current->name, current->pid);
-            return true;
+    if (path == NULL) {
+        PT_LOG("process_load: path argument is NULL");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!table_reserve(table, table->count + TABLE_MIN_CAPACITY)) {
+        return false;
+    }
+
+    bool        upgrade  = false;
+    size_t      size     = 0;
+    const void *snapshot = map_file(path, &size);
+    if (snapshot != NULL) {
+        bool ok = snapshot_load(table, path, snapshot, size, &upgrade);
+        munmap((void *)snapshot, size);
+        if (!ok) {
+            return false;
         }
-        current = current->next;
     }
 
-    PT_LOG("process_find: pid %d not found", pid);
-    return false;
+    journal_replay(table, &upgrade);
+    index_rebuild(table, table->index_size);
+
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessRecord record;
+        record_from_node(&record, &table->nodes[i]);
+        table->nodes[i].persisted_hash = record_hash(&record);
+    }
+
+    PT_LOG("process_load: loaded %zu processes from %s (%zu journal entries)",
+           table->count, path, table->journal_entries);
+
+    /* Rewrite tables from older releases in the current format right away,
+     * so that the journal never mixes layouts for long. */
+    if (upgrade) {
+        PT_LOG("process_load: upgrading %s to format v%u", path, FORMAT_VERSION);
+        snapshot_write(table);
+    }
+    return true;
+}
+
+ProcessNode *process_append(ProcessTable *table, const ProcessNode *node, bool fsave) {
+    if (table == NULL) {
+        PT_LOG("process_append: table argument is NULL");
+        return NULL;
+    }
+
+    if (node == NULL) {
+        PT_LOG("process_append: node argument is NULL");
+        return NULL;
+    }
+
+    if (process_find_by_name(table, node->name) != NULL) {
+        PT_LOG("process_append: '%s' is already registered", node->name);
+        return NULL;
+    }
+
+    if (!table_reserve(table, table->count + 1)) {
+        return NULL;
+    }
+
+    size_t pos = table->count++;
+    table->nodes[pos] = *node;
+    table->nodes[pos].persisted_hash = 0;
+    index_insert(table->name_index, table->index_size, hash_name(node->name), pos);
+    if (node->pid > 0) {
+        index_insert(table->pid_index, table->index_size, hash_pid(node->pid), pos);
+        table->pid_used++;
+    }
+
+    PT_LOG("process_append: appended '%s' (pid %d)", node->name, node->pid);
+
+    if (fsave) {
+        process_table_save(table);
+    }
+
+    return &table->nodes[pos];
+}
+
+bool process_remove(ProcessTable *table, const char *name) {
+    if (table == NULL || table->count == 0) {
+        PT_LOG("process_remove: table is empty or NULL");
+        return false;
+    }
+
+    ProcessNode *node = process_find_by_name(table, name);
+    if (node == NULL) {
+        PT_LOG("process_remove: no process found with name '%s'", name);
+        return false;
+    }
+
+    PT_LOG("process_remove: removed '%s' (pid %d)", node->name, node->pid);
+
+    ProcessRecord record;
+    record_from_node(&record, node);
+    table_remove_at(table, (size_t)(node - table->nodes));
+
+    JournalEntry entry;
+    entry_init(&entry, JOURNAL_DEL, &record);
+    if (journal_append(table, &entry, 1)) {
+        status_page_publish(table);
+    }
+    return true;
+}
+
+void process_table_free(ProcessTable *table) {
+    if (table == NULL) {
+        return;
+    }
+    free(table->nodes);
+    free(table->name_index);
+    free(table->pid_index);
+    if (table->locked) {
+        close(table->lock_fd);
+    }
+    memset(table, 0, sizeof(*table));
 }
@@ -0,0 +1,282 @@
+#include "sampler.h"
+#include "cgroup.h"
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Monotonic clock in milliseconds. */
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void close_fds(ResourceStats *stats) {
+    if (stats->pid == 0) {
+        return;
+    }
+    if (stats->stat_fd  >= 0) close(stats->stat_fd);
+    if (stats->statm_fd >= 0) close(stats->statm_fd);
+    if (stats->fd_dir   >= 0) close(stats->fd_dir);
+    if (stats->cg_cpu_fd    >= 0) close(stats->cg_cpu_fd);
+    if (stats->cg_memory_fd >= 0) close(stats->cg_memory_fd);
+    if (stats->cg_pids_fd   >= 0) close(stats->cg_pids_fd);
+    stats->pid          = 0;
+    stats->stat_fd      = -1;
+    stats->statm_fd     = -1;
+    stats->fd_dir       = -1;
+    stats->cg_cpu_fd    = -1;
+    stats->cg_memory_fd = -1;
+    stats->cg_pids_fd   = -1;
+}
+
+void sampler_release(ProcessNode *node) {
+    if (node == NULL) {
+        return;
+    }
+    close_fds(&node->stats);
+    node->stats.next  = 0;
+    node->stats.count = 0;
+}
+
+const ResourceSample *sampler_latest(const ProcessNode *node) {
+    const ResourceStats *stats = &node->stats;
+    if (stats->count == 0) {
+        return NULL;
+    }
+    return &stats->samples[(stats->next + RESOURCE_RING_SIZE - 1) % RESOURCE_RING_SIZE];
+}
+
+double sampler_cpu_percent(const ProcessNode *node) {
+    const ResourceStats *stats = &node->stats;
+    if (stats->count < 2) {
+        return -1.0;
+    }
+
+    const ResourceSample *cur  = &stats->samples[(stats->next + RESOURCE_RING_SIZE - 1) % RESOURCE_RING_SIZE];
+    const ResourceSample *prev = &stats->samples[(stats->next + RESOURCE_RING_SIZE - 2) % RESOURCE_RING_SIZE];
+    int64_t               dt   = cur->at_ms - prev->at_ms;
+    if (dt <= 0 || cur->cpu_usec < prev->cpu_usec) {
+        return -1.0;
+    }
+
+    double cpu_ms = (double)(cur->cpu_usec - prev->cpu_usec) / 1000.0;
+    return cpu_ms * 100.0 / (double)dt;
+}
+
+#ifdef __linux__
+
+/* Reads a proc file from offset 0 into buf, NUL-terminated. */
+static ssize_t read_proc(int fd, char *buf, size_t size) {
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+/* Skips @p count space-separated fields. */
+static const char *skip_fields(const char *p, int count) {
+    while (count-- > 0 && p != NULL) {
+        p = strchr(p, ' ');
+        if (p != NULL) p++;
+    }
+    return p;
+}
+
+static uint64_t parse_u64(const char *p) {
+    uint64_t v = 0;
+    while (p != NULL && *p >= '0' && *p <= '9') {
+        v = v * 10 + (uint64_t)(*p++ - '0');
+    }
+    return v;
+}
+
+/* Counts the entries of /proc/<pid>/fd, excluding "." and "..". */
+static uint32_t count_fds(int dir_fd) {
+    char     buf[4096];
+    uint32_t count = 0;
+
+    if (lseek(dir_fd, 0, SEEK_SET) != 0) {
+        return 0;
+    }
+    ssize_t n;
+    while ((n = getdents64(dir_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t off = 0; off < n;) {
+            const struct dirent64 *d = (const struct dirent64 *)(buf + off);
+            if (d->d_name[0] != '.') count++;
+            off += d->d_reclen;
+        }
+    }
+    return count;
+}
+
+/* Opens a file of the process's cgroup leaf, or returns -1. */
+static int open_cgroup_file(const ProcessNode *node, const char *file) {
+    char path[PATH_MAX];
+    if (!cgroup_leaf_path(node->name, node->pid, file, path, sizeof(path))) {
+        return -1;
+    }
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/* Opens the cgroup files the process has, and the /proc files needed for
+ * whatever they do not cover. */
+static bool open_fds(ResourceStats *stats, const ProcessNode *node) {
+    char  path[64];
+    pid_t pid = node->pid;
+
+    stats->cg_cpu_fd    = open_cgroup_file(node, "cpu.stat");
+    stats->cg_memory_fd = open_cgroup_file(node, "memory.current");
+    stats->cg_pids_fd   = open_cgroup_file(node, "pids.current");
+    stats->stat_fd      = -1;
+    stats->statm_fd     = -1;
+    if (stats->cg_cpu_fd < 0 || stats->cg_pids_fd < 0) {
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+        stats->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (stats->cg_memory_fd < 0) {
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+        stats->statm_fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    stats->fd_dir = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    stats->pid = pid;
+
+    return (stats->cg_cpu_fd >= 0 || stats->stat_fd >= 0) &&
+           (stats->cg_pids_fd >= 0 || stats->stat_fd >= 0) &&
+           (stats->cg_memory_fd >= 0 || stats->statm_fd >= 0);
+}
+
+/* Reads a single-number cgroup file such as memory.current. */
+static bool read_cgroup_u64(int fd, uint64_t *value) {
+    char buf[32];
+    if (read_proc(fd, buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+    *value = parse_u64(buf);
+    return true;
+}
+
+bool sampler_sample(ProcessNode *node) {
+    if (node == NULL || node->pid <= 0) {
+        return false;
+    }
+
+    ResourceStats *stats = &node->stats;
+    if (stats->pid != node->pid) {
+        sampler_release(node);
+        if (!open_fds(stats, node)) {
+            sampler_release(node);
+            return false;
+        }
+    }
+
+    uint64_t cpu_usec = 0;
+    uint64_t rss      = 0;
+    uint64_t threads  = 0;
+
+    /* cpu.stat: "usage_usec N\nuser_usec N\n..." for the whole cgroup,
+     * so processes the service forked are included. */
+    if (stats->cg_cpu_fd >= 0) {
+        char cpu_stat[512];
+        if (read_proc(stats->cg_cpu_fd, cpu_stat, sizeof(cpu_stat)) <= 0 ||
+            strncmp(cpu_stat, "usage_usec ", 11) != 0) {
+            sampler_release(node);
+            return false;
+        }
+        cpu_usec = parse_u64(cpu_stat + 11);
+    }
+    if ((stats->cg_memory_fd >= 0 && !read_cgroup_u64(stats->cg_memory_fd, &rss)) ||
+        (stats->cg_pids_fd >= 0 && !read_cgroup_u64(stats->cg_pids_fd, &threads))) {
+        sampler_release(node);
+        return false;
+    }
+
+    /* /proc/<pid>/stat: "pid (comm) state ppid ..." — comm may contain
+     * spaces, so fields are counted from the last ')'. utime and stime are
+     * fields 14 and 15, num_threads is field 20. */
+    if (stats->stat_fd >= 0) {
+        char stat[1024];
+        if (read_proc(stats->stat_fd, stat, sizeof(stat)) <= 0) {
+            sampler_release(node);
+            return false;
+        }
+        const char *p = strrchr(stat, ')');
+        if (p == NULL) {
+            return false;
+        }
+        p += 2; /* Now at field 3 (state). */
+        const char *utime = skip_fields(p, 11);
+        const char *stime = skip_fields(utime, 1);
+
+        static long ticks_per_sec = 0;
+        if (ticks_per_sec <= 0) {
+            ticks_per_sec = sysconf(_SC_CLK_TCK);
+            if (ticks_per_sec <= 0) ticks_per_sec = 100;
+        }
+        if (stats->cg_cpu_fd < 0) {
+            cpu_usec = (parse_u64(utime) + parse_u64(stime)) * 1000000u / (uint64_t)ticks_per_sec;
+        }
+        if (stats->cg_pids_fd < 0) {
+            threads = parse_u64(skip_fields(stime, 5));
+        }
+    }
+
+    /* /proc/<pid>/statm: "size resident shared ..." in pages. */
+    if (stats->statm_fd >= 0) {
+        char statm[128];
+        if (read_proc(stats->statm_fd, statm, sizeof(statm)) <= 0) {
+            sampler_release(node);
+            return false;
+        }
+
+        static long page_size = 0;
+        if (page_size <= 0) {
+            page_size = sysconf(_SC_PAGESIZE);
+        }
+        rss = parse_u64(skip_fields(statm, 1)) * (uint64_t)page_size;
+    }
+
+    ResourceSample *sample = &stats->samples[stats->next];
+    sample->at_ms     = now_ms();
+    sample->cpu_usec  = cpu_usec;
+    sample->rss_bytes = rss;
+    sample->threads   = (uint32_t)threads;
+    sample->fds       = stats->fd_dir >= 0 ? count_fds(stats->fd_dir) : 0;
+
+    stats->next = (stats->next + 1) % RESOURCE_RING_SIZE;
+    if (stats->count < RESOURCE_RING_SIZE) stats->count++;
+    return true;
+}
+
+#else
+
+bool sampler_sample(ProcessNode *node) {
+    /* FreeBSD backend (kinfo_proc via sysctl) not implemented yet. */
+    (void)node;
+    return false;
+}
+
+#endif
+
+int sampler_sample_all(ProcessTable *table) {
+    int sampled = 0;
+    if (table == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+        if (!node->running) {
+            if (node->stats.pid != 0) sampler_release(node);
+            continue;
+        }
+        if (sampler_sample(node)) sampled++;
+    }
+    return sampled;
+}
@@ -0,0 +1,465 @@
+#include "service_log.h"
+#include "logger.h"
+#include "supervisor.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+extern char **environ;
+
+/* Bytes requested per splice() call. */
+#define PUMP_SPLICE_CHUNK (1 << 20)
+
+/* Size of the buffer used when splice() is unavailable. */
+#define PUMP_BUFFER_SIZE (256 * 1024)
+
+/* Rotated segments that can wait for compression at once. */
+#define HOUSEKEEP_QUEUE 16
+
+/* State of the pump; lives in the pump process only. */
+typedef struct {
+    char            path[256];    /* Log file being written. */
+    LogRotation     rotation;
+    int             in_fd;        /* Read end of the service's pipe. */
+    int             out_fd;       /* Current log file. */
+    uint64_t        written;      /* Size of the current log file. */
+    time_t          opened_at;    /* When the current log file was started. */
+
+    pthread_t       thread;       /* Housekeeping: compression and pruning. */
+    bool            threaded;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    char            queue[HOUSEKEEP_QUEUE][300];
+    size_t          queue_head;
+    size_t          queue_count;
+    bool            done;
+} Pump;
+
+static Pump pump;
+
+/* Module-level logger — initialised via service_log_logger_init(). */
+static Logger sl_logger;
+static bool   sl_logger_ready = false;
+
+#define SL_LOG(fmt, ...) \
+    do { if (sl_logger_ready) logger_write(&sl_logger, fmt, ##__VA_ARGS__); } while (0)
+
+int service_log_logger_init(const char *logfile_path, bool stdout_enabled) {
+    int rc = logger_init(&sl_logger, logfile_path, stdout_enabled);
+    if (rc == 0) {
+        sl_logger_ready = true;
+    }
+    return rc;
+}
+
+/* Opens the log file for writing at its end. Not O_APPEND: Linux refuses
+ * to splice into append-mode files. */
+static int open_log(const char *path, uint64_t *size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    off_t end = lseek(fd, 0, SEEK_END);
+    *size = end > 0 ? (uint64_t)end : 0;
+    return fd;
+}
+
+/* Runs gzip on a rotated segment and waits for it. Spawned rather than
+ * forked, as the pump has its copy loop running on another thread. */
+static void compress_segment(const char *path) {
+    posix_spawn_file_actions_t actions;
+    if (posix_spawn_file_actions_init(&actions) != 0) {
+        return;
+    }
+    char *argv[] = { "gzip", "-f", (char *)path, NULL };
+    pid_t pid    = -1;
+    if (posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0) == 0 &&
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0) == 0 &&
+        posix_spawnp(&pid, "gzip", &actions, NULL, argv, environ) == 0) {
+        int status;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+    posix_spawn_file_actions_destroy(&actions);
+}
+
+/* Length of a segment name without its ".gz" suffix. */
+static size_t stem_len(const char *name) {
+    size_t len = strlen(name);
+    return len > 3 && strcmp(name + len - 3, ".gz") == 0 ? len - 3 : len;
+}
+
+/* Orders segment names chronologically: by timestamp, then by the "-N"
+ * suffix added when several rotations happen within one second, ignoring
+ * whether a segment has been compressed yet. */
+static int compare_segments(const void *a, const void *b) {
+    const char *x = *(char *const *)a;
+    const char *y = *(char *const *)b;
+    size_t      xl = stem_len(x);
+    size_t      yl = stem_len(y);
+    int         c  = strncmp(x, y, xl < yl ? xl : yl);
+    if (c != 0) return c;
+    return xl < yl ? -1 : xl > yl ? 1 : 0;
+}
+
+/* Deletes the oldest rotated segments beyond rotation.keep. Segment names
+ * start with a timestamp, so they sort chronologically. */
+static void prune_segments(void) {
+    if (pump.rotation.keep == 0) {
+        return;
+    }
+
+    char        dir[256];
+    const char *base  = strrchr(pump.path, '/');
+    if (base == NULL) {
+        strcpy(dir, ".");
+        base = pump.path;
+    } else {
+        size_t len = (size_t)(base - pump.path);
+        memcpy(dir, pump.path, len > 0 ? len : 1);
+        dir[len > 0 ? len : 1] = '\0';
+        base++;
+    }
+    size_t base_len = strlen(base);
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+
+    char  **names = NULL;
+    size_t  count = 0;
+    size_t  cap   = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (strncmp(name, base, base_len) != 0 || name[base_len] != '.' ||
+            name[base_len + 1] < '0' || name[base_len + 1] > '9') {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap > 0 ? cap * 2 : 16;
+            char **grown = realloc(names, cap * sizeof(*names));
+            if (grown == NULL) break;
+            names = grown;
+        }
+        if ((names[count] = strdup(name)) == NULL) break;
+        count++;
+    }
+    closedir(d);
+
+    qsort(names, count, sizeof(*names), compare_segments);
+    for (size_t i = 0; i + pump.rotation.keep < count; i++) {
+        char victim[600];
+        snprintf(victim, sizeof(victim), "%s/%s", dir, names[i]);
+        unlink(victim);
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+static void *housekeeping_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pump.lock);
+    for (;;) {
+        while (pump.queue_count == 0 && !pump.done) {
+            pthread_cond_wait(&pump.cond, &pump.lock);
+        }
+        if (pump.queue_count == 0) {
+            break;
+        }
+
+        char segment[300];
+        memcpy(segment, pump.queue[pump.queue_head], sizeof(segment));
+        pump.queue_head = (pump.queue_head + 1) % HOUSEKEEP_QUEUE;
+        pump.queue_count--;
+        pthread_mutex_unlock(&pump.lock);
+
+        if (pump.rotation.compress) {
+            compress_segment(segment);
+        }
+        prune_segments();
+
+        pthread_mutex_lock(&pump.lock);
+    }
+    pthread_mutex_unlock(&pump.lock);
+    return NULL;
+}
+
+/* Hands a rotated segment to the housekeeping thread, or handles it inline
+ * if the thread could not be started. */
+static void queue_segment(const char *segment) {
+    if (!pump.threaded) {
+        prune_segments();
+        return;
+    }
+
+    pthread_mutex_lock(&pump.lock);
+    if (pump.queue_count < HOUSEKEEP_QUEUE) {
+        size_t tail = (pump.queue_head + pump.queue_count) % HOUSEKEEP_QUEUE;
+        snprintf(pump.queue[tail], sizeof(pump.queue[tail]), "%s", segment);
+        pump.queue_count++;
+        pthread_cond_signal(&pump.cond);
+    }
+    pthread_mutex_unlock(&pump.lock);
+}
+
+/* Renames the current file to <path>.<timestamp> and starts a new one. */
+static void rotate(void) {
+    time_t    now = time(NULL);
+    struct tm tm_info;
+    char      stamp[32];
+    char      segment[300];
+    localtime_r(&now, &tm_info);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_info);
+
+    snprintf(segment, sizeof(segment), "%s.%s", pump.path, stamp);
+    for (int n = 1; access(segment, F_OK) == 0; n++) {
+        snprintf(segment, sizeof(segment), "%s.%s-%d", pump.path, stamp, n);
+    }
+
+    /* If anything fails, keep writing to the current file and retry after
+     * another full interval rather than on every chunk. */
+    pump.opened_at = now;
+    if (rename(pump.path, segment) != 0) {
+        pump.written = 0;
+        return;
+    }
+
+    uint64_t size;
+    int      fd = open_log(pump.path, &size);
+    if (fd < 0) {
+        pump.written = 0;
+        return;
+    }
+    close(pump.out_fd);
+    pump.out_fd  = fd;
+    pump.written = size;
+    queue_segment(segment);
+}
+
+static bool rotation_due(time_t now) {
+    return (pump.rotation.max_bytes > 0 && pump.written >= pump.rotation.max_bytes) ||
+           (pump.rotation.max_age_secs > 0 &&
+            now - pump.opened_at >= (time_t)pump.rotation.max_age_secs);
+}
+
+/* Writes the whole buffer, retrying on short writes. */
+static bool write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p   += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* Moves whatever is readable from the pipe into the log file. Returns the
+ * number of bytes moved, 0 at end of file, or -1 on error. */
+static ssize_t copy_chunk(char *buffer) {
+#ifdef __linux__
+    static bool splice_ok = true;
+    if (splice_ok) {
+        ssize_t n = splice(pump.in_fd, NULL, pump.out_fd, NULL, PUMP_SPLICE_CHUNK,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n >= 0 || errno == EINTR || errno == EAGAIN) {
+            return n;
+        }
+        if (errno == EINVAL || errno == ENOSYS) {
+            splice_ok = false;
+        }
+        /* Otherwise the file side failed; drain this round through the buffer. */
+    }
+#endif
+    ssize_t n = read(pump.in_fd, buffer, PUMP_BUFFER_SIZE);
+    if (n > 0) {
+        /* A failed write (disk full, file gone) still counts as drained, so
+         * that the service never blocks on its own output. */
+        write_all(pump.out_fd, buffer, (size_t)n);
+    }
+    return n;
+}
+
+/* Main loop of the pump process. Never returns. */
+static void pump_run(void) {
+    static char buffer[PUMP_BUFFER_SIZE];
+
+    pthread_mutex_init(&pump.lock, NULL);
+    pthread_cond_init(&pump.cond, NULL);
+    pump.threaded = pthread_create(&pump.thread, NULL, housekeeping_main, NULL) == 0;
+    pump.opened_at = time(NULL);
+
+    for (;;) {
+        int timeout = -1;
+        if (pump.rotation.max_age_secs > 0) {
+            time_t left = pump.opened_at + (time_t)pump.rotation.max_age_secs - time(NULL);
+            timeout = left > 0 ? (int)(left * 1000) : 0;
+        }
+
+        struct pollfd pfd = { .fd = pump.in_fd, .events = POLLIN, .revents = 0 };
+        int rc = poll(&pfd, 1, timeout);
+        if (rc < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (rc > 0) {
+            ssize_t n = copy_chunk(buffer);
+            if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+                break;
+            }
+            if (n > 0) {
+                pump.written += (uint64_t)n;
+            }
+        }
+
+        if (rotation_due(time(NULL))) {
+            rotate();
+        }
+    }
+
+    close(pump.out_fd);
+    if (pump.threaded) {
+        pthread_mutex_lock(&pump.lock);
+        pump.done = true;
+        pthread_cond_signal(&pump.cond);
+        pthread_mutex_unlock(&pump.lock);
+        pthread_join(pump.thread, NULL);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Starts the pump as a new program, with the pipe as its stdin and the log
+ * file as its stdout. posix_spawn() does not copy the caller's page tables,
+ * and the pump starts from a fresh image rather than a fork of the
+ * caller's threads and heap. */
+static pid_t spawn_pump(const ProcessNode *node, int in_fd, int out_fd) {
+    const char *exe = supervisor_self_path();
+    if (exe == NULL) {
+        errno = ENOSYS;
+        return -1;
+    }
+    char max_bytes[32], max_age[16], keep[8];
+    snprintf(max_bytes, sizeof(max_bytes), "%llu", (unsigned long long)node->log_rotation.max_bytes);
+    snprintf(max_age, sizeof(max_age), "%u", node->log_rotation.max_age_secs);
+    snprintf(keep, sizeof(keep), "%u", (unsigned)node->log_rotation.keep);
+    char *argv[] = { "supervisor", SERVICE_LOG_PUMP_COMMAND, (char *)node->log_path,
+                     max_bytes, max_age, keep, node->log_rotation.compress ? "1" : "0", NULL };
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    if (posix_spawn_file_actions_init(&actions) != 0) return -1;
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    /* Detached like the service, with default signal handling. */
+    sigset_t defaults, none;
+    sigemptyset(&none);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGINT);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_SETSID
+    flags |= POSIX_SPAWN_SETSID;
+#endif
+    int rc = posix_spawnattr_setflags(&attr, flags);
+    if (rc == 0) rc = posix_spawnattr_setsigdefault(&attr, &defaults);
+    if (rc == 0) rc = posix_spawnattr_setsigmask(&attr, &none);
+    if (rc == 0) rc = posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    if (rc == 0) rc = posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    if (rc == 0) rc = posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid = -1;
+    if (rc == 0) rc = posix_spawn(&pid, exe, &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+int service_log_pump(int argc, char **argv) {
+    if (argc != 7) {
+        return EXIT_FAILURE;
+    }
+
+    /* Holding anything but the pipe and the log file, e.g. the daemon's pid
+     * file, would keep it open for as long as the service runs. */
+    setsid();
+    signal(SIGHUP, SIG_IGN);
+    closefrom(STDERR_FILENO + 1);
+#if defined(__linux__)
+    prctl(PR_SET_NAME, "log-pump"); /* rather than "exe", from /proc/self/exe */
+#endif
+
+    memset(&pump, 0, sizeof(pump));
+    strncpy(pump.path, argv[2], sizeof(pump.path) - 1);
+    pump.rotation.max_bytes    = strtoull(argv[3], NULL, 10);
+    pump.rotation.max_age_secs = (uint32_t)strtoul(argv[4], NULL, 10);
+    pump.rotation.keep         = (uint16_t)strtoul(argv[5], NULL, 10);
+    pump.rotation.compress     = strcmp(argv[6], "1") == 0;
+    pump.in_fd                 = STDIN_FILENO;
+    pump.out_fd                = STDOUT_FILENO;
+    off_t end                  = lseek(STDOUT_FILENO, 0, SEEK_END);
+    pump.written               = end > 0 ? (uint64_t)end : 0;
+    pump_run();
+    return EXIT_SUCCESS;
+}
+
+int service_log_open(const ProcessNode *node) {
+    if (node == NULL || node->log_path[0] == '\0') {
+        return -1;
+    }
+
+    uint64_t size;
+    int      out_fd = open_log(node->log_path, &size);
+    if (out_fd < 0) {
+        SL_LOG("service_log_open: could not open log file '%s' of '%s': %s",
+               node->log_path, node->name, strerror(errno));
+        return -1;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        SL_LOG("service_log_open: pipe for '%s' failed: %s", node->name, strerror(errno));
+        close(out_fd);
+        return -1;
+    }
+
+    if (spawn_pump(node, fds[0], out_fd) < 0) {
+        SL_LOG("service_log_open: could not start the log pump of '%s': %s",
+               node->name, strerror(errno));
+        close(out_fd);
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    close(out_fd);
+    close(fds[0]);
+    return fds[1];
+}
@@ -0,0 +1,200 @@
+#include "status_page.h"
+#include "sampler.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(StatusEntry) == 120, "StatusEntry is part of the published layout");
+_Static_assert(sizeof(StatusRecord) == 128, "a StatusRecord fills one cache line");
+_Static_assert(sizeof(StatusPage) == 64, "the page header is one cache line");
+
+#define PAGE_SIZE_BYTES (sizeof(StatusPage) + STATUS_PAGE_CAPACITY * sizeof(StatusRecord))
+
+/* The publisher's mapping, created on first use. */
+static StatusPage *sp_page   = NULL;
+static bool        sp_failed = false;
+
+static bool layout_matches(const StatusPage *page) {
+    return atomic_load_explicit(&page->magic, memory_order_acquire) == STATUS_PAGE_MAGIC &&
+           page->version == STATUS_PAGE_VERSION &&
+           page->record_size == sizeof(StatusRecord) &&
+           page->capacity > 0;
+}
+
+/* Maps the page for writing. An existing page of this layout is reused,
+ * keeping its sequence numbers, so that readers mapped across a
+ * publisher's restart never see a sequence go backwards. */
+static StatusPage *open_page(void) {
+    int fd = open(STATUS_PAGE_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((size_t)st.st_size != PAGE_SIZE_BYTES && ftruncate(fd, (off_t)PAGE_SIZE_BYTES) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, PAGE_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    StatusPage *page = map;
+    if (!layout_matches(page) || page->capacity != STATUS_PAGE_CAPACITY) {
+        atomic_store_explicit(&page->magic, 0, memory_order_relaxed);
+        memset((char *)page + sizeof(page->magic), 0, PAGE_SIZE_BYTES - sizeof(page->magic));
+        page->version     = STATUS_PAGE_VERSION;
+        page->record_size = sizeof(StatusRecord);
+        page->capacity    = STATUS_PAGE_CAPACITY;
+        atomic_store_explicit(&page->magic, STATUS_PAGE_MAGIC, memory_order_release);
+    } else {
+        /* A publisher that died mid-write left that record's sequence odd,
+         * which readers would retry forever: clear the torn entry, so the
+         * next publish rewrites it, and make the sequence even again. */
+        for (uint32_t i = 0; i < page->capacity; i++) {
+            StatusRecord *record = &page->records[i];
+            uint32_t      seq    = atomic_load_explicit(&record->seq, memory_order_relaxed);
+            if ((seq & 1u) == 0) continue;
+            memset(&record->entry, 0, sizeof(record->entry));
+            atomic_store_explicit(&record->seq, seq + 1, memory_order_release);
+        }
+    }
+    return page;
+}
+
+void status_entry_fill(StatusEntry *entry, const ProcessNode *node) {
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->name, node->name, sizeof(entry->name));
+    entry->name[sizeof(entry->name) - 1] = '\0';
+    entry->start_time        = (int64_t)node->start_time;
+    entry->next_restart_time = (int64_t)node->next_restart_time;
+    entry->pid               = (int32_t)node->pid;
+    entry->restart_count     = node->restart_count;
+    entry->exit_status       = node->exit_status;
+    entry->port              = node->port;
+    entry->running           = node->running;
+    entry->exit_reason       = (uint8_t)node->exit_reason;
+    entry->restart_policy    = (uint8_t)node->restart_policy;
+    entry->readiness         = (uint8_t)node->readiness;
+    entry->crash_loop        = node->crash_loop;
+
+    const ResourceSample *sample = sampler_latest(node);
+    double                cpu    = sampler_cpu_percent(node);
+    entry->rss_bytes        = node->running && sample != NULL ? sample->rss_bytes : 0;
+    entry->cpu_centipercent = node->running && cpu >= 0 ? (int32_t)(cpu * 100.0 + 0.5) : -1;
+}
+
+void status_entry_apply(const StatusEntry *entry, ProcessNode *node) {
+    node->pid               = (pid_t)entry->pid;
+    node->running           = entry->running != 0;
+    node->restart_count     = entry->restart_count;
+    node->start_time        = (time_t)entry->start_time;
+    node->next_restart_time = (time_t)entry->next_restart_time;
+    node->port              = entry->port;
+    node->exit_reason       = (ExitReason)entry->exit_reason;
+    node->exit_status       = entry->exit_status;
+    node->restart_policy    = (RestartPolicy)entry->restart_policy;
+    node->readiness         = (Readiness)entry->readiness;
+    node->crash_loop        = entry->crash_loop != 0;
+
+    /* Two samples one second apart reproduce the published CPU usage. */
+    ResourceStats *stats = &node->stats;
+    memset(stats->samples, 0, sizeof(stats->samples));
+    stats->count = 0;
+    stats->next  = 0;
+    if (entry->rss_bytes == 0 && entry->cpu_centipercent < 0) return;
+    stats->samples[0].rss_bytes = entry->rss_bytes;
+    stats->count                = 1;
+    stats->next                 = 1;
+    if (entry->cpu_centipercent >= 0) {
+        stats->samples[1].at_ms     = 1000;
+        stats->samples[1].cpu_usec  = (uint64_t)entry->cpu_centipercent * 100;
+        stats->samples[1].rss_bytes = entry->rss_bytes;
+        stats->count                = 2;
+        stats->next                 = 2;
+    }
+}
+
+int status_page_publish(const ProcessTable *table) {
+    if (sp_page == NULL) {
+        if (sp_failed) return -1;
+        sp_page = open_page();
+        if (sp_page == NULL) {
+            sp_failed = true; /* Do not retry on every save. */
+            return -1;
+        }
+    }
+
+    uint32_t count   = table->count < STATUS_PAGE_CAPACITY ? (uint32_t)table->count : STATUS_PAGE_CAPACITY;
+    int      written = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        StatusRecord *record = &sp_page->records[i];
+        StatusEntry   entry;
+        status_entry_fill(&entry, &table->nodes[i]);
+        if (memcmp(&record->entry, &entry, sizeof(entry)) == 0) {
+            continue;
+        }
+
+        /* Odd sequence: readers that overlap the copy retry. */
+        uint32_t seq = atomic_load_explicit(&record->seq, memory_order_relaxed);
+        atomic_store_explicit(&record->seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(&record->entry, &entry, sizeof(entry));
+        atomic_store_explicit(&record->seq, seq + 2, memory_order_release);
+        written++;
+    }
+    atomic_store_explicit(&sp_page->count, count, memory_order_release);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    atomic_store_explicit(&sp_page->updated_ms,
+                          (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000, memory_order_relaxed);
+    return written;
+}
+
+const StatusPage *status_page_map(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StatusPage)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const StatusPage *page = map;
+    if (!layout_matches(page) ||
+        sizeof(StatusPage) + (size_t)page->capacity * sizeof(StatusRecord) > (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    return page;
+}
+
+bool status_page_read(const StatusPage *page, uint32_t index, StatusEntry *entry) {
+    if (index >= page->capacity) return false;
+
+    const StatusRecord *record = &page->records[index];
+    for (unsigned attempt = 0; attempt < STATUS_PAGE_READ_TRIES; attempt++) {
+        uint32_t before = atomic_load_explicit(&record->seq, memory_order_acquire);
+        if (before & 1u) continue;
+        memcpy(entry, &record->entry, sizeof(*entry));
+        atomic_thread_fence(memory_order_acquire);
+        uint32_t after = atomic_load_explicit(&record->seq, memory_order_relaxed);
+        if (before == after) {
+            entry->name[sizeof(entry->name) - 1] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+void status_page_unmap(const StatusPage *page) {
+    if (page == NULL) return;
+    munmap((void *)page, sizeof(StatusPage) + (size_t)page->capacity * sizeof(StatusRecord));
+}
@@ -1,72 +1,643 @@
 #include "supervisor.h"
+#include "cgroup.h"
+#include "jvm.h"
+#include "probe.h"
+#include "sampler.h"
+#include "service_log.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#elif defined(__FreeBSD__) || defined(__APPLE__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#include <sys/event.h>
+#endif
 #include <time.h>
 #include <unistd.h>
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#elif defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#endif
 
-/* Seconds to wait for SIGTERM before escalating to SIGKILL. */
-#define STOP_GRACE_PERIOD 5
+/* Exit polling while stopping, where the kernel cannot report the exit
+ * (see exit_watch_open()): the first check follows the signal after
+ * STOP_POLL_MIN_MS, and the interval doubles up to STOP_POLL_MAX_MS. */
+#define STOP_POLL_MIN_MS 1
+#define STOP_POLL_MAX_MS 50
+
+/* Milliseconds to wait for a process to disappear after SIGKILL. */
+#define STOP_KILL_WAIT_MS 5000
+
+/* First inherited descriptor under the LISTEN_FDS contract (as in sd_listen_fds). */
+#define LISTEN_FDS_START 3
+
+/* Descriptors on which a child started under SUPERVISOR_EXEC_COMMAND finds
+ * the read end of its gate, and the write end of the pipe it reports a
+ * failed exec on. */
+#define GATE_FD       3
+#define GATE_ERROR_FD 4
+
+/* Restart backoff: the first failure is restarted at once, the Nth
+ * consecutive one waits BACKOFF_BASE_SECS << (N - 2) seconds, capped. */
+#define BACKOFF_BASE_SECS 1
+#define BACKOFF_MAX_SECS  300
+
+/* Search path execvp() uses when PATH is not set. */
+#define DEFAULT_EXEC_PATH "/bin:/usr/bin"
+
+/* Environment built from a .env file, reused until the file changes. */
+typedef struct EnvCache {
+    char            path[256];
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+    char           *text; /* The file, split into "KEY=VALUE" strings. */
+    char          **envp; /* The supervisor's environment with the file's variables on top. */
+} EnvCache;
+
+/* Executable the latest launch resolved, and the search path it was found in. */
+typedef struct ExecCache {
+    char *name;
+    char *search;
+    char  path[PATH_MAX];
+} ExecCache;
 
 /* Module state. */
 static Logger      sv_logger;
 static bool        sv_logger_ready = false;
-static ProcessNode **sv_head       = NULL;
+static ProcessTable *sv_table      = NULL;
+static EnvCache   *sv_env          = NULL;
+static size_t      sv_env_count    = 0;
+static ExecCache   sv_exec         = { NULL, NULL, "" };
+
+extern char **environ;
 
 #define SV_LOG(fmt, ...) \
     do { if (sv_logger_ready) logger_write(&sv_logger, fmt, ##__VA_ARGS__); } while (0)
 
-void supervisor_init(ProcessNode **head, const char *logfile_path, bool stdout_enabled) {
-    sv_head = head;
+/* Records a waitpid() status on the node. A signal death is attributed to
+ * the OOM killer if the process's cgroup counted an OOM kill. */
+static void record_exit(ProcessNode *node, int status) {
+    if (WIFEXITED(status)) {
+        node->exit_reason = EXIT_NORMAL;
+        node->exit_status = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        node->exit_reason = cgroup_oom_killed(node) ? EXIT_OOM_KILLED : EXIT_SIGNALED;
+        node->exit_status = WTERMSIG(status);
+    }
+}
+
+static bool has_cgroup_limits(const ProcessNode *node) {
+    const CgroupLimits *limits = &node->cgroup;
+    return limits->memory_max > 0 || limits->memory_high > 0 || limits->cpu_quota > 0 ||
+           limits->cpu_weight > 0 || limits->io_weight > 0;
+}
+
+/* Kills what the node's exited process left in its cgroup and removes the
+ * cgroup, so that forked helpers do not outlive the service. */
+static void release_cgroup(ProcessNode *node) {
+    int left = cgroup_release(node);
+    if (left > 0) {
+        SV_LOG("supervisor: killed %d leftover process(es) of '%s' (pid %d)",
+               left, node->name, node->pid);
+    }
+}
+
+/*
+ * Decides whether the last run ended in failure. Exit code 0 is clean, and
+ * so is a SIGTERM-initiated shutdown: the JVM runs its shutdown hooks and
+ * exits with 128 + SIGTERM. An exit the supervisor could not observe is
+ * treated as a failure so that on-failure keeps restarting crashed services.
+ */
+static bool exit_is_failure(const ProcessNode *node) {
+    switch (node->exit_reason) {
+        case EXIT_NORMAL:
+            return node->exit_status != 0 && node->exit_status != 128 + SIGTERM;
+        case EXIT_SIGNALED:
+            return node->exit_status != SIGTERM;
+        case EXIT_OOM_KILLED:
+            return true;
+        case EXIT_STOPPED:
+            return false;
+        case EXIT_UNKNOWN:
+            break;
+    }
+    return true;
+}
+
+void supervisor_init(ProcessTable *table, const char *logfile_path, bool stdout_enabled) {
+    sv_table = table;
     if (logger_init(&sv_logger, logfile_path, stdout_enabled) == 0) {
         sv_logger_ready = true;
     }
     SV_LOG("supervisor_init: supervisor ready");
 }
 
+/* Compares the variable names of two "KEY=VALUE" strings. */
+static bool same_key(const char *a, const char *b) {
+    while (*a != '\0' && *a != '=' && *a == *b) {
+        a++;
+        b++;
+    }
+    return (*a == '\0' || *a == '=') && (*b == '\0' || *b == '=');
+}
+
+/* Returns the value of @p key in @p envp, or NULL. */
+static const char *env_value(char *const *envp, const char *key) {
+    size_t len = strlen(key);
+    for (size_t i = 0; envp[i] != NULL; i++) {
+        if (strncmp(envp[i], key, len) == 0 && envp[i][len] == '=') {
+            return envp[i] + len + 1;
+        }
+    }
+    return NULL;
+}
+
+static size_t env_count(char *const *envp) {
+    size_t n = 0;
+    while (envp[n] != NULL) n++;
+    return n;
+}
+
+static void env_cache_clear(EnvCache *cache) {
+    free(cache->text);
+    free(cache->envp);
+    cache->text = NULL;
+    cache->envp = NULL;
+}
+
 /*
- * Reads a .env file and calls setenv() for each non-empty, non-comment line.
- * Expected format: KEY=VALUE  (no quoting, no export prefix)
- * Lines starting with '#' and blank lines are silently skipped.
- * Called in the child process only.
+ * Parses a .env file into @p cache. Expected format: KEY=VALUE (no quoting,
+ * no export prefix); blank lines and lines starting with '#' are skipped.
+ * The variables are merged over the supervisor's own environment, as
+ * setenv() in the child used to do, so a launch only passes the array on.
  */
-static void load_env_file(const char *path) {
-    FILE *f = fopen(path, "r");
-    if (f == NULL) {
-        fprintf(stderr, "supervisor_start: could not open env file '%s': %s\n",
-                path, strerror(errno));
-        return;
+static bool env_cache_load(EnvCache *cache, int fd, const struct stat *st) {
+    char *text = malloc((size_t)st->st_size + 1);
+    if (text == NULL) return false;
+
+    size_t len = 0;
+    while (len < (size_t)st->st_size) {
+        ssize_t n = read(fd, text + len, (size_t)st->st_size - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    text[len] = '\0';
+
+    /* Split into lines in place, keeping the valid assignments. */
+    size_t lines = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') lines++;
+    }
+    char **vars  = malloc(lines * sizeof(*vars));
+    if (vars == NULL) {
+        free(text);
+        return false;
+    }
+    size_t count = 0;
+    for (char *line = text; line != NULL && *line != '\0'; ) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        size_t n = strlen(line);
+        while (n > 0 && line[n - 1] == '\r') line[--n] = '\0';
+        if (n > 0 && line[0] != '#' && line[0] != '=' && strchr(line, '=') != NULL) {
+            vars[count++] = line;
+        }
+        line = next;
+    }
+
+    /* The supervisor's variables not set by the file, then the file's,
+     * the last assignment of a name winning. */
+    size_t inherited = env_count(environ);
+    char **envp      = malloc((inherited + count + 1) * sizeof(*envp));
+    if (envp == NULL) {
+        free(vars);
+        free(text);
+        return false;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < inherited; i++) {
+        bool overridden = false;
+        for (size_t j = 0; j < count && !overridden; j++) {
+            overridden = same_key(environ[i], vars[j]);
+        }
+        if (!overridden) envp[n++] = environ[i];
+    }
+    for (size_t i = 0; i < count; i++) {
+        bool overridden = false;
+        for (size_t j = i + 1; j < count && !overridden; j++) {
+            overridden = same_key(vars[i], vars[j]);
+        }
+        if (!overridden) envp[n++] = vars[i];
+    }
+    envp[n] = NULL;
+    free(vars);
+
+    env_cache_clear(cache);
+    cache->dev   = st->st_dev;
+    cache->ino   = st->st_ino;
+    cache->size  = st->st_size;
+#if defined(__APPLE__)
+    cache->mtime = st->st_mtimespec;
+#else
+    cache->mtime = st->st_mtim;
+#endif
+    cache->text  = text;
+    cache->envp  = envp;
+    return true;
+}
+
+/*
+ * Returns the environment a node's service is launched with: the
+ * supervisor's own, with the node's .env file on top if it has one. The
+ * file is parsed once and parsed again only when it changes, so a restart
+ * costs one stat(). A file that cannot be read is logged and ignored.
+ */
+static char **service_environment(const ProcessNode *node) {
+    if (node->env_path[0] == '\0') {
+        return environ;
+    }
+
+    EnvCache *cache = NULL;
+    for (size_t i = 0; i < sv_env_count && cache == NULL; i++) {
+        if (strcmp(sv_env[i].path, node->env_path) == 0) cache = &sv_env[i];
+    }
+
+    struct stat st;
+    if (stat(node->env_path, &st) != 0) {
+        SV_LOG("supervisor_start: could not open env file '%s': %s",
+               node->env_path, strerror(errno));
+        return environ;
+    }
+#if defined(__APPLE__)
+    struct timespec mtime = st.st_mtimespec;
+#else
+    struct timespec mtime = st.st_mtim;
+#endif
+    if (cache != NULL && cache->envp != NULL && cache->dev == st.st_dev && cache->ino == st.st_ino &&
+        cache->size == st.st_size && cache->mtime.tv_sec == mtime.tv_sec &&
+        cache->mtime.tv_nsec == mtime.tv_nsec) {
+        return cache->envp;
+    }
+
+    if (cache == NULL) {
+        EnvCache *grown = realloc(sv_env, (sv_env_count + 1) * sizeof(*grown));
+        if (grown == NULL) return environ;
+        sv_env = grown;
+        cache  = &sv_env[sv_env_count++];
+        memset(cache, 0, sizeof(*cache));
+        snprintf(cache->path, sizeof(cache->path), "%s", node->env_path);
+    }
+
+    int fd = open(node->env_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0 || !env_cache_load(cache, fd, &st)) {
+        SV_LOG("supervisor_start: could not read env file '%s': %s",
+               node->env_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        env_cache_clear(cache);
+        return environ;
+    }
+    close(fd);
+    SV_LOG("supervisor_start: loaded env file '%s' (%zu variables in the environment)",
+           node->env_path, env_count(cache->envp));
+    return cache->envp;
+}
+
+/*
+ * Resolves @p name against the PATH of @p envp, as execvp() would in the
+ * child. The result is kept for the next launch with the same name and
+ * search path, and only checked with one access() then.
+ */
+static const char *resolve_executable(const char *name, char *const *envp) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+    const char *search = env_value(envp, "PATH");
+    if (search == NULL) search = DEFAULT_EXEC_PATH;
+
+    if (sv_exec.name != NULL && strcmp(sv_exec.name, name) == 0 &&
+        strcmp(sv_exec.search, search) == 0 && access(sv_exec.path, X_OK) == 0) {
+        return sv_exec.path;
+    }
+
+    for (const char *dir = search; ; ) {
+        const char *end = strchr(dir, ':');
+        size_t      len = end != NULL ? (size_t)(end - dir) : strlen(dir);
+        char        candidate[PATH_MAX];
+        int         n   = len == 0 ? snprintf(candidate, sizeof(candidate), "%s", name)
+                                   : snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, dir, name);
+        struct stat st;
+        if (n > 0 && (size_t)n < sizeof(candidate) && access(candidate, X_OK) == 0 &&
+            stat(candidate, &st) == 0 && S_ISREG(st.st_mode)) {
+            char *cached_name   = strdup(name);
+            char *cached_search = strdup(search);
+            if (cached_name != NULL && cached_search != NULL) {
+                free(sv_exec.name);
+                free(sv_exec.search);
+                sv_exec.name   = cached_name;
+                sv_exec.search = cached_search;
+                memcpy(sv_exec.path, candidate, (size_t)n + 1);
+                SV_LOG("supervisor_start: resolved '%s' to %s", name, sv_exec.path);
+                return sv_exec.path;
+            }
+            free(cached_name);
+            free(cached_search);
+            return NULL;
+        }
+        if (end == NULL) break;
+        dir = end + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Returns a copy of @p envp with the LISTEN_FDS variables of an inherited
+ * socket on top. LISTEN_PID is completed in the child, which alone knows
+ * its pid. Free with free().
+ */
+static char **listen_environment(char *const *envp, char *listen_pid, char *listen_names) {
+    static char listen_fds[] = "LISTEN_FDS=1";
+    char      *listen[]      = { listen_fds, listen_pid, listen_names };
+    size_t     inherited     = env_count(envp);
+    char     **merged        = malloc((inherited + 4) * sizeof(*merged));
+    if (merged == NULL) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < 3; i++) {
+        merged[n++] = listen[i];
+    }
+    for (size_t i = 0; i < inherited; i++) {
+        if (!same_key(envp[i], listen_fds) && !same_key(envp[i], listen_pid) &&
+            !same_key(envp[i], listen_names)) {
+            merged[n++] = envp[i];
+        }
+    }
+    merged[n] = NULL;
+    return merged;
+}
+
+/* Writes @p pid in decimal at @p out; async-signal-safe, unlike snprintf(). */
+static void format_pid(char *out, pid_t pid) {
+    char   digits[16];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + pid % 10);
+        pid /= 10;
+    } while (pid > 0);
+    while (n > 0) *out++ = digits[--n];
+    *out = '\0';
+}
+
+const char *supervisor_self_path(void) {
+#if defined(__linux__)
+    return "/proc/self/exe"; /* the running binary, even if replaced on disk since */
+#elif defined(__APPLE__)
+    static char path[PATH_MAX];
+    uint32_t    size = sizeof(path);
+    return path[0] != '\0' || _NSGetExecutablePath(path, &size) == 0 ? path : NULL;
+#elif defined(__FreeBSD__)
+    static char path[PATH_MAX];
+    int         mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, -1 };
+    size_t      size   = sizeof(path);
+    return path[0] != '\0' || sysctl(mib, 4, path, &size, NULL, 0) == 0 ? path : NULL;
+#else
+    return NULL;
+#endif
+}
+
+/* Blocks until every copy of the gate's write end is closed, i.e. until
+ * the supervisor has moved this process into its cgroup. */
+static void wait_gate(int gate_fd) {
+    char c;
+    while (read(gate_fd, &c, 1) < 0 && errno == EINTR) {}
+}
+
+int supervisor_exec_gate(int argc, char **argv) {
+    if (argc < 4) {
+        return EXIT_FAILURE;
+    }
+    wait_gate(GATE_FD);
+    close(GATE_FD);
+    fcntl(GATE_ERROR_FD, F_SETFD, FD_CLOEXEC); /* closed by a successful exec */
+    execv(argv[2], argv + 3);
+    int exec_errno = errno;
+    while (write(GATE_ERROR_FD, &exec_errno, sizeof(exec_errno)) < 0 && errno == EINTR) {}
+    return 127;
+}
+
+#ifdef POSIX_SPAWN_SETSID
+/*
+ * Launches a service with posix_spawn(): in a new session, stdin on
+ * /dev/null and stdout/stderr on @p out_fd (or /dev/null if -1). The C
+ * library starts the child without copying the supervisor's page tables
+ * (vfork-style), and reports a failed exec as an error here.
+ *
+ * With a @p gate_fd, the child is the supervisor's own binary under
+ * SUPERVISOR_EXEC_COMMAND, which execs the service once the gate's write
+ * end is closed; the process, and so its pid, stays the same. The gate
+ * reports a failed exec of the service on @p error_fd.
+ */
+static pid_t spawn_service(const char *exe, char *const *argv, char *const *envp, int out_fd,
+                           int gate_fd, int error_fd) {
+    char      **gate_argv = NULL;
+    const char *self      = supervisor_self_path();
+    if (gate_fd >= 0 && self != NULL) {
+        size_t argc = 0;
+        while (argv[argc] != NULL) argc++;
+        gate_argv = malloc((argc + 4) * sizeof(*gate_argv));
+        if (gate_argv == NULL) return -1;
+        gate_argv[0] = "supervisor";
+        gate_argv[1] = SUPERVISOR_EXEC_COMMAND;
+        gate_argv[2] = (char *)exe;
+        memcpy(gate_argv + 3, argv, (argc + 1) * sizeof(*gate_argv));
+        exe  = self;
+        argv = gate_argv;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    if (posix_spawn_file_actions_init(&actions) != 0) {
+        free(gate_argv);
+        return -1;
+    }
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        free(gate_argv);
+        return -1;
+    }
+
+    int rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    if (rc == 0) rc = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (rc == 0 && out_fd >= 0) {
+        /* The pipe is close-on-exec; only its copies survive. */
+        rc = posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+        if (rc == 0) rc = posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+    } else if (rc == 0) {
+        rc = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        if (rc == 0) rc = posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    }
+    if (rc == 0 && gate_argv != NULL) rc = posix_spawn_file_actions_adddup2(&actions, gate_fd, GATE_FD);
+    if (rc == 0 && gate_argv != NULL && error_fd >= 0) {
+        rc = posix_spawn_file_actions_adddup2(&actions, error_fd, GATE_ERROR_FD);
     }
 
-    char line[1024];
-    while (fgets(line, sizeof(line), f)) {
-        /* Strip trailing newline / carriage return. */
-        size_t len = strlen(line);
-        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
-            line[--len] = '\0';
+    pid_t pid = -1;
+    if (rc == 0) rc = posix_spawn(&pid, exe, &actions, &attr, argv, envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    free(gate_argv);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+#endif
 
-        /* Skip blank lines and comments. */
-        if (len == 0 || line[0] == '#') continue;
+/*
+ * Launches a service with fork(), for the cases posix_spawn() cannot
+ * express: handing over a socket under LISTEN_PID, which must name the
+ * child, and platforms without POSIX_SPAWN_SETSID. Everything is prepared
+ * by the caller, so the child only makes async-signal-safe calls. With a
+ * @p gate pipe, the child drops its copy of the write end and waits for the
+ * gate before anything else. A failed exec is reported on @p error_fd,
+ * which lies above the descriptors the child sets up.
+ */
+static pid_t fork_service(const char *exe, char *const *argv, char *const *envp, int out_fd,
+                          int listen_fd, char *listen_pid_value, const int gate[2], int error_fd) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    if (gate[0] >= 0) {
+        close(gate[1]);
+        wait_gate(gate[0]);
+    }
 
-        /* Must contain '=' to be a valid KEY=VALUE pair. */
-        char *eq = strchr(line, '=');
-        if (eq == NULL) continue;
+    /* Child — detach from the parent's session so it survives the CLI exiting. */
+    if (setsid() < 0) {
+        _exit(EXIT_FAILURE);
+    }
 
-        *eq = '\0';
-        const char *key   = line;
-        const char *value = eq + 1;
+    /* Redirect stdin to /dev/null. Send stdout/stderr to the log pump if
+     * one is running, otherwise also to /dev/null. */
+    int devnull = open("/dev/null", O_RDWR);
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+    }
+    if (out_fd >= 0) {
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(out_fd, STDERR_FILENO);
+    } else if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+    }
+    if (devnull > STDERR_FILENO) close(devnull);
 
-        if (setenv(key, value, 1) != 0) {
-            fprintf(stderr, "supervisor_start: setenv(%s) failed: %s\n",
-                    key, strerror(errno));
+    /* Hand over the held socket as fd 3 under the systemd LISTEN_FDS contract. */
+    if (listen_fd >= 0) {
+        if (listen_fd == LISTEN_FDS_START) {
+            fcntl(listen_fd, F_SETFD, 0);
+        } else {
+            dup2(listen_fd, LISTEN_FDS_START);
         }
+        format_pid(listen_pid_value, getpid());
+    }
+
+    execve(exe, argv, envp);
+    int exec_errno = errno;
+    if (error_fd >= 0) {
+        while (write(error_fd, &exec_errno, sizeof(exec_errno)) < 0 && errno == EINTR) {}
+    }
+    _exit(EXIT_FAILURE);
+}
+
+/* Closes the node's held listening socket, if any. */
+static void listen_socket_release(ProcessNode *node) {
+    if (node->listen_port == 0) {
+        return;
+    }
+    close(node->listen_fd);
+    SV_LOG("supervisor: released listening socket of '%s' on port %hu",
+           node->name, node->listen_port);
+    node->listen_fd   = -1;
+    node->listen_port = 0;
+}
+
+/*
+ * Returns the node's listening socket, binding one if none is held for its
+ * current port. SO_REUSEPORT lets a new socket share the port with one still
+ * held by a previous generation of the service, so even a one-shot CLI
+ * restart can bind before the old JVM stops listening. The socket is
+ * close-on-exec; the child dups it onto LISTEN_FDS_START. Returns -1 if
+ * the port could not be bound.
+ */
+static int listen_socket_acquire(ProcessNode *node) {
+    if (node->listen_port != 0 && node->listen_port == node->port) {
+        return node->listen_fd;
+    }
+    listen_socket_release(node);
+
+    /* Dual-stack like the JVM's own wildcard bind, IPv4 only as a fallback. */
+    bool v6 = true;
+    int  fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) {
+        v6 = false;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (fd < 0) {
+        SV_LOG("supervisor: socket() failed for '%s': %s", node->name, strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+
+    int rc;
+    if (v6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port   = htons(node->port);
+        addr.sin6_addr   = in6addr_any;
+        rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(node->port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0) {
+        SV_LOG("supervisor: could not listen on port %hu for '%s': %s",
+               node->port, node->name, strerror(errno));
+        close(fd);
+        return -1;
     }
 
-    fclose(f);
+    node->listen_fd   = fd;
+    node->listen_port = node->port;
+    SV_LOG("supervisor: holding listening socket of '%s' on port %hu", node->name, node->port);
+    return fd;
 }
 
 int supervisor_start(ProcessNode *node) {
@@ -75,110 +646,482 @@ int supervisor_start(ProcessNode *node) {
         return -1;
     }
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        SV_LOG("supervisor_start: fork failed for '%s': %s", node->name, strerror(errno));
+    int listen_fd = -1;
+    if (node->listen_socket && node->port != 0) {
+        listen_fd = listen_socket_acquire(node);
+        if (listen_fd < 0) {
+            SV_LOG("supervisor_start: starting '%s' without an inherited socket", node->name);
+        }
+    } else {
+        listen_socket_release(node);
+    }
+
+    /* Command line, environment and executable are all prepared here, so
+     * the child only has to exec. */
+    JvmCommand cmd;
+    if (jvm_build_command(sv_table, node, &cmd) != 0) {
+        SV_LOG("supervisor_start: command line for '%s' is too long", node->name);
+        return -1;
+    }
+    char      **envp = service_environment(node);
+    const char *exe  = resolve_executable(cmd.argv[0], envp);
+    if (exe == NULL) {
+        SV_LOG("supervisor_start: '%s' not found in PATH for '%s'", cmd.argv[0], node->name);
         return -1;
     }
 
-    if (pid == 0) {
-        /* Child — detach from the parent's session so it survives the CLI exiting. */
-        if (setsid() < 0) {
-            fprintf(stderr, "supervisor_start: setsid failed: %s\n", strerror(errno));
-            _exit(EXIT_FAILURE);
-        }
-
-        /* Redirect stdin to /dev/null. Redirect stdout/stderr to the service log
-         * file if one is configured, otherwise also send them to /dev/null. */
-        int devnull = open("/dev/null", O_RDWR);
-        if (devnull >= 0) {
-            dup2(devnull, STDIN_FILENO);
-        }
-        if (node->log_path[0] != '\0') {
-            int logfd = open(node->log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-            if (logfd >= 0) {
-                dup2(logfd, STDOUT_FILENO);
-                dup2(logfd, STDERR_FILENO);
-                if (logfd > STDERR_FILENO) close(logfd);
-            } else {
-                /* stderr still points to terminal here — log the error then silence it. */
-                fprintf(stderr, "supervisor_start: could not open log file '%s': %s\n",
-                        node->log_path, strerror(errno));
-                if (devnull >= 0) {
-                    dup2(devnull, STDOUT_FILENO);
-                    dup2(devnull, STDERR_FILENO);
-                }
-            }
-        } else {
-            if (devnull >= 0) {
-                dup2(devnull, STDOUT_FILENO);
-                dup2(devnull, STDERR_FILENO);
-            }
+    /* Set after the .env file so it cannot be overridden. */
+    char   listen_pid[32] = "LISTEN_PID=";
+    char   listen_names[sizeof("LISTEN_FDNAMES=") + sizeof(node->name)];
+    char **listen_envp    = NULL;
+    if (listen_fd >= 0) {
+        snprintf(listen_names, sizeof(listen_names), "LISTEN_FDNAMES=%s", node->name);
+        listen_envp = listen_environment(envp, listen_pid, listen_names);
+        if (listen_envp == NULL) {
+            SV_LOG("supervisor_start: out of memory for the environment of '%s'", node->name);
+            return -1;
         }
-        if (devnull > STDERR_FILENO) close(devnull);
+        envp = listen_envp;
+    }
 
-        /* Load environment variables from the .env file if one is configured. */
-        if (node->env_path[0] != '\0') {
-            load_env_file(node->env_path);
+    /* stdout/stderr go through a pipe to a log pump that rotates the file. */
+    int log_fd = -1;
+    if (node->log_path[0] != '\0') {
+        log_fd = service_log_open(node);
+        if (log_fd < 0) {
+            SV_LOG("supervisor_start: could not set up log '%s' for '%s', discarding output",
+                   node->log_path, node->name);
         }
+    }
 
-        /* exec java -jar <path>. Never returns on success. */
-        char port_arg[32];
-        snprintf(port_arg, sizeof(port_arg), "--server.port=%hu", node->port);
-        execlp("java", "java", "-jar", node->path, port_arg, (char *)NULL);
-        _exit(EXIT_FAILURE);
+    /* With cgroups, the child waits at a gate until it is in its leaf, so
+     * that nothing it forks escapes the leaf's limits. */
+    int gate[2] = { -1, -1 };
+    if (cgroup_root() != NULL && pipe2(gate, O_CLOEXEC) != 0) {
+        SV_LOG("supervisor_start: pipe failed for '%s', it joins its cgroup once running: %s",
+               node->name, strerror(errno));
+        gate[0] = gate[1] = -1;
+    }
+
+    /* posix_spawn() reports a failed exec itself; the gate and a forked
+     * child report it on this pipe, which a successful exec closes. It is
+     * made after the gate, so that neither end is GATE_FD or LISTEN_FDS_START. */
+    int error_pipe[2] = { -1, -1 };
+    if (pipe2(error_pipe, O_CLOEXEC) != 0) {
+        SV_LOG("supervisor_start: pipe failed for '%s', a failed exec shows as an exit: %s",
+               node->name, strerror(errno));
+        error_pipe[0] = error_pipe[1] = -1;
+    }
+
+    /* exec java [tuning] -jar <path> --server.port=<port> [args]. */
+    char *pid_value = listen_pid + strlen(listen_pid);
+#ifdef POSIX_SPAWN_SETSID
+    pid_t pid = listen_fd < 0 ? spawn_service(exe, cmd.argv, envp, log_fd, gate[0], error_pipe[1])
+                              : fork_service(exe, cmd.argv, envp, log_fd, listen_fd, pid_value, gate,
+                                             error_pipe[1]);
+#else
+    pid_t pid = fork_service(exe, cmd.argv, envp, log_fd, listen_fd, pid_value, gate, error_pipe[1]);
+#endif
+    int launch_errno = errno;
+    free(listen_envp);
+    if (gate[0] >= 0) close(gate[0]);
+    if (error_pipe[1] >= 0) close(error_pipe[1]);
+    if (pid < 0) {
+        SV_LOG("supervisor_start: could not launch '%s': %s", node->name, strerror(launch_errno));
+        if (log_fd >= 0) close(log_fd);
+        if (gate[1] >= 0) close(gate[1]);
+        if (error_pipe[0] >= 0) close(error_pipe[0]);
+        return -1;
+    }
+
+    /* Only the service and the pump may hold the pipe. */
+    if (log_fd >= 0) close(log_fd);
+
+    /* The child is moved into its leaf before it execs; closing the gate
+     * lets it go on. */
+    char unset[128];
+    int  attached = cgroup_attach(node, pid, unset, sizeof(unset));
+    if (gate[1] >= 0) close(gate[1]);
+    if (attached < 0) {
+        SV_LOG("supervisor_start: could not create a cgroup for '%s': %s", node->name, strerror(errno));
+    } else if (attached > 0 && has_cgroup_limits(node)) {
+        SV_LOG("supervisor_start: no writable cgroup v2 hierarchy, limits of '%s' are not enforced",
+               node->name);
+    } else if (unset[0] != '\0') {
+        SV_LOG("supervisor_start: could not set %s of '%s' (controller not enabled?)", unset, node->name);
+    }
+
+    /* The child writes its errno if the exec failed, then exits; end of
+     * file means the service runs. */
+    int exec_errno = 0;
+    if (error_pipe[0] >= 0) {
+        ssize_t n;
+        while ((n = read(error_pipe[0], &exec_errno, sizeof(exec_errno))) < 0 && errno == EINTR) {}
+        close(error_pipe[0]);
+        if (n != (ssize_t)sizeof(exec_errno)) exec_errno = 0;
+    }
+    if (exec_errno != 0) {
+        SV_LOG("supervisor_start: could not launch '%s': %s", node->name, strerror(exec_errno));
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+        ProcessNode failed = *node;
+        failed.pid         = pid;
+        cgroup_release(&failed);
+        errno = exec_errno;
+        return -1;
     }
 
-    /* Parent — record the new PID. */
-    node->pid        = pid;
-    node->running    = true;
-    node->start_time = time(NULL);
+    /* Record the new PID. */
+    process_set_pid(sv_table, node, pid);
+    node->running     = true;
+    node->owned       = true;
+    node->start_time  = time(NULL);
+    node->exit_reason = EXIT_UNKNOWN;
+    node->exit_status = 0;
+    node->rss_strikes = 0;
+    node->cpu_strikes = 0;
+    node->health_failures = 0;
+    node->readiness   = node->port != 0 ? READINESS_STARTING : READINESS_READY;
 
-    SV_LOG("supervisor_start: started '%s' (pid %d)", node->name, node->pid);
+    char line[512];
+    size_t len = 0;
+    for (size_t i = 0; cmd.argv[i] != NULL && len < sizeof(line); i++) {
+        int n = snprintf(line + len, sizeof(line) - len, i == 0 ? "%s" : " %s", cmd.argv[i]);
+        if (n < 0) break;
+        len += (size_t)n;
+    }
+    SV_LOG("supervisor_start: started '%s' (pid %d): %s", node->name, node->pid, line);
     return 0;
 }
 
-int supervisor_stop(ProcessNode *node) {
-    if (node == NULL) {
-        SV_LOG("supervisor_stop: node is NULL");
+/* Signals accepted in a stop sequence, by the name used on the command line. */
+static const struct {
+    int         signal;
+    const char *name;
+} stop_signals[] = {
+    { SIGTERM, "TERM" }, { SIGINT,  "INT"  }, { SIGQUIT, "QUIT" }, { SIGHUP, "HUP" },
+    { SIGUSR1, "USR1" }, { SIGUSR2, "USR2" }, { SIGKILL, "KILL" },
+};
+
+#define STOP_SIGNAL_COUNT (sizeof(stop_signals) / sizeof(stop_signals[0]))
+
+static const char *signal_name(int signal) {
+    for (size_t i = 0; i < STOP_SIGNAL_COUNT; i++) {
+        if (stop_signals[i].signal == signal) return stop_signals[i].name;
+    }
+    return "?";
+}
+
+int supervisor_parse_stop_sequence(const char *text, StopSpec *spec) {
+    StopSpec parsed = *spec;
+    parsed.step_count = 0;
+
+    const char *p = text;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        char   step[32];
+        if (len == 0 || len >= sizeof(step)) return -1;
+        memcpy(step, p, len);
+        step[len] = '\0';
+        p += len;
+        if (*p == ',') p++;
+
+        char       *colon = strchr(step, ':');
+        const char *name  = strncmp(step, "SIG", 3) == 0 ? step + 3 : step;
+        if (colon != NULL) *colon = '\0';
+
+        int signal = 0;
+        for (size_t i = 0; i < STOP_SIGNAL_COUNT; i++) {
+            if (strcmp(name, stop_signals[i].name) == 0) signal = stop_signals[i].signal;
+        }
+        if (signal == 0) return -1;
+        if (signal == SIGKILL) break; /* Always the last step anyway. */
+        if (parsed.step_count == STOP_MAX_STEPS) return -1;
+
+        StopStep *s  = &parsed.steps[parsed.step_count++];
+        s->signal     = (uint8_t)signal;
+        s->timeout_ms = colon != NULL ? (uint32_t)strtoul(colon + 1, NULL, 10) : DEFAULT_STOP_TIMEOUT_MS;
+    }
+
+    *spec = parsed;
+    return 0;
+}
+
+const char *supervisor_format_stop_sequence(const StopSpec *spec, char *buf, size_t size) {
+    StopStep        fallback = { .signal = SIGTERM, .timeout_ms = DEFAULT_STOP_TIMEOUT_MS };
+    const StopStep *steps    = spec->step_count > 0 ? spec->steps : &fallback;
+    size_t          count    = spec->step_count > 0 ? spec->step_count : 1;
+    size_t          len      = 0;
+
+    buf[0] = '\0';
+    for (size_t i = 0; i < count && len < size; i++) {
+        int n = snprintf(buf + len, size - len, "%s:%u,", signal_name(steps[i].signal),
+                         steps[i].timeout_ms);
+        if (n < 0) break;
+        len += (size_t)n;
+    }
+    if (len < size) snprintf(buf + len, size - len, "KILL");
+    return buf;
+}
+
+unsigned supervisor_stop_budget_ms(const StopSpec *spec) {
+    unsigned budget = STOP_KILL_WAIT_MS;
+    if (spec->pre_stop_path[0] != '\0') {
+        budget += spec->pre_stop_timeout_ms > 0 ? spec->pre_stop_timeout_ms : DEFAULT_PRE_STOP_TIMEOUT_MS;
+    }
+    if (spec->step_count == 0) {
+        return budget + DEFAULT_STOP_TIMEOUT_MS;
+    }
+    for (size_t i = 0; i < spec->step_count; i++) {
+        budget += spec->steps[i].timeout_ms;
+    }
+    return budget;
+}
+
+/* Monotonic clock in milliseconds. */
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Whether a process that is not our child has exited. An orphan lingers as
+ * a zombie until init reaps it, which can take a while; on Linux that
+ * state is read from /proc so it counts as exited straight away. */
+static bool process_gone(pid_t pid) {
+    if (kill(pid, 0) != 0) {
+        return errno == ESRCH;
+    }
+#ifdef __linux__
+    char path[32], stat[256];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    stat[n] = '\0';
+    char *end = strrchr(stat, ')'); /* the command name may contain spaces */
+    return end != NULL && end[1] == ' ' && end[2] == 'Z';
+#else
+    return false;
+#endif
+}
+
+/* Whether @p pid has exited; for a child of ours the exit is reaped and
+ * its waitpid() status stored in @p status, with @p reaped set. */
+static bool exit_seen(pid_t pid, int *status, bool *reaped) {
+    pid_t result = waitpid(pid, status, WNOHANG);
+    if (result == pid) {
+        *reaped = true;
+        return true;
+    }
+    return result < 0 && process_gone(pid);
+}
+
+/*
+ * Opens a descriptor that reports the exit of @p pid, whether or not it is
+ * our child: a pidfd on Linux (5.3 and later), or a kqueue with an
+ * EVFILT_PROC/NOTE_EXIT filter on the BSDs and macOS. Returns -1 where
+ * neither is available, or if @p pid is already gone.
+ */
+static int exit_watch_open(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    return (int)syscall(SYS_pidfd_open, pid, 0); /* close-on-exec by default */
+#elif defined(__FreeBSD__) || defined(__APPLE__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    int kq = kqueue();
+    if (kq < 0) {
+        return -1;
+    }
+    fcntl(kq, F_SETFD, FD_CLOEXEC);
+    struct kevent change;
+    EV_SET(&change, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+    if (kevent(kq, &change, 1, NULL, 0, NULL) != 0) {
+        close(kq);
         return -1;
     }
+    return kq;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/* Blocks until the watched process exits or @p timeout_ms passes. Returns
+ * 1 on exit, 0 on timeout and -1 on error. */
+static int exit_watch_wait(int watch, long long timeout_ms) {
+#if defined(__FreeBSD__) || defined(__APPLE__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    struct kevent   event;
+    struct timespec limit = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000 };
+    int rc = kevent(watch, NULL, 0, &event, 1, &limit);
+    return rc < 0 ? (errno == EINTR ? 0 : -1) : rc > 0;
+#else
+    struct pollfd pfd = { .fd = watch, .events = POLLIN, .revents = 0 };
+    int rc = poll(&pfd, 1, timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms);
+    return rc < 0 ? (errno == EINTR ? 0 : -1) : rc > 0;
+#endif
+}
+
+/*
+ * Waits up to @p timeout_ms for @p pid to exit. The kernel reports the exit
+ * through exit_watch_open(), so the wait ends as soon as the process is
+ * gone; where that is unavailable the process is polled at an interval
+ * that starts at STOP_POLL_MIN_MS and doubles up to STOP_POLL_MAX_MS.
+ * @p status and @p reaped are as for exit_seen().
+ */
+static bool await_exit(pid_t pid, long long timeout_ms, int *status, bool *reaped) {
+    *reaped = false;
+    if (exit_seen(pid, status, reaped)) {
+        return true;
+    }
+
+    long long deadline = now_ms() + timeout_ms;
+    int       watch    = exit_watch_open(pid);
+    if (watch < 0 && errno == ESRCH) {
+        exit_seen(pid, status, reaped); /* gone between the two checks */
+        return true;
+    }
+
+    long long pause_ms = STOP_POLL_MIN_MS;
+    for (;;) {
+        long long left = deadline - now_ms();
+        if (left <= 0) {
+            break;
+        }
+        if (watch >= 0) {
+            int rc = exit_watch_wait(watch, left);
+            if (rc < 0) {
+                close(watch);
+                watch = -1;
+            } else if (rc > 0) {
+                /* A child is reaped here; any other process has already exited. */
+                close(watch);
+                exit_seen(pid, status, reaped);
+                return true;
+            }
+        } else {
+            if (pause_ms > left) pause_ms = left;
+            struct timespec pause = { .tv_sec = pause_ms / 1000, .tv_nsec = (long)(pause_ms % 1000) * 1000000 };
+            nanosleep(&pause, NULL);
+            if (pause_ms < STOP_POLL_MAX_MS) pause_ms *= 2;
+        }
+        if (exit_seen(pid, status, reaped)) {
+            if (watch >= 0) close(watch);
+            return true;
+        }
+    }
+
+    if (watch >= 0) close(watch);
+    return false;
+}
+
+bool supervisor_wait_exit(pid_t pid, unsigned timeout_ms) {
+    int  status;
+    bool reaped;
+    return await_exit(pid, timeout_ms, &status, &reaped);
+}
+
+/* Waits up to @p timeout_ms for the node's process to exit, recording its
+ * exit status when it is a child of this process. */
+static bool wait_exit(ProcessNode *node, long long timeout_ms) {
+    int  status;
+    bool reaped;
+    if (!await_exit(node->pid, timeout_ms, &status, &reaped)) {
+        return false;
+    }
+    if (reaped) record_exit(node, status);
+    return true;
+}
 
+/* Stops the process by running its stop spec, leaving any held listening
+ * socket open. */
+static int stop_process(ProcessNode *node) {
     if (!node->running || node->pid <= 0) {
+        /* Still record the intent so that monitor does not bring it back. */
+        node->exit_reason       = EXIT_STOPPED;
+        node->next_restart_time = 0;
         SV_LOG("supervisor_stop: '%s' is not running", node->name);
         return -1;
     }
 
-    SV_LOG("supervisor_stop: sending SIGTERM to '%s' (pid %d)", node->name, node->pid);
+    long long started = now_ms();
+    bool      exited  = false;
+    node->readiness = READINESS_DRAINING;
 
-    if (kill(node->pid, SIGTERM) != 0) {
-        SV_LOG("supervisor_stop: kill(SIGTERM) failed for '%s': %s",
-               node->name, strerror(errno));
-        return -1;
+    /* Ask the application to shut itself down first. */
+    if (node->stop.pre_stop_path[0] != '\0' && node->port != 0) {
+        uint32_t budget = node->stop.pre_stop_timeout_ms > 0 ? node->stop.pre_stop_timeout_ms
+                                                             : DEFAULT_PRE_STOP_TIMEOUT_MS;
+        Probe    hook   = { .port = node->port, .path = node->stop.pre_stop_path,
+                            .method = "POST", .timeout_ms = budget };
+        SV_LOG("supervisor_stop: calling pre-stop hook POST %s of '%s' (pid %d)",
+               node->stop.pre_stop_path, node->name, node->pid);
+        probe_run(&hook, 1);
+        if (hook.result != PROBE_OK) {
+            /* Nothing will shut the application down; go on to the signals. */
+            SV_LOG("supervisor_stop: pre-stop hook of '%s' failed (%s, status %d)",
+                   node->name, probe_result_str(hook.result), hook.status);
+        } else {
+            long long left = started + budget - now_ms();
+            exited = wait_exit(node, left > 0 ? left : 0);
+        }
     }
 
-    /* Wait up to STOP_GRACE_PERIOD seconds for clean exit. */
-    time_t deadline = time(NULL) + STOP_GRACE_PERIOD;
-    int    status;
-    while (time(NULL) < deadline) {
-        pid_t result = waitpid(node->pid, &status, WNOHANG);
-        if (result == node->pid) {
-            node->running = false;
-            SV_LOG("supervisor_stop: '%s' exited cleanly", node->name);
-            return 0;
+    StopStep        fallback = { .signal = SIGTERM, .timeout_ms = DEFAULT_STOP_TIMEOUT_MS };
+    const StopStep *steps    = node->stop.step_count > 0 ? node->stop.steps : &fallback;
+    size_t          count    = node->stop.step_count > 0 ? node->stop.step_count : 1;
+    for (size_t i = 0; !exited && i < count; i++) {
+        SV_LOG("supervisor_stop: sending SIG%s to '%s' (pid %d), waiting up to %ums",
+               signal_name(steps[i].signal), node->name, node->pid, steps[i].timeout_ms);
+        if (kill(node->pid, steps[i].signal) != 0) {
+            if (errno == ESRCH) {
+                /* Already gone (exit not observed) — just record the stop. */
+                SV_LOG("supervisor_stop: '%s' (pid %d) had already exited", node->name, node->pid);
+                exited = true;
+                break;
+            }
+            SV_LOG("supervisor_stop: kill(SIG%s) failed for '%s': %s",
+                   signal_name(steps[i].signal), node->name, strerror(errno));
+            return -1;
         }
-        sleep(1);
+        exited = wait_exit(node, steps[i].timeout_ms);
     }
 
-    /* Grace period elapsed — escalate. */
-    SV_LOG("supervisor_stop: grace period elapsed, sending SIGKILL to '%s' (pid %d)",
-           node->name, node->pid);
-    kill(node->pid, SIGKILL);
-    waitpid(node->pid, &status, 0);
-    node->running = false;
+    if (!exited) {
+        SV_LOG("supervisor_stop: stop sequence elapsed, sending SIGKILL to '%s' (pid %d)",
+               node->name, node->pid);
+        kill(node->pid, SIGKILL);
+        if (!wait_exit(node, STOP_KILL_WAIT_MS)) {
+            SV_LOG("supervisor_stop: '%s' (pid %d) survived SIGKILL for %dms",
+                   node->name, node->pid, STOP_KILL_WAIT_MS);
+        }
+    }
+    release_cgroup(node);
+
+    node->exit_reason       = EXIT_STOPPED;
+    node->next_restart_time = 0;
+    node->running           = false;
+    node->owned             = false;
+    SV_LOG("supervisor_stop: '%s' stopped in %lldms", node->name, now_ms() - started);
     return 0;
 }
 
+int supervisor_stop(ProcessNode *node) {
+    if (node == NULL) {
+        SV_LOG("supervisor_stop: node is NULL");
+        return -1;
+    }
+
+    int rc = stop_process(node);
+    if (node->listen_port != 0) {
+        listen_socket_release(node);
+    }
+    return rc;
+}
+
 int supervisor_restart(ProcessNode *node) {
     if (node == NULL) {
         SV_LOG("supervisor_restart: node is NULL");
@@ -187,8 +1130,15 @@ int supervisor_restart(ProcessNode *node) {
 
     SV_LOG("supervisor_restart: restarting '%s'", node->name);
 
+    /* Bind the replacement's socket while the old process still listens,
+     * so the port is never closed; without SO_REUSEPORT this may only
+     * succeed after the stop, in supervisor_start(). */
+    if (node->listen_socket && node->port != 0) {
+        listen_socket_acquire(node);
+    }
+
     if (node->running) {
-        if (supervisor_stop(node) != 0) {
+        if (stop_process(node) != 0) {
             SV_LOG("supervisor_restart: stop failed for '%s'", node->name);
             return -1;
         }
@@ -211,8 +1161,9 @@ int supervisor_status(ProcessNode *node) {
         return -1;
     }
 
-    /* kill(pid, 0) checks existence without sending a signal. */
-    if (kill(node->pid, 0) == 0) {
+    /* kill(pid, 0) checks existence without sending a signal; pid 0 would
+     * name our own process group, so a never-started node is down. */
+    if (node->pid > 0 && kill(node->pid, 0) == 0) {
         node->running = true;
         SV_LOG("supervisor_status: '%s' (pid %d) is running — restarts: %u, uptime: %lds",
                node->name, node->pid, node->restart_count,
@@ -226,40 +1177,1328 @@ int supervisor_status(ProcessNode *node) {
     return 1;
 }
 
-void supervisor_monitor_all(ProcessNode **head) {
-    if (head == NULL || *head == NULL) {
-        SV_LOG("supervisor_monitor_all: process table is empty");
-        return;
+/* Returns the first dependency of @p node that is not running and ready,
+ * or NULL if the node may be started. Dependencies that are no longer in
+ * the table do not hold it back. */
+static const char *unready_dependency(const ProcessNode *node) {
+    for (size_t d = 0; sv_table != NULL && d < MAX_DEPENDENCIES; d++) {
+        if (node->depends_on[d][0] == '\0') continue;
+        const ProcessNode *dep = process_find_by_name(sv_table, node->depends_on[d]);
+        if (dep != NULL && (!dep->running || dep->readiness != READINESS_READY)) {
+            return dep->name;
+        }
+    }
+    return NULL;
+}
+
+/* Depth-first search for a dependency cycle from node @p at, whose path
+ * from the search root is in @p path. Nodes are white (0), on the path
+ * (1) or cleared (2). On a cycle, describes it in @p error and returns -1. */
+static int find_cycle(ProcessTable *table, size_t at, uint8_t *color, size_t *path, size_t depth,
+                      char *error, size_t size) {
+    color[at]   = 1;
+    path[depth] = at;
+    for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+        const char  *name = table->nodes[at].depends_on[d];
+        ProcessNode *dep  = name[0] != '\0' ? process_find_by_name(table, name) : NULL;
+        if (dep == NULL) continue;
+
+        size_t to = (size_t)(dep - table->nodes);
+        if (color[to] == 1) {
+            size_t from = 0, used = 0;
+            while (path[from] != to) from++;
+            used += (size_t)snprintf(error, size, "dependency cycle: ");
+            for (size_t i = from; i <= depth && used < size; i++) {
+                used += (size_t)snprintf(error + used, size - used, "%s -> ", table->nodes[path[i]].name);
+            }
+            if (used < size) snprintf(error + used, size - used, "%s", dep->name);
+            return -1;
+        }
+        if (color[to] == 0 && find_cycle(table, to, color, path, depth + 1, error, size) != 0) {
+            return -1;
+        }
+    }
+    color[at] = 2;
+    return 0;
+}
+
+int supervisor_check_dependencies(ProcessTable *table, char *error, size_t size) {
+    if (table == NULL || table->count == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *node = &table->nodes[i];
+        for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+            if (node->depends_on[d][0] == '\0') continue;
+            if (process_find_by_name(table, node->depends_on[d]) == NULL) {
+                snprintf(error, size, "'%s' depends on unknown service '%s'",
+                         node->name, node->depends_on[d]);
+                return -1;
+            }
+        }
+    }
+
+    uint8_t *color = calloc(table->count, sizeof(*color));
+    size_t  *path  = calloc(table->count, sizeof(*path));
+    int      rc    = 0;
+    if (color == NULL || path == NULL) {
+        snprintf(error, size, "out of memory");
+        rc = -1;
+    }
+    for (size_t i = 0; rc == 0 && i < table->count; i++) {
+        if (color[i] == 0) rc = find_cycle(table, i, color, path, 0, error, size);
+    }
+    free(color);
+    free(path);
+    return rc;
+}
+
+static time_t backoff_delay(uint32_t failures) {
+    if (failures <= 1) return 0;
+    uint32_t shift = failures - 2;
+    if (shift >= 16) return BACKOFF_MAX_SECS;
+    time_t delay = (time_t)BACKOFF_BASE_SECS << shift;
+    return delay > BACKOFF_MAX_SECS ? BACKOFF_MAX_SECS : delay;
+}
+
+/* Returns true if the node's policy asks for a restart after its last exit. */
+static bool policy_wants_restart(const ProcessNode *node) {
+    if (node->exit_reason == EXIT_STOPPED) {
+        SV_LOG("supervisor_monitor_all: '%s' was stopped on request, not restarting",
+               node->name);
+        return false;
+    }
+
+    switch (node->restart_policy) {
+        case RESTART_NEVER:
+            SV_LOG("supervisor_monitor_all: '%s' is down, policy=never, not restarting",
+                   node->name);
+            return false;
+
+        case RESTART_ON_FAILURE:
+            if (!exit_is_failure(node)) {
+                SV_LOG("supervisor_monitor_all: '%s' exited cleanly, policy=on-failure, "
+                       "not restarting", node->name);
+                return false;
+            }
+            SV_LOG("supervisor_monitor_all: '%s' is down, policy=on-failure", node->name);
+            return true;
+
+        case RESTART_ALWAYS:
+            SV_LOG("supervisor_monitor_all: '%s' is down, policy=always", node->name);
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Applies the node's restart policy to a process that is known to be down.
+ * The first pass after an exit accounts the failure and schedules the
+ * restart; later passes only restart once next_restart_time has passed.
+ * Returns 1 if the node's state changed, 0 otherwise.
+ */
+static int apply_restart_policy(ProcessNode *node) {
+    if (node->crash_loop) {
+        SV_LOG("supervisor_monitor_all: '%s' is in a crash loop, not restarting", node->name);
+        return 0;
+    }
+
+    if (!policy_wants_restart(node)) {
+        /* Drop a restart scheduled before the node was stopped or its
+         * policy changed, so the daemon stops waking up for it. */
+        int pending = node->next_restart_time != 0 || node->failure_count != 0;
+        supervisor_reset_backoff(node);
+        return pending;
+    }
+
+    time_t now     = time(NULL);
+    int    changed = 0;
+
+    if (node->next_restart_time == 0) {
+        if (now - node->start_time >= (time_t)node->stable_secs) {
+            node->failure_count = 0;
+        }
+        node->failure_count++;
+        changed = 1;
+
+        if (node->restart_budget > 0 && node->failure_count > node->restart_budget) {
+            node->crash_loop = true;
+            listen_socket_release(node);
+            SV_LOG("supervisor_monitor_all: '%s' failed %u times in a row, "
+                   "crash loop detected, giving up", node->name, node->failure_count - 1);
+            return changed;
+        }
+        node->next_restart_time = now + backoff_delay(node->failure_count);
+    }
+
+    if (now < node->next_restart_time) {
+        SV_LOG("supervisor_monitor_all: '%s' backing off, next restart in %lds (failure #%u)",
+               node->name, (long)(node->next_restart_time - now), node->failure_count);
+        return changed;
+    }
+
+    const char *blocker = unready_dependency(node);
+    if (blocker != NULL) {
+        SV_LOG("supervisor_monitor_all: '%s' waiting for its dependency '%s' to be ready",
+               node->name, blocker);
+        return changed;
+    }
+
+    node->next_restart_time = 0;
+    supervisor_restart(node);
+    return 1;
+}
+
+/* Bumps a strike counter if @p over, resets it otherwise. */
+static void count_strike(uint16_t *strikes, bool over) {
+    if (!over)                  *strikes = 0;
+    else if (*strikes < UINT16_MAX) (*strikes)++;
+}
+
+/*
+ * Checks a running node's latest sample against its soft limits. A limit is breached
+ * once the node has been over it for limits.checks consecutive passes;
+ * the breach is logged when first reached and, with LIMIT_RESTART, the
+ * service is restarted gracefully. Returns 1 if the node's persisted state changed, 0 otherwise.
+ */
+static int enforce_limits(ProcessNode *node, bool *restart) {
+    const ResourceLimits *limits = &node->limits;
+    if (limits->rss_max_bytes == 0 && limits->cpu_max_percent == 0) {
+        return 0;
+    }
+    const ResourceSample *sample  = sampler_latest(node);
+    if (sample == NULL) {
+        return 0;
+    }
+
+    double                cpu     = sampler_cpu_percent(node);
+    uint16_t              rss_was = node->rss_strikes;
+    uint16_t              cpu_was = node->cpu_strikes;
+    uint16_t              needed  = limits->checks > 0 ? limits->checks : 1;
+
+    if (limits->rss_max_bytes > 0) {
+        count_strike(&node->rss_strikes, sample->rss_bytes > limits->rss_max_bytes);
+    }
+    if (limits->cpu_max_percent > 0 && cpu >= 0) {
+        count_strike(&node->cpu_strikes, cpu > (double)limits->cpu_max_percent);
+    }
+
+    bool rss_breach = node->rss_strikes >= needed;
+    bool cpu_breach = node->cpu_strikes >= needed;
+    int  changed    = node->rss_strikes != rss_was || node->cpu_strikes != cpu_was;
+
+    if (rss_breach && rss_was < needed) {
+        SV_LOG("supervisor_enforce_limits: ALERT '%s' (pid %d) rss %llu bytes over its "
+               "limit of %llu for %u checks", node->name, node->pid,
+               (unsigned long long)sample->rss_bytes,
+               (unsigned long long)limits->rss_max_bytes, needed);
+    }
+    if (cpu_breach && cpu_was < needed) {
+        SV_LOG("supervisor_enforce_limits: ALERT '%s' (pid %d) cpu %.1f%% over its "
+               "limit of %u%% for %u checks", node->name, node->pid, cpu,
+               limits->cpu_max_percent, needed);
+    }
+
+    if ((rss_breach || cpu_breach) && limits->action == LIMIT_RESTART) {
+        SV_LOG("supervisor_enforce_limits: restarting '%s' to bring it back under its limits",
+               node->name);
+        *restart = true;
+        return 1;
+    }
+    return changed;
+}
+
+void supervisor_reset_backoff(ProcessNode *node) {
+    if (node == NULL) return;
+    node->failure_count     = 0;
+    node->next_restart_time = 0;
+    node->crash_loop        = false;
+}
+
+time_t supervisor_next_restart(ProcessTable *table) {
+    time_t earliest = 0;
+    if (table == NULL) return 0;
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *n = &table->nodes[i];
+        if (n->running || n->crash_loop || n->next_restart_time == 0) continue;
+        if (n->exit_reason == EXIT_STOPPED) continue;
+        if (unready_dependency(n) != NULL) continue; /* retried once it becomes ready */
+        if (earliest == 0 || n->next_restart_time < earliest) {
+            earliest = n->next_restart_time;
+        }
+    }
+    return earliest;
+}
+
+/* Fills in the readiness probe of a starting node. */
+static void ready_probe_init(Probe *probe, const ProcessNode *node) {
+    *probe = (Probe){ .port = node->port, .path = node->ready_probe.path,
+                      .timeout_ms = node->ready_probe.timeout_ms > 0 ? node->ready_probe.timeout_ms
+                                                                     : DEFAULT_READY_TIMEOUT_MS };
+}
+
+static void mark_ready(ProcessNode *node) {
+    node->readiness = READINESS_READY;
+    SV_LOG("supervisor_check_readiness: '%s' (pid %d) is ready after %lds",
+           node->name, node->pid, (long)(time(NULL) - node->start_time));
+}
+
+/* Runs the readiness probes of @p nodes at once and marks the ones that
+ * pass as ready. Returns the number of nodes that became ready. */
+static int probe_readiness(ProcessNode **nodes, size_t count) {
+    Probe *probes = calloc(count, sizeof(*probes));
+    int    ready  = 0;
+    if (probes == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ready_probe_init(&probes[i], nodes[i]);
+    }
+    probe_run(probes, count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (probes[i].result != PROBE_OK) continue;
+        mark_ready(nodes[i]);
+        ready++;
+    }
+
+    free(probes);
+    return ready;
+}
+
+unsigned supervisor_readiness_interval(ProcessTable *table) {
+    unsigned interval = 0;
+    if (table == NULL) return 0;
+    for (size_t i = 0; i < table->count; i++) {
+        const ProcessNode *n = &table->nodes[i];
+        if (!n->running || n->busy || n->readiness != READINESS_STARTING) continue;
+        unsigned every = n->ready_probe.interval_ms > 0 ? n->ready_probe.interval_ms
+                                                        : DEFAULT_READY_INTERVAL_MS;
+        if (interval == 0 || every < interval) interval = every;
+    }
+    return interval;
+}
+
+int supervisor_wait_ready(ProcessNode *node, unsigned timeout_secs) {
+    unsigned every    = node->ready_probe.interval_ms > 0 ? node->ready_probe.interval_ms
+                                                          : DEFAULT_READY_INTERVAL_MS;
+    time_t   deadline = time(NULL) + (time_t)timeout_secs;
+
+    for (;;) {
+        int status;
+        if (node->owned && waitpid(node->pid, &status, WNOHANG) == node->pid) {
+            record_exit(node, status);
+            release_cgroup(node);
+            node->running = false;
+            node->owned   = false;
+            SV_LOG("supervisor_wait_ready: '%s' (pid %d) exited before becoming ready",
+                   node->name, node->pid);
+            return -1;
+        }
+        if (!node->running) {
+            return -1;
+        }
+
+        if (node->readiness == READINESS_STARTING && node->port == 0) {
+            node->readiness = READINESS_READY;
+        }
+        if (node->readiness == READINESS_STARTING) {
+            probe_readiness(&node, 1);
+        }
+        if (node->readiness == READINESS_READY) {
+            return 0;
+        }
+
+        if (time(NULL) >= deadline) {
+            SV_LOG("supervisor_wait_ready: '%s' not ready after %us", node->name, timeout_secs);
+            return 1;
+        }
+        struct timespec pause = { .tv_sec = every / 1000, .tv_nsec = (long)(every % 1000) * 1000000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+/* Where a node is in a bulk operation. */
+typedef enum {
+    JOB_PENDING,   /* Waiting for a free slot. */
+    JOB_HOOK,      /* Pre-stop hook called; waiting for the exit. */
+    JOB_SIGNALLED, /* Stop step `step` sent; waiting for the exit. */
+    JOB_KILLED,    /* SIGKILL sent; waiting for the exit. */
+    JOB_STARTING,  /* Started; waiting for readiness. */
+    JOB_DONE
+} JobPhase;
+
+#define NO_JOB SIZE_MAX
+
+/* One node of a bulk operation. */
+typedef struct BulkJob {
+    ProcessNode *node;
+    JobPhase     phase;
+    bool         failed;
+    size_t       step;       /* Stop step sent, in JOB_SIGNALLED. */
+    long long    started;    /* When the stop began. */
+    long long    deadline;   /* When the current phase gives up. */
+    long long    next_probe; /* When the next readiness probe is due, in JOB_STARTING. */
+    int          watch;      /* exit_watch_open() descriptor, or -1. */
+    Probe        probe;      /* Pre-stop hook or readiness probe... */
+    ProbeBatch  *batch;      /* ...while it is in flight, or NULL. */
+    ProcessNode *deps[MAX_DEPENDENCIES];     /* Dependencies found in the table. */
+    size_t       dep_jobs[MAX_DEPENDENCIES]; /* Their jobs in this bulk, or NO_JOB. */
+    size_t       dependents; /* Jobs of this bulk depending on this one and, for
+                                a stop, not done yet. */
+} BulkJob;
+
+typedef struct Bulk {
+    BulkJob   *jobs;
+    size_t     count;
+    BulkAction action;
+    unsigned   parallel;
+    long long  ready_ms; /* Readiness wait per node, 0 to not wait. */
+    long long  began;
+    size_t     pending;  /* Jobs not admitted yet. */
+    size_t     active;   /* Jobs holding a slot. */
+    size_t     settled;  /* Jobs done. */
+    size_t     failed;
+} Bulk;
+
+static const char *const bulk_names[] = {
+    [BULK_START]   = "start",
+    [BULK_STOP]    = "stop",
+    [BULK_RESTART] = "restart",
+};
+
+/* Ends a job that never took a slot. */
+static void job_skip(Bulk *bulk, BulkJob *job) {
+    job->phase     = JOB_DONE;
+    job->failed    = true;
+    job->node->busy = false;
+    bulk->pending--;
+    bulk->settled++;
+    bulk->failed++;
+}
+
+static void job_done(Bulk *bulk, BulkJob *job, bool failed) {
+    if (job->watch >= 0) close(job->watch);
+    if (job->batch != NULL) probe_end(job->batch);
+    job->watch      = -1;
+    job->batch      = NULL;
+    job->phase      = JOB_DONE;
+    job->failed     = failed;
+    job->node->busy = false;
+    bulk->active--;
+    bulk->settled++;
+    if (failed) bulk->failed++;
+
+    /* A stopped dependent no longer holds its dependencies up. */
+    for (size_t d = 0; bulk->action == BULK_STOP && d < MAX_DEPENDENCIES; d++) {
+        if (job->dep_jobs[d] != NO_JOB) bulk->jobs[job->dep_jobs[d]].dependents--;
+    }
+}
+
+/* Whether a pending job may take a slot: a start waits for the node's
+ * dependencies to be ready, a stop for the nodes depending on it to be
+ * stopped. Returns 1 if it may, 0 if it must wait, and -1 if it never will
+ * because a dependency failed or is down outside the bulk. */
+static int job_may_begin(Bulk *bulk, const BulkJob *job) {
+    if (bulk->action == BULK_STOP) {
+        return job->dependents == 0;
+    }
+    if (bulk->action == BULK_START && job->node->running) {
+        return 1;
+    }
+
+    for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+        ProcessNode *dep = job->deps[d];
+        if (dep == NULL) continue;
+        if (job->dep_jobs[d] != NO_JOB && bulk->jobs[job->dep_jobs[d]].phase != JOB_DONE) {
+            return 0;
+        }
+        if (!dep->running || dep->readiness != READINESS_READY) {
+            SV_LOG("supervisor_bulk: not %sing '%s': its dependency '%s' is not ready",
+                   bulk_names[bulk->action], job->node->name, dep->name);
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/* Keeps the job's slot until its running node is ready, when the bulk
+ * waits for readiness; otherwise the job is done. */
+static void job_await_ready(Bulk *bulk, BulkJob *job) {
+    ProcessNode *node = job->node;
+    if (node->readiness == READINESS_STARTING && node->port == 0) {
+        node->readiness = READINESS_READY;
+    }
+    /* Dependents wait for readiness even when the bulk itself does not. */
+    long long wait_ms = bulk->ready_ms;
+    if (wait_ms == 0 && job->dependents > 0) wait_ms = (long long)DEFAULT_READY_WAIT_SECS * 1000;
+    if (wait_ms == 0 || node->readiness == READINESS_READY) {
+        job_done(bulk, job, false);
+        return;
+    }
+    job->phase      = JOB_STARTING;
+    job->deadline   = now_ms() + wait_ms;
+    job->next_probe = 0;
+    job->watch      = exit_watch_open(node->pid);
+}
+
+/* Starts the job's node. When the bulk waits for readiness, the job keeps
+ * its slot until the node is ready. */
+static void job_launch(Bulk *bulk, BulkJob *job) {
+    ProcessNode *node = job->node;
+    if (supervisor_start(node) != 0) {
+        SV_LOG("supervisor_bulk: start failed for '%s'", node->name);
+        job_done(bulk, job, true);
+        return;
+    }
+    if (bulk->action == BULK_RESTART) {
+        node->restart_count++;
+        SV_LOG("supervisor_bulk: '%s' restarted (restart #%u)", node->name, node->restart_count);
+    }
+    job_await_ready(bulk, job);
+}
+
+/* Records the end of the job's stop, then starts it again on a restart. */
+static void job_stopped(Bulk *bulk, BulkJob *job) {
+    ProcessNode *node = job->node;
+    release_cgroup(node);
+    node->exit_reason       = EXIT_STOPPED;
+    node->next_restart_time = 0;
+    node->running           = false;
+    node->owned             = false;
+    SV_LOG("supervisor_bulk: '%s' stopped in %lldms", node->name, now_ms() - job->started);
+
+    if (job->watch >= 0) close(job->watch);
+    if (job->batch != NULL) probe_end(job->batch);
+    job->watch = -1;
+    job->batch = NULL;
+    if (bulk->action == BULK_RESTART) {
+        job_launch(bulk, job);
+        return;
+    }
+    if (node->listen_port != 0) {
+        listen_socket_release(node);
+    }
+    job_done(bulk, job, false);
+}
+
+/* Sends the job's stop step `step`, or SIGKILL once the steps are used up. */
+static void job_signal(Bulk *bulk, BulkJob *job) {
+    ProcessNode    *node     = job->node;
+    StopStep        fallback = { .signal = SIGTERM, .timeout_ms = DEFAULT_STOP_TIMEOUT_MS };
+    const StopStep *steps    = node->stop.step_count > 0 ? node->stop.steps : &fallback;
+    size_t          count    = node->stop.step_count > 0 ? node->stop.step_count : 1;
+
+    if (job->batch != NULL) {
+        probe_end(job->batch); /* a pre-stop hook that did not answer in time */
+        job->batch = NULL;
+    }
+    if (job->step >= count) {
+        SV_LOG("supervisor_bulk: stop sequence elapsed, sending SIGKILL to '%s' (pid %d)",
+               node->name, node->pid);
+        kill(node->pid, SIGKILL);
+        job->phase    = JOB_KILLED;
+        job->deadline = now_ms() + STOP_KILL_WAIT_MS;
+        return;
+    }
+
+    const StopStep *step = &steps[job->step];
+    if (kill(node->pid, step->signal) != 0) {
+        if (errno == ESRCH) {
+            job_stopped(bulk, job);
+            return;
+        }
+        SV_LOG("supervisor_bulk: kill(SIG%s) failed for '%s': %s",
+               signal_name(step->signal), node->name, strerror(errno));
+        job_done(bulk, job, true);
+        return;
+    }
+    job->phase    = JOB_SIGNALLED;
+    job->deadline = now_ms() + step->timeout_ms;
+}
+
+/* Takes a slot for the job and begins its operation. A pre-stop hook is
+ * only sent off; its answer is picked up by job_step(). */
+static void job_begin(Bulk *bulk, BulkJob *job) {
+    ProcessNode *node = job->node;
+    bulk->pending--;
+    bulk->active++;
+
+    if (bulk->action == BULK_START) {
+        if (node->running) {
+            job_await_ready(bulk, job);
+        } else {
+            job_launch(bulk, job);
+        }
+        return;
+    }
+
+    /* As in supervisor_restart(), bind the replacement's socket first. */
+    if (bulk->action == BULK_RESTART && node->listen_socket && node->port != 0) {
+        listen_socket_acquire(node);
+    }
+    if (!node->running || node->pid <= 0) {
+        if (bulk->action == BULK_RESTART) {
+            job_launch(bulk, job);
+            return;
+        }
+        node->exit_reason       = EXIT_STOPPED;
+        node->next_restart_time = 0;
+        if (node->listen_port != 0) listen_socket_release(node);
+        job_done(bulk, job, false);
+        return;
+    }
+
+    job->started    = now_ms();
+    job->watch      = exit_watch_open(node->pid);
+    node->readiness = READINESS_DRAINING;
+    if (node->stop.pre_stop_path[0] != '\0' && node->port != 0) {
+        uint32_t budget = node->stop.pre_stop_timeout_ms > 0 ? node->stop.pre_stop_timeout_ms
+                                                             : DEFAULT_PRE_STOP_TIMEOUT_MS;
+        job->probe    = (Probe){ .port = node->port, .path = node->stop.pre_stop_path,
+                                 .method = "POST", .timeout_ms = budget };
+        job->batch    = probe_begin(&job->probe, 1);
+        job->phase    = JOB_HOOK;
+        job->deadline = job->started + budget;
+        if (job->batch != NULL) return;
+    }
+    job->step = 0;
+    job_signal(bulk, job);
+}
+
+/* Advances a job that holds a slot, now that one of its descriptors fired
+ * or a deadline may have passed. */
+static void job_step(Bulk *bulk, BulkJob *job, long long now) {
+    ProcessNode *node = job->node;
+    int          status;
+    bool         reaped = false;
+
+    if (job->phase == JOB_STARTING) {
+        if (job->batch != NULL && probe_advance(job->batch)) {
+            probe_end(job->batch);
+            job->batch = NULL;
+            if (job->probe.result == PROBE_OK) {
+                mark_ready(node);
+                job_done(bulk, job, false);
+                return;
+            }
+        }
+        if (exit_seen(node->pid, &status, &reaped)) {
+            if (reaped) record_exit(node, status);
+            release_cgroup(node);
+            node->running = false;
+            node->owned   = false;
+            SV_LOG("supervisor_bulk: '%s' (pid %d) exited before becoming ready",
+                   node->name, node->pid);
+            job_done(bulk, job, true);
+        } else if (now >= job->deadline) {
+            SV_LOG("supervisor_bulk: '%s' not ready in time", node->name);
+            job_done(bulk, job, true);
+        } else if (job->batch == NULL && now >= job->next_probe) {
+            unsigned every = node->ready_probe.interval_ms > 0 ? node->ready_probe.interval_ms
+                                                               : DEFAULT_READY_INTERVAL_MS;
+            ready_probe_init(&job->probe, node);
+            job->batch      = probe_begin(&job->probe, 1);
+            job->next_probe = now + every;
+        }
+        return;
+    }
+
+    if (job->phase == JOB_HOOK && job->batch != NULL && probe_advance(job->batch)) {
+        probe_end(job->batch);
+        job->batch = NULL;
+        SV_LOG("supervisor_bulk: pre-stop hook POST %s of '%s' (pid %d): %s, status %d",
+               node->stop.pre_stop_path, node->name, node->pid,
+               probe_result_str(job->probe.result), job->probe.status);
+        if (job->probe.result != PROBE_OK) {
+            /* A failed hook shuts nothing down; signal at once. */
+            job->step = 0;
+            job_signal(bulk, job);
+            return;
+        }
+    }
+
+    if (exit_seen(node->pid, &status, &reaped)) {
+        if (reaped) record_exit(node, status);
+        job_stopped(bulk, job);
+    } else if (now >= job->deadline) {
+        if (job->phase == JOB_KILLED) {
+            SV_LOG("supervisor_bulk: '%s' (pid %d) survived SIGKILL for %dms",
+                   node->name, node->pid, STOP_KILL_WAIT_MS);
+            job_stopped(bulk, job);
+        } else {
+            job->step = job->phase == JOB_HOOK ? 0 : job->step + 1;
+            job_signal(bulk, job);
+        }
+    }
+}
+
+/* Fills the free slots with jobs that may begin, in order, until none
+ * can. Once nothing holds a slot, jobs still pending wait on each other. */
+static void bulk_admit(Bulk *bulk) {
+    bool progress = true;
+    while (progress && bulk->pending > 0) {
+        progress = false;
+        for (size_t i = 0; i < bulk->count && bulk->pending > 0 && bulk->active < bulk->parallel; i++) {
+            BulkJob *job = &bulk->jobs[i];
+            if (job->phase != JOB_PENDING) continue;
+            int go = job_may_begin(bulk, job);
+            if (go > 0) {
+                job_begin(bulk, job);
+                progress = true;
+            } else if (go < 0) {
+                job_skip(bulk, job);
+                progress = true;
+            }
+        }
+    }
+    if (bulk->active > 0) {
+        return;
+    }
+
+    /* See supervisor_check_dependencies(). */
+    for (size_t i = 0; i < bulk->count; i++) {
+        if (bulk->jobs[i].phase != JOB_PENDING) continue;
+        SV_LOG("supervisor_bulk: not %sing '%s': its dependencies form a cycle",
+               bulk_names[bulk->action], bulk->jobs[i].node->name);
+        job_skip(bulk, &bulk->jobs[i]);
+    }
+}
+
+/* Index of @p node in the table, or NO_JOB for a copy outside it, such as
+ * the replacement a deploy starts. */
+static size_t table_slot(const ProcessNode *node) {
+    uintptr_t at    = (uintptr_t)node;
+    uintptr_t first = sv_table != NULL ? (uintptr_t)sv_table->nodes : 0;
+    if (sv_table == NULL || at < first || at >= first + sv_table->count * sizeof(*node)) {
+        return NO_JOB;
+    }
+    return (size_t)(at - first) / sizeof(*node);
+}
+
+/* Sets up a bulk and admits its first jobs; bulk_advance() does the rest.
+ * Returns NULL if out of memory. */
+static Bulk *bulk_begin(ProcessNode **nodes, size_t count, BulkAction action,
+                        unsigned parallel, unsigned ready_timeout_secs) {
+    Bulk   *bulk   = calloc(1, sizeof(*bulk));
+    size_t  slots  = sv_table != NULL ? sv_table->count : 0;
+    size_t *job_of = malloc((slots > 0 ? slots : 1) * sizeof(*job_of));
+    if (bulk != NULL) {
+        bulk->jobs = calloc(count > 0 ? count : 1, sizeof(*bulk->jobs));
+    }
+    if (bulk == NULL || bulk->jobs == NULL || job_of == NULL) {
+        SV_LOG("supervisor_bulk: out of memory for %zu services", count);
+        if (bulk != NULL) free(bulk->jobs);
+        free(bulk);
+        free(job_of);
+        return NULL;
+    }
+    bulk->count    = count;
+    bulk->action   = action;
+    bulk->ready_ms = (long long)ready_timeout_secs * 1000;
+    bulk->pending  = count;
+    bulk->parallel = parallel == 0 || parallel > count ? (unsigned)count : parallel;
+    bulk->began    = now_ms();
+
+    /* Resolve each node's dependencies to jobs of this bulk. */
+    for (size_t i = 0; i < slots; i++) job_of[i] = NO_JOB;
+    for (size_t i = 0; i < count; i++) {
+        bulk->jobs[i].node  = nodes[i];
+        bulk->jobs[i].phase = JOB_PENDING;
+        bulk->jobs[i].watch = -1;
+        nodes[i]->busy      = true;
+        if (table_slot(nodes[i]) != NO_JOB) job_of[table_slot(nodes[i])] = i;
+    }
+    for (size_t i = 0; i < count; i++) {
+        BulkJob *job = &bulk->jobs[i];
+        for (size_t d = 0; d < MAX_DEPENDENCIES; d++) {
+            ProcessNode *dep = job->node->depends_on[d][0] != '\0' && sv_table != NULL
+                             ? process_find_by_name(sv_table, job->node->depends_on[d]) : NULL;
+            job->deps[d]     = dep;
+            job->dep_jobs[d] = dep != NULL ? job_of[dep - sv_table->nodes] : NO_JOB;
+            if (job->dep_jobs[d] != NO_JOB) bulk->jobs[job->dep_jobs[d]].dependents++;
+        }
+    }
+    free(job_of);
+
+    SV_LOG("supervisor_bulk: %s of %zu services, %u at a time",
+           bulk_names[action], count, bulk->parallel);
+    bulk_admit(bulk);
+    return bulk;
+}
+
+/* Lists the descriptors the bulk waits on in @p pfds (at most bulk_fds())
+ * and lowers @p wake to its nearest deadline. Returns the number listed. */
+static size_t bulk_pollfds(const Bulk *bulk, struct pollfd *pfds, long long *wake) {
+    long long now = now_ms();
+    size_t    n   = 0;
+    if (bulk->pending == 0 && bulk->active == 0) {
+        if (now < *wake) *wake = now; /* done: nothing to wait for before bulk_advance() */
+        return 0;
+    }
+    for (size_t i = 0; i < bulk->count; i++) {
+        const BulkJob *job = &bulk->jobs[i];
+        if (job->phase == JOB_PENDING || job->phase == JOB_DONE) continue;
+        if (job->deadline < *wake) *wake = job->deadline;
+        if (job->watch >= 0) {
+            pfds[n].fd      = job->watch;
+            pfds[n].events  = POLLIN;
+            pfds[n].revents = 0;
+            n++;
+        } else if (now + STOP_POLL_MAX_MS < *wake) {
+            *wake = now + STOP_POLL_MAX_MS; /* exits the kernel cannot report are polled */
+        }
+        if (job->batch != NULL) {
+            n += probe_pollfds(job->batch, &pfds[n], wake);
+        } else if (job->phase == JOB_STARTING && job->next_probe < *wake) {
+            *wake = job->next_probe;
+        }
+    }
+    return n;
+}
+
+/* Descriptors a bulk may wait on at once: an exit and a probe per job. */
+static size_t bulk_fds(const Bulk *bulk) {
+    return bulk->count * 2;
+}
+
+/* Advances every job as far as it goes without blocking, then fills the
+ * freed slots. Returns true once every job is done. */
+static bool bulk_advance(Bulk *bulk) {
+    long long now = now_ms();
+    for (size_t i = 0; i < bulk->count; i++) {
+        BulkJob *job = &bulk->jobs[i];
+        if (job->phase == JOB_PENDING || job->phase == JOB_DONE) continue;
+        job_step(bulk, job, now);
+    }
+    bulk_admit(bulk);
+    return bulk->pending == 0 && bulk->active == 0;
+}
+
+/* Frees a bulk. Returns the number of jobs that failed. */
+static int bulk_end(Bulk *bulk) {
+    if (bulk == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < bulk->count; i++) {
+        BulkJob *job = &bulk->jobs[i];
+        if (job->phase != JOB_DONE && job->phase != JOB_PENDING) job_done(bulk, job, true);
+        job->node->busy = false;
+    }
+    SV_LOG("supervisor_bulk: %s of %zu services done in %lldms, %zu failed",
+           bulk_names[bulk->action], bulk->count, now_ms() - bulk->began, bulk->failed);
+    int failed = (int)bulk->failed;
+    free(bulk->jobs);
+    free(bulk);
+    return failed;
+}
+
+int supervisor_bulk(ProcessNode **nodes, size_t count, BulkAction action,
+                    unsigned parallel, unsigned ready_timeout_secs) {
+    if (nodes == NULL || count == 0) {
+        return 0;
+    }
+
+    Bulk          *bulk = bulk_begin(nodes, count, action, parallel, ready_timeout_secs);
+    struct pollfd *pfds = calloc(count * 2, sizeof(*pfds));
+    if (bulk == NULL || pfds == NULL) {
+        free(pfds);
+        return bulk != NULL ? bulk_end(bulk) : -1;
+    }
+
+    /* Sleep until an exit is reported, a probe answers or a deadline
+     * passes, then advance every job. */
+    while (bulk->pending > 0 || bulk->active > 0) {
+        long long wake = LLONG_MAX;
+        nfds_t    nfds = (nfds_t)bulk_pollfds(bulk, pfds, &wake);
+        long long wait = wake - now_ms();
+        if (wait > 0) {
+            poll(pfds, nfds, wait > INT_MAX ? INT_MAX : (int)wait);
+        }
+        bulk_advance(bulk);
+    }
+
+    free(pfds);
+    return bulk_end(bulk);
+}
+
+/* ------------------------------------------------------------------ */
+/* Background work                                                    */
+/* ------------------------------------------------------------------ */
+
+/* What a piece of background work does. */
+typedef enum {
+    TASK_BULK,   /* Runs a bulk operation. */
+    TASK_HEALTH, /* Runs a round of health probes. */
+    TASK_READY,  /* Runs a round of readiness probes. */
+    TASK_WORK    /* Runs work of another module, e.g. a deploy. */
+} TaskKind;
+
+/* Work driven by the daemon's poll loop; see supervisor_set_background(). */
+typedef struct Task {
+    TaskKind      kind;
+    Bulk         *bulk;   /* TASK_BULK: the bulk, and whom to tell when it is done. */
+    BulkDone      done;
+    void         *arg;
+    ProbeBatch   *batch;  /* Probe rounds: the probes in flight... */
+    Probe        *probes;
+    ProcessNode **nodes;  /* ...the node each one is aimed at... */
+    pid_t        *pids;   /* ...and the process that node ran when it was sent. */
+    size_t        count;
+    const BackgroundWork *work; /* TASK_WORK: what to call, with `arg`. */
+    struct Task  *next;
+} Task;
+
+static bool  sv_background = false;
+static Task *sv_tasks      = NULL;
+
+static void task_free(Task *task) {
+    if (task->batch != NULL) probe_end(task->batch);
+    free(task->probes);
+    free(task->nodes);
+    free(task->pids);
+    free(task);
+}
+
+static bool task_running(TaskKind kind) {
+    for (const Task *task = sv_tasks; task != NULL; task = task->next) {
+        if (task->kind == kind) return true;
+    }
+    return false;
+}
+
+/* Allocates a probe round with room for @p count nodes. */
+static Task *round_new(TaskKind kind, size_t count) {
+    Task *round = calloc(1, sizeof(*round));
+    if (round == NULL) {
+        return NULL;
+    }
+    round->kind   = kind;
+    round->probes = calloc(count > 0 ? count : 1, sizeof(*round->probes));
+    round->nodes  = calloc(count > 0 ? count : 1, sizeof(*round->nodes));
+    round->pids   = calloc(count > 0 ? count : 1, sizeof(*round->pids));
+    if (round->probes == NULL || round->nodes == NULL || round->pids == NULL) {
+        task_free(round);
+        return NULL;
+    }
+    return round;
+}
+
+/* Whether a probe of the round still applies to its node: a process that
+ * has since exited or been replaced says nothing about the node. */
+static bool round_current(const Task *round, size_t i) {
+    const ProcessNode *node = round->nodes[i];
+    return node->running && node->pid == round->pids[i] && !node->busy;
+}
+
+/* Restarts @p nodes all at once: in the background under the daemon,
+ * otherwise before returning. */
+static void restart_nodes(ProcessNode **nodes, size_t count) {
+    if (count == 0) return;
+    if (!sv_background || supervisor_bulk_background(nodes, count, BULK_RESTART, 0, 0, NULL, NULL) != 0) {
+        supervisor_bulk(nodes, count, BULK_RESTART, 0, 0);
+    }
+}
+
+/* Marks the nodes whose readiness probe of the round passed as ready.
+ * Returns the number of nodes that became ready. */
+static int ready_apply(Task *round) {
+    int ready = 0;
+    for (size_t i = 0; i < round->count; i++) {
+        ProcessNode *node = round->nodes[i];
+        if (round->probes[i].result != PROBE_OK || !round_current(round, i)) continue;
+        if (node->readiness != READINESS_STARTING) continue;
+        mark_ready(node);
+        ready++;
+    }
+    return ready;
+}
+
+/* Counts the health probes of the round against their nodes and restarts
+ * the nodes that have failed too often, all at once. Returns the number of
+ * nodes whose state changed. */
+static int health_apply(Task *round) {
+    size_t restarts = 0;
+    int    changed  = 0;
+
+    for (size_t i = 0; i < round->count; i++) {
+        ProcessNode *node   = round->nodes[i];
+        uint16_t     needed = node->health.failures > 0 ? node->health.failures : 1;
+        if (!round_current(round, i)) continue;
+
+        if (round->probes[i].result == PROBE_OK) {
+            if (node->health_failures > 0) {
+                SV_LOG("supervisor_monitor_all: '%s' is healthy again", node->name);
+                node->health_failures = 0;
+                changed++;
+            }
+            continue;
+        }
+
+        if (node->health_failures < UINT16_MAX) node->health_failures++;
+        changed++;
+        SV_LOG("supervisor_monitor_all: health check of '%s' failed (%s, status %d), %u/%u",
+               node->name, probe_result_str(round->probes[i].result), round->probes[i].status,
+               node->health_failures, needed);
+
+        if (node->health_failures >= needed && node->restart_policy != RESTART_NEVER) {
+            SV_LOG("supervisor_monitor_all: '%s' (pid %d) is unresponsive, restarting",
+                   node->name, node->pid);
+            round->nodes[restarts++] = node;
+        }
+    }
+    restart_nodes(round->nodes, restarts);
+    return changed;
+}
+
+static int round_apply(Task *round) {
+    return round->kind == TASK_READY ? ready_apply(round) : health_apply(round);
+}
+
+/* Sends the probes of a round. Under the daemon they are answered in the
+ * background and applied by supervisor_background_advance(); otherwise
+ * they are awaited and applied here. Returns the number of nodes whose
+ * state changed so far. */
+static int round_run(Task *round) {
+    if (round->count == 0) {
+        task_free(round);
+        return 0;
+    }
+    if (sv_background) {
+        round->batch = probe_begin(round->probes, round->count);
+        if (round->batch != NULL) {
+            round->next = sv_tasks;
+            sv_tasks    = round;
+            return 0;
+        }
+    }
+    probe_run(round->probes, round->count);
+    int changed = round_apply(round);
+    task_free(round);
+    return changed;
+}
+
+/* Probes every running node with a health check that is past its grace
+ * period, all at once, and restarts nodes that have failed too often,
+ * also all at once. Under the daemon, the round runs in the background
+ * and a new one is only sent once the last one is done.
+ * Returns the number of nodes whose state changed. */
+static int check_health(ProcessTable *table) {
+    if (sv_background && task_running(TASK_HEALTH)) {
+        return 0;
+    }
+    Task  *round = round_new(TASK_HEALTH, table->count);
+    time_t now   = time(NULL);
+    if (round == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+        if (!node->running || node->busy || node->port == 0 || node->health.path[0] == '\0') continue;
+        if (now - node->start_time < (time_t)node->health.grace_secs) continue;
+
+        Probe *probe      = &round->probes[round->count];
+        probe->port       = node->port;
+        probe->path       = node->health.path;
+        probe->timeout_ms = node->health.timeout_ms > 0 ? node->health.timeout_ms
+                                                        : DEFAULT_HEALTH_TIMEOUT_MS;
+        round->nodes[round->count] = node;
+        round->pids[round->count++] = node->pid;
+    }
+    return round_run(round);
+}
+
+int supervisor_enforce_limits(ProcessTable *table) {
+    if (table == NULL) {
+        fprintf(stderr, "supervisor_enforce_limits: table argument is NULL\n");
+        return 0;
+    }
+
+    ProcessNode **restarts = calloc(table->count, sizeof(*restarts));
+    size_t        count    = 0;
+    int           changed  = 0;
+    if (restarts == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node    = &table->nodes[i];
+        bool         restart = false;
+        if (node->running && !node->busy) {
+            changed += enforce_limits(node, &restart);
+        }
+        if (restart) restarts[count++] = node;
+    }
+    restart_nodes(restarts, count);
+
+    free(restarts);
+    return changed;
+}
+
+int supervisor_check_readiness(ProcessTable *table) {
+    if (table == NULL || table->count == 0) {
+        return 0;
+    }
+    if (sv_background && task_running(TASK_READY)) {
+        return 0;
+    }
+    Task *round = round_new(TASK_READY, table->count);
+    int   ready = 0;
+    if (round == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+        if (!node->running || node->busy || node->readiness != READINESS_STARTING) continue;
+        if (node->port == 0) {
+            node->readiness = READINESS_READY;
+            ready++;
+            continue;
+        }
+        ready_probe_init(&round->probes[round->count], node);
+        round->nodes[round->count] = node;
+        round->pids[round->count++] = node->pid;
+    }
+    return ready + round_run(round);
+}
+
+void supervisor_set_background(bool enabled) {
+    sv_background = enabled;
+}
+
+int supervisor_bulk_background(ProcessNode **nodes, size_t count, BulkAction action,
+                               unsigned parallel, unsigned ready_timeout_secs,
+                               BulkDone done, void *arg) {
+    Task *task = calloc(1, sizeof(*task));
+    Bulk *bulk = task != NULL ? bulk_begin(nodes, count, action, parallel, ready_timeout_secs) : NULL;
+    if (bulk == NULL) {
+        free(task);
+        return -1;
+    }
+    task->kind = TASK_BULK;
+    task->bulk = bulk;
+    task->done = done;
+    task->arg  = arg;
+    task->next = sv_tasks;
+    sv_tasks   = task;
+    return 0;
+}
+
+int supervisor_background_add(const BackgroundWork *work, void *arg) {
+    Task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return -1;
+    }
+    task->kind = TASK_WORK;
+    task->work = work;
+    task->arg  = arg;
+    task->next = sv_tasks;
+    sv_tasks   = task;
+    return 0;
+}
+
+/* Whether the task is work waiting to run alone. */
+static bool task_held(const Task *task) {
+    return task->kind == TASK_WORK && task->work->exclusive != NULL &&
+           task->work->exclusive(task->arg);
+}
+
+/* Whether every task but @p task is also waiting to run alone, so that
+ * @p task may go ahead: work that waits holds no node. */
+static bool task_alone(const Task *task) {
+    for (const Task *other = sv_tasks; other != NULL; other = other->next) {
+        if (other != task && !task_held(other)) return false;
+    }
+    return true;
+}
+
+size_t supervisor_background_fds(void) {
+    size_t fds = 0;
+    for (const Task *task = sv_tasks; task != NULL; task = task->next) {
+        if (task->kind == TASK_BULK) fds += bulk_fds(task->bulk);
+        else if (task->kind == TASK_WORK) fds += task->work->fds(task->arg);
+        else fds += task->count;
+    }
+    return fds;
+}
+
+size_t supervisor_background_pollfds(struct pollfd *pfds, long long *wake) {
+    size_t n = 0;
+    for (const Task *task = sv_tasks; task != NULL; task = task->next) {
+        if (task->kind == TASK_BULK) {
+            n += bulk_pollfds(task->bulk, &pfds[n], wake);
+        } else if (task->kind != TASK_WORK) {
+            n += probe_pollfds(task->batch, &pfds[n], wake);
+        } else if (!task_held(task)) {
+            n += task->work->pollfds(task->arg, &pfds[n], wake);
+        } else if (task_alone(task)) {
+            long long now = now_ms();
+            if (now < *wake) *wake = now; /* nothing left to wait for */
+        }
+    }
+    return n;
+}
+
+/* One pass of supervisor_background_advance() over the tasks. Returns
+ * true if work waiting to run alone was passed over while another task
+ * finished, so that another pass may let it go ahead. */
+static bool background_pass(bool *ready, int *changed) {
+    bool   held  = false;
+    bool   ended = false;
+    Task **link  = &sv_tasks;
+    while (*link != NULL) {
+        Task *task = *link;
+        bool  finished;
+        if (task->kind == TASK_BULK) {
+            size_t settled = task->bulk->settled;
+            finished = bulk_advance(task->bulk);
+            *changed += (int)(task->bulk->settled - settled);
+        } else if (task->kind == TASK_WORK) {
+            if (task_held(task) && !task_alone(task)) {
+                held = true;
+                link = &task->next;
+                continue;
+            }
+            finished = task->work->advance(task->arg, changed);
+            /* The work may have queued tasks of its own ahead of it. */
+            while (*link != task) link = &(*link)->next;
+        } else {
+            finished = probe_advance(task->batch);
+        }
+        if (!finished) {
+            link = &task->next;
+            continue;
+        }
+
+        /* Unlink first: applying a health round may queue its restarts. */
+        *link = task->next;
+        ended = true;
+        if (task->kind == TASK_BULK) {
+            int failed = bulk_end(task->bulk);
+            if (task->done != NULL) task->done(task->arg, failed);
+        } else if (task->kind == TASK_WORK) {
+            task->work->end(task->arg);
+        } else {
+            int applied = round_apply(task);
+            if (task->kind == TASK_READY && applied > 0 && ready != NULL) *ready = true;
+            *changed += applied;
+        }
+        task_free(task);
+    }
+    return held && ended;
+}
+
+int supervisor_background_advance(bool *ready) {
+    int  changed = 0;
+    bool again   = true;
+    while (again) again = background_pass(ready, &changed);
+    return changed;
+}
+
+int supervisor_background_wait(void) {
+    int changed = 0;
+    while (sv_tasks != NULL) {
+        struct pollfd *pfds = calloc(supervisor_background_fds() + 1, sizeof(*pfds));
+        long long      wake = LLONG_MAX;
+        if (pfds != NULL) {
+            nfds_t    nfds = (nfds_t)supervisor_background_pollfds(pfds, &wake);
+            long long wait = wake - now_ms();
+            if (wait > 0) {
+                poll(pfds, nfds, wait > INT_MAX ? INT_MAX : (int)wait);
+            }
+            free(pfds);
+        }
+        changed += supervisor_background_advance(NULL);
+    }
+    return changed;
+}
+
+int supervisor_monitor_all(ProcessTable *table) {
+    if (table == NULL || table->count == 0) {
+        SV_LOG("supervisor_monitor_all: process table is empty");
+        return 0;
     }
 
     SV_LOG("supervisor_monitor_all: checking all processes");
 
-    for (ProcessNode *node = *head; node != NULL; node = node->next) {
-        int alive = supervisor_status(node);
+    int changed = 0;
+    for (size_t i = 0; i < table->count; i++) {
+        ProcessNode *node = &table->nodes[i];
+
+        /* Our own children report their exit through SIGCHLD; see supervisor_reap().
+         * Nodes a background bulk works on are left to it. */
+        if ((node->owned && node->running) || node->busy) {
+            continue;
+        }
+
+        bool was_running = node->running;
+        int  alive       = supervisor_status(node);
 
         if (alive == 0) {
-            /* Process is healthy — nothing to do. */
+            /* Process is healthy — forget past failures once it has been up long enough. */
+            if (!was_running) changed++;
+            if (node->failure_count > 0 &&
+                time(NULL) - node->start_time >= (time_t)node->stable_secs) {
+                node->failure_count = 0;
+                changed++;
+            }
             continue;
         }
 
         /* Process is dead — apply restart policy. */
-        switch (node->restart_policy) {
-            case RESTART_NEVER:
-                SV_LOG("supervisor_monitor_all: '%s' is down, policy=never, not restarting",
-                       node->name);
-                break;
+        if (was_running) {
+            if (cgroup_oom_killed(node)) {
+                node->exit_reason = EXIT_OOM_KILLED;
+                node->exit_status = SIGKILL;
+                SV_LOG("supervisor_monitor_all: '%s' (pid %d) was killed by the OOM killer",
+                       node->name, node->pid);
+            }
+            release_cgroup(node);
+            changed++;
+        }
+        changed += apply_restart_policy(node);
+    }
 
-            case RESTART_ON_FAILURE:
-                SV_LOG("supervisor_monitor_all: '%s' is down, policy=on-failure, restarting",
-                       node->name);
-                supervisor_restart(node);
-                break;
+    changed += supervisor_check_readiness(table);
+    changed += check_health(table);
+    return changed;
+}
 
-            case RESTART_ALWAYS:
-                SV_LOG("supervisor_monitor_all: '%s' is down, policy=always, restarting",
-                       node->name);
-                supervisor_restart(node);
-                break;
+int supervisor_reap(void) {
+    int   reaped = 0;
+    int   status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        ProcessNode *node = process_find(sv_table, pid);
+        if (node == NULL || !node->owned) {
+            SV_LOG("supervisor_reap: reaped unmanaged child (pid %d)", pid);
+            continue;
         }
+
+        reaped++;
+        record_exit(node, status);
+        release_cgroup(node);
+        node->running = false;
+        node->owned   = false;
+
+        if (node->exit_reason == EXIT_OOM_KILLED) {
+            SV_LOG("supervisor_reap: '%s' (pid %d) was killed by the OOM killer (memory.max %llu bytes)",
+                   node->name, pid, (unsigned long long)node->cgroup.memory_max);
+        } else if (WIFEXITED(status)) {
+            SV_LOG("supervisor_reap: '%s' (pid %d) exited with status %d",
+                   node->name, pid, WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            SV_LOG("supervisor_reap: '%s' (pid %d) killed by signal %d",
+                   node->name, pid, WTERMSIG(status));
+        }
+
+        if (!node->busy) apply_restart_policy(node);
     }
+
+    return reaped;
 }